@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstring>
 #include <thread>
+#include <chrono>
 
 #include "utils.h"
 #include "../../lib/llama_mobile.h"
@@ -157,6 +158,11 @@ int main(int argc, char **argv) {
             return 1;
         }
 
+        // Vocode on a separate thread while the model keeps generating codes
+        if (!context.configureTTSPipeline(true, 0, 0, 4)) {
+            std::cerr << "Failed to start the TTS pipeline, decoding audio serially." << std::endl;
+        }
+
         if (!context.initSampling()) {
             std::cerr << "Failed to initialize sampling context." << std::endl;
             return 1;
@@ -172,6 +178,18 @@ int main(int argc, char **argv) {
         
         std::cout << "Starting TTS generation..." << std::endl;
         context.beginCompletion();
+
+        // Stream audio while the codes are generated; the first chunk arrives after one
+        // vocoder window instead of after the whole utterance
+        std::vector<float> streamed_audio;
+        const auto t_start = std::chrono::steady_clock::now();
+        context.beginAudioStream(16, 4, [&](const float* pcm, size_t n_samples) {
+            if (streamed_audio.empty()) {
+                const auto t_first = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_start);
+                std::cout << "First audio after " << t_first.count() << " ms" << std::endl;
+            }
+            streamed_audio.insert(streamed_audio.end(), pcm, pcm + n_samples);
+        });
         context.loadPrompt();
 
         std::vector<llama_token> audio_tokens;
@@ -194,6 +212,7 @@ int main(int argc, char **argv) {
             }
         }
 
+        context.endAudioStream();
         std::cout << "Generated " << audio_tokens.size() << " audio tokens" << std::endl;
         
         if (audio_tokens.empty()) {
@@ -201,8 +220,11 @@ int main(int argc, char **argv) {
             return 1;
         }
 
-        std::cout << "Decoding audio tokens..." << std::endl;
-        std::vector<float> audio_data = context.decodeAudioTokens(audio_tokens);
+        std::vector<float> audio_data = streamed_audio;
+        if (audio_data.empty()) {
+            std::cout << "Decoding audio tokens..." << std::endl;
+            audio_data = context.decodeAudioTokens(audio_tokens);
+        }
         
         if (audio_data.empty()) {
             std::cerr << "Failed to decode audio tokens!" << std::endl;
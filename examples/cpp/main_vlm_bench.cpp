@@ -0,0 +1,169 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "utils.h"
+#include "../../lib/llama_mobile.h"
+
+// Measures end-to-end time-to-first-token for prompts carrying 1, 4 and 8 images:
+// media loading, decoding, preprocessing, encoding and prompt evaluation up to the
+// first sampled token.
+//
+// Usage: llama_mobile_vlm_bench [model] [mmproj] [n_threads] [image ...]
+// With no images the example image is used for every slot; with fewer images than
+// slots they are repeated in order.
+
+int main(int argc, char **argv) {
+    const std::string local_model_path = "../../lib/models/SmolVLM-256M-Instruct-Q8_0.gguf";
+    const std::string local_mmproj_path = "../../lib/models/mmproj-SmolVLM-256M-Instruct-Q8_0.gguf";
+    const std::string default_image_path = "../files/image.jpg";
+
+    const std::string default_model_url = "https://huggingface.co/ggml-org/SmolVLM-256M-Instruct-GGUF/resolve/main/SmolVLM-256M-Instruct-Q8_0.gguf";
+    const std::string default_model_filename = "SmolVLM-256M-Instruct-Q8_0.gguf";
+    const std::string default_mmproj_url = "https://huggingface.co/ggml-org/SmolVLM-256M-Instruct-GGUF/resolve/main/mmproj-SmolVLM-256M-Instruct-Q8_0.gguf";
+    const std::string default_mmproj_filename = "mmproj-SmolVLM-256M-Instruct-Q8_0.gguf";
+
+    const std::vector<int> image_counts = {1, 4, 8};
+    const int n_runs = 3;
+
+    std::string model_path = argc > 1 ? argv[1] : "";
+    std::string mmproj_path = argc > 2 ? argv[2] : "";
+    int n_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+    std::vector<std::string> images;
+    for (int i = 4; i < argc; i++) {
+        images.push_back(argv[i]);
+    }
+    if (images.empty()) {
+        images.push_back(default_image_path);
+    }
+
+    if (model_path.empty()) {
+        if (fileExists(local_model_path)) {
+            model_path = local_model_path;
+        } else {
+            model_path = default_model_filename;
+            if (!downloadFile(default_model_url, default_model_filename, "VLM model")) {
+                return 1;
+            }
+        }
+    }
+    if (mmproj_path.empty()) {
+        if (fileExists(local_mmproj_path)) {
+            mmproj_path = local_mmproj_path;
+        } else {
+            mmproj_path = default_mmproj_filename;
+            if (!downloadFile(default_mmproj_url, default_mmproj_filename, "Multimodal projector")) {
+                return 1;
+            }
+        }
+    }
+    for (const auto &image : images) {
+        if (!fileExists(image)) {
+            std::cerr << "Image file not found: " << image << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "\n=== Multi-image Time-To-First-Token Benchmark ===" << std::endl;
+
+    try {
+        llama_mobile::llama_mobile_context context;
+
+        common_params params;
+        params.model.path = model_path;
+        params.n_ctx = 16384;
+        params.n_batch = 512;
+        params.n_gpu_layers = 99;
+        params.cpuparams.n_threads = n_threads;
+
+        std::cout << "Loading model: " << model_path << std::endl;
+        if (!context.loadModel(params)) {
+            std::cerr << "Failed to load model" << std::endl;
+            return 1;
+        }
+        std::cout << "Initializing multimodal with projector: " << mmproj_path << std::endl;
+        if (!context.initMultimodal(mmproj_path, true)) {
+            std::cerr << "Failed to initialize multimodal" << std::endl;
+            return 1;
+        }
+
+        // Returns the milliseconds until the first token, or a negative value on failure
+        auto time_first_token = [&](int n_images, double &load_ms) -> double {
+            std::vector<std::string> media_paths;
+            std::string content;
+            for (int i = 0; i < n_images; i++) {
+                media_paths.push_back(images[i % images.size()]);
+                content += "<__media__>\\n";
+            }
+            content += "Describe these images.";
+
+            std::string messages = R"([{"role": "user", "content": ")" + content + R"("}])";
+            context.rewind();
+            context.params.prompt = context.getFormattedChat(messages, "");
+            context.params.n_predict = 1;
+            if (!context.initSampling()) {
+                return -1.0;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            context.beginCompletion();
+            context.loadPrompt(media_paths);
+            auto loaded = std::chrono::high_resolution_clock::now();
+            auto token_output = context.doCompletion();
+            auto end = std::chrono::high_resolution_clock::now();
+            if (token_output.tok == -1) {
+                return -1.0;
+            }
+
+            load_ms = std::chrono::duration<double, std::milli>(loaded - start).count();
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        // The first multimodal run pays for graph allocation and weight paging
+        double warmup_load_ms = 0.0;
+        if (time_first_token(1, warmup_load_ms) < 0.0) {
+            std::cerr << "Warmup run failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << "\n" << n_threads << " threads, median of " << n_runs << " runs" << std::endl;
+        std::cout << std::left << std::setw(10) << "images"
+                  << std::right << std::setw(16) << "prompt (ms)"
+                  << std::setw(16) << "TTFT (ms)"
+                  << std::setw(20) << "TTFT / image (ms)" << std::endl;
+        std::cout << std::string(62, '-') << std::endl;
+
+        for (int n_images : image_counts) {
+            std::vector<double> ttft;
+            std::vector<double> load;
+            for (int run = 0; run < n_runs; run++) {
+                double load_ms = 0.0;
+                double ms = time_first_token(n_images, load_ms);
+                if (ms < 0.0) {
+                    std::cerr << "Run with " << n_images << " images failed" << std::endl;
+                    return 1;
+                }
+                ttft.push_back(ms);
+                load.push_back(load_ms);
+            }
+            std::sort(ttft.begin(), ttft.end());
+            std::sort(load.begin(), load.end());
+            double median_ttft = ttft[n_runs / 2];
+            double median_load = load[n_runs / 2];
+
+            std::cout << std::left << std::setw(10) << n_images
+                      << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(16) << median_load
+                      << std::setw(16) << median_ttft
+                      << std::setw(20) << median_ttft / n_images << std::endl;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -4,7 +4,9 @@
 #include <nlohmann/json.hpp>
 
 #include <algorithm>
+#include <list>
 #include <map>
+#include <mutex>
 #include <regex>
 #include <sstream>
 #include <string>
@@ -1119,6 +1121,36 @@ bool common_schema_info::resolves_to_string(const nlohmann::ordered_json & schem
     return check(schema);
 }
 
+// tool-calling apps send the same schemas with every request, the conversion is kept by schema text
+struct common_schema_cache {
+    size_t max_entries = 64;
+
+    common_schema_cache_stats stats;
+
+    std::mutex mutex;
+    std::list<std::pair<std::string, std::string>> entries; // most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+};
+
+static common_schema_cache & common_get_schema_cache() {
+    static auto * cache = new common_schema_cache();
+    return *cache;
+}
+
+common_schema_cache_stats json_schema_to_grammar_cache_stats() {
+    auto & cache = common_get_schema_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.stats;
+}
+
+void json_schema_to_grammar_cache_clear() {
+    auto & cache = common_get_schema_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+    cache.index.clear();
+    cache.stats.n_entries = 0;
+}
+
 std::string json_schema_to_grammar(const json & schema, bool force_gbnf) {
 #ifdef LLAMA_USE_LLGUIDANCE
     if (!force_gbnf) {
@@ -1127,11 +1159,37 @@ std::string json_schema_to_grammar(const json & schema, bool force_gbnf) {
 #else
     (void)force_gbnf;
 #endif // LLAMA_USE_LLGUIDANCE
-    return build_grammar([&](const common_grammar_builder & callbacks) {
+    auto & cache = common_get_schema_cache();
+    std::string key = schema.dump();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.index.find(key);
+        if (it != cache.index.end()) {
+            cache.entries.splice(cache.entries.begin(), cache.entries, it->second);
+            cache.stats.hits++;
+            return it->second->second;
+        }
+        cache.stats.misses++;
+    }
+
+    std::string grammar = build_grammar([&](const common_grammar_builder & callbacks) {
         auto copy = schema;
         callbacks.resolve_refs(copy);
         callbacks.add_schema("", copy);
     });
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.index.find(key) == cache.index.end()) {
+        cache.entries.emplace_front(key, grammar);
+        cache.index.emplace(std::move(key), cache.entries.begin());
+        while (cache.entries.size() > cache.max_entries) {
+            cache.index.erase(cache.entries.back().first);
+            cache.entries.pop_back();
+            cache.stats.evictions++;
+        }
+        cache.stats.n_entries = cache.entries.size();
+    }
+    return grammar;
 }
 
 std::string build_grammar(const std::function<void(const common_grammar_builder &)> & cb, const common_grammar_options & options) {
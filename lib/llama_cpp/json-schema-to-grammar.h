@@ -9,6 +9,17 @@
 std::string json_schema_to_grammar(const nlohmann::ordered_json & schema,
                                    bool force_gbnf = false);
 
+// json_schema_to_grammar keeps the grammars of the schemas it converted in a process-wide cache
+struct common_schema_cache_stats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    size_t   n_entries = 0;
+};
+
+common_schema_cache_stats json_schema_to_grammar_cache_stats();
+void                      json_schema_to_grammar_cache_clear();
+
 class common_schema_converter;
 
 // Probes a JSON schema to extract information about its structure and type constraints.
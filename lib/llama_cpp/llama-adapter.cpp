@@ -4,8 +4,11 @@
 #include "llama-mmap.h"
 #include "llama-model.h"
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <cassert>
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
 
@@ -135,6 +138,11 @@ bool llama_adapter_cvec::apply(
 
 // lora
 
+static std::atomic<uint64_t> llama_adapter_lora_next_uid { 1 };
+
+llama_adapter_lora::llama_adapter_lora() : uid(llama_adapter_lora_next_uid++) {
+}
+
 llama_adapter_lora_weight * llama_adapter_lora::get_weight(lm_ggml_tensor * w) {
     const std::string name(w->name);
 
@@ -429,6 +437,186 @@ llama_adapter_lora * llama_adapter_lora_init(llama_model * model, const char * p
     return nullptr;
 }
 
+// lora stacked per sequence
+
+bool llama_adapter_lora_seq::active() const {
+    return std::any_of(seq_slot.begin(), seq_slot.end(), [](int32_t slot) { return slot >= 0; });
+}
+
+int32_t llama_adapter_lora_seq::find(const llama_adapter_lora * adapter) const {
+    for (size_t i = 0; i < adapters.size(); ++i) {
+        if (adapters[i] == adapter && uids[i] == adapter->uid) {
+            return (int32_t) i;
+        }
+    }
+
+    return -1;
+}
+
+const llama_adapter_lora_weight * llama_adapter_lora_seq::get_weight(const lm_ggml_tensor * w) const {
+    const auto pos = ab_map.find(w->name);
+    if (pos != ab_map.end()) {
+        return &pos->second;
+    }
+
+    return nullptr;
+}
+
+void llama_adapter_lora_seq::clear() {
+    adapters.clear();
+    uids.clear();
+    ab_map.clear();
+    ctxs.clear();
+    bufs.clear();
+    std::fill(seq_slot.begin(), seq_slot.end(), -1);
+}
+
+static void llama_adapter_lora_read_f32(const lm_ggml_tensor * t, std::vector<uint8_t> & raw, std::vector<float> & out) {
+    raw.resize(lm_ggml_nbytes(t));
+    lm_ggml_backend_tensor_get(t, raw.data(), 0, raw.size());
+
+    out.resize(lm_ggml_nelements(t));
+    if (t->type == LM_GGML_TYPE_F32) {
+        memcpy(out.data(), raw.data(), raw.size());
+        return;
+    }
+
+    const auto * traits = lm_ggml_get_type_traits(t->type);
+    if (!traits->to_float) {
+        throw std::runtime_error(format("LoRA tensor '%s' has unsupported type %s", t->name, lm_ggml_type_name(t->type)));
+    }
+    traits->to_float(raw.data(), out.data(), out.size());
+}
+
+void llama_adapter_lora_seq::build(const std::vector<llama_adapter_lora *> & adapters_new) {
+    struct stack_info {
+        int64_t n_in  = 0;
+        int64_t n_out = 0;
+        int64_t r_max = 0;
+        lm_ggml_backend_buffer_type_t buft = nullptr;
+    };
+
+    auto str_endswith = [](const std::string & str, const std::string & suffix) {
+        return str.size() >= suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    // the token embeddings go through get_rows and the experts through mul_mat_id already,
+    // those keep using the adapters set on the whole context only
+    std::map<std::string, stack_info> infos;
+    for (auto * adapter : adapters_new) {
+        for (const auto & it : adapter->ab_map) {
+            const auto & w = it.second;
+            if (str_endswith(it.first, "token_embd.weight") || w.a->ne[2] != 1 || w.b->ne[2] != 1) {
+                continue;
+            }
+
+            auto & info = infos[it.first];
+            if (info.buft == nullptr) {
+                info.n_in  = w.a->ne[0];
+                info.n_out = w.b->ne[1];
+                info.buft  = lm_ggml_backend_buffer_get_type(w.a->buffer);
+            } else if (info.n_in != w.a->ne[0] || info.n_out != w.b->ne[1]) {
+                throw std::runtime_error("LoRA adapters disagree on the shape of '" + it.first + "'");
+            }
+            info.r_max = std::max(info.r_max, w.a->ne[1]);
+        }
+    }
+
+    const int64_t n_slots = adapters_new.size();
+
+    std::map<lm_ggml_backend_buffer_type_t, lm_ggml_context_ptr> ctx_map;
+    std::unordered_map<std::string, llama_adapter_lora_weight> ab_map_new;
+    for (const auto & it : infos) {
+        const stack_info & info = it.second;
+
+        auto & ctx = ctx_map[info.buft];
+        if (!ctx) {
+            lm_ggml_init_params params = {
+                /*.mem_size   =*/ 2*infos.size()*lm_ggml_tensor_overhead(),
+                /*.mem_buffer =*/ NULL,
+                /*.no_alloc   =*/ true,
+            };
+            ctx.reset(lm_ggml_init(params));
+            if (!ctx) {
+                throw std::runtime_error("failed to create ggml context for stacked lora adapters");
+            }
+        }
+
+        lm_ggml_tensor * a = lm_ggml_new_tensor_3d(ctx.get(), LM_GGML_TYPE_F16, info.n_in, info.r_max, n_slots);
+        lm_ggml_tensor * b = lm_ggml_new_tensor_3d(ctx.get(), LM_GGML_TYPE_F16, info.r_max, info.n_out, n_slots);
+        lm_ggml_format_name(a, "%s.lora_seq_a", it.first.c_str());
+        lm_ggml_format_name(b, "%s.lora_seq_b", it.first.c_str());
+        ab_map_new[it.first] = llama_adapter_lora_weight(a, b);
+    }
+
+    std::vector<lm_ggml_context_ptr> ctxs_new;
+    std::vector<lm_ggml_backend_buffer_ptr> bufs_new;
+    for (auto & it : ctx_map) {
+        lm_ggml_backend_buffer_ptr buf { lm_ggml_backend_alloc_ctx_tensors_from_buft(it.second.get(), it.first) };
+        if (!buf) {
+            throw std::runtime_error("failed to allocate buffer for stacked lora adapters");
+        }
+        LLAMA_LOG_INFO("%s: %10s stacked LoRA buffer size = %8.2f MiB\n", __func__, lm_ggml_backend_buffer_name(buf.get()), lm_ggml_backend_buffer_get_size(buf.get())/1024.0/1024.0);
+        ctxs_new.emplace_back(std::move(it.second));
+        bufs_new.emplace_back(std::move(buf));
+    }
+
+    // copy every adapter into its slot, ranks below r_max are zero padded
+    const lm_ggml_fp16_t zero = lm_ggml_fp32_to_fp16(0.0f);
+    std::vector<uint8_t> raw;
+    std::vector<float> fa;
+    std::vector<float> fb;
+    std::vector<lm_ggml_fp16_t> slot_a;
+    std::vector<lm_ggml_fp16_t> slot_b;
+    for (const auto & it : ab_map_new) {
+        const stack_info & info = infos.at(it.first);
+        const size_t n_a = info.n_in*info.r_max;
+        const size_t n_b = info.r_max*info.n_out;
+
+        for (int64_t s = 0; s < n_slots; ++s) {
+            slot_a.assign(n_a, zero);
+            slot_b.assign(n_b, zero);
+
+            const llama_adapter_lora * adapter = adapters_new[s];
+            const auto pos = adapter->ab_map.find(it.first);
+            if (pos != adapter->ab_map.end()) {
+                const llama_adapter_lora_weight & lw = pos->second;
+                const int64_t r     = lw.a->ne[1];
+                const float   scale = lw.get_scale(adapter->alpha, 1.0f);
+
+                llama_adapter_lora_read_f32(lw.a, raw, fa);
+                lm_ggml_fp32_to_fp16_row(fa.data(), slot_a.data(), info.n_in*r);
+
+                llama_adapter_lora_read_f32(lw.b, raw, fb);
+                for (int64_t o = 0; o < info.n_out; ++o) {
+                    for (int64_t k = 0; k < r; ++k) {
+                        slot_b[o*info.r_max + k] = lm_ggml_fp32_to_fp16(fb[o*r + k]*scale);
+                    }
+                }
+            }
+
+            lm_ggml_backend_tensor_set(it.second.a, slot_a.data(), s*n_a*sizeof(lm_ggml_fp16_t), n_a*sizeof(lm_ggml_fp16_t));
+            lm_ggml_backend_tensor_set(it.second.b, slot_b.data(), s*n_b*sizeof(lm_ggml_fp16_t), n_b*sizeof(lm_ggml_fp16_t));
+        }
+    }
+
+    adapters = adapters_new;
+    uids.clear();
+    for (const auto * adapter : adapters) {
+        uids.push_back(adapter->uid);
+    }
+    ab_map   = std::move(ab_map_new);
+    ctxs     = std::move(ctxs_new);
+    bufs     = std::move(bufs_new);
+
+    for (size_t i = 0; i < seq_adapter.size(); ++i) {
+        const auto pos = std::find(adapters.begin(), adapters.end(), seq_adapter[i]);
+        seq_slot[i] = seq_adapter[i] != nullptr && pos != adapters.end() ? (int32_t) (pos - adapters.begin()) : -1;
+    }
+
+    LLAMA_LOG_INFO("%s: stacked %zu LoRA adapters over %zu weights\n", __func__, adapters.size(), ab_map.size());
+}
+
 int32_t llama_adapter_meta_val_str(const llama_adapter_lora * adapter, const char * key, char * buf, size_t buf_size) {
     const auto & it = adapter->lm_gguf_kv.find(key);
     if (it == adapter->lm_gguf_kv.end()) {
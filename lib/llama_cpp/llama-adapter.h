@@ -73,10 +73,48 @@ struct llama_adapter_lora {
     // activated lora (aLoRA)
     std::vector<llama_token> alora_invocation_tokens;
 
-    llama_adapter_lora() = default;
+    // unique for the process, tells a freed adapter apart from a new one at the same address
+    const uint64_t uid;
+
+    llama_adapter_lora();
     ~llama_adapter_lora() = default;
 
     llama_adapter_lora_weight * get_weight(lm_ggml_tensor * w);
 };
 
 using llama_adapter_loras = std::unordered_map<llama_adapter_lora *, float>;
+
+// adapters selected per sequence: for every weight they are stacked along a third dimension
+// so that a single mul_mat_id applies to each token the adapter of its own sequence
+struct llama_adapter_lora_seq {
+    // per sequence: selected adapter, its slot in the stack (-1 for none) and its scale
+    std::vector<llama_adapter_lora *> seq_adapter;
+    std::vector<int32_t>              seq_slot;
+    std::vector<float>                seq_scale;
+
+    // adapters in stack order and their uid at the time they were stacked
+    std::vector<llama_adapter_lora *> adapters;
+    std::vector<uint64_t>             uids;
+
+    // per base weight: a [n_in, r_max, n_slots] and b [r_max, n_out, n_slots] in F16
+    // b is pre-scaled by alpha/rank, slots of adapters that do not touch the weight are zero
+    std::unordered_map<std::string, llama_adapter_lora_weight> ab_map;
+
+    std::vector<lm_ggml_context_ptr> ctxs;
+    std::vector<lm_ggml_backend_buffer_ptr> bufs;
+
+    bool empty() const { return adapters.empty(); }
+
+    // true if at least one sequence selects a stacked adapter
+    bool active() const;
+
+    // slot of the adapter in the stack, -1 if it is not stacked (or was freed since)
+    int32_t find(const llama_adapter_lora * adapter) const;
+
+    const llama_adapter_lora_weight * get_weight(const lm_ggml_tensor * w) const;
+
+    // throws on failure, the previous stack is kept in that case
+    void build(const std::vector<llama_adapter_lora *> & adapters_new);
+
+    void clear();
+};
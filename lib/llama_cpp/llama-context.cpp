@@ -135,6 +135,7 @@ llama_context::llama_context(
 
     cparams.op_offload = params.op_offload;
     cparams.kv_unified = params.kv_unified;
+    cparams.lora_seq   = params.lora_seq;
 
     {
         const char * LLAMA_GRAPH_REUSE_DISABLE = getenv("LLAMA_GRAPH_REUSE_DISABLE");
@@ -773,6 +774,7 @@ void llama_context::set_adapter_lora(
     LLAMA_LOG_DEBUG("%s: adapter = %p, scale = %f\n", __func__, (void *) adapter, scale);
 
     loras[adapter] = scale;
+    loras_gen++;
 }
 
 bool llama_context::rm_adapter_lora(
@@ -782,6 +784,7 @@ bool llama_context::rm_adapter_lora(
     auto pos = loras.find(adapter);
     if (pos != loras.end()) {
         loras.erase(pos);
+        loras_gen++;
         return true;
     }
 
@@ -792,6 +795,96 @@ void llama_context::clear_adapter_lora() {
     LLAMA_LOG_DEBUG("%s: call\n", __func__);
 
     loras.clear();
+    loras_gen++;
+}
+
+bool llama_context::set_adapter_lora_seq(
+            llama_adapter_lora * adapter,
+            llama_seq_id seq_id,
+            float scale) {
+    LLAMA_LOG_DEBUG("%s: adapter = %p, seq_id = %d, scale = %f\n", __func__, (void *) adapter, seq_id, scale);
+
+    if (seq_id < 0 || (uint32_t) seq_id >= cparams.n_seq_max) {
+        LLAMA_LOG_ERROR("%s: invalid seq_id = %d >= %u\n", __func__, seq_id, cparams.n_seq_max);
+        return false;
+    }
+
+    if (!cparams.lora_seq) {
+        LLAMA_LOG_ERROR("%s: per-sequence adapters are not enabled for this context (lora_seq = false)\n", __func__);
+        return false;
+    }
+
+    if (adapter == nullptr) {
+        LLAMA_LOG_ERROR("%s: adapter is null, use llama_clear_adapter_lora_seq to clear seq_id = %d\n", __func__, seq_id);
+        return false;
+    }
+
+    if (loras_seq.seq_adapter.size() < cparams.n_seq_max) {
+        loras_seq.seq_adapter.resize(cparams.n_seq_max, nullptr);
+        loras_seq.seq_slot   .resize(cparams.n_seq_max, -1);
+        loras_seq.seq_scale  .resize(cparams.n_seq_max, 0.0f);
+    }
+
+    const bool active = loras_seq.active();
+
+    // an adapter that is already stacked only changes the graph inputs. the uid check keeps a
+    // freed adapter from being taken for a new one at the same address
+    int32_t slot = loras_seq.find(adapter);
+    if (slot < 0) {
+        // rebuild with the adapters the other sequences hold on to, the unused ones are dropped
+        std::vector<llama_adapter_lora *> adapters_new;
+        for (size_t i = 0; i < loras_seq.seq_adapter.size(); ++i) {
+            llama_adapter_lora * other = loras_seq.seq_adapter[i];
+            if ((llama_seq_id) i != seq_id && other != nullptr &&
+                    std::find(adapters_new.begin(), adapters_new.end(), other) == adapters_new.end()) {
+                adapters_new.push_back(other);
+            }
+        }
+        adapters_new.push_back(adapter);
+
+        try {
+            loras_seq.build(adapters_new);
+        } catch (const std::exception & err) {
+            LLAMA_LOG_ERROR("%s: failed to stack lora adapters: %s\n", __func__, err.what());
+            return false;
+        }
+        loras_gen++;
+
+        slot = loras_seq.find(adapter);
+    }
+
+    loras_seq.seq_adapter[seq_id] = adapter;
+    loras_seq.seq_slot[seq_id]    = slot;
+    loras_seq.seq_scale[seq_id]   = scale;
+
+    if (!active) {
+        // the graph gets the per-sequence path back
+        loras_gen++;
+    }
+
+    return true;
+}
+
+void llama_context::clear_adapter_lora_seq(llama_seq_id seq_id) {
+    LLAMA_LOG_DEBUG("%s: seq_id = %d\n", __func__, seq_id);
+
+    const bool active = loras_seq.active();
+
+    if (seq_id >= 0 && (size_t) seq_id < loras_seq.seq_adapter.size()) {
+        // the stacked weights stay for the next selection of the same adapter
+        loras_seq.seq_adapter[seq_id] = nullptr;
+        loras_seq.seq_slot[seq_id]    = -1;
+        loras_seq.seq_scale[seq_id]   = 0.0f;
+    } else if (seq_id < 0) {
+        std::fill(loras_seq.seq_adapter.begin(), loras_seq.seq_adapter.end(), nullptr);
+        std::fill(loras_seq.seq_scale  .begin(), loras_seq.seq_scale  .end(), 0.0f);
+        loras_seq.clear();
+    }
+
+    if (active && !loras_seq.active()) {
+        // no sequence uses an adapter, the graph skips the per-sequence path
+        loras_gen++;
+    }
 }
 
 bool llama_context::apply_adapter_cvec(
@@ -1442,7 +1535,9 @@ uint32_t llama_context::graph_max_nodes(uint32_t n_tokens) const {
     if (model.arch == LLM_ARCH_QWEN3NEXT) {
         return std::max<uint32_t>(n_tokens * 40, 32u * model.n_tensors());
     }
-    return std::max<uint32_t>(1024u, 8u*model.n_tensors());
+    // room for the per-sequence adapters, which may be stacked at any time after the reserve
+    const uint32_t n_lora_seq = cparams.lora_seq ? 8u*model.n_tensors() : 0u;
+    return std::max<uint32_t>(1024u, 8u*model.n_tensors()) + n_lora_seq;
 }
 
 llm_graph_result * llama_context::get_gf_res_reserve() const {
@@ -1516,8 +1611,10 @@ llm_graph_params llama_context::graph_params(
         /*.backend_cpu =*/ backend_cpu,
         /*.cvec        =*/ &cvec,
         /*.loras       =*/ &loras,
+        /*.loras_seq   =*/ &loras_seq,
         /*.mctx        =*/ mctx,
         /*.cross       =*/ &cross,
+        /*.loras_gen   =*/ loras_gen,
         /*.n_outputs   =*/ n_outputs,
         /*.cb          =*/ graph_get_cb(),
         /*.res         =*/ res,
@@ -2392,6 +2489,7 @@ llama_context_params llama_context_default_params() {
         /*.op_offload                  =*/ true,
         /*.swa_full                    =*/ true,
         /*.kv_unified                  =*/ false,
+        /*.lora_seq                    =*/ false,
     };
 
     return result;
@@ -2613,6 +2711,20 @@ void llama_clear_adapter_lora(llama_context * ctx) {
     ctx->clear_adapter_lora();
 }
 
+int32_t llama_set_adapter_lora_seq(
+            llama_context * ctx,
+            llama_adapter_lora * adapter,
+            llama_seq_id seq_id,
+            float scale) {
+    bool res = ctx->set_adapter_lora_seq(adapter, seq_id, scale);
+
+    return res ? 0 : -1;
+}
+
+void llama_clear_adapter_lora_seq(llama_context * ctx, llama_seq_id seq_id) {
+    ctx->clear_adapter_lora_seq(seq_id);
+}
+
 int32_t llama_apply_adapter_cvec(
         llama_context * ctx,
                  const float * data,
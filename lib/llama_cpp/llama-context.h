@@ -93,6 +93,13 @@ struct llama_context {
 
     void clear_adapter_lora();
 
+    bool set_adapter_lora_seq(
+            llama_adapter_lora * adapter,
+            llama_seq_id seq_id,
+            float scale);
+
+    void clear_adapter_lora_seq(llama_seq_id seq_id);
+
     bool apply_adapter_cvec(
             const float * data,
                  size_t   len,
@@ -239,6 +246,11 @@ private:
     llama_adapter_cvec  cvec;
     llama_adapter_loras loras;
 
+    llama_adapter_lora_seq loras_seq;
+
+    // bumped on every change of the adapter sets so that graphs built with the old ones are not reused
+    uint32_t loras_gen = 0;
+
     llama_cross cross; // TODO: tmp for handling cross-attention - need something better probably
 
     std::unique_ptr<llama_memory_i> memory;
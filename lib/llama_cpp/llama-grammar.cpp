@@ -1105,18 +1105,46 @@ struct llama_grammar * llama_grammar_init_impl(
         /* .trigger_buffer_positions = */ {},
         /* .trigger_tokens = */           {},
         /* .trigger_patterns = */         {},
+        /* .masks = */                    nullptr,
+        /* .mask_positions = */           {},
     };
 }
 
-struct llama_grammar * llama_grammar_init_impl(
+// rule and element index of every element of rules, built once per grammar since its rules never change
+static llama_grammar_element_positions llama_grammar_element_positions_of(const llama_grammar_rules & rules) {
+    llama_grammar_element_positions positions;
+    size_t n_elements = 0;
+    for (const auto & rule : rules) {
+        n_elements += rule.size();
+    }
+    positions.reserve(n_elements);
+    for (size_t ir = 0; ir < rules.size(); ir++) {
+        for (size_t ie = 0; ie < rules[ir].size(); ie++) {
+            positions.emplace(&rules[ir][ie], std::make_pair((uint32_t) ir, (uint32_t) ie));
+        }
+    }
+    return positions;
+}
+
+// rule positions of the elements on a stack, independent of where this grammar's rules live in memory
+static llama_grammar_mask_cache::key llama_grammar_mask_key(const llama_grammar_element_positions & positions, const llama_grammar_stack & stack) {
+    llama_grammar_mask_cache::key key;
+    key.reserve(stack.size() * 2);
+    for (const auto * pos : stack) {
+        const auto it = positions.find(pos);
+        if (it != positions.end()) {
+            key.push_back(it->second.first);
+            key.push_back(it->second.second);
+        }
+    }
+    return key;
+}
+
+// parses a grammar text into the rules and initial stacks every grammar compiled from it starts with
+static std::shared_ptr<llama_grammar_compiled> llama_grammar_compile(
         const struct llama_vocab * vocab,
                       const char * grammar_str,
-                      const char * grammar_root,
-                              bool lazy,
-                     const char ** trigger_patterns,
-                            size_t num_trigger_patterns,
-               const llama_token * trigger_tokens,
-                            size_t num_trigger_tokens) {
+                      const char * grammar_root) {
     llama_grammar_parser parser(vocab);
 
     // if there is a grammar, parse it
@@ -1139,8 +1167,11 @@ struct llama_grammar * llama_grammar_init_impl(
 
     const llama_grammar_element * pos;
 
+    auto compiled = std::make_shared<llama_grammar_compiled>();
+
     // copy rule definitions into vectors
-    llama_grammar_rules vec_rules(n_rules);
+    llama_grammar_rules & vec_rules = compiled->rules;
+    vec_rules.resize(n_rules);
     for (size_t i = 0; i < n_rules; i++) {
         for (pos = grammar_rules[i]; pos->type != LLAMA_GRETYPE_END; pos++) {
             vec_rules[i].push_back(*pos);
@@ -1184,6 +1215,147 @@ struct llama_grammar * llama_grammar_init_impl(
         }
     } while (true);
 
+    const auto positions = llama_grammar_element_positions_of(vec_rules);
+    for (const auto & stack : stacks) {
+        compiled->stacks.push_back(llama_grammar_mask_key(positions, stack));
+    }
+    compiled->masks = std::make_shared<llama_grammar_masks>();
+
+    return compiled;
+}
+
+// process-wide cache of compiled grammars, so that a grammar sent with every request is parsed once
+struct llama_grammar_compile_cache {
+    struct entry {
+        const llama_vocab * vocab;
+        std::string         grammar_str;
+        std::string         grammar_root;
+
+        std::shared_ptr<llama_grammar_compiled> compiled;
+    };
+
+    size_t max_entries = 16;
+
+    llama_grammar_cache_stats stats;
+
+    std::mutex mutex;
+    std::list<entry> entries; // most recently used first
+
+    std::unordered_map<std::string, std::regex> regexes; // trigger patterns
+};
+
+static llama_grammar_compile_cache & llama_grammar_get_compile_cache() {
+    // never destroyed, vocabularies freed during exit still clear their entries
+    static auto * cache = new llama_grammar_compile_cache();
+    return *cache;
+}
+
+static std::shared_ptr<llama_grammar_compiled> llama_grammar_compile_cached(
+        const struct llama_vocab * vocab,
+                      const char * grammar_str,
+                      const char * grammar_root) {
+    auto & cache = llama_grammar_get_compile_cache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+            if (it->vocab == vocab && it->grammar_root == grammar_root && it->grammar_str == grammar_str) {
+                cache.entries.splice(cache.entries.begin(), cache.entries, it);
+                cache.stats.hits++;
+                return it->compiled;
+            }
+        }
+        cache.stats.misses++;
+    }
+
+    auto compiled = llama_grammar_compile(vocab, grammar_str, grammar_root);
+    if (!compiled) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.push_front({ vocab, grammar_str, grammar_root, compiled });
+    while (cache.entries.size() > cache.max_entries) {
+        cache.entries.pop_back();
+        cache.stats.evictions++;
+    }
+    cache.stats.n_entries = cache.entries.size();
+
+    return compiled;
+}
+
+static std::regex llama_grammar_trigger_regex(const std::string & pattern) {
+    auto & cache = llama_grammar_get_compile_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.regexes.find(pattern);
+    if (it == cache.regexes.end()) {
+        // patterns come from chat templates and tool definitions, a handful per app
+        if (cache.regexes.size() >= 64) {
+            cache.regexes.clear();
+        }
+        it = cache.regexes.emplace(pattern, std::regex(pattern)).first;
+    }
+    return it->second;
+}
+
+llama_grammar_cache_stats llama_grammar_cache_get_stats() {
+    llama_grammar_cache_stats stats;
+    {
+        auto & cache = llama_grammar_get_compile_cache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        stats = cache.stats;
+    }
+    auto & masks = llama_grammar_get_mask_cache();
+    std::lock_guard<std::mutex> lock(masks.mutex);
+    stats.mask_bytes = masks.bytes;
+    return stats;
+}
+
+void llama_grammar_cache_clear(const struct llama_vocab * vocab) {
+    auto & cache = llama_grammar_get_compile_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (vocab == nullptr) {
+        cache.entries.clear();
+        cache.regexes.clear();
+
+        // grammars still in use keep their ids and simply compute their masks again
+        auto & masks = llama_grammar_get_mask_cache();
+        std::lock_guard<std::mutex> lock_masks(masks.mutex);
+        masks.entries.clear();
+        masks.lru.clear();
+        masks.bytes = 0;
+    } else {
+        cache.entries.remove_if([vocab](const llama_grammar_compile_cache::entry & e) { return e.vocab == vocab; });
+    }
+    cache.stats.n_entries = cache.entries.size();
+}
+
+struct llama_grammar * llama_grammar_init_impl(
+        const struct llama_vocab * vocab,
+                      const char * grammar_str,
+                      const char * grammar_root,
+                              bool lazy,
+                     const char ** trigger_patterns,
+                            size_t num_trigger_patterns,
+               const llama_token * trigger_tokens,
+                            size_t num_trigger_tokens) {
+    // the token masks are only used with a vocabulary, grammars for tests are compiled every time
+    const auto compiled = vocab != nullptr ? llama_grammar_compile_cached(vocab, grammar_str, grammar_root)
+                                           : llama_grammar_compile(vocab, grammar_str, grammar_root);
+    if (!compiled) {
+        return nullptr;
+    }
+
+    llama_grammar_rules vec_rules = compiled->rules;
+
+    llama_grammar_stacks stacks;
+    for (const auto & key : compiled->stacks) {
+        llama_grammar_stack stack;
+        for (size_t i = 0; i < key.size(); i += 2) {
+            stack.push_back(&vec_rules[key[i]][key[i + 1]]);
+        }
+        stacks.push_back(std::move(stack));
+    }
+
     std::vector<llama_token>    vec_trigger_tokens;
     std::vector<llama_grammar_trigger_pattern> vec_trigger_patterns;
     for (size_t i = 0; i < num_trigger_tokens; i++) {
@@ -1194,13 +1366,13 @@ struct llama_grammar * llama_grammar_init_impl(
         LM_GGML_ASSERT(trigger_patterns != nullptr);
         auto & trigger = vec_trigger_patterns.emplace_back();
         trigger.pattern = trigger_patterns[i];
-        trigger.regex = std::regex(trigger.pattern);
+        trigger.regex = llama_grammar_trigger_regex(trigger.pattern);
     }
 
     // Important: vec_rules has to be moved here, not copied, because stacks contains
     // pointers to elements of vec_rules. If vec_rules were copied into llama_grammar
     // then the pointers would be invalidated when the local vec_rules goes out of scope.
-    return new llama_grammar {
+    auto * result = new llama_grammar {
         vocab,
         std::move(vec_rules),
         std::move(stacks),
@@ -1211,7 +1383,14 @@ struct llama_grammar * llama_grammar_init_impl(
         /* .trigger_buffer_positions = */ {},
         std::move(vec_trigger_tokens),
         std::move(vec_trigger_patterns),
+        /* .masks = */                    vocab != nullptr ? compiled->masks : nullptr,
+        /* .mask_positions = */           {},
     };
+    if (result->masks) {
+        result->mask_positions = llama_grammar_element_positions_of(result->rules);
+    }
+
+    return result;
 }
 
 void llama_grammar_free_impl(struct llama_grammar * grammar) {
@@ -1234,7 +1413,12 @@ struct llama_grammar * llama_grammar_clone_impl(const struct llama_grammar & gra
         grammar.trigger_buffer_positions,
         grammar.trigger_tokens,
         grammar.trigger_patterns,
+        grammar.masks,
+        /* .mask_positions = */ {},
     };
+    if (result->masks) {
+        result->mask_positions = llama_grammar_element_positions_of(result->rules);
+    }
 
     // redirect elements in stacks to point to new rules
     for (size_t is = 0; is < result->stacks.size(); is++) {
@@ -1252,6 +1436,349 @@ struct llama_grammar * llama_grammar_clone_impl(const struct llama_grammar & gra
     return result;
 }
 
+//
+// token masks
+//
+
+static void llama_grammar_trie_build_node(
+        llama_grammar_token_trie & trie,
+        const std::vector<std::pair<std::vector<uint32_t>, llama_grammar_token_trie::token>> & entries,
+        size_t lo,
+        size_t hi,
+        size_t depth,
+        uint32_t node_idx) {
+    // entries[lo, hi) share their first depth code points; sorted, so the ones ending here come first
+    trie.nodes[node_idx].token_begin = trie.tokens.size();
+    for (; lo < hi && entries[lo].first.size() == depth; lo++) {
+        trie.tokens.push_back(entries[lo].second);
+    }
+    trie.nodes[node_idx].token_end = trie.tokens.size();
+
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i = lo; i < hi; ) {
+        size_t j = i + 1;
+        while (j < hi && entries[j].first[depth] == entries[i].first[depth]) {
+            j++;
+        }
+        groups.emplace_back(i, j);
+        i = j;
+    }
+
+    const uint32_t child_begin = trie.nodes.size();
+    trie.nodes[node_idx].child_begin = child_begin;
+    trie.nodes[node_idx].child_end   = child_begin + groups.size();
+    for (const auto & group : groups) {
+        trie.nodes.push_back({ entries[group.first].first[depth], 0, 0, 0, 0, 0 });
+    }
+    for (size_t g = 0; g < groups.size(); g++) {
+        llama_grammar_trie_build_node(trie, entries, groups[g].first, groups[g].second, depth + 1, child_begin + g);
+    }
+
+    trie.nodes[node_idx].subtree_end = trie.tokens.size();
+}
+
+std::shared_ptr<const llama_grammar_token_trie> llama_grammar_token_trie_build(const llama_vocab & vocab) {
+    const int64_t t_start_us = lm_ggml_time_us();
+
+    auto trie = std::make_shared<llama_grammar_token_trie>();
+    trie->n_vocab = vocab.n_tokens();
+    trie->eog.assign((trie->n_vocab + 63) / 64, 0);
+
+    // the same texts llama_grammar_apply_impl matches, decoded with no partial sequence pending
+    std::vector<std::pair<std::vector<uint32_t>, llama_grammar_token_trie::token>> entries;
+    entries.reserve(trie->n_vocab);
+    for (uint32_t id = 0; id < trie->n_vocab; id++) {
+        if (vocab.is_eog(id)) {
+            trie->eog[id / 64] |= uint64_t(1) << (id % 64);
+            continue;
+        }
+        const std::string & piece = vocab.token_to_piece(id);
+        if (piece.empty() || piece[0] == 0) {
+            continue;
+        }
+        auto decoded = decode_utf8(piece, {});
+        auto & code_points = decoded.first;
+        code_points.resize(std::find(code_points.begin(), code_points.end(), 0) - code_points.begin());
+        entries.push_back({ std::move(code_points), { (llama_token) id, decoded.second } });
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto & a, const auto & b) {
+        return a.first != b.first ? a.first < b.first : a.second.id < b.second.id;
+    });
+
+    trie->tokens.reserve(entries.size());
+    trie->nodes.push_back({ 0, 0, 0, 0, 0, 0 });
+    llama_grammar_trie_build_node(*trie, entries, 0, entries.size(), 0, 0);
+
+    trie->nodes.shrink_to_fit();
+    LLAMA_LOG_INFO("%s: %zu tokens in %zu trie nodes, built in %.1f ms\n", __func__,
+            trie->tokens.size(), trie->nodes.size(), 1e-3 * (lm_ggml_time_us() - t_start_us));
+
+    return trie;
+}
+
+llama_grammar_mask_cache & llama_grammar_get_mask_cache() {
+    // never destroyed, like the compile cache whose grammars release their masks during exit
+    static auto * cache = new llama_grammar_mask_cache();
+    return *cache;
+}
+
+static uint32_t llama_grammar_masks_next_id() {
+    auto & cache = llama_grammar_get_mask_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.next_id++;
+}
+
+llama_grammar_masks::llama_grammar_masks() : id(llama_grammar_masks_next_id()) {}
+
+llama_grammar_masks::~llama_grammar_masks() {
+    auto & cache = llama_grammar_get_mask_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    for (auto it = cache.lru.begin(); it != cache.lru.end();) {
+        if ((*it)[0] != id) {
+            ++it;
+            continue;
+        }
+        auto entry = cache.entries.find(*it);
+        cache.bytes -= entry->second.mask.size() * sizeof(uint64_t);
+        cache.entries.erase(entry);
+        it = cache.lru.erase(it);
+    }
+}
+
+size_t llama_grammar_mask_cache::key_hash::operator()(const key & k) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const uint32_t v : k) {
+        hash = (hash ^ v) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// walks the trie below one grammar stack and sets the bits of the tokens some path through the grammar
+// accepts, following the same rules as llama_grammar_reject_candidates_for_stack
+struct llama_grammar_mask_walk {
+    const llama_grammar_rules      & rules;
+    const llama_grammar_token_trie & trie;
+    uint64_t                       * mask;
+
+    // stacks met during the walk and, once needed, the stacks they advance to after matching a char
+    std::map<llama_grammar_stack, uint32_t> ids;
+    std::vector<llama_grammar_stack>        stacks;
+    std::vector<std::vector<uint32_t>>      after;
+    std::vector<bool>                       after_done;
+
+    // scratch sets of stack ids, one per trie depth
+    std::vector<std::vector<uint32_t>> sets;
+
+    size_t n_nodes = 0;
+
+    uint32_t intern(const llama_grammar_stack & stack) {
+        auto it = ids.find(stack);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        const uint32_t id = stacks.size();
+        ids.emplace(stack, id);
+        stacks.push_back(stack);
+        after.emplace_back();
+        after_done.push_back(false);
+        return id;
+    }
+
+    // the stacks a char matched at the top of stack id leads to; the same whichever char matched
+    const std::vector<uint32_t> & advance(uint32_t id) {
+        if (!after_done[id]) {
+            const llama_grammar_stack & stack = stacks[id];
+            const auto * pos_after = llama_grammar_match_char(stack.back(), 0).second;
+
+            llama_grammar_stack stack_after(stack.begin(), stack.end() - 1);
+            if (!llama_grammar_is_end_of_sequence(pos_after)) {
+                stack_after.push_back(pos_after);
+            }
+            llama_grammar_stacks next_stacks;
+            llama_grammar_advance_stack(rules, stack_after, next_stacks);
+
+            std::vector<uint32_t> next;
+            for (const auto & next_stack : next_stacks) {
+                next.push_back(intern(next_stack));
+            }
+            after[id]      = std::move(next);
+            after_done[id] = true;
+        }
+        return after[id];
+    }
+
+    void set(llama_token id) {
+        mask[id / 64] |= uint64_t(1) << (id % 64);
+    }
+
+    bool accepts_end(const std::vector<uint32_t> & set_ids, const llama_partial_utf8 & partial_utf8) const {
+        for (const uint32_t id : set_ids) {
+            const llama_grammar_stack & stack = stacks[id];
+            if (partial_utf8.n_remain == 0) {
+                return true;
+            }
+            if (!stack.empty() && (stack.back()->type == LLAMA_GRETYPE_CHAR || stack.back()->type == LLAMA_GRETYPE_CHAR_NOT ||
+                                   stack.back()->type == LLAMA_GRETYPE_CHAR_ANY) &&
+                    llama_grammar_match_partial_char(stack.back(), partial_utf8)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void visit(uint32_t node_idx, size_t depth) {
+        n_nodes++;
+
+        const auto & node = trie.nodes[node_idx];
+
+        for (uint32_t t = node.token_begin; t < node.token_end; t++) {
+            if (accepts_end(sets[depth], trie.tokens[t].partial_utf8)) {
+                set(trie.tokens[t].id);
+            }
+        }
+
+        bool any_char = false;
+        for (const uint32_t id : sets[depth]) {
+            const llama_grammar_stack & stack = stacks[id];
+            if (stack.empty()) {
+                continue;
+            }
+            const llama_grammar_element * pos = stack.back();
+            if (pos->type == LLAMA_GRETYPE_TOKEN || pos->type == LLAMA_GRETYPE_TOKEN_NOT) {
+                // a token rule decides on the id alone for every longer token below
+                for (uint32_t t = node.token_end; t < node.subtree_end; t++) {
+                    if (llama_grammar_match_token(pos, trie.tokens[t].id)) {
+                        set(trie.tokens[t].id);
+                    }
+                }
+            } else {
+                any_char = true;
+            }
+        }
+        if (!any_char) {
+            return;
+        }
+
+        if (sets.size() <= depth + 1) {
+            sets.resize(depth + 2);
+        }
+
+        for (uint32_t child = node.child_begin; child < node.child_end; child++) {
+            const uint32_t code_point = trie.nodes[child].code_point;
+
+            // deeper visits only reuse sets[depth + 1] onwards, so this depth's set survives across children
+            std::vector<uint32_t> & next = sets[depth + 1];
+            next.clear();
+            for (size_t i = 0; i < sets[depth].size(); i++) {
+                const uint32_t id = sets[depth][i];
+                const llama_grammar_stack & stack = stacks[id];
+                if (stack.empty()) {
+                    continue;
+                }
+                const llama_grammar_element * pos = stack.back();
+                if (pos->type == LLAMA_GRETYPE_TOKEN || pos->type == LLAMA_GRETYPE_TOKEN_NOT) {
+                    continue;
+                }
+                if (llama_grammar_match_char(pos, code_point).first) {
+                    const auto & next_ids = advance(id);
+                    next.insert(next.end(), next_ids.begin(), next_ids.end());
+                }
+            }
+            if (next.empty()) {
+                continue;
+            }
+            if (next.size() > 1) {
+                std::sort(next.begin(), next.end());
+                next.erase(std::unique(next.begin(), next.end()), next.end());
+            }
+            visit(child, depth + 1);
+        }
+    }
+};
+
+// ORs the allowed tokens of one stack into allowed, from the cache or by walking the trie
+static void llama_grammar_mask_for_stack(
+        const llama_grammar            & grammar,
+        const llama_grammar_token_trie & trie,
+        const llama_grammar_stack      & stack,
+        std::vector<uint64_t>          & allowed) {
+    auto & cache = llama_grammar_get_mask_cache();
+    auto & masks = *grammar.masks;
+    auto key = llama_grammar_mask_key(grammar.mask_positions, stack);
+    key.insert(key.begin(), masks.id);
+
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.entries.find(key);
+        if (it != cache.entries.end()) {
+            const auto & mask = it->second.mask;
+            for (size_t i = 0; i < allowed.size(); i++) {
+                allowed[i] |= mask[i];
+            }
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lru_it);
+            masks.n_hits++;
+            return;
+        }
+        masks.n_misses++;
+    }
+
+    std::vector<uint64_t> mask(allowed.size(), 0);
+    llama_grammar_mask_walk walk { grammar.rules, trie, mask.data(), {}, {}, {}, {}, {}, 0 };
+    walk.sets.resize(1);
+    walk.sets[0].push_back(walk.intern(stack));
+    walk.visit(0, 0);
+
+    for (size_t i = 0; i < allowed.size(); i++) {
+        allowed[i] |= mask[i];
+    }
+
+    if (walk.n_nodes < cache.min_nodes) {
+        return;
+    }
+
+    // masks of other grammars, possibly over other vocabularies, give way in LRU order
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    const size_t mask_bytes = mask.size() * sizeof(uint64_t);
+    if (mask_bytes > cache.max_bytes || cache.entries.count(key)) {
+        return;
+    }
+    while (cache.bytes + mask_bytes > cache.max_bytes && !cache.lru.empty()) {
+        auto oldest = cache.entries.find(cache.lru.back());
+        cache.bytes -= oldest->second.mask.size() * sizeof(uint64_t);
+        cache.entries.erase(oldest);
+        cache.lru.pop_back();
+        cache.n_evicted++;
+    }
+    cache.lru.push_front(key);
+    cache.entries.emplace(std::move(key), llama_grammar_mask_cache::entry { std::move(mask), cache.lru.begin() });
+    cache.bytes += mask_bytes;
+    cache.n_stored++;
+}
+
+// candidate sets smaller than this are matched token by token
+#define LLAMA_GRAMMAR_MASK_MIN_CANDIDATES 256
+
+static void llama_grammar_apply_masks(const llama_grammar & grammar, llama_token_data_array * cur_p, bool allow_eog) {
+    const auto trie = grammar.vocab->grammar_trie();
+
+    std::vector<uint64_t> allowed(trie->eog.size(), 0);
+    for (const auto & stack : grammar.stacks) {
+        llama_grammar_mask_for_stack(grammar, *trie, stack, allowed);
+    }
+    if (allow_eog) {
+        for (size_t i = 0; i < allowed.size(); i++) {
+            allowed[i] |= trie->eog[i];
+        }
+    }
+
+    llama_token_data * data = cur_p->data;
+    const uint64_t   * bits = allowed.data();
+    for (size_t i = 0; i < cur_p->size; ++i) {
+        const uint32_t id = data[i].id;
+        data[i].logit = (bits[id / 64] >> (id % 64)) & 1 ? data[i].logit : -INFINITY;
+    }
+}
+
 void llama_grammar_apply_impl(const struct llama_grammar & grammar, llama_token_data_array * cur_p) {
     LM_GGML_ASSERT(grammar.vocab != nullptr);
 
@@ -1267,6 +1794,12 @@ void llama_grammar_apply_impl(const struct llama_grammar & grammar, llama_token_
         }
     }
 
+    // the trie holds the token texts decoded from a clean state, a pending partial sequence changes them
+    if (grammar.masks && grammar.partial_utf8.n_remain == 0 && cur_p->size >= LLAMA_GRAMMAR_MASK_MIN_CANDIDATES) {
+        llama_grammar_apply_masks(grammar, cur_p, allow_eog);
+        return;
+    }
+
     std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
     candidates_decoded.reserve(cur_p->size);
 
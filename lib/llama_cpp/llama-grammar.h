@@ -2,9 +2,13 @@
 
 #include "llama.h"
 
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 struct llama_vocab;
@@ -116,6 +120,105 @@ struct llama_grammar_parser {
     void print(FILE * file);
 };
 
+// the vocabulary decoded into a trie of code points, built once per vocab (see llama_vocab::grammar_trie)
+// tokens sharing a prefix are matched against the grammar together; tokens are stored in depth-first
+// order, so the tokens of a subtree are contiguous
+struct llama_grammar_token_trie {
+    struct node {
+        uint32_t code_point;  // label of the edge from the parent
+        uint32_t child_begin; // children are nodes[child_begin, child_end)
+        uint32_t child_end;
+        uint32_t token_begin; // tokens whose text ends here are tokens[token_begin, token_end)
+        uint32_t token_end;
+        uint32_t subtree_end; // tokens of the whole subtree are tokens[token_begin, subtree_end)
+    };
+
+    struct token {
+        llama_token        id;
+        llama_partial_utf8 partial_utf8; // incomplete UTF-8 sequence at the end of the text
+    };
+
+    uint32_t n_vocab = 0;
+
+    std::vector<node>     nodes; // nodes[0] is the root
+    std::vector<token>    tokens;
+    std::vector<uint64_t> eog;   // bit mask of the end-of-generation tokens, which are not in the trie
+};
+
+std::shared_ptr<const llama_grammar_token_trie> llama_grammar_token_trie_build(const llama_vocab & vocab);
+
+// allowed-token bit masks of single grammar stacks, keyed by the compiled grammar and the rule positions
+// on the stack so that a grammar, its clones and its resets share them
+// the allowed set of a grammar state is the union of the masks of its stacks
+// one process-wide store holds the masks of every compiled grammar, so a single byte budget and LRU
+// bound them no matter how many grammars are cached
+struct llama_grammar_mask_cache {
+    using key = std::vector<uint32_t>; // llama_grammar_masks::id, then rule and element index per stack entry
+
+    struct key_hash {
+        size_t operator()(const key & k) const;
+    };
+
+    struct entry {
+        std::vector<uint64_t> mask;
+        std::list<key>::iterator lru_it;
+    };
+
+    // masks that took fewer trie nodes to compute are recomputed rather than stored
+    size_t min_nodes = 2048;
+    size_t max_bytes = 32u << 20;
+    size_t bytes     = 0;
+
+    uint64_t n_stored  = 0;
+    uint64_t n_evicted = 0;
+
+    uint32_t next_id = 0;
+
+    std::mutex mutex;
+    std::unordered_map<key, entry, key_hash> entries;
+    std::list<key> lru; // most recently used first
+};
+
+llama_grammar_mask_cache & llama_grammar_get_mask_cache();
+
+// the masks of one compiled grammar in the process-wide store, dropped from it once the compiled
+// grammar and every grammar made from it are gone
+struct llama_grammar_masks {
+    const uint32_t id;
+
+    // guarded by the store's mutex
+    uint64_t n_hits   = 0;
+    uint64_t n_misses = 0;
+
+    llama_grammar_masks();
+    ~llama_grammar_masks();
+};
+
+// a grammar text parsed once: the rules, the initial stacks as rule positions and the token masks
+// found so far, shared by every grammar compiled from the same text (see llama_grammar_init_impl)
+struct llama_grammar_compiled {
+    llama_grammar_rules                       rules;
+    std::vector<llama_grammar_mask_cache::key> stacks;
+
+    std::shared_ptr<llama_grammar_masks> masks;
+};
+
+struct llama_grammar_cache_stats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    size_t   n_entries = 0;
+    size_t   mask_bytes = 0; // token masks held for all compiled grammars
+};
+
+// counters of the process-wide cache of compiled grammars
+llama_grammar_cache_stats llama_grammar_cache_get_stats();
+
+// drops the compiled grammars of one vocabulary, or all of them and every stored token mask if vocab is null
+void llama_grammar_cache_clear(const struct llama_vocab * vocab);
+
+using llama_grammar_element_positions = std::unordered_map<const llama_grammar_element *, std::pair<uint32_t, uint32_t>>;
+
 struct llama_grammar_trigger_pattern {
     std::string pattern;
     std::regex  regex;
@@ -146,6 +249,11 @@ struct llama_grammar {
                              trigger_patterns;         // Regular expressions that trigger a lazy grammar. Must be a full match of the entire generated
                                                        // string, and the grammar will be given the string from the first match group onwards.
 
+    // token masks used by llama_grammar_apply_impl on large candidate sets, null to always match token by token
+    std::shared_ptr<llama_grammar_masks> masks;
+
+    // rule and element index of every element of rules, to key the masks without searching the rules
+    llama_grammar_element_positions mask_positions;
 };
 
 //
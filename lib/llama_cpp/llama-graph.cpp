@@ -146,6 +146,54 @@ bool llm_graph_input_out_ids::can_reuse(const llm_graph_params & params) {
     return res;
 }
 
+void llm_graph_input_lora_seq::set_input(const llama_ubatch * ubatch) {
+    const int64_t n_tokens = ubatch->n_tokens;
+
+    // a token shared by several sequences uses the adapter of the first one, tokens of
+    // sequences without an adapter read slot 0 with a zero scale
+    auto fill = [&](lm_ggml_tensor * t_ids, lm_ggml_tensor * t_scale, bool outputs_only) {
+        if (!t_ids || !t_ids->buffer) {
+            return;
+        }
+
+        LM_GGML_ASSERT(lm_ggml_backend_buffer_is_host(t_ids->buffer));
+        LM_GGML_ASSERT(lm_ggml_backend_buffer_is_host(t_scale->buffer));
+
+        int32_t * data_ids   = (int32_t *) t_ids->data;
+        float   * data_scale = (float   *) t_scale->data;
+
+        int n = 0;
+        for (int i = 0; i < n_tokens; ++i) {
+            if (outputs_only && !ubatch->output[i]) {
+                continue;
+            }
+
+            const llama_seq_id seq_id = ubatch->seq_id[i][0];
+
+            int32_t slot = -1;
+            if (seq_id >= 0 && (size_t) seq_id < loras_seq->seq_slot.size()) {
+                slot = loras_seq->seq_slot[seq_id];
+            }
+
+            data_ids[n]   = slot >= 0 ? slot : 0;
+            data_scale[n] = slot >= 0 ? loras_seq->seq_scale[seq_id] : 0.0f;
+            n++;
+        }
+    };
+
+    fill(ids,     scale,     false);
+    fill(ids_out, scale_out, true);
+}
+
+bool llm_graph_input_lora_seq::can_reuse(const llm_graph_params & params) {
+    bool res = true;
+
+    res &= ids->ne[1] == params.ubatch.n_tokens;
+    res &= n_outputs  == params.n_outputs;
+
+    return res;
+}
+
 void llm_graph_input_mean::set_input(const llama_ubatch * ubatch) {
     if (cparams.embeddings && cparams.pooling_type == LLAMA_POOLING_TYPE_MEAN) {
         const int64_t n_tokens     = ubatch->n_tokens;
@@ -644,6 +692,7 @@ llm_graph_context::llm_graph_context(const llm_graph_params & params) :
     backend_cpu      (params.backend_cpu),
     cvec             (params.cvec),
     loras            (params.loras),
+    loras_seq        (params.loras_seq),
     mctx             (params.mctx),
     cross            (params.cross),
     cb_func          (params.cb),
@@ -651,6 +700,10 @@ llm_graph_context::llm_graph_context(const llm_graph_params & params) :
     ctx0             (res->get_ctx()),
     gf               (res->get_gf()) {
         res->set_params(params);
+
+        if (loras_seq && loras_seq->active()) {
+            inp_lora_seq = build_inp_lora_seq();
+        }
     }
 
 void llm_graph_context::cb(lm_ggml_tensor * cur, const char * name, int il) const {
@@ -688,9 +741,53 @@ lm_ggml_tensor * llm_graph_context::build_lora_mm(
         res = lm_ggml_add(ctx0, res, ab_cur);
     }
 
+    if (inp_lora_seq) {
+        res = build_lora_seq_mm(w, cur, res);
+    }
+
     return res;
 }
 
+lm_ggml_tensor * llm_graph_context::build_lora_seq_mm(
+          lm_ggml_tensor * w,
+          lm_ggml_tensor * cur,
+          lm_ggml_tensor * res) const {
+    const llama_adapter_lora_weight * lw = loras_seq->get_weight(w);
+    if (lw == nullptr) {
+        return res;
+    }
+
+    // every row of cur is one token, either of the whole ubatch or of the selected outputs
+    const int64_t n_rows = lm_ggml_nrows(cur);
+
+    lm_ggml_tensor * ids   = nullptr;
+    lm_ggml_tensor * scale = nullptr;
+    if (n_rows == n_tokens) {
+        ids   = inp_lora_seq->ids;
+        scale = inp_lora_seq->scale;
+    } else if (n_rows == n_outputs && inp_lora_seq->ids_out) {
+        ids   = inp_lora_seq->ids_out;
+        scale = inp_lora_seq->scale_out;
+    } else {
+        return res;
+    }
+
+    // one "expert" per token: the adapter slot of its sequence
+    lm_ggml_tensor * x = lm_ggml_is_contiguous(cur) ? cur : lm_ggml_cont(ctx0, cur);
+    x = lm_ggml_reshape_3d(ctx0, x, cur->ne[0], 1, n_rows);
+
+    lm_ggml_tensor * ab_cur = lm_ggml_mul_mat_id(
+            ctx0, lw->b,
+            lm_ggml_mul_mat_id(ctx0, lw->a, x, ids),
+            ids
+            );
+
+    ab_cur = lm_ggml_mul(ctx0, ab_cur, scale);
+    ab_cur = lm_ggml_reshape(ctx0, ab_cur, res);
+
+    return lm_ggml_add(ctx0, res, ab_cur);
+}
+
 lm_ggml_tensor * llm_graph_context::build_lora_mm_id(
           lm_ggml_tensor * w,   // lm_ggml_tensor * as
           lm_ggml_tensor * cur, // lm_ggml_tensor * b
@@ -1302,6 +1399,25 @@ lm_ggml_tensor * llm_graph_context::build_inp_out_ids() const {
     return cur;
 }
 
+llm_graph_input_lora_seq * llm_graph_context::build_inp_lora_seq() const {
+    auto inp = std::make_unique<llm_graph_input_lora_seq>(loras_seq, n_outputs);
+
+    inp->ids   = lm_ggml_new_tensor_2d(ctx0, LM_GGML_TYPE_I32, 1, n_tokens);
+    inp->scale = lm_ggml_new_tensor_3d(ctx0, LM_GGML_TYPE_F32, 1, 1, n_tokens);
+    lm_ggml_set_input(inp->ids);
+    lm_ggml_set_input(inp->scale);
+
+    // the rows left after the output selection of the last layer
+    if (n_outputs > 0 && n_outputs != n_tokens) {
+        inp->ids_out   = lm_ggml_new_tensor_2d(ctx0, LM_GGML_TYPE_I32, 1, n_outputs);
+        inp->scale_out = lm_ggml_new_tensor_3d(ctx0, LM_GGML_TYPE_F32, 1, 1, n_outputs);
+        lm_ggml_set_input(inp->ids_out);
+        lm_ggml_set_input(inp->scale_out);
+    }
+
+    return (llm_graph_input_lora_seq *) res->add_input(std::move(inp));
+}
+
 lm_ggml_tensor * llm_graph_context::build_inp_mean() const {
     auto inp = std::make_unique<llm_graph_input_mean>(cparams);
 
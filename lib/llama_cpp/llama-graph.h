@@ -193,6 +193,26 @@ public:
     const uint32_t n_outputs;
 };
 
+// per-token slot and scale of the per-sequence LoRA adapters
+class llm_graph_input_lora_seq : public llm_graph_input_i {
+public:
+    llm_graph_input_lora_seq(const llama_adapter_lora_seq * loras_seq, uint32_t n_outputs) : loras_seq(loras_seq), n_outputs(n_outputs) {}
+    virtual ~llm_graph_input_lora_seq() = default;
+
+    void set_input(const llama_ubatch * ubatch) override;
+
+    bool can_reuse(const llm_graph_params & params) override;
+
+    lm_ggml_tensor * ids       = nullptr; // I32 [1, n_batch]
+    lm_ggml_tensor * scale     = nullptr; // F32 [1, 1, n_batch]
+    lm_ggml_tensor * ids_out   = nullptr; // I32 [1, n_outputs]
+    lm_ggml_tensor * scale_out = nullptr; // F32 [1, 1, n_outputs]
+
+    const llama_adapter_lora_seq * loras_seq;
+
+    const uint32_t n_outputs;
+};
+
 class llm_graph_input_mean : public llm_graph_input_i {
 public:
     llm_graph_input_mean(const llama_cparams & cparams) : cparams(cparams) {}
@@ -426,9 +446,13 @@ struct llm_graph_params {
 
     const llama_adapter_cvec     * cvec;
     const llama_adapter_loras    * loras;
+    const llama_adapter_lora_seq * loras_seq;
     const llama_memory_context_i * mctx;
     const llama_cross            * cross;
 
+    // changes whenever an adapter is set or removed, the adapter maps themselves are always the same objects
+    uint32_t loras_gen;
+
     uint32_t n_outputs;
 
     llm_graph_cb cb;
@@ -475,6 +499,7 @@ struct llm_graph_params {
             gtype     == other.gtype &&
             cvec      == other.cvec  &&
             loras     == other.loras &&
+            loras_gen == other.loras_gen &&
             cross     == other.cross &&
             n_outputs == other.n_outputs;
     }
@@ -589,6 +614,7 @@ struct llm_graph_context {
 
     const llama_adapter_cvec     * cvec;
     const llama_adapter_loras    * loras;
+    const llama_adapter_lora_seq * loras_seq;
     const llama_memory_context_i * mctx;
     const llama_cross            * cross;
 
@@ -599,6 +625,8 @@ struct llm_graph_context {
     lm_ggml_context * ctx0 = nullptr;
     lm_ggml_cgraph  * gf   = nullptr;
 
+    llm_graph_input_lora_seq * inp_lora_seq = nullptr;
+
     llm_graph_context(const llm_graph_params & params);
     virtual ~llm_graph_context() = default;
 
@@ -623,6 +651,12 @@ struct llm_graph_context {
               lm_ggml_tensor * cur, // lm_ggml_tensor * b
               lm_ggml_tensor * ids) const;
 
+    // add the per-sequence adapters of w to the product res of w and cur
+    lm_ggml_tensor * build_lora_seq_mm(
+              lm_ggml_tensor * w,
+              lm_ggml_tensor * cur,
+              lm_ggml_tensor * res) const;
+
     lm_ggml_tensor * build_norm(
              lm_ggml_tensor * cur,
              lm_ggml_tensor * mw,
@@ -694,6 +728,8 @@ struct llm_graph_context {
     lm_ggml_tensor * build_inp_attn_scale() const;
     lm_ggml_tensor * build_inp_out_ids() const;
     lm_ggml_tensor * build_inp_mean() const;
+
+    llm_graph_input_lora_seq * build_inp_lora_seq() const;
     lm_ggml_tensor * build_inp_cls() const;
 
     lm_ggml_tensor * build_inp_cross_embd() const;
@@ -1581,6 +1581,11 @@ static void llama_sampler_grammar_reset(struct llama_sampler * smpl) {
                                                  ctx->grammar->lazy, trigger_patterns_c.data(), trigger_patterns_c.size(),
                                                  ctx->grammar->trigger_tokens.data(), ctx->grammar->trigger_tokens.size());
 
+    // same rules, so the token masks computed so far still apply
+    if (grammar_new) {
+        grammar_new->masks = ctx->grammar->masks;
+    }
+
     llama_grammar_free_impl(ctx->grammar);
     ctx->grammar = grammar_new;
 }
@@ -2,6 +2,7 @@
 
 #include "ggml.h"
 #include "gguf.h"
+#include "llama-grammar.h"
 #include "llama-impl.h"
 #include "llama-model-loader.h"
 
@@ -17,6 +18,7 @@
 #include <forward_list>
 #include <limits>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <unordered_map>
@@ -1590,6 +1592,9 @@ struct llama_vocab::impl {
 
     std::vector<llama_token> cache_special_tokens;
     std::vector<std::string> cache_token_to_piece; // llama_token_to_piece(special = true);
+
+    std::mutex grammar_trie_mutex;
+    std::shared_ptr<const llama_grammar_token_trie> grammar_trie;
     struct pair_hash {
         size_t operator()(const std::pair<std::string, std::string> & p) const {
             return std::hash<std::string>{}(p.first) ^  //create some hash for pair
@@ -3265,7 +3270,10 @@ void llama_vocab::impl::print_info() const {
 llama_vocab::llama_vocab() : pimpl(new impl(*this)) {
 }
 
-llama_vocab::~llama_vocab() = default;
+llama_vocab::~llama_vocab() {
+    // compiled grammars hold token ids and masks of this vocabulary
+    llama_grammar_cache_clear(this);
+}
 
 void llama_vocab::load(llama_model_loader & ml, const LLM_KV & kv) {
     pimpl->load(ml, kv);
@@ -3565,6 +3573,14 @@ const std::string & llama_vocab::token_to_piece(llama_token token) const {
     return pimpl->token_to_piece(token);
 }
 
+std::shared_ptr<const llama_grammar_token_trie> llama_vocab::grammar_trie() const {
+    std::lock_guard<std::mutex> lock(pimpl->grammar_trie_mutex);
+    if (!pimpl->grammar_trie) {
+        pimpl->grammar_trie = llama_grammar_token_trie_build(*this);
+    }
+    return pimpl->grammar_trie;
+}
+
 int32_t llama_vocab::token_to_piece(llama_token token, char * buf, int32_t length, int32_t lstrip, bool special) const {
     return pimpl->token_to_piece(token, buf, length, lstrip, special);
 }
@@ -6,6 +6,8 @@
 #include <vector>
 #include <memory>
 
+struct llama_grammar_token_trie;
+
 // pre-tokenization types
 enum llama_vocab_pre_type {
     LLAMA_VOCAB_PRE_TYPE_DEFAULT         = 0,
@@ -160,6 +162,9 @@ struct llama_vocab {
     // use cached data
     const std::string & token_to_piece(llama_token token) const;
 
+    // token texts as a trie of code points for grammar masks, built on first use
+    std::shared_ptr<const llama_grammar_token_trie> grammar_trie() const;
+
     int32_t detokenize(
             const llama_token * tokens,
                       int32_t   n_tokens,
@@ -364,6 +364,7 @@ extern "C" {
         bool kv_unified;  // use a unified buffer across the input sequences when computing the attention
                           // try to disable when n_seq_max > 1 for improved performance when the sequences do not share a large prefix
                           // ref: https://github.com/ggml-org/llama.cpp/pull/14363
+        bool lora_seq;    // allow LoRA adapters per sequence (llama_set_adapter_lora_seq), reserves graph nodes for them
     };
 
     // model quantization parameters
@@ -648,6 +649,26 @@ extern "C" {
     // Remove all LoRA adapters from given context
     LLAMA_API void llama_clear_adapter_lora(struct llama_context * ctx);
 
+    // Use a loaded LoRA adapter for the tokens of one sequence only, on top of the adapters
+    // set on the whole context. Sequences in the same batch may use different adapters.
+    // A token that belongs to several sequences uses the adapter of the first one.
+    // Token embeddings and MoE experts are not adapted per sequence. The adapter must not be
+    // freed while a sequence uses it. Requires llama_context_params.lora_seq.
+    // Selecting an adapter that is already stacked only switches the slot of seq_id, the
+    // stack is rebuilt when a new adapter comes in.
+    // Return -1 if seq_id is out of range, the adapter is null or it cannot be stacked with the others
+    LLAMA_API int32_t llama_set_adapter_lora_seq(
+            struct llama_context * ctx,
+            struct llama_adapter_lora * adapter,
+            llama_seq_id seq_id,
+            float scale);
+
+    // Remove the per-sequence LoRA adapter of seq_id, or of all sequences if seq_id < 0
+    // The stacked adapters are kept for later selections until seq_id < 0 frees them
+    LLAMA_API void llama_clear_adapter_lora_seq(
+            struct llama_context * ctx,
+            llama_seq_id seq_id);
+
     // Apply a loaded control vector to a llama_context, or if data is NULL, clear
     // the currently loaded vector.
     // n_embd should be the size of a single layer's control, and data should point
@@ -8,6 +8,14 @@
 #include <cstring>
 #include <unordered_map>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define COMMON_SAMPLING_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define COMMON_SAMPLING_NEON
+#endif
+
 // the ring buffer works similarly to std::deque, but with a fixed capacity
 // TODO: deduplicate with llama-impl.h
 template<typename T>
@@ -104,6 +112,9 @@ struct ring_buffer {
 struct common_sampler {
     common_params_sampling params;
 
+    // the vocabulary the grammar and the chain were built for
+    const struct llama_vocab * vocab;
+
     struct llama_sampler * grmr;
     struct llama_sampler * chain;
 
@@ -113,6 +124,12 @@ struct common_sampler {
 
     llama_token_data_array cur_p;
 
+    // > 0 when only the top_k_fast largest logits can come out of the chain, see common_sampler_fast_top_k
+    int32_t top_k_fast;
+
+    // tokens whose logits the chain may raise or lower ahead of top-k
+    std::vector<llama_token> moved;
+
     void reset() {
         prev.clear();
 
@@ -136,6 +153,49 @@ struct common_sampler {
         cur_p = { cur.data(), cur.size(), -1, false };
     }
 
+    // Candidates that give the same top_k_fast survivors as set_logits: tokens nobody
+    // touches ahead of top-k keep their order, so only the largest of them (one per moved
+    // token to be safe) and the moved tokens themselves can make it through
+    void set_logits_top_k(struct llama_context * ctx, int idx) {
+        const auto * logits = llama_get_logits_ith(ctx, idx);
+
+        const llama_model * model = llama_get_model(ctx);
+        const llama_vocab * vocab = llama_model_get_vocab(model);
+
+        const int n_vocab = llama_vocab_n_tokens(vocab);
+
+        moved.clear();
+        for (const auto & bias : params.logit_bias) {
+            moved.push_back(bias.token);
+        }
+        if (params.penalty_last_n > 0 &&
+            (params.penalty_repeat != 1.0f || params.penalty_freq != 0.0f || params.penalty_present != 0.0f)) {
+            const size_t n_last = std::min(prev.size(), (size_t) params.penalty_last_n);
+            for (size_t i = 0; i < n_last; ++i) {
+                moved.push_back(prev.rat(i));
+            }
+        }
+        std::sort(moved.begin(), moved.end());
+        moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+
+        common_sampler_select_top_k(logits, n_vocab, top_k_fast + (int32_t) moved.size(), cur);
+
+        if ((int) cur.size() < n_vocab) {
+            const size_t n_selected = cur.size();
+            for (const llama_token token : moved) {
+                if (token < 0 || token >= n_vocab) {
+                    continue;
+                }
+                const auto end = cur.begin() + n_selected;
+                if (std::find_if(cur.begin(), end, [token](const llama_token_data & td) { return td.id == token; }) == end) {
+                    cur.push_back(llama_token_data{token, logits[token], 0.0f});
+                }
+            }
+        }
+
+        cur_p = { cur.data(), cur.size(), -1, false };
+    }
+
     common_time_meas tm() {
         return common_time_meas(t_total_us, params.no_perf);
     }
@@ -159,17 +219,70 @@ std::string common_params_sampling::print() const {
     return std::string(result);
 }
 
-struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params) {
-    const llama_vocab * vocab = llama_model_get_vocab(model);
+// Returns top_k when everything the chain runs ahead of the top-k sampler either moves
+// known tokens (logit bias, penalties), keeps the logit order (plain temperature) or is
+// disabled by its parameters, so the candidates can be cut to the k largest up front.
+// Returns 0 otherwise and the full vocabulary is handed to the chain.
+static int32_t common_sampler_fast_top_k(const struct common_params_sampling & params, int32_t n_vocab) {
+    if (params.mirostat != 0 || params.top_k <= 0 || params.top_k >= n_vocab) {
+        return 0;
+    }
+    // penalized tokens are recovered from prev, which has to cover the penalty window
+    if (params.penalty_last_n > std::max(32, params.n_prev)) {
+        return 0;
+    }
 
-    llama_sampler_chain_params lparams = llama_sampler_chain_default_params();
+    for (const auto & cnstr : params.samplers) {
+        switch (cnstr) {
+            case COMMON_SAMPLER_TYPE_TOP_K:
+                return params.top_k;
+            case COMMON_SAMPLER_TYPE_PENALTIES:
+                break;
+            case COMMON_SAMPLER_TYPE_TEMPERATURE:
+                if (params.dynatemp_range > 0.0f) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_DRY:
+                if (params.dry_multiplier != 0.0f && params.dry_base >= 1.0f && params.dry_penalty_last_n != 0) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_TOP_N_SIGMA:
+                if (params.top_n_sigma > 0.0f) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_TOP_P:
+                if (params.top_p < 1.0f) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_MIN_P:
+                if (params.min_p > 0.0f) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_TYPICAL_P:
+                if (params.typ_p < 1.0f) {
+                    return 0;
+                }
+                break;
+            case COMMON_SAMPLER_TYPE_XTC:
+                if (params.xtc_probability > 0.0f) {
+                    return 0;
+                }
+                break;
+            default:
+                return 0;
+        }
+    }
 
-    lparams.no_perf = params.no_perf;
+    return 0;
+}
 
+static llama_sampler * common_sampler_init_grammar(const struct llama_vocab * vocab, const struct common_params_sampling & params) {
     llama_sampler * grmr = nullptr;
-    llama_sampler * chain = llama_sampler_chain_init(lparams);
-
-    std::vector<llama_sampler *> samplers;
 
     if (params.grammar.compare(0, 11, "%llguidance") == 0) {
 #ifdef LLAMA_USE_LLGUIDANCE
@@ -231,83 +344,242 @@ struct common_sampler * common_sampler_init(const struct llama_model * model, co
         }
     }
 
+    return grmr;
+}
+
+static bool common_sampler_same_grammar(const struct common_params_sampling & a, const struct common_params_sampling & b) {
+    if (a.grammar != b.grammar || a.grammar_lazy != b.grammar_lazy || a.grammar_triggers.size() != b.grammar_triggers.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.grammar_triggers.size(); ++i) {
+        const auto & ta = a.grammar_triggers[i];
+        const auto & tb = b.grammar_triggers[i];
+        if (ta.type != tb.type || ta.value != tb.value || ta.token != tb.token) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// chain entries that do not come from params.samplers, numbered after common_sampler_type
+enum common_sampler_stage {
+    COMMON_SAMPLER_STAGE_LOGIT_BIAS = 64,
+    COMMON_SAMPLER_STAGE_DIST,
+    COMMON_SAMPLER_STAGE_MIROSTAT_TEMP,
+    COMMON_SAMPLER_STAGE_MIROSTAT,
+    COMMON_SAMPLER_STAGE_MIROSTAT_V2,
+};
+
+// the samplers of the chain, in chain order
+static std::vector<int> common_sampler_stages(const struct common_params_sampling & params) {
+    std::vector<int> stages;
+
     if (params.has_logit_bias()) {
-        samplers.push_back(llama_sampler_init_logit_bias(llama_vocab_n_tokens(vocab), params.logit_bias.size(), params.logit_bias.data()));
+        stages.push_back(COMMON_SAMPLER_STAGE_LOGIT_BIAS);
     }
 
     if (params.mirostat == 0) {
         for (const auto & cnstr : params.samplers) {
-            switch (cnstr) {
-                case COMMON_SAMPLER_TYPE_DRY:
-                    {
-                        std::vector<const char *> c_breakers;
-                        c_breakers.reserve(params.dry_sequence_breakers.size());
-                        for (const auto & str : params.dry_sequence_breakers) {
-                            c_breakers.push_back(str.c_str());
-                        }
-
-                        samplers.push_back(llama_sampler_init_dry    (vocab, llama_model_n_ctx_train(model), params.dry_multiplier, params.dry_base, params.dry_allowed_length, params.dry_penalty_last_n, c_breakers.data(), c_breakers.size()));
-                    }
-                    break;
-                case COMMON_SAMPLER_TYPE_TOP_K:
-                    samplers.push_back(llama_sampler_init_top_k      (params.top_k));
-                    break;
-                case COMMON_SAMPLER_TYPE_TOP_P:
-                    samplers.push_back(llama_sampler_init_top_p      (params.top_p, params.min_keep));
-                    break;
-                case COMMON_SAMPLER_TYPE_TOP_N_SIGMA:
-                    samplers.push_back(llama_sampler_init_top_n_sigma(params.top_n_sigma));
-                    break;
-                case COMMON_SAMPLER_TYPE_MIN_P:
-                    samplers.push_back(llama_sampler_init_min_p      (params.min_p, params.min_keep));
-                    break;
-                case COMMON_SAMPLER_TYPE_XTC:
-                    samplers.push_back(llama_sampler_init_xtc        (params.xtc_probability, params.xtc_threshold, params.min_keep, params.seed));
-                    break;
-                case COMMON_SAMPLER_TYPE_TYPICAL_P:
-                    samplers.push_back(llama_sampler_init_typical    (params.typ_p, params.min_keep));
-                    break;
-                case COMMON_SAMPLER_TYPE_TEMPERATURE:
-                    samplers.push_back(llama_sampler_init_temp_ext   (params.temp, params.dynatemp_range, params.dynatemp_exponent));
-                    break;
-                case COMMON_SAMPLER_TYPE_INFILL:
-                    samplers.push_back(llama_sampler_init_infill     (vocab));
-                    break;
-                case COMMON_SAMPLER_TYPE_PENALTIES:
-                    samplers.push_back(llama_sampler_init_penalties  (params.penalty_last_n, params.penalty_repeat, params.penalty_freq, params.penalty_present));
-                    break;
-                default:
-                    LM_GGML_ASSERT(false && "unknown sampler type");
-            }
+            stages.push_back(cnstr);
         }
-
-        samplers.push_back(llama_sampler_init_dist(params.seed));
+        stages.push_back(COMMON_SAMPLER_STAGE_DIST);
     } else if (params.mirostat == 1) {
-        samplers.push_back(llama_sampler_init_temp(params.temp));
-        samplers.push_back(llama_sampler_init_mirostat(llama_vocab_n_tokens(vocab), params.seed, params.mirostat_tau, params.mirostat_eta, 100));
+        stages.push_back(COMMON_SAMPLER_STAGE_MIROSTAT_TEMP);
+        stages.push_back(COMMON_SAMPLER_STAGE_MIROSTAT);
     } else if (params.mirostat == 2) {
-        samplers.push_back(llama_sampler_init_temp(params.temp));
-        samplers.push_back(llama_sampler_init_mirostat_v2(params.seed, params.mirostat_tau, params.mirostat_eta));
+        stages.push_back(COMMON_SAMPLER_STAGE_MIROSTAT_TEMP);
+        stages.push_back(COMMON_SAMPLER_STAGE_MIROSTAT_V2);
     } else {
         LM_GGML_ASSERT(false && "unknown mirostat version");
     }
 
-    for (auto * smpl : samplers) {
-        llama_sampler_chain_add(chain, smpl);
+    return stages;
+}
+
+static llama_sampler * common_sampler_stage_init(const struct llama_model * model, const struct common_params_sampling & params, int stage) {
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+
+    switch (stage) {
+        case COMMON_SAMPLER_STAGE_LOGIT_BIAS:
+            return llama_sampler_init_logit_bias(llama_vocab_n_tokens(vocab), params.logit_bias.size(), params.logit_bias.data());
+        case COMMON_SAMPLER_TYPE_DRY:
+            {
+                std::vector<const char *> c_breakers;
+                c_breakers.reserve(params.dry_sequence_breakers.size());
+                for (const auto & str : params.dry_sequence_breakers) {
+                    c_breakers.push_back(str.c_str());
+                }
+
+                return llama_sampler_init_dry    (vocab, llama_model_n_ctx_train(model), params.dry_multiplier, params.dry_base, params.dry_allowed_length, params.dry_penalty_last_n, c_breakers.data(), c_breakers.size());
+            }
+        case COMMON_SAMPLER_TYPE_TOP_K:
+            return llama_sampler_init_top_k      (params.top_k);
+        case COMMON_SAMPLER_TYPE_TOP_P:
+            return llama_sampler_init_top_p      (params.top_p, params.min_keep);
+        case COMMON_SAMPLER_TYPE_TOP_N_SIGMA:
+            return llama_sampler_init_top_n_sigma(params.top_n_sigma);
+        case COMMON_SAMPLER_TYPE_MIN_P:
+            return llama_sampler_init_min_p      (params.min_p, params.min_keep);
+        case COMMON_SAMPLER_TYPE_XTC:
+            return llama_sampler_init_xtc        (params.xtc_probability, params.xtc_threshold, params.min_keep, params.seed);
+        case COMMON_SAMPLER_TYPE_TYPICAL_P:
+            return llama_sampler_init_typical    (params.typ_p, params.min_keep);
+        case COMMON_SAMPLER_TYPE_TEMPERATURE:
+            return llama_sampler_init_temp_ext   (params.temp, params.dynatemp_range, params.dynatemp_exponent);
+        case COMMON_SAMPLER_TYPE_INFILL:
+            return llama_sampler_init_infill     (vocab);
+        case COMMON_SAMPLER_TYPE_PENALTIES:
+            return llama_sampler_init_penalties  (params.penalty_last_n, params.penalty_repeat, params.penalty_freq, params.penalty_present);
+        case COMMON_SAMPLER_STAGE_DIST:
+            return llama_sampler_init_dist(params.seed);
+        case COMMON_SAMPLER_STAGE_MIROSTAT_TEMP:
+            return llama_sampler_init_temp(params.temp);
+        case COMMON_SAMPLER_STAGE_MIROSTAT:
+            return llama_sampler_init_mirostat(llama_vocab_n_tokens(vocab), params.seed, params.mirostat_tau, params.mirostat_eta, 100);
+        case COMMON_SAMPLER_STAGE_MIROSTAT_V2:
+            return llama_sampler_init_mirostat_v2(params.seed, params.mirostat_tau, params.mirostat_eta);
+        default:
+            LM_GGML_ASSERT(false && "unknown sampler type");
+    }
+
+    return nullptr;
+}
+
+// true when a sampler built from a for this stage, once reset, is the one b would build
+static bool common_sampler_same_stage(const struct common_params_sampling & a, const struct common_params_sampling & b, int stage) {
+    switch (stage) {
+        case COMMON_SAMPLER_STAGE_LOGIT_BIAS:
+            return std::equal(a.logit_bias.begin(), a.logit_bias.end(), b.logit_bias.begin(), b.logit_bias.end(),
+                [](const llama_logit_bias & x, const llama_logit_bias & y) { return x.token == y.token && x.bias == y.bias; });
+        case COMMON_SAMPLER_TYPE_DRY:
+            return a.dry_multiplier == b.dry_multiplier && a.dry_base == b.dry_base && a.dry_allowed_length == b.dry_allowed_length &&
+                   a.dry_penalty_last_n == b.dry_penalty_last_n && a.dry_sequence_breakers == b.dry_sequence_breakers;
+        case COMMON_SAMPLER_TYPE_TOP_K:
+            return a.top_k == b.top_k;
+        case COMMON_SAMPLER_TYPE_TOP_P:
+            return a.top_p == b.top_p && a.min_keep == b.min_keep;
+        case COMMON_SAMPLER_TYPE_TOP_N_SIGMA:
+            return a.top_n_sigma == b.top_n_sigma;
+        case COMMON_SAMPLER_TYPE_MIN_P:
+            return a.min_p == b.min_p && a.min_keep == b.min_keep;
+        case COMMON_SAMPLER_TYPE_XTC:
+            return a.xtc_probability == b.xtc_probability && a.xtc_threshold == b.xtc_threshold && a.min_keep == b.min_keep && a.seed == b.seed;
+        case COMMON_SAMPLER_TYPE_TYPICAL_P:
+            return a.typ_p == b.typ_p && a.min_keep == b.min_keep;
+        case COMMON_SAMPLER_TYPE_TEMPERATURE:
+            return a.temp == b.temp && a.dynatemp_range == b.dynatemp_range && a.dynatemp_exponent == b.dynatemp_exponent;
+        case COMMON_SAMPLER_TYPE_INFILL:
+            return true;
+        case COMMON_SAMPLER_TYPE_PENALTIES:
+            return a.penalty_last_n == b.penalty_last_n && a.penalty_repeat == b.penalty_repeat &&
+                   a.penalty_freq == b.penalty_freq && a.penalty_present == b.penalty_present;
+        case COMMON_SAMPLER_STAGE_DIST:
+            return a.seed == b.seed;
+        case COMMON_SAMPLER_STAGE_MIROSTAT_TEMP:
+            return a.temp == b.temp;
+        case COMMON_SAMPLER_STAGE_MIROSTAT:
+        case COMMON_SAMPLER_STAGE_MIROSTAT_V2:
+            return a.seed == b.seed && a.mirostat_tau == b.mirostat_tau && a.mirostat_eta == b.mirostat_eta;
+        default:
+            return false;
+    }
+}
+
+struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params) {
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+
+    llama_sampler_chain_params lparams = llama_sampler_chain_default_params();
+
+    lparams.no_perf = params.no_perf;
+
+    llama_sampler * grmr = common_sampler_init_grammar(vocab, params);
+    llama_sampler * chain = llama_sampler_chain_init(lparams);
+
+    for (const int stage : common_sampler_stages(params)) {
+        llama_sampler_chain_add(chain, common_sampler_stage_init(model, params, stage));
     }
 
     auto * result = new common_sampler {
         /* .params  = */ params,
+        /* .vocab   = */ vocab,
         /* .grmr    = */ grmr,
         /* .chain   = */ chain,
         /* .prev    = */ ring_buffer<llama_token>(std::max(32, params.n_prev)),
         /* .cur     = */ {},
         /* .cur_p   = */ {},
+        /* .top_k_fast = */ common_sampler_fast_top_k(params, llama_vocab_n_tokens(vocab)),
+        /* .moved   = */ {},
     };
 
     return result;
 }
 
+void common_sampler_reconfigure(struct common_sampler * gsmpl, const struct llama_model * model, const struct common_params_sampling & params) {
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+    const bool same_vocab = vocab == gsmpl->vocab;
+
+    if (same_vocab && common_sampler_same_grammar(gsmpl->params, params)) {
+        if (gsmpl->grmr) {
+            llama_sampler_reset(gsmpl->grmr);
+        }
+    } else {
+        llama_sampler_free(gsmpl->grmr);
+        gsmpl->grmr = common_sampler_init_grammar(vocab, params);
+    }
+
+    // take the samplers out of the chain and put back, reset, those that the new parameters
+    // would build the same way; only the ones that differ are created again
+    std::vector<llama_sampler *> prev_samplers(llama_sampler_chain_n(gsmpl->chain));
+    for (int i = (int) prev_samplers.size() - 1; i >= 0; --i) {
+        prev_samplers[i] = llama_sampler_chain_remove(gsmpl->chain, i);
+    }
+
+    if (gsmpl->params.no_perf != params.no_perf) {
+        llama_sampler_chain_params lparams = llama_sampler_chain_default_params();
+
+        lparams.no_perf = params.no_perf;
+
+        llama_sampler_free(gsmpl->chain);
+        gsmpl->chain = llama_sampler_chain_init(lparams);
+    } else {
+        llama_perf_sampler_reset(gsmpl->chain);
+    }
+
+    const std::vector<int> prev_stages = common_sampler_stages(gsmpl->params);
+    const std::vector<int> stages = common_sampler_stages(params);
+    const bool reuse = same_vocab && prev_stages.size() == prev_samplers.size();
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        llama_sampler * smpl = nullptr;
+        if (reuse && i < prev_stages.size() && prev_stages[i] == stages[i] &&
+            common_sampler_same_stage(gsmpl->params, params, stages[i])) {
+            smpl = prev_samplers[i];
+            prev_samplers[i] = nullptr;
+            llama_sampler_reset(smpl);
+        } else {
+            smpl = common_sampler_stage_init(model, params, stages[i]);
+        }
+        llama_sampler_chain_add(gsmpl->chain, smpl);
+    }
+
+    for (auto * smpl : prev_samplers) {
+        llama_sampler_free(smpl);
+    }
+
+    const size_t n_prev = std::max(32, params.n_prev);
+    if (gsmpl->prev.capacity != n_prev) {
+        gsmpl->prev = ring_buffer<llama_token>(n_prev);
+    } else {
+        gsmpl->prev.clear();
+    }
+
+    gsmpl->params     = params;
+    gsmpl->vocab      = vocab;
+    gsmpl->cur_p      = {};
+    gsmpl->top_k_fast = common_sampler_fast_top_k(params, llama_vocab_n_tokens(vocab));
+    gsmpl->t_total_us = 0;
+}
+
 void common_sampler_free(struct common_sampler * gsmpl) {
     if (gsmpl) {
         llama_sampler_free(gsmpl->grmr);
@@ -336,14 +608,48 @@ void common_sampler_reset(struct common_sampler * gsmpl) {
 struct common_sampler * common_sampler_clone(common_sampler * gsmpl) {
     return new common_sampler {
         /* .params  = */ gsmpl->params,
+        /* .vocab   = */ gsmpl->vocab,
         /* .grmr    = */ llama_sampler_clone(gsmpl->grmr),
         /* .chain   = */ llama_sampler_clone(gsmpl->chain),
         /* .prev    = */ gsmpl->prev,
         /* .cur     = */ gsmpl->cur,
         /* .cur_p   = */ gsmpl->cur_p,
+        /* .top_k_fast = */ gsmpl->top_k_fast,
+        /* .moved   = */ {},
     };
 }
 
+struct common_sampler * common_sampler_clone_seeded(struct common_sampler * gsmpl, const struct llama_model * model, uint32_t seed) {
+    auto * result = common_sampler_clone(gsmpl);
+
+    result->params.seed = seed;
+
+    // only the samplers that draw random numbers are built again, with the new seed
+    const std::vector<int> stages = common_sampler_stages(result->params);
+    std::vector<llama_sampler *> samplers(llama_sampler_chain_n(result->chain));
+    for (int i = (int) samplers.size() - 1; i >= 0; --i) {
+        samplers[i] = llama_sampler_chain_remove(result->chain, i);
+    }
+    LM_GGML_ASSERT(samplers.size() == stages.size());
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        switch (stages[i]) {
+            case COMMON_SAMPLER_TYPE_XTC:
+            case COMMON_SAMPLER_STAGE_DIST:
+            case COMMON_SAMPLER_STAGE_MIROSTAT:
+            case COMMON_SAMPLER_STAGE_MIROSTAT_V2:
+                llama_sampler_free(samplers[i]);
+                samplers[i] = common_sampler_stage_init(model, result->params, stages[i]);
+                break;
+            default:
+                break;
+        }
+        llama_sampler_chain_add(result->chain, samplers[i]);
+    }
+
+    return result;
+}
+
 void common_perf_print(const struct llama_context * ctx, const struct common_sampler * gsmpl) {
     // TODO: measure grammar performance
 
@@ -405,7 +711,12 @@ llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_co
     auto & chain = gsmpl->chain;
     auto & cur_p = gsmpl->cur_p; // initialized by set_logits
 
-    gsmpl->set_logits(ctx, idx);
+    // the grammar has to see the full vocabulary, the rejection check below only needs the sampled token
+    if (gsmpl->top_k_fast > 0 && !(grammar_first && grmr)) {
+        gsmpl->set_logits_top_k(ctx, idx);
+    } else {
+        gsmpl->set_logits(ctx, idx);
+    }
 
     if (grammar_first) {
         llama_sampler_apply(grmr, &cur_p);
@@ -491,6 +802,75 @@ uint32_t common_sampler_get_seed(const struct common_sampler * gsmpl) {
 
 // helpers
 
+static inline float common_max_16(const float * x) {
+#if defined(COMMON_SAMPLING_SSE)
+    __m128 m = _mm_max_ps(_mm_max_ps(_mm_loadu_ps(x), _mm_loadu_ps(x + 4)), _mm_max_ps(_mm_loadu_ps(x + 8), _mm_loadu_ps(x + 12)));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+#elif defined(COMMON_SAMPLING_NEON)
+    return vmaxvq_f32(vmaxq_f32(vmaxq_f32(vld1q_f32(x), vld1q_f32(x + 4)), vmaxq_f32(vld1q_f32(x + 8), vld1q_f32(x + 12))));
+#else
+    float m = x[0];
+    for (int i = 1; i < 16; ++i) {
+        m = std::max(m, x[i]);
+    }
+    return m;
+#endif
+}
+
+void common_sampler_select_top_k(const float * logits, int32_t n_vocab, int32_t k, std::vector<llama_token_data> & cur) {
+    cur.clear();
+
+    if (k <= 0 || k >= n_vocab) {
+        cur.resize(n_vocab);
+        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+            cur[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+        }
+        return;
+    }
+
+    // candidates above the current k-th largest logit are collected and cut back to k once
+    // the buffer fills up; after the first cut most blocks of 16 fail the threshold on their max
+    const size_t n_keep    = k;
+    const size_t n_compact = std::max<size_t>(2*n_keep, 256);
+    cur.reserve(n_compact + 16);
+
+    float threshold = -INFINITY;
+
+    const auto compact = [&]() {
+        std::nth_element(cur.begin(), cur.begin() + (n_keep - 1), cur.end(), [](const llama_token_data & a, const llama_token_data & b) {
+            return a.logit > b.logit;
+        });
+        cur.resize(n_keep);
+        threshold = cur[n_keep - 1].logit;
+    };
+
+    llama_token token_id = 0;
+    for (; token_id + 16 <= n_vocab; token_id += 16) {
+        if (common_max_16(logits + token_id) <= threshold) {
+            continue;
+        }
+        for (llama_token i = token_id; i < token_id + 16; i++) {
+            if (logits[i] > threshold) {
+                cur.push_back(llama_token_data{i, logits[i], 0.0f});
+            }
+        }
+        if (cur.size() >= n_compact) {
+            compact();
+        }
+    }
+    for (; token_id < n_vocab; token_id++) {
+        if (logits[token_id] > threshold) {
+            cur.push_back(llama_token_data{token_id, logits[token_id], 0.0f});
+        }
+    }
+
+    if (cur.size() > n_keep) {
+        compact();
+    }
+}
+
 llama_token_data_array * common_sampler_get_candidates(struct common_sampler * gsmpl, bool do_sort) {
     const auto tm = gsmpl->tm();
 
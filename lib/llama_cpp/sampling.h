@@ -40,11 +40,21 @@ struct common_sampler * common_sampler_init(const struct llama_model * model, co
 
 void common_sampler_free(struct common_sampler * gsmpl);
 
+// set up an existing sampler for a new request with params, as common_sampler_init(model, params) would:
+// the grammar and every sampler of the chain whose parameters did not change are reset and kept, only
+// the others are created again, and the history and candidate buffers keep their allocations
+void common_sampler_reconfigure(struct common_sampler * gsmpl, const struct llama_model * model, const struct common_params_sampling & params);
+
 // if accept_grammar is true, the token is accepted both by the sampling chain and the grammar
 void                    common_sampler_accept(struct common_sampler * gsmpl, llama_token token, bool accept_grammar);
 void                    common_sampler_reset (struct common_sampler * gsmpl);
 struct common_sampler * common_sampler_clone (struct common_sampler * gsmpl);
 
+// clone for one of several completions continuing from the same state: the samplers that draw random
+// numbers (dist, mirostat, xtc) start over from seed, or from a random seed with LLAMA_DEFAULT_SEED,
+// so the clones do not all pick the same tokens
+struct common_sampler * common_sampler_clone_seeded(struct common_sampler * gsmpl, const struct llama_model * model, uint32_t seed);
+
 // arguments can be nullptr to skip printing
 void common_perf_print(const struct llama_context * ctx, const struct common_sampler * gsmpl);
 
@@ -92,6 +102,10 @@ uint32_t common_sampler_get_seed(const struct common_sampler * gsmpl);
 // the .sorted flag of the result indicates whether the returned candidates are sorted
 llama_token_data_array * common_sampler_get_candidates(struct common_sampler * gsmpl, bool do_sort);
 
+// fill cur with the k largest logits in no particular order, or with all of them if k <= 0 or k >= n_vocab
+// common_sampler_sample uses this instead of the full vocabulary when the chain starts with a plain top-k
+void common_sampler_select_top_k(const float * logits, int32_t n_vocab, int32_t k, std::vector<llama_token_data> & cur);
+
 // get the last accepted token
 llama_token common_sampler_last(const struct common_sampler * gsmpl);
 
@@ -3,28 +3,48 @@
 
 #include <sstream>
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "llama_cpp/chat.h"
 #include "llama_cpp/common.h"
 #include "llama_cpp/ggml.h"
 #include "llama_cpp/gguf.h"
 #include "llama_cpp/llama.h"
 #include "llama_cpp/llama-impl.h"
+#include "llama_cpp/ngram-cache.h"
 #include "llama_cpp/sampling.h"
+#include "llama_cpp/speculative.h"
 #if defined(__ANDROID__)
 #include <android/log.h>
 #endif
 
 struct mtmd_context;
+struct mtmd_input_chunk;
 
 namespace llama_mobile {
 
+struct llama_mobile_async_worker;
+struct llama_mobile_tts_pipeline;
+struct llama_mobile_media_tokens;
+
 std::string tokens_to_output_formatted_string(const llama_context *ctx, const llama_token token);
 
 std::string tokens_to_str(llama_context *ctx, const std::vector<llama_token>::const_iterator begin, const std::vector<llama_token>::const_iterator end);
 
 lm_ggml_type kv_cache_type_from_str(const std::string & s);
 
+std::string format_chat(const llama_model *model, const common_chat_templates *templates, const std::string &messages, const std::string &chat_template);
+
 enum stop_type
 {
     STOP_FULL,
@@ -56,12 +76,274 @@ struct conversation_result {
     int tokens_generated;
 };
 
+// One of the alternative completions of a shared prompt, see completeBranches()
+struct completion_branch_result {
+    std::string text;
+    int tokens_predicted = 0;
+    bool truncated = false;
+    bool stopped_eos = false;
+    bool stopped_word = false;
+    bool stopped_limit = false;
+    std::string stopping_word;
+};
+
 struct llama_mobile_tokenize_result {
     std::vector<llama_token> tokens;
     bool has_media = false;
     std::vector<std::string> bitmap_hashes;
     std::vector<size_t> chunk_pos;
     std::vector<size_t> chunk_pos_media;
+    std::vector<size_t> media_n_tokens;
+};
+
+struct llama_mobile_prefix_cache_params {
+    size_t max_bytes = 0;
+    std::string disk_dir;
+    std::vector<int32_t> boundaries;
+    bool snapshot_prompt_end = true;
+    int32_t min_tokens = 16;
+};
+
+struct llama_mobile_prefix_cache_stats {
+    int64_t hits = 0;
+    int64_t disk_hits = 0;
+    int64_t misses = 0;
+    int64_t snapshots = 0;
+    int64_t evictions = 0;
+    size_t bytes = 0;
+    size_t n_entries = 0;
+};
+
+struct llama_mobile_prefix_cache {
+    struct llama_mobile_prefix_cache_entry {
+        size_t n_tokens = 0;
+        std::vector<llama_token> tokens;
+        std::vector<uint8_t> data;
+        bool on_disk = false;
+        std::list<uint64_t>::iterator lru_it;
+    };
+
+    llama_mobile_prefix_cache_params params;
+    std::string model_id;
+    uint64_t scope = 0;
+    std::unordered_map<uint64_t, llama_mobile_prefix_cache_entry> entries;
+    std::list<uint64_t> lru;
+    llama_mobile_prefix_cache_stats stats;
+
+    static uint64_t hashStep(uint64_t hash, llama_token token);
+
+    bool enabled() const;
+
+    bool configure(const llama_mobile_prefix_cache_params &params_, const std::string &model_id_);
+
+    void clear();
+
+    void setScope(uint64_t scope_);
+
+    size_t restore(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t min_len, size_t max_len, bool &cleared);
+
+    bool contains(const std::vector<llama_token> &tokens, size_t n_tokens) const;
+
+    void snapshot(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t n_tokens);
+
+    std::string diskPath(uint64_t hash) const;
+    void loadDiskIndex();
+    void appendDiskIndex(uint64_t hash, size_t n_tokens);
+    void evict();
+};
+
+struct llama_mobile_media_cache_params {
+    size_t max_bytes = 0;
+    std::string disk_dir;
+    // Budget for the persisted files, 0 for four times max_bytes
+    size_t max_disk_bytes = 0;
+};
+
+struct llama_mobile_media_cache_stats {
+    int64_t hits = 0;
+    int64_t disk_hits = 0;
+    int64_t misses = 0;
+    int64_t evictions = 0;
+    int64_t encode_ms = 0;
+    int64_t encode_ms_saved = 0;
+    size_t bytes = 0;
+    size_t disk_bytes = 0;
+    size_t n_entries = 0;
+};
+
+// Process-wide counters of the caches behind structured output: JSON schemas
+// converted to GBNF and grammar texts parsed into rules with their token masks
+struct llama_mobile_grammar_cache_stats {
+    int64_t schema_hits = 0;
+    int64_t schema_misses = 0;
+    int64_t grammar_hits = 0;
+    int64_t grammar_misses = 0;
+    int64_t evictions = 0;
+    size_t n_schemas = 0;
+    size_t n_grammars = 0;
+    size_t mask_bytes = 0;
+};
+
+// LRU cache of media embeddings produced by the multimodal encoder, keyed by the hash
+// of the decoded bitmap so the same image is only encoded once across conversations
+struct llama_mobile_media_cache {
+    struct llama_mobile_media_cache_entry {
+        size_t n_tokens = 0;
+        int64_t encode_ms = 0;
+        std::vector<float> embd;
+        bool on_disk = false;
+        size_t disk_bytes = 0;
+        uint64_t last_used = 0;
+        std::list<uint64_t>::iterator lru_it;
+    };
+
+    llama_mobile_media_cache_params params;
+    std::string model_id;
+    std::unordered_map<uint64_t, llama_mobile_media_cache_entry> entries;
+    std::list<uint64_t> lru;
+    uint64_t use_clock = 0;
+    llama_mobile_media_cache_stats stats;
+
+    bool enabled() const;
+
+    bool configure(const llama_mobile_media_cache_params &params_, const std::string &model_id_);
+
+    void clear();
+
+    const float *lookup(uint64_t key, size_t n_tokens, size_t n_floats);
+
+    void insert(uint64_t key, size_t n_tokens, const float *embd, size_t n_floats, int64_t encode_ms);
+
+    std::string diskPath(uint64_t key) const;
+    void loadDiskIndex();
+    void appendDiskIndex(uint64_t key, const llama_mobile_media_cache_entry &entry);
+    void writeDiskIndex();
+    void evict();
+    void evictDisk();
+};
+
+struct llama_mobile_lora_selection {
+    std::string id;
+    float scale = 1.0f;
+};
+
+struct llama_mobile_lora_registry_stats {
+    int64_t loads = 0;
+    int64_t hits = 0;
+    int64_t evictions = 0;
+    int64_t switches = 0;
+    size_t bytes = 0;
+    size_t n_registered = 0;
+    size_t n_resident = 0;
+};
+
+// LoRA adapters registered by id and loaded at most once, the ones not in use are
+// freed least recently used first when the resident bytes exceed max_bytes
+struct llama_mobile_lora_registry {
+    struct llama_mobile_lora_registry_entry {
+        std::string path;
+        llama_adapter_lora_ptr adapter;
+        size_t bytes = 0;
+        uint64_t identity = 0;
+        bool active = false;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    size_t max_bytes = 0;
+    std::unordered_map<std::string, llama_mobile_lora_registry_entry> entries;
+    std::list<std::string> lru;
+    llama_mobile_lora_registry_stats stats;
+
+    bool add(const std::string &id, const std::string &path);
+
+    bool remove(const std::string &id);
+
+    llama_mobile_lora_registry_entry *acquire(llama_model *model, const std::string &id);
+
+    void unloadAll();
+
+    void evict();
+};
+
+enum context_shift_policy {
+    CONTEXT_SHIFT_HALF,
+    CONTEXT_SHIFT_DROP_OLDEST_TURNS,
+    CONTEXT_SHIFT_KEEP_LAST_TURNS,
+    CONTEXT_SHIFT_NONE,
+};
+
+struct llama_mobile_context_shift_params {
+    context_shift_policy policy = CONTEXT_SHIFT_HALF;
+    int keep_turns = 4;
+    int n_free = 0;
+    bool keep_first_turn = true;
+    std::vector<std::string> turn_markers;
+};
+
+// Aho-Corasick automaton over the stop words, compiled into a dense byte-indexed
+// transition table so advancing over generated text is one lookup per byte
+struct llama_mobile_stop_matcher {
+    std::vector<std::string> words;
+    std::vector<int32_t> next;
+    std::vector<int32_t> depth;
+    std::vector<int32_t> match_word;
+    size_t max_word_size = 0;
+    int32_t state = 0;
+    size_t n_fed = 0;
+
+    void build(const std::vector<std::string> &stop_words);
+    void reset(size_t offset = 0);
+    bool empty() const;
+
+    size_t feed(const char *text, size_t length, int32_t &word);
+    size_t partialLength() const;
+
+    size_t findFull(const std::string &text, size_t from, int32_t &word) const;
+    size_t findPartial(const std::string &text) const;
+};
+
+// Inverse real FFT plan for even lengths: a Hermitian half-spectrum is transformed
+// as one complex FFT of half the length (Stockham, radix 2/4/5, precomputed twiddles)
+struct llama_mobile_rfft {
+    int n = 0;
+    std::vector<int> radices;
+    std::vector<float> twiddle_re;
+    std::vector<float> twiddle_im;
+    std::vector<float> pack_re;
+    std::vector<float> pack_im;
+
+    bool init(int size);
+    size_t workSize() const;
+    void inverse(const float *spectrum, float *out, float scale, float *work) const;
+};
+
+// One vocoder call of a stream: codes [first, last) encoded with their neighbours
+// [lo, lo + codes.size()), after which every sample before emit_end is final
+struct llama_mobile_tts_window {
+    std::vector<llama_token> codes;
+    size_t lo = 0;
+    size_t first = 0;
+    size_t last = 0;
+    size_t emit_end = 0;
+};
+
+// Incremental vocoder state: audio codes are decoded in windows as they are generated,
+// frames are overlap-added and samples are handed out once no later frame can touch them
+struct llama_mobile_tts_stream {
+    bool active = false;
+    int window_codes = 16;
+    int context_codes = 4;
+    std::function<void(const float *pcm, size_t n_samples)> on_audio;
+    std::vector<llama_token> codes;
+    size_t n_scheduled = 0;
+    size_t n_synthesized = 0;
+    size_t ola_start = 0;
+    std::vector<float> ola_audio;
+    std::vector<float> ola_env;
+    std::vector<float> pcm;
+    size_t n_samples = 0;
+    int64_t t_start_us = 0;
+    int64_t t_first_audio_us = 0;
 };
 
 struct llama_mobile_context {
@@ -81,12 +363,15 @@ struct llama_mobile_context {
     common_init_result_ptr llama_init;
 
     llama_model *model = nullptr;
-    float loading_progress = 0;
-    bool is_load_interrupted = false;
+    // Written by the loading thread, read and set from any other
+    std::atomic<float> loading_progress{0};
+    std::atomic<bool> is_load_interrupted{false};
+    std::function<void(float progress)> on_load_progress;
 
     llama_context *ctx = nullptr;
     common_sampler *ctx_sampling = nullptr;
     common_chat_templates_ptr templates;
+    llama_batch batch = {};
 
     int n_ctx;
 
@@ -96,29 +381,64 @@ struct llama_mobile_context {
     bool stopped_limit = false;
     std::string stopping_word;
     bool incomplete = false;
+    llama_mobile_stop_matcher stop_matcher;
 
     std::vector<common_adapter_lora_info> lora;
+    llama_mobile_lora_registry lora_registry;
+    uint64_t lora_identity = 0;
+
+    llama_mobile_prefix_cache prefix_cache;
+    std::vector<size_t> prefix_cache_pending;
 
     bool context_full = false;
+    llama_mobile_context_shift_params context_shift;
+    std::vector<llama_token> turn_tokens;
+    size_t n_context_shifts = 0;
+    size_t n_tokens_discarded = 0;
     std::vector<llama_token> guide_tokens;
     bool next_token_uses_guide_token = false;
 
     struct llama_mobile_context_mtmd {
         mtmd_context* mtmd_ctx = nullptr;
+        std::string mmproj_path;
     };
     llama_mobile_context_mtmd *mtmd_wrapper = nullptr;
     bool has_multimodal = false;
     std::vector<std::string> mtmd_bitmap_past_hashes;
+    llama_mobile_media_cache media_cache;
+    std::shared_ptr<llama_mobile_media_tokens> media_tokens;
 
     struct llama_mobile_context_vocoder {
         common_init_result_ptr init_result;
         llama_model *model = nullptr;
         llama_context *ctx = nullptr;
         tts_type type = TTS_UNKNOWN;
+        llama_mobile_rfft rfft;
+        std::vector<float> hann;
     };
     llama_mobile_context_vocoder *vocoder_wrapper = nullptr;
     bool has_vocoder = false;
     std::vector<llama_token> audio_tokens;
+    llama_mobile_tts_stream tts_stream;
+    llama_mobile_tts_pipeline *tts_pipeline = nullptr;
+
+    struct llama_mobile_context_speculative {
+        common_init_result_ptr draft_init;
+        common_speculative *spec = nullptr;
+        common_speculative_params params;
+        common_ngram_cache ngram_cache;
+        size_t ngram_n_tokens = 0;
+        std::deque<llama_token> accepted;
+        int64_t n_drafted = 0;
+        int64_t n_draft_accepted = 0;
+    };
+    llama_mobile_context_speculative *spec_wrapper = nullptr;
+
+    llama_mobile_async_worker *async_worker = nullptr;
+    // Held by the async worker for a whole request and by the FFI calls that use the context
+    std::recursive_mutex state_mutex;
+    // Cancel flag of the async request being served, checked between prefill chunks
+    const std::atomic<bool> *cancel_flag = nullptr;
 
     // Conversation management state
     bool conversation_active = false;
@@ -150,6 +470,10 @@ struct llama_mobile_context {
     
     void truncatePrompt(std::vector<llama_token> &prompt_tokens);
 
+    bool configureContextShift(const llama_mobile_context_shift_params &shift_params);
+
+    bool shiftContext();
+
     void loadPrompt();
 
     void loadPrompt(const std::vector<std::string> &media_paths);
@@ -160,15 +484,30 @@ struct llama_mobile_context {
 
     void endCompletion();
     
+    bool evalPending(bool &tg, int32_t &i_logits);
+
     completion_token_output nextToken();
    
     size_t findStoppingStrings(const std::string &text, const size_t last_token_size, const stop_type type);
    
     completion_token_output doCompletion();
+
+    std::vector<completion_branch_result> completeBranches(int n_branches);
    
     std::vector<float> getEmbedding(common_params &embd_params);
+
+    int getEmbeddingBatch(const std::vector<std::string> &texts, float *out);
     
     std::string bench(int pp, int tg, int pl, int nr);
+
+    std::string benchPrefill(int pp, int nr);
+
+    bool configurePrefixCache(const llama_mobile_prefix_cache_params &cache_params);
+    bool configureMediaCache(const llama_mobile_media_cache_params &cache_params);
+
+    int saveSession(const std::string &path);
+
+    int loadSession(const std::string &path);
    
     int applyLoraAdapters(std::vector<common_adapter_lora_info> lora);
    
@@ -176,7 +515,18 @@ struct llama_mobile_context {
     
     std::vector<common_adapter_lora_info> getLoadedLoraAdapters();
 
+    void configureLoraRegistry(size_t max_bytes);
+
+    int registerLoraAdapter(const std::string &id, const std::string &path);
+
+    int unregisterLoraAdapter(const std::string &id);
+
+    int selectLoraAdapters(const std::vector<llama_mobile_lora_selection> &selection);
+
+    void setActiveLora(std::vector<common_adapter_lora_info> lora_, uint64_t identity);
+
     llama_mobile_tokenize_result tokenize(const std::string &text, const std::vector<std::string> &media_paths);
+    llama_mobile_tokenize_result tokenizeMedia(const std::string &text, const std::vector<std::string> &media_paths);
 
     bool initMultimodal(const std::string &mmproj_path, bool use_gpu);
     bool isMultimodalEnabled() const;
@@ -184,6 +534,7 @@ struct llama_mobile_context {
     bool isMultimodalSupportAudio() const;
     void releaseMultimodal();
     void processMedia(const std::string &prompt, const std::vector<std::string> &media_paths);
+    int32_t evalMediaChunkCached(const mtmd_input_chunk *chunk, int slice, llama_pos chunk_n_past, llama_pos *new_n_past);
 
     bool initVocoder(const std::string &vocoder_model_path);
     bool isVocoderEnabled() const;
@@ -191,8 +542,23 @@ struct llama_mobile_context {
     std::string getFormattedAudioCompletion(const std::string &speaker_json_str, const std::string &text_to_speak);
     std::vector<llama_token> getAudioCompletionGuideTokens(const std::string &text_to_speak);
     std::vector<float> decodeAudioTokens(const std::vector<llama_token> &tokens);
+    bool beginAudioStream(int window_codes, int context_codes, std::function<void(const float *pcm, size_t n_samples)> on_audio);
+    void pushAudioCode(llama_token token);
+    bool endAudioStream();
+    bool synthesizeAudioWindow(const llama_mobile_tts_window &window);
+    bool configureTTSPipeline(bool enabled, int n_threads_llm, int n_threads_vocoder, int queue_windows);
+    void releaseTTSPipeline();
     void releaseVocoder();
 
+    bool initSpeculative(const std::string &draft_model_path, int n_draft);
+    bool isSpeculativeEnabled() const;
+    void releaseSpeculative();
+    bool speculativeStep();
+    void discardSpeculative();
+
+    llama_mobile_async_worker *asyncWorker();
+    void releaseAsync();
+
     // High-level conversation management API
     std::string generateResponse(const std::string &user_message, int max_tokens = 200);
     conversation_result continueConversation(const std::string &user_message, int max_tokens = 200);
@@ -200,6 +566,294 @@ struct llama_mobile_context {
     bool isConversationActive() const;
 };
 
+struct llama_mobile_engine_result {
+    std::string text;
+    int tokens_predicted = 0;
+    int tokens_evaluated = 0;
+    bool truncated = false;
+    bool stopped_eos = false;
+    bool stopped_word = false;
+    bool stopped_limit = false;
+    bool cancelled = false;
+    std::string stopping_word;
+    // Set when the request could not be served, e.g. its adapter failed to load
+    std::string error;
+};
+
+struct llama_mobile_engine_request {
+    std::string prompt;
+    int n_predict = -1;
+    common_params_sampling sampling;
+    std::vector<std::string> antiprompt;
+    // Registered adapter applied to this request's sequence only, empty for the base model
+    std::string lora_id;
+    float lora_scale = 1.0f;
+    std::function<bool(int32_t request_id, llama_token tok, const std::string &piece)> on_token;
+    std::function<void(int32_t request_id, const llama_mobile_engine_result &result)> on_complete;
+};
+
+struct llama_mobile_engine {
+    enum slot_state {
+        SLOT_IDLE,
+        SLOT_PREFILL,
+        SLOT_GENERATE,
+    };
+
+    struct llama_mobile_engine_slot {
+        llama_seq_id seq_id = 0;
+        slot_state state = SLOT_IDLE;
+        int32_t request_id = -1;
+        llama_mobile_engine_request request;
+        common_sampler *smpl = nullptr;
+        std::vector<llama_token> prompt_tokens;
+        size_t n_prompt_done = 0;
+        llama_pos n_past = 0;
+        llama_token last_token = -1;
+        int32_t i_batch = -1;
+        llama_mobile_stop_matcher stop_matcher;
+        // Bytes of result.text passed to on_token, a possible stop word prefix is held back
+        size_t n_streamed = 0;
+        llama_mobile_engine_result result;
+        llama_adapter_lora *lora = nullptr;
+    };
+
+    struct llama_mobile_engine_pending {
+        int32_t request_id = -1;
+        llama_mobile_engine_request request;
+        std::vector<llama_token> prompt_tokens;
+    };
+
+    common_params params;
+    common_init_result_ptr llama_init;
+    llama_model *model = nullptr;
+    llama_context *ctx = nullptr;
+    int n_ctx_slot = 0;
+    llama_batch batch = {};
+    std::vector<llama_mobile_engine_slot> slots;
+    // Generating slot offered the first place in the next batch, rotates when they do not all fit
+    size_t next_generate = 0;
+    // Prompt tokens allowed per batch, halved when the KV cache has no room for a batch
+    int n_prefill_max = 0;
+
+    std::thread worker;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<llama_mobile_engine_pending> queue;
+    std::unordered_set<int32_t> cancelled_ids;
+    int32_t next_request_id = 0;
+    bool is_running = false;
+
+    // Shared by the caller's thread registering adapters and the worker selecting them
+    std::mutex lora_mutex;
+    llama_mobile_lora_registry lora_registry;
+
+    ~llama_mobile_engine();
+
+    bool loadModel(common_params &params_, int n_parallel);
+
+    int32_t submit(llama_mobile_engine_request request);
+
+    int registerLoraAdapter(const std::string &id, const std::string &path);
+
+    void cancel(int32_t request_id);
+
+    void shutdown();
+
+    void run();
+    bool hasActiveSlots() const;
+    void startSlot(llama_mobile_engine_slot &slot, llama_mobile_engine_pending &&pending);
+    bool selectSlotLora(llama_mobile_engine_slot &slot);
+    void releaseSlotLora(llama_mobile_engine_slot &slot);
+    void processToken(llama_mobile_engine_slot &slot);
+    void finishSlot(llama_mobile_engine_slot &slot);
+};
+
+// Fixed-capacity ring buffer for exactly one producer and one consumer thread
+template <typename T>
+struct llama_mobile_spsc_ring {
+    std::vector<T> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    explicit llama_mobile_spsc_ring(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    bool push(const T &item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+struct llama_mobile_async_chunk {
+    llama_token token = -1;
+    uint8_t length = 0;
+    bool partial = false;
+    char text[48];
+};
+
+enum llama_mobile_async_state {
+    ASYNC_QUEUED,
+    ASYNC_RUNNING,
+    ASYNC_DONE,
+    ASYNC_CANCELLED,
+    ASYNC_FAILED,
+};
+
+struct llama_mobile_async_request {
+    int32_t id = -1;
+    std::string prompt;
+    int n_predict = -1;
+    int n_threads = 0;
+    common_params_sampling sampling;
+    std::vector<std::string> antiprompt;
+    bool select_lora = false;
+    std::vector<llama_mobile_lora_selection> lora;
+    std::function<void()> notify;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> state{ASYNC_QUEUED};
+    llama_mobile_spsc_ring<llama_mobile_async_chunk> tokens;
+
+    llama_mobile_engine_result result;
+    int64_t n_drafted = 0;
+    int64_t n_draft_accepted = 0;
+    double tokens_per_second = 0.0;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    explicit llama_mobile_async_request(size_t ring_capacity) : tokens(ring_capacity) {}
+
+    bool finished() const;
+    bool wait(int timeout_ms);
+};
+
+struct llama_mobile_async_worker {
+    llama_mobile_context *context = nullptr;
+
+    std::thread worker;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::shared_ptr<llama_mobile_async_request>> queue;
+    std::shared_ptr<llama_mobile_async_request> current;
+    int32_t next_request_id = 0;
+    bool is_running = false;
+
+    ~llama_mobile_async_worker();
+
+    bool start(llama_mobile_context *context_);
+
+    int32_t submit(std::shared_ptr<llama_mobile_async_request> request);
+
+    void shutdown();
+
+    void run();
+    void process(llama_mobile_async_request &request);
+    bool pushPiece(llama_mobile_async_request &request, llama_token tok, const char *text, size_t length);
+    void finish(llama_mobile_async_request &request, llama_mobile_async_state state);
+};
+
+enum llama_mobile_load_state {
+    LOAD_VOCAB,
+    LOAD_WEIGHTS,
+    LOAD_DONE,
+    LOAD_CANCELLED,
+    LOAD_FAILED,
+};
+
+// Model load on its own thread. The vocabulary and chat templates are read first, so
+// prompts can be tokenized and formatted while the weights are still streaming in
+struct llama_mobile_load_task : std::enable_shared_from_this<llama_mobile_load_task> {
+    std::string model_path;
+    std::string chat_template;
+    std::function<bool(llama_mobile_context &context)> load;
+    std::function<void(int state, float progress)> notify;
+
+    llama_mobile_context *context = nullptr;
+    llama_model *vocab_model = nullptr;
+    common_chat_templates_ptr templates;
+
+    std::atomic<int> state{LOAD_VOCAB};
+    std::atomic<float> loading_progress{0};
+    std::atomic<bool> released{false};
+    float progress_notified = -1.0f;
+    // Held across every notify call, so release() returns only once none is in flight;
+    // recursive for a callback that releases the task itself
+    std::recursive_mutex notify_mutex;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    ~llama_mobile_load_task();
+
+    // The thread keeps the task alive until it finishes, whoever started it may let go earlier
+    void start();
+
+    bool finished() const;
+    bool wait(int timeout_ms);
+    void cancel();
+    // Stops further notify calls, waiting for one in progress on the loading thread
+    void release();
+    llama_mobile_context *takeContext();
+
+    // Only valid once the state has moved past LOAD_VOCAB
+    std::vector<llama_token> tokenize(const std::string &text) const;
+    std::string getFormattedChat(const std::string &messages, const std::string &chat_template) const;
+
+    void run();
+    void setState(llama_mobile_load_state state_, float progress);
+    void notifyState(llama_mobile_load_state state_, float progress);
+};
+
+// Vocoder thread of a pipelined audio stream. The completion loop hands it code windows
+// through a bounded queue and keeps generating while earlier windows turn into audio
+struct llama_mobile_tts_pipeline {
+    llama_mobile_context *context = nullptr;
+
+    std::thread worker;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<llama_mobile_tts_window> queue;
+    size_t capacity = 4;
+    bool busy = false;
+    bool failed = false;
+    bool is_running = false;
+
+    ~llama_mobile_tts_pipeline();
+
+    bool start(llama_mobile_context *context_, size_t capacity_);
+
+    bool push(llama_mobile_tts_window window);
+    bool drain();
+    void clear();
+
+    void shutdown();
+
+    void run();
+};
+
 extern bool llama_mobile_verbose;
 
 #if LLAMA_MOBILE_VERBOSE != 1
@@ -233,6 +887,16 @@ bool ends_with(const std::string &str, const std::string &suffix);
 
 size_t find_partial_stop_string(const std::string &stop, const std::string &text);
 
+llama_mobile_grammar_cache_stats grammar_cache_stats();
+
+void grammar_cache_clear();
+
+size_t base64_decoded_size_max(size_t encoded_len);
+
+// Decodes standard base64 into out, which must hold base64_decoded_size_max(encoded.size())
+// bytes; whitespace is skipped and padding or any other character ends the input
+size_t base64_decode(std::string_view encoded, uint8_t *out);
+
 } // namespace llama_mobile
 
 #endif /* LLAMA_MOBILE_H */
\ No newline at end of file
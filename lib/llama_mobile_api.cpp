@@ -21,6 +21,10 @@ static llama_mobile_init_params_c_t convert_init_params(const llama_mobile_init_
         ffi_params.progress_callback = api_params->progress_callback;
         ffi_params.cache_type_k = api_params->cache_type_k;
         ffi_params.cache_type_v = api_params->cache_type_v;
+        ffi_params.draft_model_path = api_params->draft_model_path;
+        ffi_params.prompt_lookup = api_params->prompt_lookup;
+        ffi_params.n_draft = api_params->n_draft;
+        ffi_params.n_seq_max = api_params->n_seq_max;
     }
     
     return ffi_params;
@@ -41,6 +45,9 @@ static llama_mobile_completion_params_c_t convert_completion_params(const llama_
         ffi_params.stop_sequences = api_params->stop_sequences;
         ffi_params.stop_sequence_count = api_params->stop_sequence_count;
         ffi_params.token_callback = api_params->token_callback;
+        ffi_params.token_event_callback = api_params->token_event_callback;
+        ffi_params.token_event_user_data = api_params->token_event_user_data;
+        ffi_params.token_event_utf8_safe = api_params->token_event_utf8_safe;
     }
     
     return ffi_params;
@@ -56,6 +63,8 @@ static void convert_completion_result(const llama_mobile_completion_result_c_t*
         api_result->stopped_eos = ffi_result->stopped_eos;
         api_result->stopped_word = ffi_result->stopped_word;
         api_result->stopped_limit = ffi_result->stopped_limit;
+        api_result->draft_acceptance_rate = ffi_result->draft_acceptance_rate;
+        api_result->tokens_per_second = ffi_result->tokens_per_second;
     }
 }
 
@@ -238,6 +247,19 @@ llama_mobile_float_array_t llama_mobile_embedding(
     return convert_float_array(ffi_result);
 }
 
+int llama_mobile_embedding_batch(
+    llama_mobile_context_t ctx,
+    const char** texts,
+    int count,
+    float* out_matrix) {
+    
+    return llama_mobile_embedding_batch_c(
+        (llama_mobile_context_handle_t) ctx,
+        texts,
+        count,
+        out_matrix);
+}
+
 int llama_mobile_apply_lora_adapters(
     llama_mobile_context_t ctx,
     const llama_mobile_lora_adapter_t* adapters,
@@ -63,26 +63,44 @@
 
 // Forward declarations
 struct mtmd_context;
+struct mtmd_input_chunk;
 
 // C++ Interface (from llama_mobile.h)
 #ifdef __cplusplus
 
 #include <sstream>
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "llama_cpp/chat.h"
 #include "llama_cpp/common.h"
 #include "llama_cpp/ggml.h"
 #include "llama_cpp/gguf.h"
 #include "llama_cpp/llama.h"
 #include "llama_cpp/llama-impl.h"
+#include "llama_cpp/ngram-cache.h"
 #include "llama_cpp/sampling.h"
+#include "llama_cpp/speculative.h"
 #if defined(__ANDROID__)
 #include <android/log.h>
 #endif
 
 namespace llama_mobile {
 
+struct llama_mobile_async_worker;
+struct llama_mobile_tts_pipeline;
+struct llama_mobile_media_tokens;
+
 /**
  * @brief Convert a single token to a properly formatted string for output.
  * 
@@ -116,6 +134,17 @@ std::string tokens_to_str(llama_context *ctx, const std::vector<llama_token>::co
  */
 lm_ggml_type kv_cache_type_from_str(const std::string & s);
 
+/**
+ * @brief Apply a chat template (non-Jinja) to OpenAI-style messages.
+ *
+ * @param model Model the templates were read from, may be a vocab-only model
+ * @param templates Templates used when chat_template is empty or invalid
+ * @param messages JSON array of messages
+ * @param chat_template Custom template, empty for the model's own
+ * @return The formatted prompt
+ */
+std::string format_chat(const llama_model *model, const common_chat_templates *templates, const std::string &messages, const std::string &chat_template);
+
 /**
  * @brief Types of stopping conditions for text generation.
  */
@@ -162,6 +191,19 @@ struct conversation_result {
     int tokens_generated;                 ///< Number of tokens generated in the response
 };
 
+/**
+ * @brief One of several alternative completions generated from a shared prompt.
+ */
+struct completion_branch_result {
+    std::string text;              ///< Generated text, without a matched stop word
+    int tokens_predicted = 0;      ///< Number of tokens sampled for this branch
+    bool truncated = false;        ///< Whether the context ran out of cells for this branch
+    bool stopped_eos = false;      ///< Whether generation ended on an end-of-generation token
+    bool stopped_word = false;     ///< Whether generation ended on a stop sequence
+    bool stopped_limit = false;    ///< Whether generation ended on n_predict or the context size
+    std::string stopping_word;     ///< The stop sequence that ended generation, if any
+};
+
 /**
  * @brief Result structure for tokenization, including multimodal support.
  */
@@ -171,6 +213,482 @@ struct llama_mobile_tokenize_result {
     std::vector<std::string> bitmap_hashes;    ///< Hashes of processed media
     std::vector<size_t> chunk_pos;             ///< Positions of text chunks
     std::vector<size_t> chunk_pos_media;       ///< Positions of media chunks
+    std::vector<size_t> media_n_tokens;        ///< Positions taken by each media, in input order
+};
+
+/**
+ * @brief How nextToken() makes room once the context is full.
+ */
+enum context_shift_policy {
+    CONTEXT_SHIFT_HALF,              ///< Drop half of the tokens after the protected prefix
+    CONTEXT_SHIFT_DROP_OLDEST_TURNS, ///< Drop whole messages from the front until n_free tokens are free
+    CONTEXT_SHIFT_KEEP_LAST_TURNS,   ///< Keep only the last keep_turns messages after the protected prefix
+    CONTEXT_SHIFT_NONE,              ///< Stop generation instead of discarding anything
+};
+
+/**
+ * @brief Configuration for sliding-window context shifts.
+ *
+ * Message boundaries are found from turn marker tokens such as <|im_start|>. When none
+ * are present, the turn based policies fall back to CONTEXT_SHIFT_HALF.
+ */
+struct llama_mobile_context_shift_params {
+    context_shift_policy policy = CONTEXT_SHIFT_HALF; ///< Shift policy
+    int keep_turns = 4;                               ///< Messages kept by CONTEXT_SHIFT_KEEP_LAST_TURNS
+    int n_free = 0;                                   ///< Minimum tokens freed per shift, 0 for n_ctx / 4
+    bool keep_first_turn = true;                      ///< Protect the first message, usually the system prompt
+    std::vector<std::string> turn_markers;            ///< Single-token strings opening a message, empty to detect them
+};
+
+/**
+ * @brief Configuration for the prompt prefix KV cache.
+ */
+struct llama_mobile_prefix_cache_params {
+    size_t max_bytes = 0;              ///< RAM budget for snapshots, 0 disables the cache
+    std::string disk_dir;              ///< Directory snapshots are spilled to, empty for RAM only
+    std::vector<int32_t> boundaries;   ///< Token counts to snapshot at, e.g. the end of the system prompt
+    bool snapshot_prompt_end = true;   ///< Also snapshot every prompt minus its last token
+    int32_t min_tokens = 16;           ///< Prefixes shorter than this are not worth caching
+};
+
+/**
+ * @brief Prefix cache counters.
+ */
+struct llama_mobile_prefix_cache_stats {
+    int64_t hits = 0;        ///< Restores served from RAM
+    int64_t disk_hits = 0;   ///< Restores served from disk
+    int64_t misses = 0;      ///< Prompts with no usable snapshot
+    int64_t snapshots = 0;   ///< Snapshots taken
+    int64_t evictions = 0;   ///< Snapshots dropped from RAM to stay within budget
+    size_t bytes = 0;        ///< RAM currently held by snapshots
+    size_t n_entries = 0;    ///< Known snapshots, in RAM or on disk
+};
+
+/**
+ * @brief LRU cache of KV sequence snapshots keyed by a rolling hash of their token prefix.
+ *
+ * Lets loadPrompt() restore the longest cached prefix of a new prompt instead of
+ * only reusing what the previous prompt left in the KV cache.
+ */
+struct llama_mobile_prefix_cache {
+    /**
+     * @brief A snapshot of one token prefix.
+     */
+    struct llama_mobile_prefix_cache_entry {
+        size_t n_tokens = 0;                  ///< Prefix length
+        std::vector<llama_token> tokens;      ///< Prefix tokens, empty for disk-only entries
+        std::vector<uint8_t> data;            ///< Sequence state, empty when evicted to disk
+        bool on_disk = false;                 ///< Whether a spill file exists
+        std::list<uint64_t>::iterator lru_it; ///< Position in lru while resident in RAM
+    };
+
+    llama_mobile_prefix_cache_params params;  ///< Active configuration
+    std::string model_id;                     ///< Identifies the model/KV layout snapshots belong to
+    uint64_t scope = 0;                       ///< LoRA adapter set the KV state is computed with, 0 for none
+    std::unordered_map<uint64_t, llama_mobile_prefix_cache_entry> entries; ///< Snapshots by prefix hash
+    std::list<uint64_t> lru;                  ///< RAM-resident snapshots, most recently used first
+    llama_mobile_prefix_cache_stats stats;    ///< Counters
+
+    /**
+     * @brief Extend a prefix hash by one token.
+     */
+    static uint64_t hashStep(uint64_t hash, llama_token token);
+
+    /**
+     * @brief Whether the cache has a non-zero budget.
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Reset the cache with a new configuration, loading the disk index if any.
+     *
+     * @param params_ Cache configuration
+     * @param model_id_ Model/KV layout identity; disk entries of other models are discarded
+     * @return true on success
+     */
+    bool configure(const llama_mobile_prefix_cache_params &params_, const std::string &model_id_);
+
+    /**
+     * @brief Drop every snapshot, including spilled files.
+     */
+    void clear();
+
+    /**
+     * @brief Switch the LoRA adapter set snapshots are taken and restored for.
+     *
+     * The scope is mixed into the prefix hash, so snapshots of other adapter sets are
+     * kept but never restored until their scope is selected again.
+     */
+    void setScope(uint64_t scope_);
+
+    /**
+     * @brief Restore the longest cached prefix of tokens into a sequence.
+     *
+     * @param ctx Context to restore into
+     * @param seq_id Destination sequence
+     * @param tokens Prompt tokens
+     * @param min_len Only prefixes longer than this are considered
+     * @param max_len Only prefixes up to this length are considered
+     * @param cleared Set when a snapshot failed to load after the sequence was
+     *                cleared for it, so the sequence is empty on a 0 return
+     * @return Number of tokens restored, 0 on a miss
+     */
+    size_t restore(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t min_len, size_t max_len, bool &cleared);
+
+    /**
+     * @brief Whether a snapshot of the first n_tokens tokens exists.
+     */
+    bool contains(const std::vector<llama_token> &tokens, size_t n_tokens) const;
+
+    /**
+     * @brief Snapshot a sequence that currently holds exactly the first n_tokens tokens.
+     */
+    void snapshot(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t n_tokens);
+
+    std::string diskPath(uint64_t hash) const;
+    void loadDiskIndex();
+    void appendDiskIndex(uint64_t hash, size_t n_tokens);
+    void evict();
+};
+
+/**
+ * @brief Configuration for the media embedding cache.
+ */
+struct llama_mobile_media_cache_params {
+    size_t max_bytes = 0;    ///< RAM budget for cached embeddings, 0 disables the cache
+    std::string disk_dir;    ///< Directory embeddings are persisted to, empty for RAM only
+    size_t max_disk_bytes = 0; ///< Budget for the persisted files, 0 for four times max_bytes
+};
+
+/**
+ * @brief Counters of the process-wide grammar caches.
+ *
+ * JSON schemas are converted to GBNF once per schema text and grammars are parsed once
+ * per text and model, keeping the token masks computed while sampling with them.
+ */
+struct llama_mobile_grammar_cache_stats {
+    int64_t schema_hits = 0;      ///< Schema conversions served from the cache
+    int64_t schema_misses = 0;    ///< Schemas that had to be converted
+    int64_t grammar_hits = 0;     ///< Grammar compilations served from the cache
+    int64_t grammar_misses = 0;   ///< Grammars that had to be parsed
+    int64_t evictions = 0;        ///< Schemas and grammars dropped to stay within the entry limits
+    size_t n_schemas = 0;         ///< Cached schema conversions
+    size_t n_grammars = 0;        ///< Cached compiled grammars
+    size_t mask_bytes = 0;        ///< Token masks held for all grammars, within one process-wide budget
+};
+
+/**
+ * @brief Media embedding cache counters.
+ */
+struct llama_mobile_media_cache_stats {
+    int64_t hits = 0;             ///< Encodes served from RAM
+    int64_t disk_hits = 0;        ///< Encodes served from disk
+    int64_t misses = 0;           ///< Media that had to be encoded
+    int64_t evictions = 0;        ///< Embeddings dropped from RAM to stay within budget
+    int64_t encode_ms = 0;        ///< Time spent in the encoder on misses
+    int64_t encode_ms_saved = 0;  ///< Encoder time the hits would have cost
+    size_t bytes = 0;             ///< RAM currently held by embeddings
+    size_t disk_bytes = 0;        ///< Size of the persisted files
+    size_t n_entries = 0;         ///< Known embeddings, in RAM or on disk
+};
+
+/**
+ * @brief LRU cache of encoded media embeddings keyed by the hash of the decoded bitmap.
+ *
+ * processMedia() consults it before running the multimodal encoder, so asking about the
+ * same photo again in a new conversation skips the image encoder entirely.
+ */
+struct llama_mobile_media_cache {
+    /**
+     * @brief The encoder output for one media chunk.
+     */
+    struct llama_mobile_media_cache_entry {
+        size_t n_tokens = 0;                  ///< Embedding tokens of the chunk
+        int64_t encode_ms = 0;                ///< Encoder time it took to produce
+        std::vector<float> embd;              ///< n_tokens embeddings, empty when evicted to disk
+        bool on_disk = false;                 ///< Whether a persisted file exists
+        size_t disk_bytes = 0;                ///< Size of the persisted file
+        uint64_t last_used = 0;               ///< use_clock at the last insert or hit, orders the files for eviction
+        std::list<uint64_t>::iterator lru_it; ///< Position in lru while resident in RAM
+    };
+
+    llama_mobile_media_cache_params params;   ///< Active configuration
+    std::string model_id;                     ///< Identifies the projector embeddings belong to
+    std::unordered_map<uint64_t, llama_mobile_media_cache_entry> entries; ///< Embeddings by bitmap hash
+    std::list<uint64_t> lru;                  ///< RAM-resident embeddings, most recently used first
+    uint64_t use_clock = 0;                   ///< Counter behind last_used
+    llama_mobile_media_cache_stats stats;     ///< Counters
+
+    /**
+     * @brief Whether the cache has a non-zero budget.
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Reset the cache with a new configuration, loading the disk index if any.
+     *
+     * @param params_ Cache configuration
+     * @param model_id_ Projector identity; disk entries of other projectors are discarded
+     * @return true on success
+     */
+    bool configure(const llama_mobile_media_cache_params &params_, const std::string &model_id_);
+
+    /**
+     * @brief Drop every embedding, including persisted files.
+     */
+    void clear();
+
+    /**
+     * @brief Find the embeddings of a media chunk, loading them from disk if needed.
+     *
+     * @param key Bitmap hash
+     * @param n_tokens Embedding tokens the chunk expects
+     * @param n_floats Floats the chunk expects
+     * @return Cached embeddings valid until the next insert, or nullptr on a miss
+     */
+    const float *lookup(uint64_t key, size_t n_tokens, size_t n_floats);
+
+    /**
+     * @brief Store freshly encoded embeddings.
+     *
+     * @param key Bitmap hash
+     * @param n_tokens Embedding tokens of the chunk
+     * @param embd Encoder output
+     * @param n_floats Number of floats in embd
+     * @param encode_ms Time the encoder took
+     */
+    void insert(uint64_t key, size_t n_tokens, const float *embd, size_t n_floats, int64_t encode_ms);
+
+    std::string diskPath(uint64_t key) const;
+    void loadDiskIndex();
+    void appendDiskIndex(uint64_t key, const llama_mobile_media_cache_entry &entry);
+    void writeDiskIndex();
+    void evict();
+    void evictDisk();
+};
+
+/**
+ * @brief A registered LoRA adapter selected for a request.
+ */
+struct llama_mobile_lora_selection {
+    std::string id;       ///< Id the adapter was registered under
+    float scale = 1.0f;   ///< Adapter scale
+};
+
+/**
+ * @brief LoRA registry counters.
+ */
+struct llama_mobile_lora_registry_stats {
+    int64_t loads = 0;        ///< Adapter files read, including reloads after eviction
+    int64_t hits = 0;         ///< Selections served by an adapter already in memory
+    int64_t evictions = 0;    ///< Adapters freed to stay within budget
+    int64_t switches = 0;     ///< Changes of the adapter set on the context
+    size_t bytes = 0;         ///< Memory held by resident adapters
+    size_t n_registered = 0;  ///< Registered adapters
+    size_t n_resident = 0;    ///< Registered adapters currently loaded
+};
+
+/**
+ * @brief Per-model set of LoRA adapters registered by id.
+ *
+ * Each adapter file is read once and stays loaded until the adapters that are not
+ * set on the context exceed the byte budget, least recently used first, so switching
+ * adapters between requests does not touch the disk.
+ */
+struct llama_mobile_lora_registry {
+    /**
+     * @brief One registered adapter.
+     */
+    struct llama_mobile_lora_registry_entry {
+        std::string path;                        ///< Adapter file
+        llama_adapter_lora_ptr adapter;          ///< Loaded adapter, null when not resident
+        size_t bytes = 0;                        ///< Size of the adapter's tensors
+        uint64_t identity = 0;                   ///< Hash of the file path, size and mtime
+        bool active = false;                     ///< Set on the context, never evicted
+        std::list<std::string>::iterator lru_it; ///< Position in lru while resident
+    };
+
+    size_t max_bytes = 0;                     ///< Budget for resident adapters, 0 for unlimited
+    std::unordered_map<std::string, llama_mobile_lora_registry_entry> entries; ///< Adapters by id
+    std::list<std::string> lru;               ///< Resident adapters, most recently used first
+    llama_mobile_lora_registry_stats stats;   ///< Counters
+
+    /**
+     * @brief Register an adapter without loading it.
+     *
+     * @return false if the id is taken by an active adapter with another path
+     */
+    bool add(const std::string &id, const std::string &path);
+
+    /**
+     * @brief Unregister an adapter, freeing it.
+     *
+     * @return false if the adapter is active
+     */
+    bool remove(const std::string &id);
+
+    /**
+     * @brief Get a registered adapter, loading it if it is not resident.
+     *
+     * @return The entry, or nullptr if the id is unknown or the file fails to load
+     */
+    llama_mobile_lora_registry_entry *acquire(llama_model *model, const std::string &id);
+
+    /**
+     * @brief Free every adapter, keeping the registrations.
+     */
+    void unloadAll();
+
+    void evict();
+};
+
+/**
+ * @brief Incremental multi-pattern matcher for stop sequences.
+ *
+ * An Aho-Corasick automaton over the stop words compiled into a dense byte-indexed
+ * transition table. Generated text is fed once as it arrives; full and partial matches
+ * are found in O(bytes) without allocating.
+ */
+struct llama_mobile_stop_matcher {
+    std::vector<std::string> words;  ///< Distinct non-empty stop words
+    std::vector<int32_t> next;       ///< Transition table, 256 entries per state
+    std::vector<int32_t> depth;      ///< Length of the word prefix each state stands for
+    std::vector<int32_t> match_word; ///< Longest word ending in each state, -1 if none
+    size_t max_word_size = 0;        ///< Length of the longest word
+    int32_t state = 0;               ///< Current state of the incremental scan
+    size_t n_fed = 0;                ///< Offset of the next byte fed
+
+    /**
+     * @brief Compile the automaton. Rebuilding with the same words only resets it.
+     *
+     * @param stop_words Stop words, empty ones are ignored
+     */
+    void build(const std::vector<std::string> &stop_words);
+
+    /**
+     * @brief Restart the incremental scan.
+     *
+     * @param offset Offset reported for the next byte fed
+     */
+    void reset(size_t offset = 0);
+
+    /**
+     * @brief Whether there are no stop words.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Advance over newly generated text.
+     *
+     * @param text New bytes
+     * @param length Number of bytes
+     * @param word Set to the index of the matched word
+     * @return Offset where the earliest word completed by these bytes starts, or std::string::npos
+     */
+    size_t feed(const char *text, size_t length, int32_t &word);
+
+    /**
+     * @brief Length of the longest suffix of the fed text that begins a stop word.
+     */
+    size_t partialLength() const;
+
+    /**
+     * @brief Find the earliest stop word in text that ends at or after from.
+     *
+     * @param text Text to search
+     * @param from Matches ending before this offset are ignored
+     * @param word Set to the index of the matched word
+     * @return Start of the match, or std::string::npos
+     */
+    size_t findFull(const std::string &text, size_t from, int32_t &word) const;
+
+    /**
+     * @brief Find the longest suffix of text that begins a stop word.
+     *
+     * @return Start of the suffix, or std::string::npos
+     */
+    size_t findPartial(const std::string &text) const;
+};
+
+/**
+ * @brief Inverse real FFT plan.
+ *
+ * Transforms a Hermitian half-spectrum of even length n back to n real samples with a
+ * single complex FFT of length n/2 (Stockham autosort, mixed radix 2/4/5). Twiddle
+ * factors are computed once in init() and the transform itself never allocates.
+ */
+struct llama_mobile_rfft {
+    int n = 0;                      ///< Transform length, 0 if not initialized
+    std::vector<int> radices;       ///< Radix of each stage of the length n/2 transform
+    std::vector<float> twiddle_re;  ///< Stage twiddle factors, real parts
+    std::vector<float> twiddle_im;  ///< Stage twiddle factors, imaginary parts
+    std::vector<float> pack_re;     ///< exp(2*pi*i*k/n) for k < n/2, real parts
+    std::vector<float> pack_im;     ///< exp(2*pi*i*k/n) for k < n/2, imaginary parts
+
+    /**
+     * @brief Build the plan.
+     *
+     * @param size Transform length; must be even with n/2 = 2^a * 5^b
+     * @return true on success, false if the length is not supported
+     */
+    bool init(int size);
+
+    /**
+     * @brief Number of floats of scratch space inverse() needs.
+     */
+    size_t workSize() const;
+
+    /**
+     * @brief Unnormalized inverse transform.
+     *
+     * out[t] = scale * (Re X[0] + (-1)^t Re X[n/2] + 2 Re sum_{k=1}^{n/2-1} X[k] e^{2 pi i k t / n})
+     *
+     * @param spectrum n/2 + 1 interleaved complex bins
+     * @param out n real samples
+     * @param scale Factor applied to every sample
+     * @param work Scratch buffer of workSize() floats
+     */
+    void inverse(const float *spectrum, float *out, float scale, float *work) const;
+};
+
+/**
+ * @brief One vocoder call of an audio stream.
+ *
+ * Codes [first, last) of the stream are encoded together with their neighbours, which
+ * start at stream position lo, and every sample before emit_end is final afterwards.
+ */
+struct llama_mobile_tts_window {
+    std::vector<llama_token> codes;  ///< Codes [lo, lo + codes.size()) of the stream
+    size_t lo = 0;                   ///< Stream position of codes[0]
+    size_t first = 0;                ///< First code whose frame is synthesized
+    size_t last = 0;                 ///< One past the last code whose frame is synthesized
+    size_t emit_end = 0;             ///< Signal position up to which samples are handed out
+};
+
+/**
+ * @brief State of a streaming vocoder session.
+ *
+ * Audio codes are decoded by the vocoder in windows of window_codes as the model
+ * generates them, each window padded with context_codes neighbours on both sides. The
+ * resulting frames are overlap-added and every sample that no later frame can change is
+ * normalized by the window envelope and handed to on_audio, so the concatenated output
+ * matches decodeAudioTokens() on the whole utterance up to the window boundaries.
+ */
+struct llama_mobile_tts_stream {
+    bool active = false;                ///< Whether audio codes are being streamed
+    int window_codes = 16;              ///< Codes turned into audio per vocoder call
+    int context_codes = 4;              ///< Neighbouring codes encoded on each side of a window
+    std::function<void(const float *pcm, size_t n_samples)> on_audio; ///< Receives mono 24 kHz PCM
+    std::vector<llama_token> codes;     ///< Vocoder codes received so far
+    size_t n_scheduled = 0;             ///< Codes handed to vocoder windows
+    size_t n_synthesized = 0;           ///< Codes whose frames are overlap-added
+    size_t ola_start = 0;               ///< Signal position of the first pending sample
+    std::vector<float> ola_audio;       ///< Pending overlap-added windowed frames
+    std::vector<float> ola_env;         ///< Pending window envelope
+    std::vector<float> pcm;             ///< Normalized samples handed to on_audio
+    size_t n_samples = 0;               ///< Samples handed out so far
+    int64_t t_start_us = 0;             ///< When the stream began
+    int64_t t_first_audio_us = 0;       ///< When the first samples were handed out, 0 if none yet
 };
 
 /**
@@ -200,12 +718,14 @@ struct llama_mobile_context {
 
     // Model and context pointers
     llama_model *model = nullptr;          ///< Pointer to the loaded model
-    float loading_progress = 0;            ///< Model loading progress (0.0-1.0)
-    bool is_load_interrupted = false;      ///< Whether model loading was interrupted
+    std::atomic<float> loading_progress{0};       ///< Model loading progress (0.0-1.0), updated per tensor
+    std::atomic<bool> is_load_interrupted{false}; ///< Set from any thread to abort loadModel() at the next tensor
+    std::function<void(float progress)> on_load_progress; ///< Called on the loading thread with the progress (optional)
 
     llama_context *ctx = nullptr;          ///< Pointer to the llama context
     common_sampler *ctx_sampling = nullptr; ///< Sampling context
     common_chat_templates_ptr templates;   ///< Chat templates for conversational AI
+    llama_batch batch = {};                ///< Reusable decode batch sized to n_batch
 
     // Context configuration
     int n_ctx;                             ///< Size of the context window
@@ -217,22 +737,36 @@ struct llama_mobile_context {
     bool stopped_limit = false;            ///< Whether generation stopped due to token limit
     std::string stopping_word;             ///< The stop word that triggered stopping
     bool incomplete = false;               ///< Whether the generation was incomplete
+    llama_mobile_stop_matcher stop_matcher; ///< Stop word automaton for the current completion
 
     // LoRA adapters
     std::vector<common_adapter_lora_info> lora; ///< Loaded LoRA adapters
+    llama_mobile_lora_registry lora_registry; ///< Adapters loaded for this model
+    uint64_t lora_identity = 0;                 ///< Identity of the active adapter set, 0 for none
+
+    // Prompt prefix cache
+    llama_mobile_prefix_cache prefix_cache;     ///< Snapshots of previously evaluated prompt prefixes
+    std::vector<size_t> prefix_cache_pending;   ///< Boundaries of the current prompt still to snapshot
 
     // Guide tokens
     bool context_full = false;             ///< Whether the context window is full
+    llama_mobile_context_shift_params context_shift; ///< Policy applied when the context fills up
+    std::vector<llama_token> turn_tokens;  ///< Tokens that open a message, found by configureContextShift()
+    size_t n_context_shifts = 0;           ///< Context shifts in the current completion
+    size_t n_tokens_discarded = 0;         ///< Tokens dropped by those shifts
     std::vector<llama_token> guide_tokens; ///< Tokens to guide generation
     bool next_token_uses_guide_token = false; ///< Whether to use guide tokens for next token
 
     // Multimodal support
     struct llama_mobile_context_mtmd {
         mtmd_context* mtmd_ctx = nullptr;  ///< Multimodal context pointer
+        std::string mmproj_path;           ///< Projector the context was created from
     };
     llama_mobile_context_mtmd *mtmd_wrapper = nullptr; ///< Multimodal wrapper
     bool has_multimodal = false;           ///< Whether multimodal support is enabled
     std::vector<std::string> mtmd_bitmap_past_hashes; ///< Hashes of past media
+    llama_mobile_media_cache media_cache;  ///< Encoded media embeddings reused across prompts
+    std::shared_ptr<llama_mobile_media_tokens> media_tokens; ///< Last media prompt tokenized, reused and released by loadPrompt()
 
     // Vocoder (TTS) support
     struct llama_mobile_context_vocoder {
@@ -240,10 +774,31 @@ struct llama_mobile_context {
         llama_model *model = nullptr;       ///< Vocoder model pointer
         llama_context *ctx = nullptr;       ///< Vocoder context
         tts_type type = TTS_UNKNOWN;        ///< Type of TTS model
+        llama_mobile_rfft rfft;             ///< Inverse FFT plan for the vocoder frames
+        std::vector<float> hann;            ///< Synthesis window
     };
     llama_mobile_context_vocoder *vocoder_wrapper = nullptr; ///< Vocoder wrapper
     bool has_vocoder = false;              ///< Whether vocoder is enabled
     std::vector<llama_token> audio_tokens; ///< Generated audio tokens
+    llama_mobile_tts_stream tts_stream;    ///< Streaming vocoder state
+    llama_mobile_tts_pipeline *tts_pipeline = nullptr; ///< Vocoder thread of pipelined streams, see configureTTSPipeline()
+
+    // Speculative decoding
+    struct llama_mobile_context_speculative {
+        common_init_result_ptr draft_init;  ///< Draft model, empty in prompt lookup mode
+        common_speculative *spec = nullptr; ///< Draft model speculator
+        common_speculative_params params;   ///< Draft length and acceptance threshold
+        common_ngram_cache ngram_cache;     ///< N-grams of the current context for prompt lookup
+        size_t ngram_n_tokens = 0;          ///< Number of embd tokens already in ngram_cache
+        std::deque<llama_token> accepted;   ///< Verified tokens not yet returned by nextToken()
+        int64_t n_drafted = 0;              ///< Tokens drafted in the current completion
+        int64_t n_draft_accepted = 0;       ///< Drafted tokens accepted by the target model
+    };
+    llama_mobile_context_speculative *spec_wrapper = nullptr; ///< Speculative decoding state
+
+    llama_mobile_async_worker *async_worker = nullptr; ///< Worker serving async completions, created on first use
+    std::recursive_mutex state_mutex;                  ///< Held by the async worker for a whole request and by the FFI calls that use the context
+    const std::atomic<bool> *cancel_flag = nullptr;    ///< Cancel flag of the async request being served, checked between prefill chunks
 
     // Conversation management state
     bool conversation_active = false;      ///< Whether a conversation is active
@@ -259,6 +814,9 @@ struct llama_mobile_context {
     /**
      * @brief Initialize the sampling parameters and context.
      * 
+     * The first call builds the sampler from params.sampling; later calls reconfigure it in
+     * place, keeping the grammar, the unchanged samplers and the history buffer.
+     * 
      * @return true on success, false on failure
      */
     bool initSampling();
@@ -319,6 +877,22 @@ struct llama_mobile_context {
      */
     void truncatePrompt(std::vector<llama_token> &prompt_tokens);
 
+    /**
+     * @brief Choose how the context makes room when it fills up during generation.
+     * 
+     * @param shift_params Policy and turn detection settings
+     * @return true on success, false if the context is not ready or the settings are invalid
+     */
+    bool configureContextShift(const llama_mobile_context_shift_params &shift_params);
+
+    /**
+     * @brief Discard history per the configured policy, moving the remaining KV entries
+     *        with llama_memory_seq_rm/seq_add instead of re-evaluating them.
+     * 
+     * @return true if room was made, false if generation has to stop
+     */
+    bool shiftContext();
+
     /**
      * @brief Load the current prompt into the model for generation.
      */
@@ -348,6 +922,15 @@ struct llama_mobile_context {
      */
     void endCompletion();
     
+    /**
+     * @brief Evaluate the tokens of embd that are not in the KV cache yet.
+     * 
+     * @param tg Set to whether a single token was pending
+     * @param i_logits Set to the batch index of the last token's logits when it was evaluated
+     * @return false when decoding failed or was interrupted
+     */
+    bool evalPending(bool &tg, int32_t &i_logits);
+
     /**
      * @brief Generate the next token in the completion.
      * 
@@ -371,6 +954,21 @@ struct llama_mobile_context {
      * @return Result containing the generated token and its probabilities
      */
     completion_token_output doCompletion();
+
+    /**
+     * @brief Generate several alternative completions of the loaded prompt at once.
+     * 
+     * Called after initSampling(), beginCompletion() and loadPrompt() instead of the
+     * doCompletion() loop. The prompt is evaluated once and shared by n_branches sequences,
+     * which are decoded together, one token per branch per batch. Each branch samples
+     * with its own copy of the sampler; with a fixed seed branch b uses seed + b. Branch 0
+     * continues with the context's own sampler and is left in the context like a plain
+     * completion.
+     * 
+     * @param n_branches Number of completions, at most the n_seq_max set at initialization
+     * @return One result per branch, empty when n_branches is out of range or the prompt could not be evaluated
+     */
+    std::vector<completion_branch_result> completeBranches(int n_branches);
    
     /**
      * @brief Generate embeddings for the input text.
@@ -379,6 +977,18 @@ struct llama_mobile_context {
      * @return Vector of floating-point embeddings
      */
     std::vector<float> getEmbedding(common_params &embd_params);
+
+    /**
+     * @brief Embed several texts, packing them into shared batches with one sequence id each.
+     * 
+     * Bypasses the sampler and completion state. Texts longer than min(n_batch, n_ubatch)
+     * tokens are truncated. Needs a pooling type other than NONE.
+     * 
+     * @param texts Input texts
+     * @param out Row-major output of texts.size() x n_embd floats
+     * @return 0 on success, -1 if the context cannot produce pooled embeddings, -2 if evaluation failed
+     */
+    int getEmbeddingBatch(const std::vector<std::string> &texts, float *out);
     
     /**
      * @brief Run benchmark tests on the loaded model.
@@ -390,6 +1000,53 @@ struct llama_mobile_context {
      * @return JSON string containing benchmark results
      */
     std::string bench(int pp, int tg, int pl, int nr);
+
+    /**
+     * @brief Measure prompt ingestion throughput of the completion path.
+     * 
+     * Prefills pp tokens through nextToken() and through raw llama_decode calls
+     * of n_batch tokens, so regressions in the chunked prefill path show up as
+     * a gap between the two numbers.
+     * 
+     * @param pp Number of prompt tokens to prefill
+     * @param nr Number of runs to average
+     * @return JSON string containing benchmark results
+     */
+    std::string benchPrefill(int pp, int nr);
+
+    /**
+     * @brief Configure the prompt prefix cache used by loadPrompt().
+     * 
+     * @param cache_params Cache configuration; a zero max_bytes disables it
+     * @return true on success, false otherwise
+     */
+    bool configurePrefixCache(const llama_mobile_prefix_cache_params &cache_params);
+
+    /**
+     * @brief Configure the media embedding cache used by processMedia().
+     * 
+     * @param cache_params Cache configuration; a zero max_bytes disables it
+     * @return true on success, false if multimodal support is not initialized
+     */
+    bool configureMediaCache(const llama_mobile_media_cache_params &cache_params);
+
+    /**
+     * @brief Save the KV cache, tokens, sampler seed and conversation state to a file.
+     * 
+     * @param path Destination file, replaced atomically
+     * @return 0 on success, -1 if the context is not ready, -2 on I/O failure
+     */
+    int saveSession(const std::string &path);
+
+    /**
+     * @brief Restore a session written by saveSession() without re-evaluating its tokens.
+     * 
+     * @param path Session file
+     * @return 0 on success, -1 if the context is not ready, -2 if the file is unreadable or corrupt,
+     *         -3 if it was saved with a different model, n_ctx or LoRA adapter set,
+     *         -4 if the KV state could not be restored
+     */
+    int loadSession(const std::string &path);
    
     /**
      * @brief Apply LoRA adapters to the loaded model.
@@ -411,6 +1068,48 @@ struct llama_mobile_context {
      */
     std::vector<common_adapter_lora_info> getLoadedLoraAdapters();
 
+    /**
+     * @brief Set the byte budget for loaded adapters that are not in use.
+     * 
+     * @param max_bytes Budget, 0 for unlimited
+     */
+    void configureLoraRegistry(size_t max_bytes);
+
+    /**
+     * @brief Register a LoRA adapter under an id and load it.
+     * 
+     * @param id Id requests select the adapter by
+     * @param path Path to the adapter file
+     * @return 0 on success, -2 if the id is in use with another file, -3 if loading fails
+     */
+    int registerLoraAdapter(const std::string &id, const std::string &path);
+
+    /**
+     * @brief Unregister a LoRA adapter and free it.
+     * 
+     * @return 0 on success, -2 if the adapter is currently selected
+     */
+    int unregisterLoraAdapter(const std::string &id);
+
+    /**
+     * @brief Set the active adapters from the registry.
+     * 
+     * Selecting the set that is already active costs nothing. Otherwise the KV cache is
+     * invalidated and the prefix cache switches to the snapshots of the new set.
+     * 
+     * @param selection Adapter ids and scales, empty for the base model
+     * @return 0 on success, -2 if an id is unknown or fails to load
+     */
+    int selectLoraAdapters(const std::vector<llama_mobile_lora_selection> &selection);
+
+    /**
+     * @brief Set loaded adapters on the context and invalidate state computed without them.
+     * 
+     * @param lora_ Adapters with ptr set
+     * @param identity Identity of the set, nothing happens when it is the active one
+     */
+    void setActiveLora(std::vector<common_adapter_lora_info> lora_, uint64_t identity);
+
     /**
      * @brief Tokenize text with optional media attachments.
      * 
@@ -420,6 +1119,18 @@ struct llama_mobile_context {
      */
     llama_mobile_tokenize_result tokenize(const std::string &text, const std::vector<std::string> &media_paths);
 
+    /**
+     * @brief Tokenize a prompt with media through mtmd, decoding and preprocessing the media.
+     * 
+     * The chunks are kept on the context so a following loadPrompt() with the same prompt
+     * and media skips tokenizing and decoding them again.
+     * 
+     * @param text Prompt, a media marker is appended if it has none
+     * @param media_paths Paths or data URIs of the media
+     * @return Tokens with LLAMA_TOKEN_NULL for media positions, hashes and chunk positions
+     */
+    llama_mobile_tokenize_result tokenizeMedia(const std::string &text, const std::vector<std::string> &media_paths);
+
     /**
      * @brief Initialize multimodal support for the model.
      * 
@@ -463,6 +1174,17 @@ struct llama_mobile_context {
      */
     void processMedia(const std::string &prompt, const std::vector<std::string> &media_paths);
 
+    /**
+     * @brief Encode an image or audio chunk, or reuse its cached embeddings, and decode it.
+     *
+     * @param chunk Media chunk produced by mtmd_tokenize
+     * @param slice Index of the chunk among the chunks of the same bitmap
+     * @param chunk_n_past Position of the first token of the chunk
+     * @param new_n_past Receives the position after the chunk
+     * @return 0 on success, the mtmd error code otherwise
+     */
+    int32_t evalMediaChunkCached(const mtmd_input_chunk *chunk, int slice, llama_pos chunk_n_past, llama_pos *new_n_past);
+
     /**
      * @brief Initialize the vocoder for text-to-speech functionality.
      * 
@@ -503,48 +1225,643 @@ struct llama_mobile_context {
     std::vector<llama_token> getAudioCompletionGuideTokens(const std::string &text_to_speak);
     
     /**
-     * @brief Decode audio tokens into raw audio data.
-     * 
-     * @param tokens Audio tokens to decode
-     * @return Vector of floating-point audio samples
+     * @brief Decode audio tokens into raw audio data.
+     * 
+     * @param tokens Audio tokens to decode
+     * @return Vector of floating-point audio samples
+     */
+    std::vector<float> decodeAudioTokens(const std::vector<llama_token> &tokens);
+
+    /**
+     * @brief Start turning audio codes into PCM while they are generated.
+     *
+     * Every audio token sampled by doCompletion() is passed to pushAudioCode() until
+     * endAudioStream() is called. rewind() drops an unfinished stream.
+     *
+     * @param window_codes Codes per vocoder call; smaller windows give earlier audio
+     * @param context_codes Neighbouring codes encoded on each side of a window to hide seams
+     * @param on_audio Receives consecutive chunks of mono 24 kHz PCM
+     * @return true on success, false if the vocoder is not enabled or the sizes are invalid
+     */
+    bool beginAudioStream(int window_codes, int context_codes, std::function<void(const float *pcm, size_t n_samples)> on_audio);
+
+    /**
+     * @brief Queue one audio token and synthesize every window it completes.
+     *
+     * @param token Audio token as sampled by the TTS model
+     */
+    void pushAudioCode(llama_token token);
+
+    /**
+     * @brief Synthesize the remaining codes, flush the tail of the signal and end the stream.
+     *
+     * @return true if all audio was delivered, false if no stream was active or decoding failed
+     */
+    bool endAudioStream();
+
+    /**
+     * @brief Synthesize one window of the audio stream and hand out the finished samples.
+     *
+     * Called by pushAudioCode() and endAudioStream(), or by the pipeline thread.
+     *
+     * @param window Window to decode
+     * @return true on success, false if the vocoder failed
+     */
+    bool synthesizeAudioWindow(const llama_mobile_tts_window &window);
+
+    /**
+     * @brief Run the vocoder of audio streams on its own thread, overlapped with generation.
+     *
+     * Code windows go through a bounded queue to the vocoder thread while the model keeps
+     * sampling; when the queue is full generation waits. The on_audio callback is then
+     * called from the vocoder thread. The threads of the two stages are split so they do
+     * not compete for the same cores.
+     *
+     * @param enabled Whether to pipeline; false stops the thread and restores the thread counts
+     * @param n_threads_llm Threads for the model, 0 for three quarters of params.cpuparams.n_threads
+     * @param n_threads_vocoder Threads for the vocoder, 0 for the rest
+     * @param queue_windows Windows that may wait for the vocoder, 0 for 4
+     * @return true on success, false if the vocoder is not enabled or a stream is active
+     */
+    bool configureTTSPipeline(bool enabled, int n_threads_llm, int n_threads_vocoder, int queue_windows);
+
+    /**
+     * @brief Stop the vocoder thread, dropping windows that have not been synthesized.
+     */
+    void releaseTTSPipeline();
+    
+    /**
+     * @brief Release vocoder (TTS) resources.
+     */
+    void releaseVocoder();
+
+    /**
+     * @brief Enable speculative decoding in the completion loop.
+     * 
+     * @param draft_model_path Path to a draft model sharing the target's vocabulary,
+     *                         or empty to draft from n-grams of the prompt (prompt lookup)
+     * @param n_draft Maximum tokens drafted per step, 0 for the default
+     * @return true on success, false otherwise
+     */
+    bool initSpeculative(const std::string &draft_model_path, int n_draft);
+
+    /**
+     * @brief Check if speculative decoding is enabled.
+     * 
+     * @return true if enabled, false otherwise
+     */
+    bool isSpeculativeEnabled() const;
+
+    /**
+     * @brief Disable speculative decoding and free the draft model.
+     */
+    void releaseSpeculative();
+
+    /**
+     * @brief Draft tokens and verify them with one batched decode, queueing the accepted ones.
+     * 
+     * @return true if tokens were queued, false if this step should decode normally
+     */
+    bool speculativeStep();
+
+    /**
+     * @brief Drop queued speculative tokens and their KV cache entries.
+     */
+    void discardSpeculative();
+
+    /**
+     * @brief Get the worker thread that serves async completions on this context, starting it if needed.
+     * 
+     * @return The worker, or nullptr if the context is not initialized
+     */
+    llama_mobile_async_worker *asyncWorker();
+
+    /**
+     * @brief Stop the async worker, cancelling its outstanding requests.
+     */
+    void releaseAsync();
+
+    // High-level conversation management API
+    /**
+     * @brief Generate a response to a user message in a conversation.
+     * 
+     * @param user_message User's message
+     * @param max_tokens Maximum number of tokens to generate
+     * @return Generated response text
+     */
+    std::string generateResponse(const std::string &user_message, int max_tokens = 200);
+    
+    /**
+     * @brief Continue a conversation with a user message, returning detailed timing information.
+     * 
+     * @param user_message User's message
+     * @param max_tokens Maximum number of tokens to generate
+     * @return Conversation result with timing and token information
+     */
+    conversation_result continueConversation(const std::string &user_message, int max_tokens = 200);
+    
+    /**
+     * @brief Clear the current conversation history.
+     */
+    void clearConversation();
+    
+    /**
+     * @brief Check if a conversation is currently active.
+     * 
+     * @return true if active, false otherwise
+     */
+    bool isConversationActive() const;
+};
+
+
+/**
+ * @brief Final state of a request served by llama_mobile_engine.
+ */
+struct llama_mobile_engine_result {
+    std::string text;              ///< Generated text, with any stop word trimmed
+    int tokens_predicted = 0;      ///< Number of tokens sampled for this request
+    int tokens_evaluated = 0;      ///< Number of prompt tokens evaluated
+    bool truncated = false;        ///< Whether generation hit the per-sequence context limit
+    bool stopped_eos = false;      ///< Whether generation stopped at an end-of-generation token
+    bool stopped_word = false;     ///< Whether generation stopped at a stop word
+    bool stopped_limit = false;    ///< Whether generation stopped at n_predict or the context limit
+    bool cancelled = false;        ///< Whether the request was cancelled or the engine shut down
+    std::string stopping_word;     ///< The stop word that ended generation, if any
+    std::string error;             ///< Why the request could not be served, empty otherwise
+};
+
+/**
+ * @brief A single completion request submitted to llama_mobile_engine.
+ *
+ * Callbacks are invoked on the engine's worker thread.
+ */
+struct llama_mobile_engine_request {
+    std::string prompt;                    ///< Prompt text, tokenized on submit
+    int n_predict = -1;                    ///< Maximum tokens to generate (-1 for no limit)
+    common_params_sampling sampling;       ///< Sampling parameters for this request
+    std::vector<std::string> antiprompt;   ///< Stop words
+    std::string lora_id;                   ///< Registered LoRA adapter for this request only, empty for the base model
+    float lora_scale = 1.0f;               ///< Scale of lora_id
+    std::function<bool(int32_t request_id, llama_token tok, const std::string &piece)> on_token; ///< Streams the text as it is generated, holding back a possible stop word prefix; return false to cancel
+    std::function<void(int32_t request_id, const llama_mobile_engine_result &result)> on_complete; ///< Called exactly once when the request finishes
+};
+
+/**
+ * @brief Continuous-batching engine serving several requests from one llama_context.
+ *
+ * Each slot owns a KV sequence id. The worker thread packs one token for every
+ * generating slot plus prompt chunks of admitted requests into a single
+ * llama_decode call, so new requests join while others are mid-generation.
+ */
+struct llama_mobile_engine {
+    /**
+     * @brief Lifecycle of a slot.
+     */
+    enum slot_state {
+        SLOT_IDLE,     ///< Free for a new request
+        SLOT_PREFILL,  ///< Prompt is being evaluated
+        SLOT_GENERATE, ///< Sampling tokens
+    };
+
+    /**
+     * @brief Per-sequence decoding state.
+     */
+    struct llama_mobile_engine_slot {
+        llama_seq_id seq_id = 0;                ///< KV cache sequence owned by this slot
+        slot_state state = SLOT_IDLE;           ///< Current lifecycle state
+        int32_t request_id = -1;                ///< Request being served
+        llama_mobile_engine_request request;    ///< Request being served
+        common_sampler *smpl = nullptr;         ///< Sampler for this request
+        std::vector<llama_token> prompt_tokens; ///< Tokenized prompt
+        size_t n_prompt_done = 0;               ///< Prompt tokens already placed in a batch
+        llama_pos n_past = 0;                   ///< Next position in the sequence
+        llama_token last_token = -1;            ///< Last sampled token, fed in the next batch
+        int32_t i_batch = -1;                   ///< Index of this slot's logits in the current batch
+        llama_mobile_stop_matcher stop_matcher; ///< Stop words of this request
+        size_t n_streamed = 0;                  ///< Bytes of result.text passed to on_token
+        llama_mobile_engine_result result;      ///< Accumulated result
+        llama_adapter_lora *lora = nullptr;     ///< Adapter set on this slot's sequence, if any
+    };
+
+    /**
+     * @brief A request waiting for a free slot.
+     */
+    struct llama_mobile_engine_pending {
+        int32_t request_id = -1;                ///< Assigned request id
+        llama_mobile_engine_request request;    ///< The request
+        std::vector<llama_token> prompt_tokens; ///< Tokenized prompt
+    };
+
+    common_params params;                        ///< Parameters used to create the context
+    common_init_result_ptr llama_init;           ///< Owns model and context
+    llama_model *model = nullptr;                ///< Loaded model
+    llama_context *ctx = nullptr;                ///< Shared context
+    int n_ctx_slot = 0;                          ///< Context size available to each sequence
+    llama_batch batch = {};                      ///< Batch reused for every decode step
+    std::vector<llama_mobile_engine_slot> slots; ///< One slot per parallel sequence
+    size_t next_generate = 0;                    ///< Generating slot offered the first place in the next batch
+    int n_prefill_max = 0;                       ///< Prompt tokens allowed per batch, halved when the KV cache has no room
+
+    std::thread worker;                              ///< Decode loop thread
+    std::mutex queue_mutex;                          ///< Guards queue, cancelled_ids and is_running
+    std::condition_variable queue_cv;                ///< Wakes the worker
+    std::deque<llama_mobile_engine_pending> queue;   ///< Requests waiting for a slot
+    std::unordered_set<int32_t> cancelled_ids;       ///< Requests cancelled since the last step
+    int32_t next_request_id = 0;                     ///< Id handed to the next submit
+    bool is_running = false;                         ///< Whether the worker should keep running
+
+    std::mutex lora_mutex;                           ///< Guards lora_registry
+    llama_mobile_lora_registry lora_registry;        ///< Adapters requests can select by id
+
+    /**
+     * @brief Destructor. Cancels outstanding requests and joins the worker.
+     */
+    ~llama_mobile_engine();
+
+    /**
+     * @brief Load a model and start the worker thread.
+     *
+     * @param params_ Model and context parameters
+     * @param n_parallel Number of sequences decoded concurrently
+     * @return true on success, false otherwise
+     */
+    bool loadModel(common_params &params_, int n_parallel);
+
+    /**
+     * @brief Queue a completion request.
+     *
+     * @param request Request to serve
+     * @return Request id, or -1 if the prompt is empty or does not fit a sequence
+     */
+    int32_t submit(llama_mobile_engine_request request);
+
+    /**
+     * @brief Register a LoRA adapter that requests select with lora_id.
+     *
+     * Requests using different adapters, or none, are decoded in the same batch:
+     * each adapter only applies to the tokens of its own slot's sequence.
+     *
+     * @param id Id requests select the adapter by
+     * @param path Path to the adapter file
+     * @return 0 on success, -1 on invalid arguments, -2 if the id is in use with another file, -3 if the file fails to load
+     */
+    int registerLoraAdapter(const std::string &id, const std::string &path);
+
+    /**
+     * @brief Cancel a queued or running request. Its on_complete still fires.
+     *
+     * @param request_id Id returned by submit()
+     */
+    void cancel(int32_t request_id);
+
+    /**
+     * @brief Stop the worker, cancelling every outstanding request.
+     */
+    void shutdown();
+
+    void run();
+    bool hasActiveSlots() const;
+    void startSlot(llama_mobile_engine_slot &slot, llama_mobile_engine_pending &&pending);
+    bool selectSlotLora(llama_mobile_engine_slot &slot);
+    void releaseSlotLora(llama_mobile_engine_slot &slot);
+    void processToken(llama_mobile_engine_slot &slot);
+    void finishSlot(llama_mobile_engine_slot &slot);
+};
+
+/**
+ * @brief Fixed-capacity lock-free ring buffer for exactly one producer and one consumer thread.
+ *
+ * The capacity is rounded up to a power of two. push() and pop() never block or allocate.
+ */
+template <typename T>
+struct llama_mobile_spsc_ring {
+    std::vector<T> slots;                    ///< Storage, size is a power of two
+    size_t mask = 0;                         ///< slots.size() - 1
+    alignas(64) std::atomic<size_t> head{0}; ///< Next slot to read, advanced by the consumer
+    alignas(64) std::atomic<size_t> tail{0}; ///< Next slot to write, advanced by the producer
+
+    /**
+     * @brief Constructor.
+     *
+     * @param capacity Minimum number of items the ring can hold
+     */
+    explicit llama_mobile_spsc_ring(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    /**
+     * @brief Append an item. Producer thread only.
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item. Consumer thread only.
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &item) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * @brief Generated text handed from the async worker to the host.
+ *
+ * Pieces longer than the inline buffer are split over several chunks.
+ */
+struct llama_mobile_async_chunk {
+    llama_token token = -1;  ///< Token that produced this text
+    uint8_t length = 0;      ///< Bytes used in text
+    bool partial = false;    ///< Whether the token's text continues in the next chunk
+    char text[48];           ///< Text bytes, not NUL-terminated
+};
+
+/**
+ * @brief Lifecycle of an async request.
+ */
+enum llama_mobile_async_state {
+    ASYNC_QUEUED,    ///< Waiting for the worker
+    ASYNC_RUNNING,   ///< Being generated
+    ASYNC_DONE,      ///< Finished normally
+    ASYNC_CANCELLED, ///< Cancelled before or during generation
+    ASYNC_FAILED,    ///< Sampling setup or generation failed
+};
+
+/**
+ * @brief A completion queued on a context's async worker.
+ *
+ * Shared between the host and the worker. Tokens flow through the ring; the result
+ * fields are written by the worker before state reaches ASYNC_DONE or later.
+ */
+struct llama_mobile_async_request {
+    int32_t id = -1;                          ///< Id assigned on submit
+    std::string prompt;                       ///< Prompt text
+    int n_predict = -1;                       ///< Maximum tokens to generate (-1 for no limit)
+    int n_threads = 0;                        ///< Thread count override, 0 to keep the context's
+    common_params_sampling sampling;          ///< Sampling parameters for this request
+    std::vector<std::string> antiprompt;      ///< Stop words
+    bool select_lora = false;                 ///< Whether to switch adapters before running
+    std::vector<llama_mobile_lora_selection> lora; ///< Adapters for this request when select_lora is set
+    std::function<void()> notify;             ///< Called on the worker after new tokens and on completion (optional)
+
+    std::atomic<bool> cancelled{false};       ///< Cancellation token, checked before every token
+    std::atomic<int> state{ASYNC_QUEUED};     ///< Current llama_mobile_async_state
+    llama_mobile_spsc_ring<llama_mobile_async_chunk> tokens; ///< Generated text, worker to host
+
+    llama_mobile_engine_result result;        ///< Final text and stop reason
+    int64_t n_drafted = 0;                    ///< Tokens drafted by speculative decoding
+    int64_t n_draft_accepted = 0;             ///< Drafted tokens accepted
+    double tokens_per_second = 0.0;           ///< Decode rate after the first token
+
+    std::mutex done_mutex;                    ///< Guards the transition to a finished state
+    std::condition_variable done_cv;          ///< Signalled when the request finishes
+
+    /**
+     * @brief Constructor.
+     *
+     * @param ring_capacity Number of chunks buffered before the worker waits for the host
+     */
+    explicit llama_mobile_async_request(size_t ring_capacity) : tokens(ring_capacity) {}
+
+    /**
+     * @brief Whether the request reached a final state.
+     */
+    bool finished() const;
+
+    /**
+     * @brief Block until the request finishes.
+     *
+     * @param timeout_ms Maximum wait, negative to wait indefinitely
+     * @return true if the request finished
+     */
+    bool wait(int timeout_ms);
+};
+
+/**
+ * @brief Worker thread running completions on one llama_mobile_context, one request at a time.
+ */
+struct llama_mobile_async_worker {
+    llama_mobile_context *context = nullptr;                         ///< Context driven by the worker
+
+    std::thread worker;                                              ///< Completion thread
+    std::mutex queue_mutex;                                          ///< Guards queue, current and is_running
+    std::condition_variable queue_cv;                                ///< Wakes the worker
+    std::deque<std::shared_ptr<llama_mobile_async_request>> queue;   ///< Requests waiting to run
+    std::shared_ptr<llama_mobile_async_request> current;             ///< Request being generated
+    int32_t next_request_id = 0;                                     ///< Id handed to the next submit
+    bool is_running = false;                                         ///< Whether the worker should keep running
+
+    /**
+     * @brief Destructor. Cancels outstanding requests and joins the worker.
+     */
+    ~llama_mobile_async_worker();
+
+    /**
+     * @brief Start the worker thread.
+     *
+     * @param context_ Initialized context, must outlive the worker
+     * @return true on success, false otherwise
+     */
+    bool start(llama_mobile_context *context_);
+
+    /**
+     * @brief Queue a request.
+     *
+     * @param request Request to run
+     * @return Request id, or -1 if the worker has stopped
+     */
+    int32_t submit(std::shared_ptr<llama_mobile_async_request> request);
+
+    /**
+     * @brief Stop the worker, cancelling every outstanding request.
+     */
+    void shutdown();
+
+    void run();
+    void process(llama_mobile_async_request &request);
+    bool pushPiece(llama_mobile_async_request &request, llama_token tok, const char *text, size_t length);
+    void finish(llama_mobile_async_request &request, llama_mobile_async_state state);
+};
+
+/**
+ * @brief Stages of a background model load.
+ */
+enum llama_mobile_load_state {
+    LOAD_VOCAB,     ///< Reading the vocabulary and chat templates
+    LOAD_WEIGHTS,   ///< Vocabulary ready, weights streaming in
+    LOAD_DONE,      ///< Context ready to be taken
+    LOAD_CANCELLED, ///< Cancelled before the context was ready
+    LOAD_FAILED,    ///< The model or context failed to load
+};
+
+/**
+ * @brief Model load on its own thread.
+ *
+ * A vocab-only copy of the model is read first, so prompts can be tokenized and
+ * chat-formatted while the weights are still loading. Cancellation is checked by
+ * the model loader after every tensor.
+ */
+struct llama_mobile_load_task : std::enable_shared_from_this<llama_mobile_load_task> {
+    std::string model_path;                                  ///< Model file
+    std::string chat_template;                               ///< Custom chat template, empty for the model's own
+    std::function<bool(llama_mobile_context &context)> load; ///< Loads the weights into the context, runs on the loading thread
+    std::function<void(int state, float progress)> notify;   ///< Called on the loading thread on every state change and percent of progress (optional)
+
+    llama_mobile_context *context = nullptr;  ///< Context being loaded, owned by the task until taken
+    llama_model *vocab_model = nullptr;       ///< Vocab-only model for early tokenization
+    common_chat_templates_ptr templates;      ///< Chat templates read with the vocabulary
+
+    std::atomic<int> state{LOAD_VOCAB};       ///< Current llama_mobile_load_state
+    std::atomic<float> loading_progress{0};   ///< Fraction of the weights loaded
+    std::atomic<bool> released{false};        ///< Set once nobody listens to notify any more
+    float progress_notified = -1.0f;          ///< Progress last passed to notify
+    std::recursive_mutex notify_mutex;        ///< Held across every notify call, recursive for a callback that releases the task
+
+    std::mutex done_mutex;                    ///< Guards context and the transition to a finished state
+    std::condition_variable done_cv;          ///< Signalled on every state change
+
+    /**
+     * @brief Destructor. Frees the context if it was never taken.
+     */
+    ~llama_mobile_load_task();
+
+    /**
+     * @brief Start loading on a detached thread that holds a reference to the task.
+     *
+     * The task must be owned by a std::shared_ptr.
+     */
+    void start();
+
+    /**
+     * @brief Whether the load reached a final state.
+     */
+    bool finished() const;
+
+    /**
+     * @brief Block until the load finishes.
+     *
+     * @param timeout_ms Maximum wait, negative to wait indefinitely
+     * @return true if the load finished
+     */
+    bool wait(int timeout_ms);
+
+    /**
+     * @brief Abort the load at the next tensor. No effect once it finished.
+     */
+    void cancel();
+
+    /**
+     * @brief Stop further notify calls.
+     *
+     * Waits for a notify call in progress on the loading thread, so the callback's
+     * user data may be freed once it returns.
+     */
+    void release();
+
+    /**
+     * @brief Take ownership of the loaded context.
+     *
+     * @return The context once the state is LOAD_DONE and it was not taken before, nullptr otherwise
+     */
+    llama_mobile_context *takeContext();
+
+    /**
+     * @brief Tokenize text with the vocab-only model, the same way llama_mobile_tokenize_c() does.
+     *
+     * @return Tokens, or empty while the state is still LOAD_VOCAB
+     */
+    std::vector<llama_token> tokenize(const std::string &text) const;
+
+    /**
+     * @brief Format chat messages with the templates read with the vocabulary.
+     *
+     * @return The formatted prompt, or empty while the state is still LOAD_VOCAB
+     */
+    std::string getFormattedChat(const std::string &messages, const std::string &chat_template) const;
+
+    void run();
+    void setState(llama_mobile_load_state state_, float progress);
+    void notifyState(llama_mobile_load_state state_, float progress);
+};
+
+/**
+ * @brief Vocoder thread of a pipelined audio stream.
+ *
+ * The completion loop pushes code windows into a bounded queue and keeps generating
+ * while the worker turns earlier windows into audio.
+ */
+struct llama_mobile_tts_pipeline {
+    llama_mobile_context *context = nullptr;        ///< Context whose vocoder and stream are used
+
+    std::thread worker;                             ///< Vocoder thread
+    std::mutex queue_mutex;                         ///< Guards every field below
+    std::condition_variable queue_cv;               ///< Signals queue, busy and failure changes
+    std::deque<llama_mobile_tts_window> queue;      ///< Windows waiting for the vocoder
+    size_t capacity = 4;                            ///< Windows the queue holds before push() blocks
+    bool busy = false;                              ///< Whether a window is being synthesized
+    bool failed = false;                            ///< Whether the vocoder failed since the last clear()
+    bool is_running = false;                        ///< Whether the worker should keep running
+
+    /**
+     * @brief Destructor. Stops and joins the worker.
      */
-    std::vector<float> decodeAudioTokens(const std::vector<llama_token> &tokens);
-    
+    ~llama_mobile_tts_pipeline();
+
     /**
-     * @brief Release vocoder (TTS) resources.
+     * @brief Start the vocoder thread.
+     *
+     * @param context_ Context with the vocoder enabled, must outlive the pipeline
+     * @param capacity_ Queue capacity in windows
+     * @return true on success, false otherwise
      */
-    void releaseVocoder();
+    bool start(llama_mobile_context *context_, size_t capacity_);
 
-    // High-level conversation management API
     /**
-     * @brief Generate a response to a user message in a conversation.
-     * 
-     * @param user_message User's message
-     * @param max_tokens Maximum number of tokens to generate
-     * @return Generated response text
+     * @brief Queue a window, waiting while the queue is full.
+     *
+     * @return false if the vocoder failed or the pipeline stopped
      */
-    std::string generateResponse(const std::string &user_message, int max_tokens = 200);
-    
+    bool push(llama_mobile_tts_window window);
+
     /**
-     * @brief Continue a conversation with a user message, returning detailed timing information.
-     * 
-     * @param user_message User's message
-     * @param max_tokens Maximum number of tokens to generate
-     * @return Conversation result with timing and token information
+     * @brief Wait until every queued window is synthesized.
+     *
+     * @return false if the vocoder failed
      */
-    conversation_result continueConversation(const std::string &user_message, int max_tokens = 200);
-    
+    bool drain();
+
     /**
-     * @brief Clear the current conversation history.
+     * @brief Drop queued windows, wait for the current one and reset the failure flag.
      */
-    void clearConversation();
-    
+    void clear();
+
     /**
-     * @brief Check if a conversation is currently active.
-     * 
-     * @return true if active, false otherwise
+     * @brief Stop the worker, dropping queued windows.
      */
-    bool isConversationActive() const;
+    void shutdown();
+
+    void run();
 };
 
 extern bool llama_mobile_verbose;
@@ -580,6 +1897,40 @@ bool ends_with(const std::string &str, const std::string &suffix);
 
 size_t find_partial_stop_string(const std::string &stop, const std::string &text);
 
+/**
+ * @brief Hit and miss counters of the process-wide grammar caches.
+ *
+ * @return Counters shared by every context in the process
+ */
+llama_mobile_grammar_cache_stats grammar_cache_stats();
+
+/**
+ * @brief Drop every cached schema conversion and compiled grammar.
+ *
+ * Grammars in use keep their rules; the counters are not reset.
+ */
+void grammar_cache_clear();
+
+/**
+ * @brief Upper bound on the number of bytes base64_decode() writes.
+ *
+ * @param encoded_len Length of the base64 text, whitespace included
+ * @return Size the output buffer must have
+ */
+size_t base64_decoded_size_max(size_t encoded_len);
+
+/**
+ * @brief Decode standard base64 text into a caller-provided buffer.
+ *
+ * Whitespace is skipped; padding or any character outside the alphabet ends the input.
+ * Uses AVX2/SSSE3 or NEON kernels where the CPU has them.
+ *
+ * @param encoded Base64 text, e.g. the payload of a data URI
+ * @param out Buffer of at least base64_decoded_size_max(encoded.size()) bytes
+ * @return Number of bytes decoded
+ */
+size_t base64_decode(std::string_view encoded, uint8_t *out);
+
 } // namespace llama_mobile
 
 #endif // __cplusplus
@@ -629,6 +1980,10 @@ typedef struct {
     const char* cache_type_k;        /**< Cache type for key (optional, NULL for default) */
     const char* cache_type_v;        /**< Cache type for value (optional, NULL for default) */
     void (*progress_callback)(float progress);  /**< Model loading progress callback (optional) */
+    const char* draft_model_path;    /**< Draft model for speculative decoding (optional, NULL to disable) */
+    bool prompt_lookup;              /**< Speculative decoding from prompt n-grams when no draft model is set (default: false) */
+    int32_t n_draft;                 /**< Maximum tokens drafted per step (default: 16) */
+    int32_t n_seq_max;               /**< Texts packed per batch by llama_mobile_embedding_batch(), and the most branches of llama_mobile_completion_n_c() (default: 1) */
 } llama_mobile_init_params_t;
 
 /**
@@ -648,6 +2003,9 @@ typedef struct {
     const char** stop_sequences;      /**< Array of stop sequences to terminate generation (optional) */
     int stop_sequence_count;          /**< Number of stop sequences (optional, 0 for none) */
     bool (*token_callback)(const char* token);  /**< Streaming callback for generated tokens (optional) */
+    bool (*token_event_callback)(const llama_mobile_token_event_c_t* event, void* user_data);  /**< Zero-copy streaming callback, see llama_mobile_token_event_c_t (optional) */
+    void* token_event_user_data;      /**< Passed through to token_event_callback (optional) */
+    bool token_event_utf8_safe;       /**< Only fire token_event_callback on complete UTF-8 code points (default: false) */
 } llama_mobile_completion_params_t;
 
 /**
@@ -664,6 +2022,8 @@ typedef struct {
     bool stopped_eos;                /**< Whether generation stopped due to EOS (end-of-sequence) token */
     bool stopped_word;               /**< Whether generation stopped due to hitting a stop sequence */
     bool stopped_limit;              /**< Whether generation stopped due to reaching max_tokens limit */
+    double draft_acceptance_rate;    /**< Fraction of drafted tokens accepted (speculative decoding only) */
+    double tokens_per_second;        /**< Decode rate after the first token */
 } llama_mobile_completion_result_t;
 
 /**
@@ -866,6 +2226,24 @@ LLAMA_MOBILE_API llama_mobile_float_array_t llama_mobile_embedding(
     llama_mobile_context_t ctx,
     const char* text);
 
+/**
+ * @brief Generate embeddings for many texts at once.
+ * 
+ * Much faster than calling llama_mobile_embedding() per text when n_seq_max was set
+ * above 1 at initialization, because several texts share each decode call.
+ * 
+ * @param ctx Context handle obtained from llama_mobile_init() with embedding enabled.
+ * @param texts Array of text strings.
+ * @param count Number of texts.
+ * @param out_matrix Caller-provided buffer of count * n_embd floats, filled row by row.
+ * @return 0 on success, negative error code on failure.
+ */
+LLAMA_MOBILE_API int llama_mobile_embedding_batch(
+    llama_mobile_context_t ctx,
+    const char** texts,
+    int count,
+    float* out_matrix);
+
 /**
  * @brief Apply LoRA adapters to the model.
  * 
@@ -1073,9 +2451,109 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_context_handle_t llama_mobile_init_context_
  */
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_context_c(llama_mobile_context_handle_t handle);
 
+// **BACKGROUND MODEL LOADING**
+
+/**
+ * @brief Start loading a model on a background thread and return immediately.
+ *
+ * The vocabulary and chat templates are read first (LLAMA_MOBILE_LOAD_VOCAB); from
+ * LLAMA_MOBILE_LOAD_WEIGHTS on, prompts can be tokenized and formatted with
+ * llama_mobile_load_tokenize_c() and llama_mobile_load_get_formatted_chat_c() while
+ * the weights stream in. params->progress_callback, if set, also receives the
+ * weight loading progress.
+ *
+ * @param params Initialization parameters, copied before returning.
+ * @param callback Called on the loading thread on every state change and every percent
+ *                 of weights loaded, may be NULL.
+ * @param user_data Opaque pointer passed back to callback.
+ * @return Load handle, or NULL on invalid parameters. Release with llama_mobile_load_release_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_load_task_handle_t llama_mobile_init_context_async_c(
+    const llama_mobile_init_params_c_t* params,
+    llama_mobile_load_callback_c_t callback,
+    void* user_data
+);
+
+/**
+ * @brief Current llama_mobile_load_state_c_t of a background load.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_load_state_c(llama_mobile_load_task_handle_t task);
+
+/**
+ * @brief Fraction of the weights loaded so far (0.0-1.0).
+ */
+LLAMA_MOBILE_FFI_EXPORT float llama_mobile_load_progress_c(llama_mobile_load_task_handle_t task);
+
+/**
+ * @brief Wait for a background load to finish.
+ *
+ * @param task Load handle.
+ * @param timeout_ms Maximum wait in milliseconds, negative to wait indefinitely.
+ * @return The state after waiting.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_load_wait_c(llama_mobile_load_task_handle_t task, int32_t timeout_ms);
+
+/**
+ * @brief Cancel a background load. The loader stops at the next tensor and the state
+ * becomes LLAMA_MOBILE_LOAD_CANCELLED.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_load_cancel_c(llama_mobile_load_task_handle_t task);
+
+/**
+ * @brief Tokenize text while the weights are loading, as llama_mobile_tokenize_c() would.
+ *
+ * @param task Load handle.
+ * @param text Text to tokenize.
+ * @return Tokens, empty until the vocabulary is ready. Free with llama_mobile_free_token_array_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_token_array_c_t llama_mobile_load_tokenize_c(llama_mobile_load_task_handle_t task, const char* text);
+
+/**
+ * @brief Format chat messages while the weights are loading, as llama_mobile_get_formatted_chat_c() would.
+ *
+ * @param task Load handle.
+ * @param messages JSON array of messages.
+ * @param chat_template Custom template, NULL for the model's own.
+ * @return Formatted prompt, or NULL on error. Free with llama_mobile_free_string_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT char* llama_mobile_load_get_formatted_chat_c(llama_mobile_load_task_handle_t task, const char* messages, const char* chat_template);
+
+/**
+ * @brief Take the loaded context.
+ *
+ * @param task Load handle.
+ * @return Context handle once the state is LLAMA_MOBILE_LOAD_DONE, NULL before that or if it
+ *         was already taken. Free with llama_mobile_free_context_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_context_handle_t llama_mobile_load_take_context_c(llama_mobile_load_task_handle_t task);
+
+/**
+ * @brief Release a load handle without waiting for the load to stop.
+ *
+ * A load still running is cancelled and its context freed on the loading thread;
+ * a context that was not taken is freed. If the callback is running on the loading
+ * thread, this waits for it to return, and it is never called again afterwards, so
+ * user_data may be freed as soon as this returns. Calling it from inside the callback
+ * is allowed.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_load_release_c(llama_mobile_load_task_handle_t task);
+
 /**
  * @brief Generate a completion from a prompt through the FFI interface.
  * 
+ * Generated text can be streamed through token_callback, which receives the piece of
+ * each token, and token_event_callback, which receives a llama_mobile_token_event_c_t
+ * pointing into the generated text buffer. Neither detokenizes a second time or
+ * allocates per token; returning false from either stops generation.
+ * 
+ * With the vocoder enabled, audio_callback receives mono 24 kHz PCM while a TTS prompt
+ * is still generating: audio codes are decoded every audio_window_codes codes (16 by
+ * default, about 0.2 s of speech) and the rest is flushed when generation ends. The
+ * result then reports time_to_first_audio_ms and audio_samples.
+ * 
+ * Setting lora_ids selects registered LoRA adapters for this request, see
+ * llama_mobile_select_lora_adapters_c(); a failed selection returns -5.
+ * 
  * @param handle Handle to the initialized context.
  * @param params Pointer to completion parameters struct.
  * @param result Output parameter to store the completion result. The result should be
@@ -1088,6 +2566,34 @@ LLAMA_MOBILE_FFI_EXPORT int llama_mobile_completion_c(
     llama_mobile_completion_result_c_t* result
 );
 
+/**
+ * @brief Generate n alternative completions of one prompt through the FFI interface.
+ * 
+ * The prompt is evaluated once and forked into n sequences that are decoded together,
+ * one token per completion per batch, so n suggestions cost about one prefill and a
+ * batched decode instead of n full completions. Each completion samples on its own:
+ * with a fixed seed, completion i uses seed + i, otherwise a random seed. With greedy
+ * sampling (temperature <= 0) all completions are the same.
+ * 
+ * n may not exceed the n_seq_max the context was initialized with; the completions share
+ * its n_ctx, so each can generate at most (n_ctx - prompt tokens) / n tokens. Streaming
+ * and audio callbacks are not used and tokens_per_second is not reported.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param params Pointer to completion parameters struct.
+ * @param n Number of completions to generate.
+ * @param results Array of n results, each to be freed with
+ *                llama_mobile_free_completion_result_members_c().
+ * @return 0 on success, -6 when n is out of range, other negative codes as
+ *         llama_mobile_completion_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_completion_n_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    int32_t n,
+    llama_mobile_completion_result_c_t* results
+);
+
 // **MULTIMODAL COMPLETION**
 /**
  * @brief Generate a completion with multimodal input (images/audio) through the FFI interface.
@@ -1145,6 +2651,23 @@ LLAMA_MOBILE_FFI_EXPORT char* llama_mobile_detokenize_c(llama_mobile_context_han
  */
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_float_array_c_t llama_mobile_embedding_c(llama_mobile_context_handle_t handle, const char* text);
 
+/**
+ * @brief Embed many texts through the FFI interface, several per decode call.
+ * 
+ * Texts are packed into batches of up to n_seq_max sequences (set at initialization)
+ * and min(n_batch, n_ubatch) tokens. Each sequence's pooled embedding is normalized
+ * per embd_normalize and written straight into out_matrix; no sampler is involved.
+ * Any KV cache state kept for completions is discarded.
+ * 
+ * @param handle Handle to a context initialized with embedding enabled and pooling other than NONE.
+ * @param texts Array of count texts.
+ * @param count Number of texts.
+ * @param out_matrix Caller-provided buffer of count * llama_mobile_get_n_embd_c() floats, row-major.
+ * @return 0 on success, -1 on invalid arguments or an unsuitable context, -2 if evaluation
+ *         failed, -3 on an internal error.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_embedding_batch_c(llama_mobile_context_handle_t handle, const char** texts, int32_t count, float* out_matrix);
+
 /**
  * @brief Free a string allocated by the FFI interface.
  * 
@@ -1304,6 +2827,23 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_float_array_c_t llama_mobile_decode_audio_t
  */
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_release_vocoder_c(llama_mobile_context_handle_t handle);
 
+/**
+ * @brief Overlap audio generation and vocoding for streaming TTS through the FFI interface.
+ * 
+ * With the pipeline enabled, the audio_callback of a completion is fed by a vocoder
+ * thread that consumes code windows from a bounded queue while the model keeps
+ * generating, and audio_callback is called from that thread.
+ * 
+ * @param handle Handle to the context with the vocoder initialized.
+ * @param enabled Whether to pipeline; false restores serial decoding.
+ * @param n_threads_llm Threads for the model, 0 for three quarters of the context threads.
+ * @param n_threads_vocoder Threads for the vocoder, 0 for the remaining ones.
+ * @param queue_windows Code windows that may wait for the vocoder, 0 for 4.
+ * @return 0 on success, -1 for invalid arguments, -2 if the vocoder is not enabled or a
+ *         stream is running, -3 on other errors.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_tts_pipeline_c(llama_mobile_context_handle_t handle, bool enabled, int32_t n_threads_llm, int32_t n_threads_vocoder, int32_t queue_windows);
+
 // **HIGH PRIORITY ADDITIONS**
 
 // LoRA adapter structs are defined in llama_mobile_ffi.h
@@ -1326,6 +2866,17 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_release_vocoder_c(llama_mobile_context
  */
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_bench_result_c_t llama_mobile_bench_c(llama_mobile_context_handle_t handle, int pp, int tg, int pl, int nr);
 
+/**
+ * @brief Compare prompt ingestion speed of the completion path against raw llama_decode.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param pp Number of prompt tokens to prefill (clamped to n_ctx - 1).
+ * @param nr Number of runs to average.
+ * @return Prefill benchmark results in tokens/sec. The result should be freed using
+ *         llama_mobile_free_bench_prefill_result_members_c() when no longer needed.
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_bench_prefill_result_c_t llama_mobile_bench_prefill_c(llama_mobile_context_handle_t handle, int pp, int nr);
+
 // **HIGH PRIORITY: LoRA Adapter Support**
 /**
  * @brief Apply LoRA adapters to the model through the FFI interface.
@@ -1352,6 +2903,61 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_remove_lora_adapters_c(llama_mobile_co
  */
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_lora_adapters_c_t llama_mobile_get_loaded_lora_adapters_c(llama_mobile_context_handle_t handle);
 
+/**
+ * @brief Set the byte budget of the LoRA adapter registry.
+ * 
+ * Adapters that are not selected are freed least recently used first while the loaded
+ * adapters exceed the budget, and read from disk again when next selected.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param max_bytes Budget in bytes, 0 for unlimited (the default).
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_configure_lora_registry_c(llama_mobile_context_handle_t handle, int64_t max_bytes);
+
+/**
+ * @brief Register a LoRA adapter under an id and load it.
+ * 
+ * Registering the same id and path again is a no-op.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param id Id to select the adapter by.
+ * @param path Path to the adapter file.
+ * @return 0 on success, -2 if the id is selected with another file, -3 if the file fails to load.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_register_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id, const char* path);
+
+/**
+ * @brief Unregister a LoRA adapter and free it.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param id Id the adapter was registered under.
+ * @return 0 on success, -2 if the adapter is currently selected.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_unregister_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id);
+
+/**
+ * @brief Select the active LoRA adapters from the registry.
+ * 
+ * Selecting the active set again costs nothing. A different set replaces the adapters on
+ * the context without loading files that are resident, clears the KV cache and switches
+ * the prefix cache to the snapshots taken with that set.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param ids Registered adapter ids.
+ * @param scales One scale per id, NULL for 1.0.
+ * @param count Number of ids, 0 for the base model.
+ * @return 0 on success, -2 if an id is unknown or fails to load.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_select_lora_adapters_c(llama_mobile_context_handle_t handle, const char** ids, const float* scales, int count);
+
+/**
+ * @brief Get the LoRA adapter registry counters.
+ * 
+ * @param handle Handle to the initialized context.
+ * @return Counters, all zero for an invalid handle.
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_lora_registry_stats_c_t llama_mobile_get_lora_registry_stats_c(llama_mobile_context_handle_t handle);
+
 // **HIGH PRIORITY: Chat Template Support**
 /**
  * @brief Validate if a chat template is compatible with the loaded model through the FFI interface.
@@ -1399,6 +3005,24 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_chat_result_c_t llama_mobile_get_formatted_
     const char* tool_choice
 );
 
+// **ADVANCED: Grammar Cache**
+// Grammar cache stats struct is defined in llama_mobile_ffi.h
+
+/**
+ * @brief Get the hit and miss counters of the process-wide grammar caches.
+ * 
+ * Completions that repeat a grammar, or chat formatting that repeats a JSON schema,
+ * are served from these caches without parsing or converting again.
+ * 
+ * @return Counters shared by every context in the process.
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_grammar_cache_stats_c_t llama_mobile_get_grammar_cache_stats_c(void);
+
+/**
+ * @brief Drop every cached schema conversion and compiled grammar, e.g. when memory is low.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_grammar_cache_c(void);
+
 // **HIGH PRIORITY: Context Management**
 /**
  * @brief Rewind the context to the beginning of the current conversation through the FFI interface.
@@ -1415,6 +3039,104 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_rewind_c(llama_mobile_context_handle_t
  */
 LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_init_sampling_c(llama_mobile_context_handle_t handle);
 
+/**
+ * @brief Configure what happens when the context fills up during generation.
+ * 
+ * The turn based policies drop whole messages, found through turn marker tokens,
+ * and slide the rest of the KV cache back instead of re-evaluating it, so long chats
+ * keep their system prompt and most recent turns.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param params Shift policy and turn detection settings.
+ * @return 0 on success, -1 on invalid arguments, -2 on an internal error.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_context_shift_c(llama_mobile_context_handle_t handle, const llama_mobile_context_shift_params_c_t* params);
+
+// **HIGH PRIORITY: Prefix Cache**
+
+/**
+ * @brief Configure the prompt prefix KV cache through the FFI interface.
+ * 
+ * Reconfiguring drops snapshots held in RAM. Snapshots spilled to disk_dir by an
+ * earlier run of the same model are picked up again.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param params Cache configuration; a zero max_bytes disables the cache.
+ * @return 0 on success, negative error code on failure.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_prefix_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_prefix_cache_params_c_t* params);
+
+/**
+ * @brief Get prefix cache hit/miss and memory counters through the FFI interface.
+ * 
+ * @param handle Handle to the initialized context.
+ * @return Counters, all zero for a NULL handle.
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_prefix_cache_stats_c_t llama_mobile_get_prefix_cache_stats_c(llama_mobile_context_handle_t handle);
+
+/**
+ * @brief Drop every prefix cache snapshot, including files spilled to disk.
+ * 
+ * @param handle Handle to the initialized context.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_prefix_cache_c(llama_mobile_context_handle_t handle);
+
+// **MULTIMODAL: Media Embedding Cache**
+
+/**
+ * @brief Configure the media embedding cache through the FFI interface.
+ * 
+ * Requires multimodal to be initialized. Embeddings persisted to disk_dir by an earlier
+ * run with the same projector and model are reused.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param params Cache configuration; a zero max_bytes disables the cache.
+ * @return 0 on success, negative error code on failure.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_media_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_media_cache_params_c_t* params);
+
+/**
+ * @brief Get media cache hit/miss counters and encoder time saved through the FFI interface.
+ * 
+ * @param handle Handle to the initialized context.
+ * @return Counters, all zero for a NULL handle.
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_media_cache_stats_c_t llama_mobile_get_media_cache_stats_c(llama_mobile_context_handle_t handle);
+
+/**
+ * @brief Drop every cached media embedding, including files persisted to disk.
+ * 
+ * @param handle Handle to the initialized context.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_media_cache_c(llama_mobile_context_handle_t handle);
+
+// **HIGH PRIORITY: Session Persistence**
+
+/**
+ * @brief Save the conversation session to a file through the FFI interface.
+ * 
+ * The file holds the KV cache, evaluated tokens, sampler seed and conversation state,
+ * so an app that is killed in the background can resume without re-evaluating the chat.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param path Destination file, replaced atomically.
+ * @return 0 on success, negative error code on failure.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_session_save_c(llama_mobile_context_handle_t handle, const char* path);
+
+/**
+ * @brief Restore a session saved by llama_mobile_session_save_c() through the FFI interface.
+ * 
+ * The file is memory-mapped where supported, so loading costs a file read rather than a prefill.
+ * 
+ * @param handle Handle to the initialized context.
+ * @param path Session file.
+ * @return 0 on success, -1 on invalid arguments or a busy context, -2 if the file is unreadable
+ *         or corrupt, -3 if it was saved with a different model, n_ctx or LoRA adapter set,
+ *         -4 if restoring failed.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_session_load_c(llama_mobile_context_handle_t handle, const char* path);
+
 // **COMPLETION CONTROL**
 /**
  * @brief Begin a new completion generation process through the FFI interface.
@@ -1554,6 +3276,160 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_conversation_c(llama_mobile_cont
  */
 LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_is_conversation_active_c(llama_mobile_context_handle_t handle);
 
+// **CONTINUOUS BATCHING ENGINE**
+
+/**
+ * @brief Create a continuous-batching engine that serves several completions from one context.
+ *
+ * The context is split into n_parallel sequences of n_ctx / n_parallel tokens each.
+ *
+ * @param params Model and context initialization parameters.
+ * @param n_parallel Number of requests decoded concurrently.
+ * @return Engine handle, or NULL on failure. Free with llama_mobile_engine_free_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_engine_handle_t llama_mobile_engine_init_c(const llama_mobile_init_params_c_t* params, int32_t n_parallel);
+
+/**
+ * @brief Queue a completion request on the engine.
+ *
+ * Both callbacks run on the engine's worker thread. The token callback returns false
+ * to cancel the request. The result passed to the completion callback, and the strings
+ * it points to, are only valid for the duration of the call.
+ *
+ * A request can use one registered adapter (lora_ids[0] scaled by lora_scales[0]),
+ * applied to its own sequence while other requests keep decoding in the same batch.
+ * A request whose adapter is unknown or cannot be applied completes with result->error set.
+ *
+ * @param handle Engine handle.
+ * @param params Completion parameters; token_callback and n_threads are ignored.
+ * @param token_callback Called with each generated piece, may be NULL.
+ * @param complete_callback Called exactly once when the request finishes, may be NULL.
+ * @param user_data Opaque pointer passed back to both callbacks.
+ * @return Request id, or -1 on failure.
+ */
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_engine_submit_c(
+    llama_mobile_engine_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_engine_token_callback_c_t token_callback,
+    llama_mobile_engine_complete_callback_c_t complete_callback,
+    void* user_data
+);
+
+/**
+ * @brief Cancel a queued or running engine request.
+ *
+ * @param handle Engine handle.
+ * @param request_id Id returned by llama_mobile_engine_submit_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_cancel_c(llama_mobile_engine_handle_t handle, int32_t request_id);
+
+/**
+ * @brief Register a LoRA adapter that engine requests select through lora_ids.
+ *
+ * @param handle Engine handle.
+ * @param id Id to select the adapter by.
+ * @param path Path to the adapter file.
+ * @return 0 on success, -2 if the id is in use with another file, -3 if the file fails to load.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_engine_register_lora_adapter_c(llama_mobile_engine_handle_t handle, const char* id, const char* path);
+
+/**
+ * @brief Stop the engine, cancel outstanding requests and free all resources.
+ *
+ * Must not be called from inside an engine callback.
+ *
+ * @param handle Engine handle.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_free_c(llama_mobile_engine_handle_t handle);
+
+// **ASYNC COMPLETION**
+
+/**
+ * @brief Queue a completion on the context's worker thread and return immediately.
+ *
+ * Requests on one context run one after another in submission order. Generated text is
+ * read with llama_mobile_async_poll_c(); the callbacks in params are ignored. While a request
+ * runs, synchronous calls that use the same context (completions, tokenization, embeddings,
+ * LoRA, caches, sessions, ...) return without doing anything: functions returning int give
+ * LLAMA_MOBILE_ERROR_BUSY, the others their usual failure value. Calls made from two threads
+ * at once on one handle are turned away the same way.
+ *
+ * @param handle Handle to the initialized context.
+ * @param params Completion parameters, copied before returning.
+ * @param notify_callback Called on the worker thread when new tokens are available and
+ *                        when the request finishes, may be NULL.
+ * @param user_data Opaque pointer passed back to notify_callback.
+ * @return Request handle, or NULL on failure. Release with llama_mobile_async_release_c().
+ */
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_async_request_handle_t llama_mobile_completion_async_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_async_notify_callback_c_t notify_callback,
+    void* user_data
+);
+
+/**
+ * @brief Get the id passed to the notify callback for a request.
+ *
+ * @param request Request handle.
+ * @return Request id, or -1 if request is NULL.
+ */
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_request_id_c(llama_mobile_async_request_handle_t request);
+
+/**
+ * @brief Take generated text from a request without blocking.
+ *
+ * Tokens are buffered in a lock-free ring; when it fills up the worker waits for the
+ * host to poll. Only one thread may poll a given request.
+ *
+ * @param request Request handle.
+ * @param tokens Output array.
+ * @param max_tokens Capacity of tokens.
+ * @return Number of entries written, 0 if nothing is pending.
+ */
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_poll_c(llama_mobile_async_request_handle_t request, llama_mobile_async_token_c_t* tokens, int32_t max_tokens);
+
+/**
+ * @brief Get the current state of a request.
+ *
+ * @param request Request handle.
+ * @return One of llama_mobile_async_state_c_t.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_state_c(llama_mobile_async_request_handle_t request);
+
+/**
+ * @brief Block until a request finishes or the timeout expires.
+ *
+ * @param request Request handle.
+ * @param timeout_ms Maximum wait in milliseconds, negative to wait indefinitely.
+ * @return The request's state after waiting.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_wait_c(llama_mobile_async_request_handle_t request, int32_t timeout_ms);
+
+/**
+ * @brief Get the final result of a finished request.
+ *
+ * @param request Request handle.
+ * @param result Output, free with llama_mobile_free_completion_result_members_c().
+ * @return 0 on success, -1 on invalid arguments, -2 if the request has not finished,
+ *         -3 if it failed.
+ */
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_result_c(llama_mobile_async_request_handle_t request, llama_mobile_completion_result_c_t* result);
+
+/**
+ * @brief Cancel a queued or running request without affecting any other request.
+ *
+ * @param request Request handle.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_cancel_c(llama_mobile_async_request_handle_t request);
+
+/**
+ * @brief Release a request handle, cancelling the request if it has not finished.
+ *
+ * @param request Request handle. It should no longer be used after this call.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_release_c(llama_mobile_async_request_handle_t request);
+
 // Memory management functions
 
 /**
@@ -1564,6 +3440,14 @@ LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_is_conversation_active_c(llama_mobile_
  */
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_bench_result_members_c(llama_mobile_bench_result_c_t* result);
 
+/**
+ * @brief Free the members of a prefill benchmark result allocated by the FFI interface.
+ * 
+ * @param result Prefill benchmark result to free members of. The struct itself is not freed,
+ *               only the dynamically allocated model_name field.
+ */
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_bench_prefill_result_members_c(llama_mobile_bench_prefill_result_c_t* result);
+
 /**
  * @brief Free the members of a LoRA adapters array allocated by the FFI interface.
  * 
@@ -0,0 +1,244 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <string>
+
+namespace llama_mobile {
+
+bool llama_mobile_async_request::finished() const {
+    return state.load(std::memory_order_acquire) >= ASYNC_DONE;
+}
+
+bool llama_mobile_async_request::wait(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(done_mutex);
+    if (timeout_ms < 0) {
+        done_cv.wait(lock, [this] { return finished(); });
+        return true;
+    }
+    return done_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return finished(); });
+}
+
+llama_mobile_async_worker *llama_mobile_context::asyncWorker() {
+    if (async_worker == nullptr) {
+        llama_mobile_async_worker *worker = new llama_mobile_async_worker();
+        if (!worker->start(this)) {
+            delete worker;
+            return nullptr;
+        }
+        async_worker = worker;
+    }
+    return async_worker;
+}
+
+void llama_mobile_context::releaseAsync() {
+    if (async_worker != nullptr) {
+        delete async_worker;
+        async_worker = nullptr;
+    }
+}
+
+llama_mobile_async_worker::~llama_mobile_async_worker() {
+    shutdown();
+}
+
+bool llama_mobile_async_worker::start(llama_mobile_context *context_) {
+    if (context_ == nullptr || context_->ctx == nullptr || context_->model == nullptr) {
+        LOG_ERROR("Context or model not initialized, cannot start async worker.");
+        return false;
+    }
+    context = context_;
+    is_running = true;
+    worker = std::thread(&llama_mobile_async_worker::run, this);
+    return true;
+}
+
+int32_t llama_mobile_async_worker::submit(std::shared_ptr<llama_mobile_async_request> request) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (!is_running) {
+        return -1;
+    }
+    request->id = next_request_id++;
+    queue.push_back(request);
+    queue_cv.notify_one();
+    return request->id;
+}
+
+void llama_mobile_async_worker::shutdown() {
+    std::deque<std::shared_ptr<llama_mobile_async_request>> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!is_running) {
+            return;
+        }
+        is_running = false;
+        abandoned.swap(queue);
+        if (current) {
+            current->cancelled = true;
+        }
+        queue_cv.notify_one();
+    }
+    for (auto &request : abandoned) {
+        request->cancelled = true;
+        finish(*request, ASYNC_CANCELLED);
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void llama_mobile_async_worker::run() {
+    while (true) {
+        std::shared_ptr<llama_mobile_async_request> request;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !is_running || !queue.empty(); });
+            if (!is_running) {
+                return;
+            }
+            request = queue.front();
+            queue.pop_front();
+            current = request;
+        }
+
+        try {
+            if (request->cancelled.load(std::memory_order_relaxed)) {
+                finish(*request, ASYNC_CANCELLED);
+            } else {
+                process(*request);
+            }
+        } catch (const std::exception &e) {
+            LOG_ERROR("Async request %d failed: %s", request->id, e.what());
+            {
+                std::lock_guard<std::recursive_mutex> lock(context->state_mutex);
+                context->endCompletion();
+            }
+            finish(*request, ASYNC_FAILED);
+        }
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        current.reset();
+    }
+}
+
+bool llama_mobile_async_worker::pushPiece(llama_mobile_async_request &request, llama_token tok, const char *text, size_t length) {
+    llama_mobile_async_chunk chunk;
+    chunk.token = tok;
+    size_t offset = 0;
+    do {
+        const size_t n = std::min(length - offset, sizeof(chunk.text));
+        memcpy(chunk.text, text + offset, n);
+        chunk.length = (uint8_t)n;
+        offset += n;
+        chunk.partial = offset < length;
+
+        // A full ring means the host stopped polling, hold generation until it
+        // catches up rather than dropping tokens
+        while (!request.tokens.push(chunk)) {
+            if (request.cancelled.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    } while (offset < length);
+    return true;
+}
+
+void llama_mobile_async_worker::process(llama_mobile_async_request &request) {
+    llama_mobile_context &c = *context;
+    // A synchronous call already in progress on the handle finishes first, those that
+    // arrive while the request runs are turned away rather than racing it
+    std::lock_guard<std::recursive_mutex> lock(c.state_mutex);
+    request.state.store(ASYNC_RUNNING, std::memory_order_release);
+
+    if (request.select_lora && c.selectLoraAdapters(request.lora) != 0) {
+        LOG_ERROR("Failed to select LoRA adapters for async request %d", request.id);
+        finish(request, ASYNC_FAILED);
+        return;
+    }
+    c.rewind();
+    c.params.prompt = request.prompt;
+    c.params.n_predict = request.n_predict;
+    c.params.sampling = request.sampling;
+    c.params.antiprompt = request.antiprompt;
+    if (request.n_threads > 0) {
+        c.params.cpuparams.n_threads = request.n_threads;
+    }
+    if (!c.initSampling()) {
+        LOG_ERROR("Failed to initialize sampling for async request %d", request.id);
+        finish(request, ASYNC_FAILED);
+        return;
+    }
+    // A long prompt is prefilled in many chunks, let a cancel stop it between them
+    c.cancel_flag = &request.cancelled;
+    c.beginCompletion();
+    c.loadPrompt();
+
+    // Only this request's token is checked, so cancelling one request can never
+    // leak into the next one the way a shared is_interrupted flag would
+    int64_t t_first_token_us = 0;
+    size_t n_pushed = 0;
+    llama_token last_token = -1;
+    while (c.has_next_token && !request.cancelled.load(std::memory_order_relaxed)) {
+        const completion_token_output token_with_probs = c.doCompletion();
+        if (token_with_probs.tok == -1) {
+            continue;
+        }
+        if (t_first_token_us == 0) {
+            t_first_token_us = lm_ggml_time_us();
+        }
+        last_token = token_with_probs.tok;
+
+        // Hold back a possible stop word prefix, it is erased from the text if it completes
+        const size_t n_ready = c.has_next_token ? c.generated_text.size() - c.stop_matcher.partialLength() : c.generated_text.size();
+        if (n_ready <= n_pushed) {
+            continue;
+        }
+        if (!pushPiece(request, last_token, c.generated_text.data() + n_pushed, n_ready - n_pushed)) {
+            break;
+        }
+        n_pushed = n_ready;
+        if (request.notify) {
+            request.notify();
+        }
+    }
+    if (n_pushed < c.generated_text.size() && !request.cancelled.load(std::memory_order_relaxed)) {
+        pushPiece(request, last_token, c.generated_text.data() + n_pushed, c.generated_text.size() - n_pushed);
+    }
+
+    request.result.text = c.generated_text;
+    request.result.tokens_predicted = c.num_tokens_predicted;
+    request.result.tokens_evaluated = c.num_prompt_tokens;
+    request.result.truncated = c.truncated;
+    request.result.stopped_eos = c.stopped_eos;
+    request.result.stopped_word = c.stopped_word;
+    request.result.stopped_limit = c.stopped_limit;
+    request.result.stopping_word = c.stopping_word;
+    request.result.cancelled = request.cancelled.load(std::memory_order_relaxed);
+    if (c.spec_wrapper != nullptr) {
+        request.n_drafted = c.spec_wrapper->n_drafted;
+        request.n_draft_accepted = c.spec_wrapper->n_draft_accepted;
+    }
+    const double t_gen_s = t_first_token_us > 0 ? 1e-6 * (lm_ggml_time_us() - t_first_token_us) : 0.0;
+    if (request.result.tokens_predicted > 1 && t_gen_s > 0) {
+        request.tokens_per_second = (request.result.tokens_predicted - 1) / t_gen_s;
+    }
+    c.endCompletion();
+
+    finish(request, request.result.cancelled ? ASYNC_CANCELLED : ASYNC_DONE);
+}
+
+void llama_mobile_async_worker::finish(llama_mobile_async_request &request, llama_mobile_async_state state) {
+    {
+        std::lock_guard<std::mutex> lock(request.done_mutex);
+        request.state.store(state, std::memory_order_release);
+    }
+    request.done_cv.notify_all();
+    if (request.notify) {
+        request.notify();
+    }
+}
+
+} // namespace llama_mobile
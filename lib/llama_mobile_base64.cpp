@@ -0,0 +1,256 @@
+#include "llama_mobile.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LLAMA_MOBILE_BASE64_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define LLAMA_MOBILE_BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+namespace llama_mobile {
+
+// Values of the standard alphabet; whitespace is skipped, padding or any other
+// character ends the input, matching the decoder this replaces
+static const int8_t B64_INVALID = -1;
+static const int8_t B64_SPACE = -2;
+
+struct base64_table {
+    int8_t value[256];
+
+    base64_table() {
+        memset(value, B64_INVALID, sizeof(value));
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i) {
+            value[(uint8_t) alphabet[i]] = (int8_t) i;
+        }
+        for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+            value[(uint8_t) c] = B64_SPACE;
+        }
+    }
+};
+
+static const base64_table b64_table;
+
+// The vector kernels decode whole blocks of alphabet characters and stop at the first
+// block holding anything else, which the scalar loop then deals with. A block of
+// n chars turns into 3n/4 bytes, but the x86 kernels store a full register, so they
+// may write up to 8 bytes past the decoded data.
+typedef size_t (*base64_kernel)(const char *in, size_t n_blocks, uint8_t *out);
+
+#if defined(LLAMA_MOBILE_BASE64_X86)
+
+// Classification and translation with nibble lookups: a character is valid when the
+// masks of its low and high nibble share no bit, and the offset to add depends on its
+// high nibble, with '/' split off from '+'
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char *in, size_t n_blocks, uint8_t *out) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    const __m128i pack_shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t b = 0;
+    for (; b < n_blocks; ++b) {
+        __m128i str = _mm_loadu_si128((const __m128i *) (in + b * 16));
+        const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+            break;
+        }
+        const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+        const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+
+        // Four 6-bit values to 24 bits per 32-bit lane, then drop the top byte of each
+        const __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *) (out + b * 12), _mm_shuffle_epi8(packed, pack_shuffle));
+    }
+    return b;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(const char *in, size_t n_blocks, uint8_t *out) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack_shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lane_merge = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t b = 0;
+    for (; b < n_blocks; ++b) {
+        __m256i str = _mm256_loadu_si256((const __m256i *) (in + b * 32));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+        const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        const __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, pack_shuffle);
+        // 12 bytes in each 128-bit lane, moved next to each other
+        packed = _mm256_permutevar8x32_epi32(packed, lane_merge);
+        _mm256_storeu_si256((__m256i *) (out + b * 24), packed);
+    }
+    return b;
+}
+
+static base64_kernel base64_select_kernel(size_t &block) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        block = 32;
+        return base64_decode_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        block = 16;
+        return base64_decode_ssse3;
+    }
+    block = 0;
+    return nullptr;
+}
+
+#elif defined(LLAMA_MOBILE_BASE64_NEON)
+
+static inline bool base64_translate_neon(uint8x16_t &str) {
+    const uint8x16_t lut_lo = {0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                               0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A};
+    const uint8x16_t lut_hi = {0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10};
+    const uint8x16_t lut_roll = {0, 16, 19, 4, (uint8_t) -65, (uint8_t) -65, (uint8_t) -71, (uint8_t) -71,
+                                 0, 0, 0, 0, 0, 0, 0, 0};
+    const uint8x16_t hi_nibbles = vshrq_n_u8(str, 4);
+    const uint8x16_t lo_nibbles = vandq_u8(str, vdupq_n_u8(0x0f));
+    const uint8x16_t hi = vqtbl1q_u8(lut_hi, hi_nibbles);
+    const uint8x16_t lo = vqtbl1q_u8(lut_lo, lo_nibbles);
+    if (vmaxvq_u8(vandq_u8(lo, hi)) != 0) {
+        return false;
+    }
+    const uint8x16_t eq_2f = vceqq_u8(str, vdupq_n_u8(0x2f));
+    const uint8x16_t roll = vqtbl1q_u8(lut_roll, vaddq_u8(eq_2f, hi_nibbles));
+    str = vaddq_u8(str, roll);
+    return true;
+}
+
+// Deinterleaving loads and stores do the bit packing lane-wise, no shuffles needed
+static size_t base64_decode_neon(const char *in, size_t n_blocks, uint8_t *out) {
+    size_t b = 0;
+    for (; b < n_blocks; ++b) {
+        uint8x16x4_t str = vld4q_u8((const uint8_t *) (in + b * 64));
+        if (!base64_translate_neon(str.val[0]) || !base64_translate_neon(str.val[1]) ||
+            !base64_translate_neon(str.val[2]) || !base64_translate_neon(str.val[3])) {
+            break;
+        }
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(str.val[0], 2), vshrq_n_u8(str.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(str.val[1], 4), vshrq_n_u8(str.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(str.val[2], 6), str.val[3]);
+        vst3q_u8(out + b * 48, bytes);
+    }
+    return b;
+}
+
+static base64_kernel base64_select_kernel(size_t &block) {
+    block = 64;
+    return base64_decode_neon;
+}
+
+#else
+
+static base64_kernel base64_select_kernel(size_t &block) {
+    block = 0;
+    return nullptr;
+}
+
+#endif
+
+struct base64_dispatch {
+    size_t block = 0;
+    base64_kernel kernel = nullptr;
+
+    base64_dispatch() {
+        kernel = base64_select_kernel(block);
+    }
+};
+
+static const base64_dispatch b64_dispatch;
+
+size_t base64_decoded_size_max(size_t encoded_len) {
+    return (encoded_len + 3) / 4 * 3;
+}
+
+size_t base64_decode(std::string_view encoded, uint8_t *out) {
+    const char *in = encoded.data();
+    const size_t n = encoded.size();
+    const size_t block = b64_dispatch.block;
+
+    size_t i = 0;
+    size_t o = 0;
+    uint32_t acc = 0;
+    int n_acc = 0;
+
+    while (i < n) {
+        // One spare block after the ones handed to the kernel keeps its overlong stores
+        // inside base64_decoded_size_max(n)
+        if (n_acc == 0 && block != 0 && n - i >= 2 * block) {
+            size_t done = b64_dispatch.kernel(in + i, (n - i) / block - 1, out + o);
+            i += done * block;
+            o += done * block / 4 * 3;
+        }
+
+        const int8_t v = b64_table.value[(uint8_t) in[i]];
+        if (v < 0) {
+            if (v == B64_SPACE) {
+                i++;
+                continue;
+            }
+            break;
+        }
+        acc = (acc << 6) | (uint32_t) v;
+        n_acc++;
+        i++;
+        if (n_acc == 4) {
+            out[o++] = (uint8_t) (acc >> 16);
+            out[o++] = (uint8_t) (acc >> 8);
+            out[o++] = (uint8_t) acc;
+            acc = 0;
+            n_acc = 0;
+        }
+    }
+
+    // A trailing group of 2 or 3 characters carries 1 or 2 bytes
+    if (n_acc >= 2) {
+        acc <<= 6 * (4 - n_acc);
+        out[o++] = (uint8_t) (acc >> 16);
+        if (n_acc == 3) {
+            out[o++] = (uint8_t) (acc >> 8);
+        }
+    }
+    return o;
+}
+
+} // namespace llama_mobile
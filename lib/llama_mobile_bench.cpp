@@ -158,4 +158,127 @@ cleanup_and_exit:
     return result_str;
 }
 
+static void bench_stats(double sum, double sum_sq, int n, double &avg, double &std) {
+    avg = 0.0;
+    std = 0.0;
+    if (n <= 0) {
+        return;
+    }
+    avg = sum / n;
+    if (n > 1) {
+        double var = sum_sq / (n - 1) - avg * avg * n / (n - 1);
+        std = (var > 0) ? sqrt(var) : 0.0;
+    }
+}
+
+std::string llama_mobile_context::benchPrefill(int pp, int nr)
+{
+    if (is_predicting) {
+        LOG_ERROR("cannot benchmark while predicting", "");
+        return std::string("[]");
+    }
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for benchmarking.");
+        return std::string("[]");
+    }
+
+    pp = std::min(pp, n_ctx - 1);
+    if (pp <= 0 || nr <= 0) {
+        LOG_ERROR("Invalid prefill benchmark parameters: pp=%d, nr=%d", pp, nr);
+        return std::string("[]");
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    std::vector<llama_token> tokens(pp);
+    for (int k = 0; k < pp; ++k) {
+        tokens[k] = (llama_token)(k % n_vocab);
+    }
+
+    const int32_t n_predict_saved = params.n_predict;
+    rewind();
+    if (!initSampling()) {
+        params.n_predict = n_predict_saved;
+        return std::string("[]");
+    }
+    params.n_predict = 1;
+
+    LOG_INFO("Starting prefill benchmark: pp=%d, nr=%d, n_batch=%d", pp, nr, params.n_batch);
+
+    double engine_sum = 0.0, engine_sum_sq = 0.0;
+    double raw_sum = 0.0, raw_sum_sq = 0.0;
+    int valid_repetitions = 0;
+
+    for (int i = 0; i < nr && !is_interrupted; ++i)
+    {
+        // Completion path: the whole prompt is pending in embd, nextToken() ingests it
+        llama_memory_clear(llama_get_memory(ctx), true);
+        embd = tokens;
+        n_past = 0;
+        beginCompletion();
+
+        const int64_t t_engine_start = llama_time_us();
+        nextToken();
+        const int64_t t_engine_end = llama_time_us();
+        endCompletion();
+
+        if (n_past < (size_t)pp) {
+            LOG_ERROR("Prefill benchmark stopped early, n_past=%zu", n_past);
+            break;
+        }
+
+        // Baseline: the same tokens through raw llama_decode calls of n_batch tokens
+        llama_memory_clear(llama_get_memory(ctx), true);
+
+        const int64_t t_raw_start = llama_time_us();
+        bool raw_ok = true;
+        for (int pos = 0; pos < pp; pos += params.n_batch) {
+            const int n_eval = std::min(params.n_batch, pp - pos);
+            if (llama_decode(ctx, llama_batch_get_one(tokens.data() + pos, n_eval)) != 0) {
+                LOG_ERROR("llama_decode() failed during raw prefill benchmark", "");
+                raw_ok = false;
+                break;
+            }
+        }
+        llama_synchronize(ctx);
+        const int64_t t_raw_end = llama_time_us();
+
+        if (!raw_ok) {
+            break;
+        }
+
+        const double t_engine = (t_engine_end - t_engine_start) / 1000000.0;
+        const double t_raw = (t_raw_end - t_raw_start) / 1000000.0;
+        const double speed_engine = (t_engine > 0) ? (double)pp / t_engine : 0.0;
+        const double speed_raw = (t_raw > 0) ? (double)pp / t_raw : 0.0;
+
+        engine_sum += speed_engine;
+        engine_sum_sq += speed_engine * speed_engine;
+        raw_sum += speed_raw;
+        raw_sum_sq += speed_raw * speed_raw;
+        valid_repetitions++;
+    }
+
+    rewind();
+    llama_memory_clear(llama_get_memory(ctx), true);
+    params.n_predict = n_predict_saved;
+
+    double engine_avg, engine_std, raw_avg, raw_std;
+    bench_stats(engine_sum, engine_sum_sq, valid_repetitions, engine_avg, engine_std);
+    bench_stats(raw_sum, raw_sum_sq, valid_repetitions, raw_avg, raw_std);
+
+    char model_desc[128];
+    llama_model_desc(model, model_desc, sizeof(model_desc));
+    std::string result_str = "[\"" + std::string(model_desc) + "\"," +
+                             std::to_string(pp) + "," +
+                             std::to_string(params.n_batch) + "," +
+                             std::to_string(engine_avg) + "," +
+                             std::to_string(engine_std) + "," +
+                             std::to_string(raw_avg) + "," +
+                             std::to_string(raw_std) +
+                             "]";
+    LOG_INFO("Prefill benchmark finished. Result: %s", result_str.c_str());
+    return result_str;
+}
+
 } // namespace llama_mobile
\ No newline at end of file
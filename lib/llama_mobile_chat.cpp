@@ -55,14 +55,12 @@ common_chat_params llama_mobile_context::getFormattedChatWithJinja(
     }
 }
 
-std::string llama_mobile_context::getFormattedChat(
+std::string format_chat(
+  const llama_model *model,
+  const common_chat_templates *templates,
   const std::string &messages,
   const std::string &chat_template
-) const {
-    if (!model || !templates) {
-         LOG_ERROR("Model or templates not loaded, cannot format chat.");
-         return ""; 
-    }
+) {
     common_chat_templates_inputs inputs;
     inputs.use_jinja = false;
      try {
@@ -81,11 +79,22 @@ std::string llama_mobile_context::getFormattedChat(
              return common_chat_templates_apply(tmps.get(), inputs).prompt;
          } catch (const std::exception& e) {
              LOG_ERROR("Error applying custom chat template: %s", e.what());
-             return common_chat_templates_apply(templates.get(), inputs).prompt;
+             return common_chat_templates_apply(templates, inputs).prompt;
          }
     } else {
-        return common_chat_templates_apply(templates.get(), inputs).prompt;
+        return common_chat_templates_apply(templates, inputs).prompt;
+    }
+}
+
+std::string llama_mobile_context::getFormattedChat(
+  const std::string &messages,
+  const std::string &chat_template
+) const {
+    if (!model || !templates) {
+         LOG_ERROR("Model or templates not loaded, cannot format chat.");
+         return ""; 
     }
+    return format_chat(model, templates.get(), messages, chat_template);
 }
 
 } // namespace llama_mobile 
\ No newline at end of file
@@ -74,6 +74,37 @@ void llama_mobile_context::loadPrompt() {
         n_past--;
     }
 
+    discardSpeculative();
+    if (spec_wrapper != nullptr) {
+        spec_wrapper->ngram_cache.clear();
+        spec_wrapper->ngram_n_tokens = 0;
+    }
+
+    prefix_cache_pending.clear();
+    if (prefix_cache.enabled() && num_prompt_tokens > 0) {
+        // A cached snapshot longer than what is already in the KV cache replaces it,
+        // at least one prompt token is always left to evaluate for fresh logits
+        bool cleared = false;
+        const size_t restored = prefix_cache.restore(ctx, 0, embd, n_past, num_prompt_tokens - 1, cleared);
+        if (restored > 0) {
+            n_past = restored;
+        } else if (cleared) {
+            n_past = 0;
+        }
+
+        std::vector<size_t> boundaries(prefix_cache.params.boundaries.begin(), prefix_cache.params.boundaries.end());
+        if (prefix_cache.params.snapshot_prompt_end) {
+            boundaries.push_back(num_prompt_tokens - 1);
+        }
+        std::sort(boundaries.begin(), boundaries.end());
+        for (size_t b : boundaries) {
+            if (b > n_past && b < num_prompt_tokens && (prefix_cache_pending.empty() || prefix_cache_pending.back() != b) &&
+                !prefix_cache.contains(embd, b)) {
+                prefix_cache_pending.push_back(b);
+            }
+        }
+    }
+
     // Only clear KV cache beyond the common part
     // This preserves cache for the common prefix
     if (n_past < (int)embd.size()) {
@@ -104,8 +135,10 @@ void llama_mobile_context::loadPrompt(const std::vector<std::string> &media_path
         throw std::runtime_error("Multimodal is not enabled but media paths are provided");
     }
 
+    discardSpeculative();
     processMedia(params.prompt, media_paths);
     num_prompt_tokens = embd.size();
+    prefix_cache_pending.clear();
 
     if (params.n_keep < 0) {
         params.n_keep = (int)num_prompt_tokens;
@@ -123,37 +156,19 @@ void llama_mobile_context::loadPrompt(const std::vector<std::string> &media_path
 }
 
 void llama_mobile_context::beginCompletion() {
+    discardSpeculative();
     n_remain = params.n_predict;
+    stop_matcher.build(params.antiprompt);
+    stop_matcher.reset(generated_text.size());
     llama_perf_context_reset(ctx);
     is_predicting = true;
 }
 
-completion_token_output llama_mobile_context::nextToken()
+// Evaluates the tokens of embd not yet in sequence 0, in n_batch chunks cut at prefix
+// cache boundaries. i_logits becomes the batch index of the last token's logits when it
+// is evaluated here. Returns false when decoding failed or was interrupted.
+bool llama_mobile_context::evalPending(bool &tg, int32_t &i_logits)
 {
-    completion_token_output result;
-    result.tok = -1;
-
-    if (embd.size() >= (size_t)params.n_ctx)
-    {
-        const int n_left    = n_past - params.n_keep - 1;
-        const int n_discard = n_left/2;
-
-        llama_memory_seq_rm (llama_get_memory(ctx), 0, params.n_keep + 1            , params.n_keep + n_discard + 1);
-        llama_memory_seq_add(llama_get_memory(ctx), 0, params.n_keep + 1 + n_discard, n_past, -n_discard);
-
-        for (size_t i = params.n_keep + 1 + n_discard; i < embd.size(); i++)
-        {
-            embd[i - n_discard] = embd[i];
-        }
-        embd.resize(embd.size() - n_discard);
-
-        n_past -= n_discard;
-        truncated = true;
-
-        LOG_VERBOSE("context shifted, new n_past: %d, new size: %zu", n_past, embd.size());
-    }
-
-    bool tg = true;
     while ((size_t)n_past < embd.size())
     {
         int n_eval = (int)embd.size() - n_past;
@@ -162,15 +177,30 @@ completion_token_output llama_mobile_context::nextToken()
         {
             n_eval = params.n_batch;
         }
-        // Always evaluate one token at a time for reliable logits access during sampling
-        n_eval = 1;
+
+        // Stop the chunk at the next prefix cache boundary so the sequence holds
+        // exactly that prefix when it is snapshotted
+        while (!prefix_cache_pending.empty() && prefix_cache_pending.front() <= n_past) {
+            prefix_cache_pending.erase(prefix_cache_pending.begin());
+        }
+        if (!prefix_cache_pending.empty() && n_past + n_eval > prefix_cache_pending.front()) {
+            n_eval = (int)(prefix_cache_pending.front() - n_past);
+        }
 
         if (n_eval <= 0) {
             LOG_WARNING("No tokens to evaluate (n_eval=%d)", n_eval);
             break;
         }
 
-        if (llama_decode(ctx, llama_batch_get_one(&embd[n_past], n_eval)) != 0)
+        // Only the final token of the pending span needs logits, intermediate
+        // chunks of a long prompt are evaluated purely to fill the KV cache
+        const bool is_last_chunk = (size_t)(n_past + n_eval) == embd.size();
+        llama_batch_clear(&batch);
+        for (int i = 0; i < n_eval; ++i) {
+            llama_batch_add(&batch, embd[n_past + i], n_past + i, {0}, is_last_chunk && i == n_eval - 1);
+        }
+
+        if (llama_decode(ctx, batch) != 0)
         {
             LOG_ERROR("failed to eval, n_eval: %d, n_past: %d, n_threads: %d, embd_size: %zu",
                 n_eval,
@@ -178,17 +208,65 @@ completion_token_output llama_mobile_context::nextToken()
                 params.cpuparams.n_threads,
                 embd.size()
             );
-            has_next_token = false;
-            return result;
+            return false;
         }
         n_past += n_eval;
+        if (is_last_chunk) {
+            i_logits = batch.n_tokens - 1;
+        }
+        if (!prefix_cache_pending.empty() && prefix_cache_pending.front() == n_past) {
+            prefix_cache.snapshot(ctx, 0, embd, n_past);
+            prefix_cache_pending.erase(prefix_cache_pending.begin());
+        }
 
-        if(is_interrupted) {
+        if(is_interrupted || (cancel_flag != nullptr && cancel_flag->load(std::memory_order_relaxed))) {
             LOG_INFO("Decoding Interrupted");
             embd.resize(n_past);
+            return false;
+        }
+    }
+    return true;
+}
+
+completion_token_output llama_mobile_context::nextToken()
+{
+    completion_token_output result;
+    result.tok = -1;
+
+    if (spec_wrapper != nullptr && (!spec_wrapper->accepted.empty() || speculativeStep())) {
+        // Tokens verified by a speculative step were sampled and accepted already and,
+        // apart from the last one, sit in the KV cache
+        n_past = embd.size();
+        result.tok = spec_wrapper->accepted.front();
+        spec_wrapper->accepted.pop_front();
+        num_tokens_predicted++;
+
+        embd.push_back(result.tok);
+        if (n_remain > 0) {
+            --n_remain;
+        }
+        // Any end-of-generation token ends the turn, not only EOS
+        if (llama_vocab_is_eog(llama_model_get_vocab(model), result.tok)) {
+            discardSpeculative();
             has_next_token = false;
+            stopped_eos = true;
             return result;
         }
+        has_next_token = params.n_predict == -1 || n_remain > 0;
+        return result;
+    }
+
+    if (embd.size() >= (size_t)n_ctx && !shiftContext())
+    {
+        has_next_token = false;
+        return result;
+    }
+
+    bool tg = true;
+    int32_t i_logits = -1;
+    if (!evalPending(tg, i_logits)) {
+        has_next_token = false;
+        return result;
     }
 
     if (!model) {
@@ -211,11 +289,9 @@ completion_token_output llama_mobile_context::nextToken()
     }
 
     {
-        std::vector<llama_token_data> candidates;
-        candidates.reserve(llama_vocab_n_tokens(vocab));
-
-        // Use index 0 to reliably access the most recent logits
-        llama_token new_token_id = common_sampler_sample(ctx_sampling, ctx, 0);
+        // i_logits is the batch index of the last decoded token, or -1 (last output)
+        // when the logits were produced elsewhere, e.g. by processMedia
+        llama_token new_token_id = common_sampler_sample(ctx_sampling, ctx, i_logits);
 
         if (next_token_uses_guide_token && !guide_tokens.empty() && 
             !llama_vocab_is_control(vocab, new_token_id) && 
@@ -226,15 +302,17 @@ completion_token_output llama_mobile_context::nextToken()
         next_token_uses_guide_token = (new_token_id == 198);
         result.tok = new_token_id;
 
-        llama_token_data_array cur_p = *common_sampler_get_candidates(ctx_sampling, true);
-
+        // Sorting the candidates is only needed to report the most probable ones
         const int32_t n_probs = params.sampling.n_probs;
-        const size_t vocab_size = llama_vocab_n_tokens(vocab);
+        if (n_probs > 0) {
+            llama_token_data_array cur_p = *common_sampler_get_candidates(ctx_sampling, true);
+            const int32_t vocab_size = llama_vocab_n_tokens(vocab);
 
-        for (size_t i = 0; i < std::min((size_t)cur_p.size, (size_t)n_probs); ++i)
-        {
-            if (cur_p.data[i].id < vocab_size) {
-                 result.probs.push_back({cur_p.data[i].id, cur_p.data[i].p});
+            for (size_t i = 0; i < std::min((size_t)cur_p.size, (size_t)n_probs); ++i)
+            {
+                if (cur_p.data[i].id >= 0 && cur_p.data[i].id < vocab_size) {
+                     result.probs.push_back({cur_p.data[i].id, cur_p.data[i].p});
+                }
             }
         }
 
@@ -249,7 +327,7 @@ completion_token_output llama_mobile_context::nextToken()
         --n_remain;
     }
 
-    if (!embd.empty() && embd.back() == llama_vocab_eos(vocab))
+    if (!embd.empty() && llama_vocab_is_eog(vocab, embd.back()))
     {
         has_next_token = false;
         stopped_eos = true;
@@ -264,42 +342,27 @@ completion_token_output llama_mobile_context::nextToken()
 size_t llama_mobile_context::findStoppingStrings(const std::string &text, const size_t last_token_size,
                             const stop_type type)
 {
-    size_t stop_pos = std::string::npos;
+    // Only queries the automaton, a completion in progress keeps streaming through it.
+    // During one it was built from the same stop words by beginCompletion()
+    if (!is_predicting) {
+        stop_matcher.build(params.antiprompt);
+    }
 
-    for (const std::string &word : params.antiprompt)
+    if (type == STOP_PARTIAL)
     {
-        if (word.empty()) continue;
-
-        size_t pos;
-        if (type == STOP_FULL)
-        {
-            size_t from_pos = 0;
-            size_t tmp_len = word.size() + last_token_size;
-            if (text.size() > tmp_len) {
-                from_pos = text.size() - tmp_len;
-            }
-            pos = text.find(word, from_pos);
-        }
-        else
-        {
-             pos = llama_mobile::find_partial_stop_string(word, text);
-        }
+        return stop_matcher.findPartial(text);
+    }
 
-        if (pos != std::string::npos)
-        {
-            if (stop_pos == std::string::npos || pos < stop_pos)
-            {
-                stop_pos = pos;
-                if (type == STOP_FULL)
-                {
-                    stopping_word = word;
-                    stopped_word = true;
-                    has_next_token = false;
-                }
-            }
-        }
+    const size_t from_pos = text.size() > last_token_size ? text.size() - last_token_size : 0;
+    int32_t word = -1;
+    const size_t stop_pos = stop_matcher.findFull(text, from_pos, word);
+    if (stop_pos != std::string::npos)
+    {
+        stopping_word = stop_matcher.words[word];
+        stopped_word = true;
+        has_next_token = false;
     }
-        return stop_pos;
+    return stop_pos;
 }
 
 completion_token_output llama_mobile_context::doCompletion()
@@ -316,11 +379,22 @@ completion_token_output llama_mobile_context::doCompletion()
     }
     generated_text += token_text;
 
+    int32_t stop_word = -1;
+    const size_t stop_pos = stop_matcher.feed(token_text.data(), token_text.size(), stop_word);
+    if (stop_pos != std::string::npos)
+    {
+        generated_text.erase(std::min(stop_pos, generated_text.size()));
+        stopping_word = stop_matcher.words[stop_word];
+        stopped_word = true;
+        has_next_token = false;
+    }
+
     if (isVocoderEnabled()) {
         tts_type type = getTTSType();
         if ((type == TTS_OUTETTS_V0_2 || type == TTS_OUTETTS_V0_3) && 
             (token_with_probs.tok >= 151672 && token_with_probs.tok <= 155772)) {
             audio_tokens.push_back(token_with_probs.tok);
+            pushAudioCode(token_with_probs.tok);
         }
     }
 
@@ -357,7 +431,7 @@ completion_token_output llama_mobile_context::doCompletion()
          }
     }
 
-    if (incomplete && !has_next_token)
+    if (incomplete && !has_next_token && !stopped_word)
     {
         has_next_token = true;
         if (params.n_predict != -1) {
@@ -385,4 +459,152 @@ completion_token_output llama_mobile_context::doCompletion()
     return token_with_probs;
 }
 
+std::vector<completion_branch_result> llama_mobile_context::completeBranches(int n_branches)
+{
+    std::vector<completion_branch_result> results;
+    if (n_branches < 1 || n_branches > (int)llama_n_seq_max(ctx) || n_branches > params.n_batch) {
+        LOG_ERROR("Cannot generate %d branches, the context has %u sequences and a batch of %d tokens",
+            n_branches, llama_n_seq_max(ctx), params.n_batch);
+        has_next_token = false;
+        return results;
+    }
+
+    bool tg = true;
+    int32_t i_logits = -1;
+    if (!evalPending(tg, i_logits)) {
+        has_next_token = false;
+        return results;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    llama_memory_t mem = llama_get_memory(ctx);
+    const size_t n_prompt = embd.size();
+
+    struct branch_state {
+        common_sampler_ptr smpl_clone;
+        common_sampler *smpl = nullptr;
+        llama_mobile_stop_matcher stop_matcher;
+        std::vector<llama_token> tokens;
+        size_t n_decoded = 0;
+        int32_t i_batch = -1;
+        bool active = true;
+    };
+
+    // Sequence 0 and ctx_sampling carry branch 0 as they would a single completion. The
+    // others share the prompt's cells through llama_memory_seq_cp and sample with clones
+    // of ctx_sampling that draw their own random numbers.
+    std::vector<branch_state> branches(n_branches);
+    results.resize(n_branches);
+    for (int b = 0; b < n_branches; ++b) {
+        branch_state &branch = branches[b];
+        if (b == 0) {
+            branch.smpl = ctx_sampling;
+        } else {
+            const uint32_t seed = params.sampling.seed == LLAMA_DEFAULT_SEED ? LLAMA_DEFAULT_SEED : params.sampling.seed + b;
+            branch.smpl_clone.reset(common_sampler_clone_seeded(ctx_sampling, model, seed));
+            branch.smpl = branch.smpl_clone.get();
+            llama_memory_seq_rm(mem, b, -1, -1);
+            llama_memory_seq_cp(mem, 0, b, -1, -1);
+        }
+        branch.stop_matcher = stop_matcher;
+        branch.stop_matcher.reset();
+        branch.i_batch = i_logits;
+    }
+
+    // The prompt is stored once, every step then takes one cell per active branch
+    const size_t n_ctx_seq = llama_n_ctx_seq(ctx);
+    const size_t n_free = n_ctx_seq > n_prompt ? n_ctx_seq - n_prompt : 0;
+    const size_t n_steps_max = params.kv_unified ? n_free / n_branches : n_free;
+
+    size_t n_active = n_branches;
+    for (size_t step = 0; n_active > 0 && !is_interrupted; ++step) {
+        llama_batch_clear(&batch);
+        for (int b = 0; b < n_branches; ++b) {
+            branch_state &branch = branches[b];
+            completion_branch_result &result = results[b];
+            if (!branch.active) {
+                continue;
+            }
+
+            const llama_token id = common_sampler_sample(branch.smpl, ctx, branch.i_batch);
+            common_sampler_accept(branch.smpl, id, true);
+            branch.tokens.push_back(id);
+            result.tokens_predicted++;
+
+            bool done = false;
+            if (llama_vocab_is_eog(vocab, id)) {
+                result.stopped_eos = true;
+                done = true;
+            } else {
+                const std::string piece = common_token_to_piece(ctx, id);
+                result.text += piece;
+
+                int32_t stop_word = -1;
+                const size_t stop_pos = branch.stop_matcher.feed(piece.data(), piece.size(), stop_word);
+                if (stop_pos != std::string::npos) {
+                    result.text.erase(std::min(stop_pos, result.text.size()));
+                    result.stopping_word = branch.stop_matcher.words[stop_word];
+                    result.stopped_word = true;
+                    done = true;
+                } else if (params.n_predict >= 0 && result.tokens_predicted >= params.n_predict) {
+                    result.stopped_limit = true;
+                    done = true;
+                } else if (step + 1 >= n_steps_max) {
+                    result.truncated = true;
+                    result.stopped_limit = true;
+                    done = true;
+                }
+            }
+
+            if (done) {
+                branch.active = false;
+                n_active--;
+                continue;
+            }
+            branch.i_batch = batch.n_tokens;
+            llama_batch_add(&batch, id, n_prompt + step, {b}, true);
+        }
+
+        if (batch.n_tokens == 0) {
+            break;
+        }
+        if (llama_decode(ctx, batch) != 0) {
+            LOG_ERROR("failed to decode %d branches at position %zu", batch.n_tokens, n_prompt + step);
+            for (int b = 0; b < n_branches; ++b) {
+                if (branches[b].active) {
+                    results[b].truncated = true;
+                    results[b].stopped_limit = true;
+                    branches[b].active = false;
+                }
+            }
+            break;
+        }
+        for (auto &branch : branches) {
+            if (branch.active) {
+                branch.n_decoded++;
+            }
+        }
+    }
+
+    for (int b = 1; b < n_branches; ++b) {
+        llama_memory_seq_rm(mem, b, -1, -1);
+    }
+
+    // The context is left as after a plain completion that produced branch 0
+    const branch_state &main_branch = branches[0];
+    const completion_branch_result &main_result = results[0];
+    llama_memory_seq_rm(mem, 0, n_prompt + main_branch.n_decoded, -1);
+    embd.insert(embd.end(), main_branch.tokens.begin(), main_branch.tokens.end());
+    n_past = n_prompt + main_branch.n_decoded;
+    generated_text = main_result.text;
+    num_tokens_predicted = main_result.tokens_predicted;
+    stopped_eos = main_result.stopped_eos;
+    stopped_word = main_result.stopped_word;
+    stopped_limit = main_result.stopped_limit;
+    stopping_word = main_result.stopping_word;
+    has_next_token = false;
+
+    return results;
+}
+
 } // namespace llama_mobile
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "llama_mobile.h"
 #include "llama_cpp/common.h"
+#include "llama_cpp/json-schema-to-grammar.h"
+#include "llama_cpp/llama-grammar.h"
 #include "llama_cpp/nlohmann/json.hpp"
 
 using json = nlohmann::ordered_json;
@@ -7,10 +9,17 @@ using json = nlohmann::ordered_json;
 namespace llama_mobile {
 
 llama_mobile_context::~llama_mobile_context() {
+    // The worker drives this context, stop it before anything it uses is freed
+    releaseAsync();
     if (ctx_sampling != nullptr) {
         common_sampler_free(ctx_sampling);
         ctx_sampling = nullptr;
     }
+    if (batch.token != nullptr) {
+        llama_batch_free(batch);
+        batch = {};
+    }
+    releaseSpeculative();
     releaseMultimodal();
     releaseVocoder();
 }
@@ -27,10 +36,13 @@ void llama_mobile_context::rewind() {
     generated_token_probs.clear();
     truncated = false;
     context_full = false;
+    n_context_shifts = 0;
+    n_tokens_discarded = 0;
     stopped_eos = false;
     stopped_word = false;
     stopped_limit = false;
     stopping_word = "";
+    stop_matcher.reset();
     incomplete = false;
     n_remain = 0;
     n_past = 0;
@@ -39,33 +51,65 @@ void llama_mobile_context::rewind() {
     guide_tokens.clear();
     mtmd_bitmap_past_hashes.clear();
     audio_tokens.clear();
+    if (tts_pipeline != nullptr) {
+        tts_pipeline->clear();
+    }
+    tts_stream = llama_mobile_tts_stream();
+    if (spec_wrapper != nullptr) {
+        spec_wrapper->accepted.clear();
+        spec_wrapper->n_drafted = 0;
+        spec_wrapper->n_draft_accepted = 0;
+    }
     if (ctx_sampling) {
     }
 }
 
 bool llama_mobile_context::initSampling() {
-    if (ctx_sampling != nullptr) {
-        common_sampler_free(ctx_sampling);
-        ctx_sampling = nullptr;
-    }
-    if (model) {
-        ctx_sampling = common_sampler_init(model, params.sampling);
-        if (ctx_sampling) {
-             params.sampling.n_prev = n_ctx;
-        }
-    } else {
+    if (!model) {
         LOG_ERROR("Cannot initialize sampling context: model is not loaded.");
         return false;
     }
+    // The history covers the whole context, so it is sized before the sampler is built
+    params.sampling.n_prev = n_ctx;
+    if (ctx_sampling != nullptr) {
+        // Every request and conversation turn lands here; reconfiguring keeps the grammar,
+        // the unchanged samplers and the buffers instead of building them all again
+        common_sampler_reconfigure(ctx_sampling, model, params.sampling);
+    } else {
+        ctx_sampling = common_sampler_init(model, params.sampling);
+    }
     return ctx_sampling != nullptr;
 }
 
+llama_mobile_grammar_cache_stats grammar_cache_stats() {
+    const common_schema_cache_stats schemas = json_schema_to_grammar_cache_stats();
+    const llama_grammar_cache_stats grammars = llama_grammar_cache_get_stats();
+    llama_mobile_grammar_cache_stats stats;
+    stats.schema_hits = schemas.hits;
+    stats.schema_misses = schemas.misses;
+    stats.grammar_hits = grammars.hits;
+    stats.grammar_misses = grammars.misses;
+    stats.evictions = schemas.evictions + grammars.evictions;
+    stats.n_schemas = schemas.n_entries;
+    stats.n_grammars = grammars.n_entries;
+    stats.mask_bytes = grammars.mask_bytes;
+    return stats;
+}
+
+void grammar_cache_clear() {
+    json_schema_to_grammar_cache_clear();
+    llama_grammar_cache_clear(nullptr);
+}
+
 void llama_mobile_context::setGuideTokens(const std::vector<llama_token> &tokens) {
     guide_tokens = tokens;
 }
 
 void llama_mobile_context::endCompletion() {
+    discardSpeculative();
     is_predicting = false;
+    // The flag belongs to an async request that may be freed once it finishes
+    cancel_flag = nullptr;
 }
 
 std::string llama_mobile_context::generateResponse(const std::string &user_message, int max_tokens) {
@@ -143,9 +187,7 @@ conversation_result llama_mobile_context::continueConversation(const std::string
         
         // Set up generation parameters
         params.n_predict = max_tokens;
-        n_remain = max_tokens;
         has_next_token = true;
-        is_predicting = true;
         generated_text.clear();
         
         // Initialize sampling if needed
@@ -154,6 +196,9 @@ conversation_result llama_mobile_context::continueConversation(const std::string
             return {"", std::chrono::milliseconds(0), std::chrono::milliseconds(0), 0};
         }
         
+        // Restarts the stop matcher on the new reply, it still held the last one's state
+        beginCompletion();
+        
         // Accept the new tokens in the sampler
         for (auto token : new_tokens) {
             common_sampler_accept(ctx_sampling, token, false);
@@ -0,0 +1,147 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <vector>
+#include <string>
+
+namespace llama_mobile {
+
+// Tokens that open a message in the common chat templates
+static const char *const default_turn_markers[] = {
+    "<|im_start|>",
+    "<start_of_turn>",
+    "<|start_header_id|>",
+    "<|system|>",
+    "<|user|>",
+    "<|assistant|>",
+    "[INST]",
+};
+
+bool llama_mobile_context::configureContextShift(const llama_mobile_context_shift_params &shift_params) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized, cannot configure context shift.");
+        return false;
+    }
+    if (shift_params.keep_turns < 0 || shift_params.n_free < 0 || shift_params.n_free >= n_ctx) {
+        LOG_ERROR("Invalid context shift parameters: keep_turns=%d, n_free=%d", shift_params.keep_turns, shift_params.n_free);
+        return false;
+    }
+    context_shift = shift_params;
+
+    // A marker only counts when it is a single token, so a turn boundary is one
+    // position in embd rather than a sequence that could be split by a shift
+    std::vector<std::string> markers = shift_params.turn_markers;
+    if (markers.empty()) {
+        markers.assign(std::begin(default_turn_markers), std::end(default_turn_markers));
+    }
+    turn_tokens.clear();
+    for (const std::string &marker : markers) {
+        const std::vector<llama_token> tokens = common_tokenize(ctx, marker, false, true);
+        if (tokens.size() == 1 && std::find(turn_tokens.begin(), turn_tokens.end(), tokens[0]) == turn_tokens.end()) {
+            turn_tokens.push_back(tokens[0]);
+        }
+    }
+
+    if (turn_tokens.empty() && shift_params.policy != CONTEXT_SHIFT_HALF && shift_params.policy != CONTEXT_SHIFT_NONE) {
+        LOG_WARNING("No turn marker is a single token for this model, context shifts will drop half of the history");
+    }
+    LOG_INFO("Context shift configured: policy=%d, keep_turns=%d, n_free=%d, turn tokens=%zu",
+        context_shift.policy, context_shift.keep_turns, context_shift.n_free, turn_tokens.size());
+    return true;
+}
+
+bool llama_mobile_context::shiftContext() {
+    if (context_shift.policy == CONTEXT_SHIFT_NONE) {
+        LOG_WARNING("Context is full and shifting is disabled, stopping generation");
+        context_full = true;
+        return false;
+    }
+
+    const size_t n_free = context_shift.n_free > 0 ? (size_t)context_shift.n_free : (size_t)n_ctx / 4;
+
+    // Turn boundaries are rescanned on every shift; shifts are at least n_free tokens
+    // apart, so this stays amortized constant per generated token
+    std::vector<size_t> turns;
+    if (!turn_tokens.empty() && context_shift.policy != CONTEXT_SHIFT_HALF) {
+        for (size_t i = 0; i < n_past; ++i) {
+            if (std::find(turn_tokens.begin(), turn_tokens.end(), embd[i]) != turn_tokens.end()) {
+                turns.push_back(i);
+            }
+        }
+    }
+
+    // Everything before n_protect survives: n_keep plus BOS, and the first message
+    // (usually the system prompt) when requested
+    size_t n_protect = std::min((size_t)std::max(params.n_keep, 0) + 1, n_past);
+    if (context_shift.keep_first_turn && turns.size() >= 2) {
+        n_protect = std::max(n_protect, turns[1]);
+    }
+    auto next_turn = [&](size_t from) -> size_t {
+        for (size_t t : turns) {
+            if (t >= from && t > n_protect) {
+                return t;
+            }
+        }
+        return 0;
+    };
+
+    size_t n_discard = 0;
+    if (context_shift.policy == CONTEXT_SHIFT_DROP_OLDEST_TURNS) {
+        const size_t end = next_turn(n_protect + n_free);
+        if (end > 0) {
+            n_discard = end - n_protect;
+        }
+    } else if (context_shift.policy == CONTEXT_SHIFT_KEEP_LAST_TURNS) {
+        std::vector<size_t> later;
+        for (size_t t : turns) {
+            if (t > n_protect) {
+                later.push_back(t);
+            }
+        }
+        if (later.size() > (size_t)context_shift.keep_turns) {
+            n_discard = later[later.size() - context_shift.keep_turns] - n_protect;
+        }
+        if (n_discard < n_free) {
+            // The kept turns alone do not leave enough room, drop whole turns from
+            // the front until they do
+            const size_t end = next_turn(n_protect + n_free);
+            n_discard = end > 0 ? end - n_protect : 0;
+        }
+    }
+    if (n_discard == 0 && n_past > n_protect) {
+        n_discard = (n_past - n_protect) / 2;
+    }
+    if (n_discard == 0) {
+        LOG_WARNING("Nothing left to discard after the protected prefix of %zu tokens", n_protect);
+        context_full = true;
+        return false;
+    }
+
+    llama_memory_t mem = llama_get_memory(ctx);
+    if (llama_memory_can_shift(mem)) {
+        llama_memory_seq_rm (mem, 0, n_protect, n_protect + n_discard);
+        llama_memory_seq_add(mem, 0, n_protect + n_discard, n_past, -(llama_pos)n_discard);
+        n_past -= n_discard;
+    } else {
+        // Positions cannot be moved in this cache, evaluate the kept tail again
+        llama_memory_seq_rm(mem, 0, n_protect, -1);
+        n_past = n_protect;
+    }
+    embd.erase(embd.begin() + n_protect, embd.begin() + n_protect + n_discard);
+
+    truncated = true;
+    prefix_cache_pending.clear();
+    if (spec_wrapper != nullptr) {
+        spec_wrapper->ngram_cache.clear();
+        spec_wrapper->ngram_n_tokens = 0;
+    }
+    n_context_shifts++;
+    n_tokens_discarded += n_discard;
+
+    LOG_VERBOSE("context shifted, protected: %zu, discarded: %zu, new n_past: %zu, new size: %zu",
+        n_protect, n_discard, n_past, embd.size());
+    return true;
+}
+
+} // namespace llama_mobile
@@ -1,6 +1,7 @@
 #include "llama_mobile.h"
 #include "llama_cpp/common.h"
 #include "llama_cpp/llama.h"
+#include <algorithm>
 #include <vector>
 #include <cstdio>
 
@@ -41,4 +42,87 @@ std::vector<float> llama_mobile_context::getEmbedding(common_params &embd_params
     return out;
 }
 
+int llama_mobile_context::getEmbeddingBatch(const std::vector<std::string> &texts, float *out)
+{
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for embedding generation.");
+        return -1;
+    }
+    if (!params.embedding || llama_pooling_type(ctx) == LLAMA_POOLING_TYPE_NONE) {
+        LOG_ERROR("Batched embeddings need an embedding context with pooling enabled.");
+        return -1;
+    }
+    if (is_predicting) {
+        LOG_ERROR("Cannot compute embeddings while a completion is running.");
+        return -1;
+    }
+
+    const int n_embd = llama_model_n_embd(model);
+    const int n_seq_max = (int)llama_n_seq_max(ctx);
+    // Non-causal models need every sequence inside one ubatch
+    const int n_tokens_max = std::min(params.n_batch, (int)llama_n_ubatch(ctx));
+    const bool use_encode = llama_model_has_encoder(model) && !llama_model_has_decoder(model);
+    llama_memory_t mem = llama_get_memory(ctx);
+
+    // The batch overwrites the KV cache, anything cached for completions is gone
+    rewind();
+    prefix_cache_pending.clear();
+
+    size_t first = 0;
+    int n_seq = 0;
+    llama_batch_clear(&batch);
+
+    auto flush = [&](size_t end) -> bool {
+        if (n_seq == 0) {
+            return true;
+        }
+        if (mem) {
+            llama_memory_clear(mem, true);
+        }
+        const int ret = use_encode ? llama_encode(ctx, batch) : llama_decode(ctx, batch);
+        if (ret != 0) {
+            LOG_ERROR("Failed to evaluate embedding batch of %d sequences, ret=%d", n_seq, ret);
+            return false;
+        }
+        for (size_t i = first; i < end; ++i) {
+            float *dst = out + i * n_embd;
+            const float *data = llama_get_embeddings_seq(ctx, (llama_seq_id)(i - first));
+            if (data == nullptr) {
+                std::fill(dst, dst + n_embd, 0.0f);
+            } else {
+                common_embd_normalize(data, dst, n_embd, params.embd_normalize);
+            }
+        }
+        llama_batch_clear(&batch);
+        first = end;
+        n_seq = 0;
+        return true;
+    };
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+        std::vector<llama_token> tokens = common_tokenize(ctx, texts[i], true, true);
+        if ((int)tokens.size() > n_tokens_max) {
+            LOG_WARNING("Embedding input %zu truncated from %zu to %d tokens", i, tokens.size(), n_tokens_max);
+            tokens.resize(n_tokens_max);
+        }
+        if (n_seq == n_seq_max || batch.n_tokens + (int)tokens.size() > n_tokens_max) {
+            if (!flush(i)) {
+                return -2;
+            }
+        }
+        for (size_t j = 0; j < tokens.size(); ++j) {
+            llama_batch_add(&batch, tokens[j], j, {n_seq}, true);
+        }
+        n_seq++;
+    }
+    if (!flush(texts.size())) {
+        return -2;
+    }
+
+    if (mem) {
+        llama_memory_clear(mem, true);
+    }
+    return 0;
+}
+
 } // namespace llama_mobile
\ No newline at end of file
@@ -0,0 +1,415 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <vector>
+#include <string>
+
+namespace llama_mobile {
+
+llama_mobile_engine::~llama_mobile_engine() {
+    shutdown();
+    if (batch.token != nullptr) {
+        llama_batch_free(batch);
+        batch = {};
+    }
+}
+
+bool llama_mobile_engine::loadModel(common_params &params_, int n_parallel) {
+    if (n_parallel < 1) {
+        LOG_ERROR("Invalid number of parallel sequences: %d", n_parallel);
+        return false;
+    }
+
+    params = params_;
+    params.n_parallel = n_parallel;
+    // Requests pick their adapter per sequence
+    params.lora_seq = true;
+    LOG_INFO("Loading model for engine: %s, n_parallel=%d", params.model.path.c_str(), n_parallel);
+
+    llama_init = common_init_from_params(params);
+    if (llama_init == nullptr) {
+        LOG_ERROR("unable to initialize model context: %s", params.model.path.c_str());
+        return false;
+    }
+
+    model = llama_init->model();
+    ctx = llama_init->context();
+    if (model == nullptr || ctx == nullptr) {
+        LOG_ERROR("unable to load model: %s", params.model.path.c_str());
+        return false;
+    }
+
+    n_ctx_slot = llama_n_ctx_seq(ctx);
+    params.n_batch = llama_n_batch(ctx);
+    n_prefill_max = params.n_batch;
+    batch = llama_batch_init(params.n_batch, 0, 1);
+
+    slots.resize(n_parallel);
+    for (int i = 0; i < n_parallel; ++i) {
+        slots[i].seq_id = i;
+    }
+
+    is_running = true;
+    worker = std::thread(&llama_mobile_engine::run, this);
+
+    LOG_INFO("Engine started: n_ctx_seq=%d, n_batch=%d, slots=%d", n_ctx_slot, params.n_batch, n_parallel);
+    return true;
+}
+
+int32_t llama_mobile_engine::submit(llama_mobile_engine_request request) {
+    if (!ctx || !model) {
+        LOG_ERROR("Engine not initialized, cannot submit request.");
+        return -1;
+    }
+
+    // Tokenize on the caller's thread, the worker only ever touches the vocab read-only
+    llama_mobile_engine_pending pending;
+    pending.prompt_tokens = common_tokenize(llama_model_get_vocab(model), request.prompt, true, true);
+    if (pending.prompt_tokens.empty() || pending.prompt_tokens.size() >= (size_t)n_ctx_slot) {
+        LOG_ERROR("Prompt of %zu tokens does not fit the per-sequence context of %d", pending.prompt_tokens.size(), n_ctx_slot);
+        return -1;
+    }
+    pending.request = std::move(request);
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (!is_running) {
+        return -1;
+    }
+    pending.request_id = next_request_id++;
+    queue.push_back(std::move(pending));
+    queue_cv.notify_one();
+    return queue.back().request_id;
+}
+
+int llama_mobile_engine::registerLoraAdapter(const std::string &id, const std::string &path) {
+    if (!ctx || !model) {
+        LOG_ERROR("Engine not initialized, cannot register LoRA adapters.");
+        return -1;
+    }
+    if (id.empty() || path.empty()) {
+        LOG_ERROR("LoRA adapter id and path must not be empty.");
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(lora_mutex);
+    if (!lora_registry.add(id, path)) {
+        LOG_ERROR("LoRA adapter '%s' is in use, cannot replace it.", id.c_str());
+        return -2;
+    }
+    if (lora_registry.acquire(model, id) == nullptr) {
+        LOG_ERROR("Failed to initialize LoRA adapter '%s' from %s", id.c_str(), path.c_str());
+        lora_registry.remove(id);
+        return -3;
+    }
+    lora_registry.evict();
+    return 0;
+}
+
+void llama_mobile_engine::cancel(int32_t request_id) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    cancelled_ids.insert(request_id);
+    queue_cv.notify_one();
+}
+
+void llama_mobile_engine::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!is_running) {
+            return;
+        }
+        is_running = false;
+        queue_cv.notify_one();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool llama_mobile_engine::hasActiveSlots() const {
+    for (const auto &slot : slots) {
+        if (slot.state != SLOT_IDLE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void llama_mobile_engine::startSlot(llama_mobile_engine_slot &slot, llama_mobile_engine_pending &&pending) {
+    const int32_t request_id = pending.request_id;
+    slot.request_id = request_id;
+    slot.request = std::move(pending.request);
+    slot.prompt_tokens = std::move(pending.prompt_tokens);
+    slot.n_prompt_done = 0;
+    slot.n_streamed = 0;
+    slot.n_past = 0;
+    slot.last_token = -1;
+    slot.i_batch = -1;
+    slot.result = llama_mobile_engine_result();
+    slot.result.tokens_evaluated = slot.prompt_tokens.size();
+    slot.stop_matcher.build(slot.request.antiprompt);
+    slot.stop_matcher.reset();
+    slot.smpl = common_sampler_init(model, slot.request.sampling);
+    slot.state = SLOT_PREFILL;
+
+    if (slot.smpl == nullptr) {
+        LOG_ERROR("Failed to initialize sampler for request %d", request_id);
+        slot.result.error = "failed to initialize sampler";
+        finishSlot(slot);
+        return;
+    }
+    if (!slot.request.lora_id.empty() && !selectSlotLora(slot)) {
+        slot.result.error = "failed to apply LoRA adapter '" + slot.request.lora_id + "'";
+        finishSlot(slot);
+        return;
+    }
+    for (auto token : slot.prompt_tokens) {
+        common_sampler_accept(slot.smpl, token, false);
+    }
+    llama_memory_seq_rm(llama_get_memory(ctx), slot.seq_id, -1, -1);
+}
+
+bool llama_mobile_engine::selectSlotLora(llama_mobile_engine_slot &slot) {
+    std::lock_guard<std::mutex> lock(lora_mutex);
+    llama_mobile_lora_registry::llama_mobile_lora_registry_entry *entry = lora_registry.acquire(model, slot.request.lora_id);
+    if (entry == nullptr) {
+        LOG_ERROR("LoRA adapter '%s' is not registered or failed to load.", slot.request.lora_id.c_str());
+        return false;
+    }
+    // Only this sequence's tokens go through the adapter, the other slots keep decoding in the same batch
+    if (llama_set_adapter_lora_seq(ctx, entry->adapter.get(), slot.seq_id, slot.request.lora_scale) != 0) {
+        LOG_ERROR("Failed to apply LoRA adapter '%s' to sequence %d", slot.request.lora_id.c_str(), slot.seq_id);
+        return false;
+    }
+    slot.lora = entry->adapter.get();
+    entry->active = true;
+    lora_registry.evict();
+    return true;
+}
+
+void llama_mobile_engine::releaseSlotLora(llama_mobile_engine_slot &slot) {
+    llama_clear_adapter_lora_seq(ctx, slot.seq_id);
+    slot.lora = nullptr;
+
+    std::lock_guard<std::mutex> lock(lora_mutex);
+    for (auto &it : lora_registry.entries) {
+        llama_adapter_lora *adapter = it.second.adapter.get();
+        it.second.active = adapter != nullptr && std::any_of(slots.begin(), slots.end(),
+            [adapter](const llama_mobile_engine_slot &other) { return other.lora == adapter; });
+    }
+    lora_registry.evict();
+}
+
+void llama_mobile_engine::finishSlot(llama_mobile_engine_slot &slot) {
+    llama_memory_seq_rm(llama_get_memory(ctx), slot.seq_id, -1, -1);
+    if (slot.lora != nullptr) {
+        releaseSlotLora(slot);
+    }
+    if (slot.smpl != nullptr) {
+        common_sampler_free(slot.smpl);
+        slot.smpl = nullptr;
+    }
+    // Release the text held back for a stop word that never completed
+    if (slot.request.on_token && !slot.result.cancelled && slot.n_streamed < slot.result.text.size()) {
+        slot.request.on_token(slot.request_id, slot.last_token, slot.result.text.substr(slot.n_streamed));
+        slot.n_streamed = slot.result.text.size();
+    }
+    if (slot.request.on_complete) {
+        slot.request.on_complete(slot.request_id, slot.result);
+    }
+    slot.state = SLOT_IDLE;
+    slot.request_id = -1;
+    slot.request = llama_mobile_engine_request();
+    slot.prompt_tokens.clear();
+}
+
+void llama_mobile_engine::processToken(llama_mobile_engine_slot &slot) {
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+
+    const llama_token id = common_sampler_sample(slot.smpl, ctx, slot.i_batch);
+    common_sampler_accept(slot.smpl, id, true);
+    slot.i_batch = -1;
+    slot.last_token = id;
+    slot.result.tokens_predicted++;
+
+    if (llama_vocab_is_eog(vocab, id)) {
+        slot.result.stopped_eos = true;
+        finishSlot(slot);
+        return;
+    }
+
+    const std::string piece = common_token_to_piece(ctx, id);
+    slot.result.text += piece;
+
+    int32_t stop_word = -1;
+    const size_t stop_pos = slot.stop_matcher.feed(piece.data(), piece.size(), stop_word);
+    if (stop_pos != std::string::npos) {
+        slot.result.text.erase(stop_pos);
+        slot.result.stopping_word = slot.stop_matcher.words[stop_word];
+        slot.result.stopped_word = true;
+        finishSlot(slot);
+        return;
+    }
+
+    // Text that could still become a stop word is held back, it is erased if the word completes
+    const size_t n_ready = slot.result.text.size() - slot.stop_matcher.partialLength();
+    if (slot.request.on_token && n_ready > slot.n_streamed) {
+        const std::string text = slot.result.text.substr(slot.n_streamed, n_ready - slot.n_streamed);
+        slot.n_streamed = n_ready;
+        if (!slot.request.on_token(slot.request_id, id, text)) {
+            slot.result.cancelled = true;
+            finishSlot(slot);
+            return;
+        }
+    }
+
+    if (slot.request.n_predict >= 0 && slot.result.tokens_predicted >= slot.request.n_predict) {
+        slot.result.stopped_limit = true;
+        finishSlot(slot);
+        return;
+    }
+
+    if (slot.n_past + 1 >= n_ctx_slot) {
+        slot.result.truncated = true;
+        slot.result.stopped_limit = true;
+        finishSlot(slot);
+        return;
+    }
+
+    slot.state = SLOT_GENERATE;
+}
+
+void llama_mobile_engine::run() {
+    while (true) {
+        std::vector<llama_mobile_engine_pending> admitted;
+        std::unordered_set<int32_t> cancelled;
+        bool running;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [&] {
+                return !is_running || !queue.empty() || !cancelled_ids.empty() || hasActiveSlots();
+            });
+            running = is_running;
+            cancelled.swap(cancelled_ids);
+
+            size_t n_idle = 0;
+            for (const auto &slot : slots) {
+                if (slot.state == SLOT_IDLE) n_idle++;
+            }
+            // Cancelled or shut-down requests leave the queue right away so their
+            // completion callback fires even when every slot is busy
+            for (auto it = queue.begin(); it != queue.end();) {
+                const bool drop = !running || cancelled.count(it->request_id) > 0;
+                if (drop || n_idle > 0) {
+                    if (!drop) n_idle--;
+                    admitted.push_back(std::move(*it));
+                    it = queue.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        // Callbacks run on this thread without holding queue_mutex so they may submit or cancel
+        for (auto &pending : admitted) {
+            if (!running || cancelled.count(pending.request_id)) {
+                llama_mobile_engine_result result;
+                result.cancelled = true;
+                if (pending.request.on_complete) {
+                    pending.request.on_complete(pending.request_id, result);
+                }
+                continue;
+            }
+            for (auto &slot : slots) {
+                if (slot.state == SLOT_IDLE) {
+                    startSlot(slot, std::move(pending));
+                    break;
+                }
+            }
+        }
+
+        for (auto &slot : slots) {
+            if (slot.state != SLOT_IDLE && (!running || cancelled.count(slot.request_id))) {
+                slot.result.cancelled = true;
+                finishSlot(slot);
+            }
+        }
+
+        if (!running) {
+            break;
+        }
+
+        // Generating sequences go first so a long prefill never stalls their next token,
+        // prompt chunks then fill whatever room is left in the batch. With more slots than
+        // n_batch the first place rotates so every sequence gets its turn
+        llama_batch_clear(&batch);
+        // Tokens each slot put in the batch, taken back if it has to be retried
+        std::vector<int> n_added(slots.size(), 0);
+        for (size_t i = 0; i < slots.size() && batch.n_tokens < params.n_batch; ++i) {
+            const size_t i_slot = (next_generate + i) % slots.size();
+            auto &slot = slots[i_slot];
+            if (slot.state == SLOT_GENERATE) {
+                slot.i_batch = batch.n_tokens;
+                llama_batch_add(&batch, slot.last_token, slot.n_past++, {slot.seq_id}, true);
+                n_added[i_slot] = 1;
+            }
+        }
+        next_generate = (next_generate + 1) % slots.size();
+        const int n_generate = batch.n_tokens;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            auto &slot = slots[i];
+            if (slot.state != SLOT_PREFILL) continue;
+            while (slot.n_prompt_done < slot.prompt_tokens.size() && batch.n_tokens < params.n_batch &&
+                   batch.n_tokens - n_generate < n_prefill_max) {
+                const bool is_last = slot.n_prompt_done + 1 == slot.prompt_tokens.size();
+                if (is_last) {
+                    slot.i_batch = batch.n_tokens;
+                }
+                llama_batch_add(&batch, slot.prompt_tokens[slot.n_prompt_done++], slot.n_past++, {slot.seq_id}, is_last);
+                n_added[i]++;
+            }
+        }
+
+        if (batch.n_tokens == 0) {
+            continue;
+        }
+
+        const int ret = llama_decode(ctx, batch);
+        if (ret == 1 && batch.n_tokens - n_generate > 1) {
+            // No KV slot for the batch, the memory is left as it was. Take the batch back
+            // and retry with fewer prompt tokens, the generating sequences still get theirs
+            for (size_t i = 0; i < slots.size(); ++i) {
+                auto &slot = slots[i];
+                slot.n_past -= n_added[i];
+                if (slot.state == SLOT_PREFILL && n_added[i] > 0) {
+                    slot.n_prompt_done -= n_added[i];
+                    slot.i_batch = -1;
+                }
+            }
+            n_prefill_max = (batch.n_tokens - n_generate) / 2;
+            LOG_WARNING("No KV slot for an engine batch of %d tokens, retrying with at most %d prompt tokens", batch.n_tokens, n_prefill_max);
+            continue;
+        }
+        if (ret != 0) {
+            LOG_ERROR("llama_decode() failed for engine batch of %d tokens, ret=%d", batch.n_tokens, ret);
+            for (auto &slot : slots) {
+                if (slot.state != SLOT_IDLE) {
+                    slot.result.error = "decode failed, ret=" + std::to_string(ret);
+                    finishSlot(slot);
+                }
+            }
+            continue;
+        }
+        if (n_prefill_max < params.n_batch) {
+            n_prefill_max = std::min(params.n_batch, n_prefill_max * 2);
+        }
+
+        for (auto &slot : slots) {
+            if (slot.state != SLOT_IDLE && slot.i_batch >= 0) {
+                processToken(slot);
+            }
+        }
+    }
+}
+
+} // namespace llama_mobile
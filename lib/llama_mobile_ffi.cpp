@@ -3,6 +3,7 @@
 #include "llama_cpp/common.h"
 #include "llama_cpp/llama.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -11,6 +12,7 @@
 #include <sstream>
 #include <iostream>
 #include <climits>
+#include <mutex>
 
 static std::vector<std::string> c_str_array_to_vector(const char** arr, int count) {
     std::vector<std::string> vec;
@@ -37,6 +39,262 @@ static char* safe_strdup(const std::string& str) {
     return new_str;
 }
 
+// Synchronous calls on a handle must not touch the context while its async worker runs a
+// request. They fail with LLAMA_MOBILE_ERROR_BUSY instead of waiting: a host that blocks
+// here may be the one that has to poll the request's tokens before it can finish.
+static std::unique_lock<std::recursive_mutex> lock_context(llama_mobile::llama_mobile_context* context) {
+    std::unique_lock<std::recursive_mutex> lock(context->state_mutex, std::try_to_lock);
+    if (!lock) {
+        std::cerr << "Context is busy with an async request or a call from another thread" << std::endl;
+    }
+    return lock;
+}
+
+static void completion_params_to_common(const llama_mobile_completion_params_c_t* params, common_params& cpp_params) {
+    cpp_params.n_predict = params->n_predict;
+    cpp_params.sampling.seed = params->seed;
+    cpp_params.sampling.temp = params->temperature;
+    cpp_params.sampling.top_k = params->top_k;
+    cpp_params.sampling.top_p = params->top_p;
+    cpp_params.sampling.min_p = params->min_p;
+    cpp_params.sampling.typ_p = params->typical_p;
+    cpp_params.sampling.penalty_last_n = params->penalty_last_n;
+    cpp_params.sampling.penalty_repeat = params->penalty_repeat;
+    cpp_params.sampling.penalty_freq = params->penalty_freq;
+    cpp_params.sampling.penalty_present = params->penalty_present;
+    cpp_params.sampling.mirostat = params->mirostat;
+    cpp_params.sampling.mirostat_tau = params->mirostat_tau;
+    cpp_params.sampling.mirostat_eta = params->mirostat_eta;
+    cpp_params.sampling.ignore_eos = params->ignore_eos;
+    cpp_params.sampling.n_probs = params->n_probs;
+    cpp_params.antiprompt = c_str_array_to_vector(params->stop_sequences, params->stop_sequence_count);
+    if (params->grammar) {
+        cpp_params.sampling.grammar = params->grammar;
+    }
+}
+
+static std::vector<llama_mobile::llama_mobile_lora_selection> lora_selection_from_c(const char** ids, const float* scales, int count) {
+    std::vector<llama_mobile::llama_mobile_lora_selection> selection;
+    for (int i = 0; i < count; ++i) {
+        if (ids[i]) {
+            llama_mobile::llama_mobile_lora_selection sel;
+            sel.id = ids[i];
+            sel.scale = scales ? scales[i] : 1.0f;
+            selection.push_back(std::move(sel));
+        }
+    }
+    return selection;
+}
+
+static void fill_branch_result(const llama_mobile::llama_mobile_context* context, const llama_mobile::completion_branch_result& branch, llama_mobile_completion_result_c_t* result) {
+    result->text = safe_strdup(branch.text);
+    result->tokens_predicted = branch.tokens_predicted;
+    result->tokens_evaluated = context->num_prompt_tokens;
+    result->truncated = context->truncated || branch.truncated;
+    result->stopped_eos = branch.stopped_eos;
+    result->stopped_word = branch.stopped_word;
+    result->stopped_limit = branch.stopped_limit;
+    result->cancelled = context->is_interrupted;
+    result->stopping_word = safe_strdup(branch.stopping_word);
+    result->error = nullptr;
+}
+
+static void fill_completion_result(llama_mobile::llama_mobile_context* context, int64_t t_first_token_us, llama_mobile_completion_result_c_t* result) {
+    result->text = safe_strdup(context->generated_text);
+    result->tokens_predicted = context->num_tokens_predicted;
+    result->tokens_evaluated = context->num_prompt_tokens;
+    result->truncated = context->truncated;
+    result->stopped_eos = context->stopped_eos;
+    result->stopped_word = context->stopped_word;
+    result->stopped_limit = context->stopped_limit;
+    result->cancelled = context->is_interrupted;
+    result->stopping_word = safe_strdup(context->stopping_word);
+    result->error = nullptr;
+
+    if (context->spec_wrapper != nullptr) {
+        result->n_drafted = static_cast<int32_t>(context->spec_wrapper->n_drafted);
+        result->n_draft_accepted = static_cast<int32_t>(context->spec_wrapper->n_draft_accepted);
+        if (result->n_drafted > 0) {
+            result->draft_acceptance_rate = static_cast<double>(result->n_draft_accepted) / result->n_drafted;
+        }
+    }
+    // Measured from the first token so prompt processing does not dilute the decode rate
+    const double t_gen_s = t_first_token_us > 0 ? 1e-6 * (lm_ggml_time_us() - t_first_token_us) : 0.0;
+    if (result->tokens_predicted > 1 && t_gen_s > 0) {
+        result->tokens_per_second = (result->tokens_predicted - 1) / t_gen_s;
+    }
+
+    const llama_mobile::llama_mobile_tts_stream &stream = context->tts_stream;
+    if (stream.t_first_audio_us > 0) {
+        result->time_to_first_audio_ms = 1e-3 * (stream.t_first_audio_us - stream.t_start_us);
+    }
+    result->audio_samples = static_cast<int32_t>(stream.n_samples);
+}
+
+// Drives doCompletion() until generation ends, streaming to whichever callbacks are set.
+// Token text is handed out as spans of generated_text, which is NUL-terminated at every
+// callback, so no token is detokenized twice and nothing is allocated per token.
+// Returns the time the first token was produced.
+static int64_t run_completion_loop(llama_mobile::llama_mobile_context* context, const llama_mobile_completion_params_c_t* params) {
+    int64_t t_first_token_us = 0;
+    size_t n_emitted = 0;
+    bool stopped_by_callback = false;
+
+    llama_mobile_token_event_c_t event = {};
+    std::vector<llama_mobile_token_prob_c_t> probs;
+    if (params->token_event_callback) {
+        probs.reserve(std::max(params->n_probs, 0));
+    }
+
+    // Audio codes are turned into PCM as they are sampled instead of after the completion
+    if (params->audio_callback && context->isVocoderEnabled()) {
+        const int window_codes = params->audio_window_codes > 0 ? params->audio_window_codes : 16;
+        auto audio_callback = params->audio_callback;
+        void *audio_user_data = params->audio_user_data;
+        context->beginAudioStream(window_codes, 4, [audio_callback, audio_user_data](const float *pcm, size_t n_samples) {
+            audio_callback(pcm, static_cast<int32_t>(n_samples), audio_user_data);
+        });
+    }
+
+    while (context->has_next_token && !context->is_interrupted) {
+        const size_t n_before = context->generated_text.size();
+        const llama_mobile::completion_token_output token_with_probs = context->doCompletion();
+        if (t_first_token_us == 0 && token_with_probs.tok != -1) {
+            t_first_token_us = lm_ggml_time_us();
+        }
+
+        if (token_with_probs.tok == -1 && !context->has_next_token) {
+            break;
+        }
+        if (token_with_probs.tok == -1) {
+            continue;
+        }
+
+        // A completed stop word is cut from generated_text and may reach back into earlier tokens
+        const size_t n_after = context->generated_text.size();
+        if (params->token_callback && n_before <= n_after && (n_before < n_after || !context->stopped_word)) {
+            if (!params->token_callback(context->generated_text.c_str() + n_before)) {
+                stopped_by_callback = true;
+                context->is_interrupted = true;
+                break;
+            }
+        }
+
+        if (params->token_event_callback) {
+            // Text that could still become a stop word is held back so nothing already
+            // streamed is ever cut, and in UTF-8 safe mode so are partial code points
+            const size_t n_ready = context->has_next_token ? n_after - context->stop_matcher.partialLength() : n_after;
+            if ((params->token_event_utf8_safe && context->incomplete) || n_ready <= n_emitted) {
+                continue;
+            }
+            probs.clear();
+            for (const auto &p : token_with_probs.probs) {
+                probs.push_back({p.tok, p.prob});
+            }
+            event.text = context->generated_text.c_str();
+            event.offset = n_emitted;
+            event.length = n_ready - n_emitted;
+            event.token = token_with_probs.tok;
+            event.probs = probs.empty() ? nullptr : probs.data();
+            event.n_probs = static_cast<int32_t>(probs.size());
+            n_emitted = n_ready;
+
+            if (!params->token_event_callback(&event, params->token_event_user_data)) {
+                stopped_by_callback = true;
+                context->is_interrupted = true;
+                break;
+            }
+        }
+    }
+
+    // Flush whatever was still held back when generation ended
+    if (params->token_event_callback && !stopped_by_callback && n_emitted < context->generated_text.size()) {
+        event.text = context->generated_text.c_str();
+        event.offset = n_emitted;
+        event.length = context->generated_text.size() - n_emitted;
+        event.token = context->embd.empty() ? -1 : context->embd.back();
+        event.probs = nullptr;
+        event.n_probs = 0;
+        params->token_event_callback(&event, params->token_event_user_data);
+    }
+    if (context->tts_stream.active) {
+        context->endAudioStream();
+    }
+
+    return t_first_token_us;
+}
+
+static bool init_params_to_common(const llama_mobile_init_params_c_t* params, common_params& cpp_params) {
+    cpp_params.model.path = params->model_path;
+    if (params->chat_template) {
+        cpp_params.chat_template = params->chat_template;
+    }
+    cpp_params.n_ctx = params->n_ctx;
+    cpp_params.n_batch = params->n_batch;
+    cpp_params.n_ubatch = params->n_ubatch;
+    cpp_params.n_gpu_layers = params->n_gpu_layers;
+    cpp_params.cpuparams.n_threads = params->n_threads;
+    cpp_params.use_mmap = params->use_mmap;
+    cpp_params.use_mlock = params->use_mlock;
+    cpp_params.embedding = params->embedding;
+    cpp_params.pooling_type = static_cast<enum llama_pooling_type>(params->pooling_type);
+    cpp_params.embd_normalize = params->embd_normalize;
+
+    if (params->cache_type_k) {
+        try {
+            cpp_params.cache_type_k = llama_mobile::kv_cache_type_from_str(params->cache_type_k);
+        } catch (const std::exception& e) {
+            std::cerr << "[FFI] Warning: Invalid cache_type_k: " << params->cache_type_k << " Error: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    if (params->cache_type_v) {
+        try {
+            cpp_params.cache_type_v = llama_mobile::kv_cache_type_from_str(params->cache_type_v);
+        } catch (const std::exception& e) {
+            std::cerr << "[FFI] Warning: Invalid cache_type_v: " << params->cache_type_v << " Error: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool context_params_from_c(const llama_mobile_init_params_c_t* params, common_params& cpp_params) {
+    if (!init_params_to_common(params, cpp_params)) {
+        return false;
+    }
+    if (params->n_seq_max > 1) {
+        // Extra sequences are only used by batched embeddings and n-best completions,
+        // a unified cache keeps the full n_ctx available to sequence 0 for completions
+        cpp_params.n_parallel = params->n_seq_max;
+        cpp_params.kv_unified = true;
+    }
+    return true;
+}
+
+static bool load_context(
+    llama_mobile::llama_mobile_context& context,
+    common_params& cpp_params,
+    const std::string& draft_model_path,
+    bool prompt_lookup,
+    int32_t n_draft
+) {
+    std::cout << "[FFI] Calling context->loadModel()..." << std::endl;
+    if (!context.loadModel(cpp_params)) {
+        std::cerr << "[FFI] Error: context->loadModel() returned false" << std::endl;
+        return false;
+    }
+    std::cout << "[FFI] context->loadModel() succeeded" << std::endl;
+
+    if (!draft_model_path.empty() || prompt_lookup) {
+        std::cout << "[FFI] Enabling speculative decoding..." << std::endl;
+        if (!context.initSpeculative(draft_model_path, n_draft)) {
+            std::cerr << "[FFI] Error: context->initSpeculative() returned false" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
 extern "C" {
 
@@ -72,52 +330,20 @@ llama_mobile_context_handle_t llama_mobile_init_context_c(const llama_mobile_ini
 
         common_params cpp_params;
         std::cout << "[FFI] Initializing common_params..." << std::endl;
-        cpp_params.model.path = params->model_path;
-        if (params->chat_template) {
-            cpp_params.chat_template = params->chat_template;
-            std::cout << "[FFI] Chat template: " << params->chat_template << std::endl;
-        }
-        cpp_params.n_ctx = params->n_ctx;
-        cpp_params.n_batch = params->n_batch;
-        cpp_params.n_ubatch = params->n_ubatch;
-        cpp_params.n_gpu_layers = params->n_gpu_layers;
-        cpp_params.cpuparams.n_threads = params->n_threads;
-        cpp_params.use_mmap = params->use_mmap;
-        cpp_params.use_mlock = params->use_mlock;
-        cpp_params.embedding = params->embedding;
-        cpp_params.pooling_type = static_cast<enum llama_pooling_type>(params->pooling_type);
-        cpp_params.embd_normalize = params->embd_normalize;
-
-        if (params->cache_type_k) {
-             std::cout << "[FFI] Processing cache_type_k: " << params->cache_type_k << std::endl;
-             try {
-                  cpp_params.cache_type_k = llama_mobile::kv_cache_type_from_str(params->cache_type_k);
-                  std::cout << "[FFI] cache_type_k parsed successfully" << std::endl;
-             } catch (const std::exception& e) {
-                 std::cerr << "[FFI] Warning: Invalid cache_type_k: " << params->cache_type_k << " Error: " << e.what() << std::endl;
-                 delete context;
-                 return nullptr;
-             }
-        }
-        if (params->cache_type_v) {
-            std::cout << "[FFI] Processing cache_type_v: " << params->cache_type_v << std::endl;
-            try {
-                cpp_params.cache_type_v = llama_mobile::kv_cache_type_from_str(params->cache_type_v);
-                std::cout << "[FFI] cache_type_v parsed successfully" << std::endl;
-            } catch (const std::exception& e) {
-                std::cerr << "[FFI] Warning: Invalid cache_type_v: " << params->cache_type_v << " Error: " << e.what() << std::endl;
-                delete context;
-                return nullptr;
-            }
+        if (!context_params_from_c(params, cpp_params)) {
+            delete context;
+            return nullptr;
+        }
+        if (params->progress_callback) {
+            auto progress_callback = params->progress_callback;
+            context->on_load_progress = [progress_callback](float progress) { progress_callback(progress); };
         }
 
-        std::cout << "[FFI] Calling context->loadModel()..." << std::endl;
-        if (!context->loadModel(cpp_params)) {
-            std::cerr << "[FFI] Error: context->loadModel() returned false" << std::endl;
+        if (!load_context(*context, cpp_params, params->draft_model_path ? params->draft_model_path : "", params->prompt_lookup, params->n_draft)) {
             delete context;
             return nullptr;
         }
-        std::cout << "[FFI] context->loadModel() succeeded" << std::endl;
+        context->on_load_progress = nullptr;
 
         std::cout << "[FFI] Returning context handle: " << reinterpret_cast<void*>(context) << std::endl;
         return reinterpret_cast<llama_mobile_context_handle_t>(context);
@@ -140,6 +366,137 @@ void llama_mobile_free_context_c(llama_mobile_context_handle_t handle) {
     }
 }
 
+typedef std::shared_ptr<llama_mobile::llama_mobile_load_task> load_task_ref;
+
+llama_mobile_load_task_handle_t llama_mobile_init_context_async_c(
+    const llama_mobile_init_params_c_t* params,
+    llama_mobile_load_callback_c_t callback,
+    void* user_data
+) {
+    if (!params || !params->model_path) {
+        std::cerr << "[FFI] Error: params or params->model_path is null" << std::endl;
+        return nullptr;
+    }
+
+    try {
+        // Everything params points to is copied here, the caller may free it once this returns
+        common_params cpp_params;
+        if (!context_params_from_c(params, cpp_params)) {
+            return nullptr;
+        }
+        const std::string draft_model_path = params->draft_model_path ? params->draft_model_path : "";
+        const bool prompt_lookup = params->prompt_lookup;
+        const int32_t n_draft = params->n_draft;
+        auto progress_callback = params->progress_callback;
+
+        auto task = std::make_shared<llama_mobile::llama_mobile_load_task>();
+        task->model_path = cpp_params.model.path;
+        task->chat_template = cpp_params.chat_template;
+        task->context = new llama_mobile::llama_mobile_context();
+        task->load = [cpp_params, draft_model_path, prompt_lookup, n_draft](llama_mobile::llama_mobile_context& context) mutable {
+            return load_context(context, cpp_params, draft_model_path, prompt_lookup, n_draft);
+        };
+        task->notify = [callback, progress_callback, user_data](int state, float progress) {
+            if (progress_callback && state == llama_mobile::LOAD_WEIGHTS) {
+                progress_callback(progress);
+            }
+            if (callback) {
+                callback(state, progress, user_data);
+            }
+        };
+        task->start();
+        return reinterpret_cast<llama_mobile_load_task_handle_t>(new load_task_ref(std::move(task)));
+    } catch (const std::exception& e) {
+        std::cerr << "[FFI] Error starting background model load: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+int llama_mobile_load_state_c(llama_mobile_load_task_handle_t task) {
+    if (!task) {
+        return LLAMA_MOBILE_LOAD_FAILED;
+    }
+    return (*reinterpret_cast<load_task_ref*>(task))->state.load(std::memory_order_acquire);
+}
+
+float llama_mobile_load_progress_c(llama_mobile_load_task_handle_t task) {
+    if (!task) {
+        return 0.0f;
+    }
+    return (*reinterpret_cast<load_task_ref*>(task))->loading_progress;
+}
+
+int llama_mobile_load_wait_c(llama_mobile_load_task_handle_t task, int32_t timeout_ms) {
+    if (!task) {
+        return LLAMA_MOBILE_LOAD_FAILED;
+    }
+    llama_mobile::llama_mobile_load_task& load_task = **reinterpret_cast<load_task_ref*>(task);
+    load_task.wait(timeout_ms);
+    return load_task.state.load(std::memory_order_acquire);
+}
+
+void llama_mobile_load_cancel_c(llama_mobile_load_task_handle_t task) {
+    if (task) {
+        (*reinterpret_cast<load_task_ref*>(task))->cancel();
+    }
+}
+
+llama_mobile_token_array_c_t llama_mobile_load_tokenize_c(llama_mobile_load_task_handle_t task, const char* text) {
+    llama_mobile_token_array_c_t result = {nullptr, 0};
+    if (!task || !text) {
+        return result;
+    }
+
+    try {
+        std::vector<llama_token> tokens_vec = (*reinterpret_cast<load_task_ref*>(task))->tokenize(text);
+        if (!tokens_vec.empty()) {
+            result.count = tokens_vec.size();
+            result.tokens = (int32_t*)malloc(result.count * sizeof(int32_t));
+            if (result.tokens) {
+                std::copy(tokens_vec.begin(), tokens_vec.end(), result.tokens);
+            } else {
+                result.count = 0;
+            }
+        }
+        return result;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during tokenization: " << e.what() << std::endl;
+        return {nullptr, 0};
+    }
+}
+
+char* llama_mobile_load_get_formatted_chat_c(llama_mobile_load_task_handle_t task, const char* messages, const char* chat_template) {
+    if (!task || !messages) {
+        return nullptr;
+    }
+
+    try {
+        std::string formatted = (*reinterpret_cast<load_task_ref*>(task))->getFormattedChat(messages, chat_template ? chat_template : "");
+        return safe_strdup(formatted);
+    } catch (const std::exception& e) {
+        std::cerr << "Error formatting chat: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+llama_mobile_context_handle_t llama_mobile_load_take_context_c(llama_mobile_load_task_handle_t task) {
+    if (!task) {
+        return nullptr;
+    }
+    return reinterpret_cast<llama_mobile_context_handle_t>((*reinterpret_cast<load_task_ref*>(task))->takeContext());
+}
+
+void llama_mobile_load_release_c(llama_mobile_load_task_handle_t task) {
+    if (task) {
+        load_task_ref* ref = reinterpret_cast<load_task_ref*>(task);
+        // A load nobody can take the context from any more is abandoned, the loading
+        // thread frees it when it reaches the next tensor
+        (*ref)->release();
+        (*ref)->cancel();
+        delete ref;
+    }
+}
+
 int llama_mobile_completion_c(
     llama_mobile_context_handle_t handle,
     const llama_mobile_completion_params_c_t* params,
@@ -149,6 +506,10 @@ int llama_mobile_completion_c(
         return -1; // Invalid arguments
     }
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
 
     memset(result, 0, sizeof(llama_mobile_completion_result_c_t));
 
@@ -159,25 +520,9 @@ int llama_mobile_completion_c(
         if (params->n_threads > 0) {
              context->params.cpuparams.n_threads = params->n_threads;
         }
-        context->params.n_predict = params->n_predict;
-        context->params.sampling.seed = params->seed;
-        context->params.sampling.temp = params->temperature;
-        context->params.sampling.top_k = params->top_k;
-        context->params.sampling.top_p = params->top_p;
-        context->params.sampling.min_p = params->min_p;
-        context->params.sampling.typ_p = params->typical_p;
-        context->params.sampling.penalty_last_n = params->penalty_last_n;
-        context->params.sampling.penalty_repeat = params->penalty_repeat;
-        context->params.sampling.penalty_freq = params->penalty_freq;
-        context->params.sampling.penalty_present = params->penalty_present;
-        context->params.sampling.mirostat = params->mirostat;
-        context->params.sampling.mirostat_tau = params->mirostat_tau;
-        context->params.sampling.mirostat_eta = params->mirostat_eta;
-        context->params.sampling.ignore_eos = params->ignore_eos;
-        context->params.sampling.n_probs = params->n_probs;
-        context->params.antiprompt = c_str_array_to_vector(params->stop_sequences, params->stop_sequence_count);
-        if (params->grammar) {
-             context->params.sampling.grammar = params->grammar;
+        completion_params_to_common(params, context->params);
+        if (params->lora_ids && context->selectLoraAdapters(lora_selection_from_c(params->lora_ids, params->lora_scales, params->lora_count)) != 0) {
+            return -5;
         }
 
         if (!context->initSampling()) {
@@ -186,38 +531,73 @@ int llama_mobile_completion_c(
         context->beginCompletion();
         context->loadPrompt();
 
-        while (context->has_next_token && !context->is_interrupted) {
-            const llama_mobile::completion_token_output token_with_probs = context->doCompletion();
+        const int64_t t_first_token_us = run_completion_loop(context, params);
 
-            if (token_with_probs.tok == -1 && !context->has_next_token) {
-                 break;
-            }
-            
-            if (token_with_probs.tok != -1 && params->token_callback) {
-                std::string token_text = common_token_to_piece(context->ctx, token_with_probs.tok);
-                
-                bool continue_completion = params->token_callback(token_text.c_str());
-                if (!continue_completion) {
-                    context->is_interrupted = true;
-                    break;
-                }
-            }
+        fill_completion_result(context, t_first_token_us, result);
+
+        context->is_predicting = false;
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during completion: " << e.what() << std::endl;
+        context->is_predicting = false;
+        context->is_interrupted = true;
+        return -3;
+    } catch (...) {
+        context->is_predicting = false;
+        context->is_interrupted = true;
+        return -4;
+    }
+}
+
+int llama_mobile_completion_n_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    int32_t n,
+    llama_mobile_completion_result_c_t* results
+) {
+    if (!handle || !params || !params->prompt || !results || n < 1) {
+        return -1; // Invalid arguments
+    }
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+
+    memset(results, 0, sizeof(llama_mobile_completion_result_c_t) * n);
+
+    try {
+        context->rewind();
+
+        context->params.prompt = params->prompt;
+        if (params->n_threads > 0) {
+             context->params.cpuparams.n_threads = params->n_threads;
+        }
+        completion_params_to_common(params, context->params);
+        if (params->lora_ids && context->selectLoraAdapters(lora_selection_from_c(params->lora_ids, params->lora_scales, params->lora_count)) != 0) {
+            return -5;
         }
 
-        result->text = safe_strdup(context->generated_text);
-        result->tokens_predicted = context->num_tokens_predicted;
-        result->tokens_evaluated = context->num_prompt_tokens;
-        result->truncated = context->truncated;
-        result->stopped_eos = context->stopped_eos;
-        result->stopped_word = context->stopped_word;
-        result->stopped_limit = context->stopped_limit;
-        result->stopping_word = safe_strdup(context->stopping_word);
+        if (!context->initSampling()) {
+            return -2;
+        }
+        context->beginCompletion();
+        context->loadPrompt();
 
+        const std::vector<llama_mobile::completion_branch_result> branches = context->completeBranches(n);
         context->is_predicting = false;
+        if (branches.empty()) {
+            const bool out_of_range = n > static_cast<int32_t>(llama_n_seq_max(context->ctx)) || n > context->params.n_batch;
+            return out_of_range ? -6 : -3;
+        }
+        for (int32_t i = 0; i < n; ++i) {
+            fill_branch_result(context, branches[i], &results[i]);
+        }
         return 0;
 
     } catch (const std::exception& e) {
-        std::cerr << "Error during completion: " << e.what() << std::endl;
+        std::cerr << "Error during n-best completion: " << e.what() << std::endl;
         context->is_predicting = false;
         context->is_interrupted = true;
         return -3;
@@ -240,6 +620,10 @@ int llama_mobile_multimodal_completion_c(
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
     memset(result, 0, sizeof(llama_mobile_completion_result_c_t));
 
     try {
@@ -251,25 +635,9 @@ int llama_mobile_multimodal_completion_c(
         if (params->n_threads > 0) {
             context->params.cpuparams.n_threads = params->n_threads;
         }
-        context->params.n_predict = params->n_predict;
-        context->params.sampling.seed = params->seed;
-        context->params.sampling.temp = params->temperature;
-        context->params.sampling.top_k = params->top_k;
-        context->params.sampling.top_p = params->top_p;
-        context->params.sampling.min_p = params->min_p;
-        context->params.sampling.typ_p = params->typical_p;
-        context->params.sampling.penalty_last_n = params->penalty_last_n;
-        context->params.sampling.penalty_repeat = params->penalty_repeat;
-        context->params.sampling.penalty_freq = params->penalty_freq;
-        context->params.sampling.penalty_present = params->penalty_present;
-        context->params.sampling.mirostat = params->mirostat;
-        context->params.sampling.mirostat_tau = params->mirostat_tau;
-        context->params.sampling.mirostat_eta = params->mirostat_eta;
-        context->params.sampling.ignore_eos = params->ignore_eos;
-        context->params.sampling.n_probs = params->n_probs;
-        context->params.antiprompt = c_str_array_to_vector(params->stop_sequences, params->stop_sequence_count);
-        if (params->grammar) {
-            context->params.sampling.grammar = params->grammar;
+        completion_params_to_common(params, context->params);
+        if (params->lora_ids && context->selectLoraAdapters(lora_selection_from_c(params->lora_ids, params->lora_scales, params->lora_count)) != 0) {
+            return -5;
         }
 
         // Initialize sampling
@@ -294,33 +662,10 @@ int llama_mobile_multimodal_completion_c(
         }
 
         // Generate tokens
-        while (context->has_next_token && !context->is_interrupted) {
-            const llama_mobile::completion_token_output token_with_probs = context->doCompletion();
-            
-            if (token_with_probs.tok == -1 && !context->has_next_token) {
-                break;
-            }
-            
-            if (token_with_probs.tok != -1 && params->token_callback) {
-                std::string token_text = common_token_to_piece(context->ctx, token_with_probs.tok);
-                
-                bool continue_completion = params->token_callback(token_text.c_str());
-                if (!continue_completion) {
-                    context->is_interrupted = true;
-                    break;
-                }
-            }
-        }
+        const int64_t t_first_token_us = run_completion_loop(context, params);
 
         // Set results
-        result->text = safe_strdup(context->generated_text);
-        result->tokens_predicted = context->num_tokens_predicted;
-        result->tokens_evaluated = context->num_prompt_tokens;
-        result->truncated = context->truncated;
-        result->stopped_eos = context->stopped_eos;
-        result->stopped_word = context->stopped_word;
-        result->stopped_limit = context->stopped_limit;
-        result->stopping_word = safe_strdup(context->stopping_word);
+        fill_completion_result(context, t_first_token_us, result);
 
         context->is_predicting = false;
         return 0;
@@ -350,6 +695,10 @@ llama_mobile_token_array_c_t llama_mobile_tokenize_c(llama_mobile_context_handle
         return result;
     }
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     if (!context->ctx) {
         return result;
     }
@@ -380,6 +729,10 @@ char* llama_mobile_detokenize_c(llama_mobile_context_handle_t handle, const int3
         return safe_strdup("");
     }
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return safe_strdup("");
+    }
      if (!context->ctx) {
         return safe_strdup("");
     }
@@ -404,6 +757,10 @@ llama_mobile_float_array_c_t llama_mobile_embedding_c(llama_mobile_context_handl
         return result;
     }
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     if (!context->ctx || !context->params.embedding) {
         std::cerr << "Error: Embedding mode not enabled or context not initialized." << std::endl;
         return result;
@@ -447,6 +804,32 @@ llama_mobile_float_array_c_t llama_mobile_embedding_c(llama_mobile_context_handl
     }
 }
 
+int llama_mobile_embedding_batch_c(llama_mobile_context_handle_t handle, const char** texts, int32_t count, float* out_matrix) {
+    if (!handle || !texts || count < 0 || (count > 0 && !out_matrix)) {
+        return -1;
+    }
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+
+    try {
+        std::vector<std::string> text_vec;
+        text_vec.reserve(count);
+        for (int32_t i = 0; i < count; ++i) {
+            text_vec.push_back(texts[i] ? texts[i] : "");
+        }
+        return context->getEmbeddingBatch(text_vec, out_matrix);
+    } catch (const std::exception& e) {
+        std::cerr << "Error during batched embedding generation: " << e.what() << std::endl;
+        return -3;
+    } catch (...) {
+        std::cerr << "Unknown error during batched embedding generation." << std::endl;
+        return -3;
+    }
+}
+
 void llama_mobile_free_string_c(char* str) {
     if (str) {
         free(str);
@@ -469,8 +852,10 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_completion_result_members_c(llama
     if (result) {
         llama_mobile_free_string_c(result->text);
         llama_mobile_free_string_c(result->stopping_word);
+        llama_mobile_free_string_c(result->error);
         result->text = nullptr;
         result->stopping_word = nullptr;
+        result->error = nullptr;
     }
 }
 
@@ -481,6 +866,10 @@ llama_mobile_tokenize_result_c_t llama_mobile_tokenize_with_media_c(llama_mobile
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     if (!context->ctx) {
         return result;
     }
@@ -541,6 +930,16 @@ llama_mobile_tokenize_result_c_t llama_mobile_tokenize_with_media_c(llama_mobile
             }
         }
 
+        if (!tokenize_result.media_n_tokens.empty()) {
+            result.media_n_tokens_count = tokenize_result.media_n_tokens.size();
+            result.media_n_tokens = (size_t*)malloc(result.media_n_tokens_count * sizeof(size_t));
+            if (result.media_n_tokens) {
+                std::copy(tokenize_result.media_n_tokens.begin(), tokenize_result.media_n_tokens.end(), result.media_n_tokens);
+            } else {
+                result.media_n_tokens_count = 0;
+            }
+        }
+
         return result;
     } catch (const std::exception& e) {
         std::cerr << "Error during enhanced tokenization: " << e.what() << std::endl;
@@ -573,9 +972,15 @@ void llama_mobile_free_tokenize_result_c(llama_mobile_tokenize_result_c_t* resul
             result->chunk_positions_media = nullptr;
         }
         
+        if (result->media_n_tokens) {
+            free(result->media_n_tokens);
+            result->media_n_tokens = nullptr;
+        }
+        
         result->bitmap_hash_count = 0;
         result->chunk_position_count = 0;
         result->chunk_position_media_count = 0;
+        result->media_n_tokens_count = 0;
         result->has_media = false;
     }
 }
@@ -586,6 +991,10 @@ void llama_mobile_set_guide_tokens_c(llama_mobile_context_handle_t handle, const
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         std::vector<llama_token> guide_tokens_vec(tokens, tokens + count);
         context->setGuideTokens(guide_tokens_vec);
@@ -602,6 +1011,10 @@ int llama_mobile_init_multimodal_c(llama_mobile_context_handle_t handle, const c
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
     try {
         bool success = context->initMultimodal(mmproj_path, use_gpu);
         return success ? 0 : -2;
@@ -659,6 +1072,10 @@ void llama_mobile_release_multimodal_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->releaseMultimodal();
     } catch (const std::exception& e) {
@@ -674,6 +1091,10 @@ int llama_mobile_init_vocoder_c(llama_mobile_context_handle_t handle, const char
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
     try {
         bool success = context->initVocoder(vocoder_model_path);
         return success ? 0 : -2;
@@ -718,6 +1139,10 @@ char* llama_mobile_get_formatted_audio_completion_c(llama_mobile_context_handle_
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return safe_strdup("");
+    }
     try {
         std::string speaker_str = speaker_json_str ? speaker_json_str : "";
         std::string result = context->getFormattedAudioCompletion(speaker_str, text_to_speak);
@@ -738,6 +1163,10 @@ llama_mobile_token_array_c_t llama_mobile_get_audio_guide_tokens_c(llama_mobile_
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
         std::vector<llama_token> tokens = context->getAudioCompletionGuideTokens(text_to_speak);
         if (!tokens.empty()) {
@@ -766,6 +1195,10 @@ llama_mobile_float_array_c_t llama_mobile_decode_audio_tokens_c(llama_mobile_con
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
         std::vector<llama_token> token_vec(tokens, tokens + count);
         std::vector<float> audio = context->decodeAudioTokens(token_vec);
@@ -795,6 +1228,10 @@ void llama_mobile_release_vocoder_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->releaseVocoder();
     } catch (const std::exception& e) {
@@ -804,6 +1241,27 @@ void llama_mobile_release_vocoder_c(llama_mobile_context_handle_t handle) {
     }
 }
 
+int llama_mobile_configure_tts_pipeline_c(llama_mobile_context_handle_t handle, bool enabled, int32_t n_threads_llm, int32_t n_threads_vocoder, int32_t queue_windows) {
+    if (!handle || n_threads_llm < 0 || n_threads_vocoder < 0 || queue_windows < 0) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        return context->configureTTSPipeline(enabled, n_threads_llm, n_threads_vocoder, queue_windows) ? 0 : -2;
+    } catch (const std::exception& e) {
+        std::cerr << "Error configuring TTS pipeline: " << e.what() << std::endl;
+        return -3;
+    } catch (...) {
+        std::cerr << "Unknown error configuring TTS pipeline." << std::endl;
+        return -3;
+    }
+}
+
 } // extern "C"
 
 // **HIGH PRIORITY FFI IMPLEMENTATIONS**
@@ -817,6 +1275,10 @@ llama_mobile_bench_result_c_t llama_mobile_bench_c(llama_mobile_context_handle_t
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
         std::string bench_json = context->bench(pp, tg, pl, nr);
         
@@ -850,23 +1312,71 @@ llama_mobile_bench_result_c_t llama_mobile_bench_c(llama_mobile_context_handle_t
     }
 }
 
-int llama_mobile_apply_lora_adapters_c(llama_mobile_context_handle_t handle, const llama_mobile_lora_adapters_c_t* adapters) {
-    if (!handle || !adapters) {
-        return -1;
+llama_mobile_bench_prefill_result_c_t llama_mobile_bench_prefill_c(llama_mobile_context_handle_t handle, int pp, int nr) {
+    llama_mobile_bench_prefill_result_c_t result = {0};
+    if (!handle) {
+        return result;
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
-        std::vector<common_adapter_lora_info> lora_adapters;
+        std::string bench_json = context->benchPrefill(pp, nr);
         
-        for (int i = 0; i < adapters->count; ++i) {
-            common_adapter_lora_info adapter;
-            adapter.path = adapters->adapters[i].path;
-            adapter.scale = adapters->adapters[i].scale;
-            lora_adapters.push_back(adapter);
-        }
+        char model_desc[128];
+        llama_model_desc(context->model, model_desc, sizeof(model_desc));
+        result.model_name = safe_strdup(model_desc);
         
-        return context->applyLoraAdapters(lora_adapters);
+        std::istringstream ss(bench_json);
+        std::string token;
+        std::vector<std::string> tokens;
+        
+        ss.ignore(1);
+        while (std::getline(ss, token, ',')) {
+            if (token.back() == ']') token.pop_back();
+            tokens.push_back(token);
+        }
+        
+        if (tokens.size() >= 7) {
+            result.n_prompt = std::stoi(tokens[1]);
+            result.n_batch = std::stoi(tokens[2]);
+            result.prefill_avg = std::stod(tokens[3]);
+            result.prefill_std = std::stod(tokens[4]);
+            result.raw_avg = std::stod(tokens[5]);
+            result.raw_std = std::stod(tokens[6]);
+        }
+        
+        return result;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during prefill benchmarking: " << e.what() << std::endl;
+        return {0};
+    }
+}
+
+int llama_mobile_apply_lora_adapters_c(llama_mobile_context_handle_t handle, const llama_mobile_lora_adapters_c_t* adapters) {
+    if (!handle || !adapters) {
+        return -1;
+    }
+    
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        std::vector<common_adapter_lora_info> lora_adapters;
+        
+        for (int i = 0; i < adapters->count; ++i) {
+            common_adapter_lora_info adapter;
+            adapter.path = adapters->adapters[i].path;
+            adapter.scale = adapters->adapters[i].scale;
+            lora_adapters.push_back(adapter);
+        }
+        
+        return context->applyLoraAdapters(lora_adapters);
     } catch (const std::exception& e) {
         std::cerr << "Error applying LoRA adapters: " << e.what() << std::endl;
         return -2;
@@ -879,6 +1389,10 @@ void llama_mobile_remove_lora_adapters_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->removeLoraAdapters();
     } catch (const std::exception& e) {
@@ -893,6 +1407,10 @@ llama_mobile_lora_adapters_c_t llama_mobile_get_loaded_lora_adapters_c(llama_mob
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
         auto loaded_adapters = context->getLoadedLoraAdapters();
         
@@ -917,6 +1435,90 @@ llama_mobile_lora_adapters_c_t llama_mobile_get_loaded_lora_adapters_c(llama_mob
     }
 }
 
+void llama_mobile_configure_lora_registry_c(llama_mobile_context_handle_t handle, int64_t max_bytes) {
+    if (!handle) {
+        return;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
+    context->configureLoraRegistry(max_bytes > 0 ? static_cast<size_t>(max_bytes) : 0);
+}
+
+int llama_mobile_register_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id, const char* path) {
+    if (!handle || !id || !path) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        return context->registerLoraAdapter(id, path);
+    } catch (const std::exception& e) {
+        std::cerr << "Error registering LoRA adapter: " << e.what() << std::endl;
+        return -4;
+    }
+}
+
+int llama_mobile_unregister_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id) {
+    if (!handle || !id) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    return context->unregisterLoraAdapter(id);
+}
+
+int llama_mobile_select_lora_adapters_c(llama_mobile_context_handle_t handle, const char** ids, const float* scales, int count) {
+    if (!handle || (count > 0 && !ids)) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        return context->selectLoraAdapters(lora_selection_from_c(ids, scales, count));
+    } catch (const std::exception& e) {
+        std::cerr << "Error selecting LoRA adapters: " << e.what() << std::endl;
+        return -4;
+    }
+}
+
+llama_mobile_lora_registry_stats_c_t llama_mobile_get_lora_registry_stats_c(llama_mobile_context_handle_t handle) {
+    llama_mobile_lora_registry_stats_c_t result = {0, 0, 0, 0, 0, 0, 0};
+    if (!handle) {
+        return result;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
+    const llama_mobile::llama_mobile_lora_registry_stats& stats = context->lora_registry.stats;
+    result.loads = stats.loads;
+    result.hits = stats.hits;
+    result.evictions = stats.evictions;
+    result.switches = stats.switches;
+    result.bytes = static_cast<int64_t>(stats.bytes);
+    result.n_registered = static_cast<int32_t>(stats.n_registered);
+    result.n_resident = static_cast<int32_t>(stats.n_resident);
+    return result;
+}
+
 bool llama_mobile_validate_chat_template_c(llama_mobile_context_handle_t handle, bool use_jinja, const char* name) {
     if (!handle) {
         return false;
@@ -986,12 +1588,34 @@ llama_mobile_chat_result_c_t llama_mobile_get_formatted_chat_with_jinja_c(
     }
 }
 
+llama_mobile_grammar_cache_stats_c_t llama_mobile_get_grammar_cache_stats_c(void) {
+    llama_mobile_grammar_cache_stats_c_t result = {0, 0, 0, 0, 0, 0, 0, 0};
+    const llama_mobile::llama_mobile_grammar_cache_stats stats = llama_mobile::grammar_cache_stats();
+    result.schema_hits = stats.schema_hits;
+    result.schema_misses = stats.schema_misses;
+    result.grammar_hits = stats.grammar_hits;
+    result.grammar_misses = stats.grammar_misses;
+    result.evictions = stats.evictions;
+    result.n_schemas = static_cast<int32_t>(stats.n_schemas);
+    result.n_grammars = static_cast<int32_t>(stats.n_grammars);
+    result.mask_bytes = static_cast<int64_t>(stats.mask_bytes);
+    return result;
+}
+
+void llama_mobile_clear_grammar_cache_c(void) {
+    llama_mobile::grammar_cache_clear();
+}
+
 void llama_mobile_rewind_c(llama_mobile_context_handle_t handle) {
     if (!handle) {
         return;
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->rewind();
     } catch (const std::exception& e) {
@@ -1005,6 +1629,10 @@ bool llama_mobile_init_sampling_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return false;
+    }
     try {
         return context->initSampling();
     } catch (const std::exception& e) {
@@ -1013,12 +1641,207 @@ bool llama_mobile_init_sampling_c(llama_mobile_context_handle_t handle) {
     }
 }
 
+int llama_mobile_configure_context_shift_c(llama_mobile_context_handle_t handle, const llama_mobile_context_shift_params_c_t* params) {
+    if (!handle || !params || params->policy < llama_mobile::CONTEXT_SHIFT_HALF || params->policy > llama_mobile::CONTEXT_SHIFT_NONE) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        llama_mobile::llama_mobile_context_shift_params shift_params;
+        shift_params.policy = static_cast<llama_mobile::context_shift_policy>(params->policy);
+        shift_params.keep_turns = params->keep_turns;
+        shift_params.n_free = params->n_free;
+        shift_params.keep_first_turn = params->keep_first_turn;
+        shift_params.turn_markers = c_str_array_to_vector(params->turn_markers, params->turn_marker_count);
+        return context->configureContextShift(shift_params) ? 0 : -1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error configuring context shift: " << e.what() << std::endl;
+        return -2;
+    }
+}
+
+int llama_mobile_configure_prefix_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_prefix_cache_params_c_t* params) {
+    if (!handle || !params) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        llama_mobile::llama_mobile_prefix_cache_params cache_params;
+        cache_params.max_bytes = params->max_bytes > 0 ? static_cast<size_t>(params->max_bytes) : 0;
+        if (params->disk_dir) {
+            cache_params.disk_dir = params->disk_dir;
+        }
+        if (params->boundaries && params->boundary_count > 0) {
+            cache_params.boundaries.assign(params->boundaries, params->boundaries + params->boundary_count);
+        }
+        cache_params.snapshot_prompt_end = params->snapshot_prompt_end;
+        cache_params.min_tokens = params->min_tokens;
+        return context->configurePrefixCache(cache_params) ? 0 : -1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error configuring prefix cache: " << e.what() << std::endl;
+        return -2;
+    }
+}
+
+llama_mobile_prefix_cache_stats_c_t llama_mobile_get_prefix_cache_stats_c(llama_mobile_context_handle_t handle) {
+    llama_mobile_prefix_cache_stats_c_t result = {0, 0, 0, 0, 0, 0, 0};
+    if (!handle) {
+        return result;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
+    const llama_mobile::llama_mobile_prefix_cache_stats& stats = context->prefix_cache.stats;
+    result.hits = stats.hits;
+    result.disk_hits = stats.disk_hits;
+    result.misses = stats.misses;
+    result.snapshots = stats.snapshots;
+    result.evictions = stats.evictions;
+    result.bytes = static_cast<int64_t>(stats.bytes);
+    result.n_entries = static_cast<int32_t>(stats.n_entries);
+    return result;
+}
+
+void llama_mobile_clear_prefix_cache_c(llama_mobile_context_handle_t handle) {
+    if (!handle) {
+        return;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
+    try {
+        context->prefix_cache.clear();
+    } catch (const std::exception& e) {
+        std::cerr << "Error clearing prefix cache: " << e.what() << std::endl;
+    }
+}
+
+int llama_mobile_configure_media_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_media_cache_params_c_t* params) {
+    if (!handle || !params) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        llama_mobile::llama_mobile_media_cache_params cache_params;
+        cache_params.max_bytes = params->max_bytes > 0 ? static_cast<size_t>(params->max_bytes) : 0;
+        if (params->disk_dir) {
+            cache_params.disk_dir = params->disk_dir;
+        }
+        cache_params.max_disk_bytes = params->max_disk_bytes > 0 ? static_cast<size_t>(params->max_disk_bytes) : 0;
+        return context->configureMediaCache(cache_params) ? 0 : -1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error configuring media cache: " << e.what() << std::endl;
+        return -2;
+    }
+}
+
+llama_mobile_media_cache_stats_c_t llama_mobile_get_media_cache_stats_c(llama_mobile_context_handle_t handle) {
+    llama_mobile_media_cache_stats_c_t result = {0, 0, 0, 0, 0, 0, 0, 0};
+    if (!handle) {
+        return result;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
+    const llama_mobile::llama_mobile_media_cache_stats& stats = context->media_cache.stats;
+    result.hits = stats.hits;
+    result.disk_hits = stats.disk_hits;
+    result.misses = stats.misses;
+    result.evictions = stats.evictions;
+    result.encode_ms = stats.encode_ms;
+    result.encode_ms_saved = stats.encode_ms_saved;
+    result.bytes = static_cast<int64_t>(stats.bytes);
+    result.n_entries = static_cast<int32_t>(stats.n_entries);
+    return result;
+}
+
+void llama_mobile_clear_media_cache_c(llama_mobile_context_handle_t handle) {
+    if (!handle) {
+        return;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
+    try {
+        context->media_cache.clear();
+    } catch (const std::exception& e) {
+        std::cerr << "Error clearing media cache: " << e.what() << std::endl;
+    }
+}
+
+int llama_mobile_session_save_c(llama_mobile_context_handle_t handle, const char* path) {
+    if (!handle || !path) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        return context->saveSession(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Error saving session: " << e.what() << std::endl;
+        return -2;
+    }
+}
+
+int llama_mobile_session_load_c(llama_mobile_context_handle_t handle, const char* path) {
+    if (!handle || !path) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
+    try {
+        return context->loadSession(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading session: " << e.what() << std::endl;
+        return -2;
+    }
+}
+
 void llama_mobile_begin_completion_c(llama_mobile_context_handle_t handle) {
     if (!handle) {
         return;
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->beginCompletion();
     } catch (const std::exception& e) {
@@ -1032,6 +1855,10 @@ void llama_mobile_end_completion_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->endCompletion();
     } catch (const std::exception& e) {
@@ -1045,6 +1872,10 @@ void llama_mobile_load_prompt_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->loadPrompt();
     } catch (const std::exception& e) {
@@ -1058,6 +1889,10 @@ void llama_mobile_load_prompt_with_media_c(llama_mobile_context_handle_t handle,
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         std::vector<std::string> media_vec;
         if (media_paths && media_count > 0) {
@@ -1079,6 +1914,11 @@ int llama_mobile_do_completion_step_c(llama_mobile_context_handle_t handle, char
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        *token_text = safe_strdup("");
+        return LLAMA_MOBILE_ERROR_BUSY;
+    }
     try {
         llama_mobile::completion_token_output token_output = context->doCompletion();
         
@@ -1103,6 +1943,10 @@ size_t llama_mobile_find_stopping_strings_c(llama_mobile_context_handle_t handle
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return SIZE_MAX;
+    }
     try {
         llama_mobile::stop_type type = static_cast<llama_mobile::stop_type>(stop_type);
         return context->findStoppingStrings(text, last_token_size, type);
@@ -1191,6 +2035,13 @@ void llama_mobile_free_bench_result_members_c(llama_mobile_bench_result_c_t* res
     }
 }
 
+void llama_mobile_free_bench_prefill_result_members_c(llama_mobile_bench_prefill_result_c_t* result) {
+    if (result) {
+        llama_mobile_free_string_c(result->model_name);
+        result->model_name = nullptr;
+    }
+}
+
 void llama_mobile_free_lora_adapters_c(llama_mobile_lora_adapters_c_t* adapters) {
     if (adapters && adapters->adapters) {
         for (int i = 0; i < adapters->count; ++i) {
@@ -1222,6 +2073,10 @@ char* llama_mobile_generate_response_c(llama_mobile_context_handle_t handle, con
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return safe_strdup("");
+    }
     try {
         std::string result = context->generateResponse(user_message, max_tokens);
         return safe_strdup(result);
@@ -1241,6 +2096,10 @@ llama_mobile_conversation_result_c_t llama_mobile_continue_conversation_c(llama_
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return result;
+    }
     try {
         llama_mobile::conversation_result cpp_result = context->continueConversation(user_message, max_tokens);
         
@@ -1265,6 +2124,10 @@ void llama_mobile_clear_conversation_c(llama_mobile_context_handle_t handle) {
     }
     
     llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+    auto context_lock = lock_context(context);
+    if (!context_lock) {
+        return;
+    }
     try {
         context->clearConversation();
     } catch (const std::exception& e) {
@@ -1301,4 +2164,271 @@ LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_conversation_result_members_c(lla
     }
 }
 
+
+// **CONTINUOUS BATCHING ENGINE**
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_engine_handle_t llama_mobile_engine_init_c(const llama_mobile_init_params_c_t* params, int32_t n_parallel) {
+    if (!params || !params->model_path) {
+        std::cerr << "[FFI] Error: engine params or model_path is null" << std::endl;
+        return nullptr;
+    }
+
+    llama_mobile::llama_mobile_engine* engine = nullptr;
+    try {
+        engine = new llama_mobile::llama_mobile_engine();
+
+        common_params cpp_params;
+        if (!init_params_to_common(params, cpp_params)) {
+            delete engine;
+            return nullptr;
+        }
+
+        if (!engine->loadModel(cpp_params, n_parallel)) {
+            std::cerr << "[FFI] Error: engine->loadModel() returned false" << std::endl;
+            delete engine;
+            return nullptr;
+        }
+        return reinterpret_cast<llama_mobile_engine_handle_t>(engine);
+    } catch (const std::exception& e) {
+        std::cerr << "[FFI] Error initializing engine: " << e.what() << std::endl;
+        if (engine) delete engine;
+        return nullptr;
+    } catch (...) {
+        std::cerr << "[FFI] Unknown error initializing engine." << std::endl;
+        if (engine) delete engine;
+        return nullptr;
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_engine_submit_c(
+    llama_mobile_engine_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_engine_token_callback_c_t token_callback,
+    llama_mobile_engine_complete_callback_c_t complete_callback,
+    void* user_data
+) {
+    if (!handle || !params || !params->prompt) {
+        return -1;
+    }
+    llama_mobile::llama_mobile_engine* engine = reinterpret_cast<llama_mobile::llama_mobile_engine*>(handle);
+
+    try {
+        common_params cpp_params;
+        completion_params_to_common(params, cpp_params);
+
+        llama_mobile::llama_mobile_engine_request request;
+        request.prompt = params->prompt;
+        request.n_predict = cpp_params.n_predict;
+        request.sampling = cpp_params.sampling;
+        request.antiprompt = cpp_params.antiprompt;
+        if (params->lora_ids && params->lora_count > 0 && params->lora_ids[0]) {
+            request.lora_id = params->lora_ids[0];
+            request.lora_scale = params->lora_scales ? params->lora_scales[0] : 1.0f;
+        }
+
+        if (token_callback) {
+            request.on_token = [token_callback, user_data](int32_t request_id, llama_token, const std::string& piece) {
+                return token_callback(request_id, piece.c_str(), user_data);
+            };
+        }
+        if (complete_callback) {
+            // The result only lives for the duration of the callback, copy out anything that is needed
+            request.on_complete = [complete_callback, user_data](int32_t request_id, const llama_mobile::llama_mobile_engine_result& res) {
+                llama_mobile_completion_result_c_t result = {};
+                result.text = safe_strdup(res.text);
+                result.tokens_predicted = static_cast<int32_t>(res.tokens_predicted);
+                result.tokens_evaluated = static_cast<int32_t>(res.tokens_evaluated);
+                result.truncated = res.truncated;
+                result.stopped_eos = res.stopped_eos;
+                result.stopped_word = res.stopped_word;
+                result.stopped_limit = res.stopped_limit;
+                result.cancelled = res.cancelled;
+                result.stopping_word = safe_strdup(res.stopping_word);
+                result.error = res.error.empty() ? nullptr : safe_strdup(res.error);
+                complete_callback(request_id, &result, user_data);
+                llama_mobile_free_completion_result_members_c(&result);
+            };
+        }
+
+        return engine->submit(std::move(request));
+    } catch (const std::exception& e) {
+        std::cerr << "[FFI] Error submitting engine request: " << e.what() << std::endl;
+        return -1;
+    } catch (...) {
+        std::cerr << "[FFI] Unknown error submitting engine request." << std::endl;
+        return -1;
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_cancel_c(llama_mobile_engine_handle_t handle, int32_t request_id) {
+    if (handle) {
+        reinterpret_cast<llama_mobile::llama_mobile_engine*>(handle)->cancel(request_id);
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_engine_register_lora_adapter_c(llama_mobile_engine_handle_t handle, const char* id, const char* path) {
+    if (!handle || !id || !path) {
+        return -1;
+    }
+
+    llama_mobile::llama_mobile_engine* engine = reinterpret_cast<llama_mobile::llama_mobile_engine*>(handle);
+    try {
+        return engine->registerLoraAdapter(id, path);
+    } catch (const std::exception& e) {
+        std::cerr << "[FFI] Error registering engine LoRA adapter: " << e.what() << std::endl;
+        return -4;
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_free_c(llama_mobile_engine_handle_t handle) {
+    if (handle) {
+        llama_mobile::llama_mobile_engine* engine = reinterpret_cast<llama_mobile::llama_mobile_engine*>(handle);
+        delete engine;
+    }
+}
+
+// **ASYNC COMPLETION**
+// A request handle owns one reference to the request, the worker holds another
+// until it is done with it, so releasing a running request is safe.
+typedef std::shared_ptr<llama_mobile::llama_mobile_async_request> async_request_ref;
+
+static_assert(LLAMA_MOBILE_ASYNC_TOKEN_TEXT_SIZE == sizeof(llama_mobile::llama_mobile_async_chunk::text),
+              "async token text size must match the worker's chunk size");
+
+static const size_t ASYNC_RING_CAPACITY = 256;
+
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_async_request_handle_t llama_mobile_completion_async_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_async_notify_callback_c_t notify_callback,
+    void* user_data
+) {
+    if (!handle || !params || !params->prompt) {
+        return nullptr;
+    }
+    llama_mobile::llama_mobile_context* context = reinterpret_cast<llama_mobile::llama_mobile_context*>(handle);
+
+    try {
+        llama_mobile::llama_mobile_async_worker* worker = context->asyncWorker();
+        if (worker == nullptr) {
+            return nullptr;
+        }
+
+        common_params cpp_params;
+        completion_params_to_common(params, cpp_params);
+
+        auto request = std::make_shared<llama_mobile::llama_mobile_async_request>(ASYNC_RING_CAPACITY);
+        request->prompt = params->prompt;
+        request->n_predict = cpp_params.n_predict;
+        request->n_threads = params->n_threads;
+        request->sampling = cpp_params.sampling;
+        request->antiprompt = cpp_params.antiprompt;
+        if (params->lora_ids) {
+            request->select_lora = true;
+            request->lora = lora_selection_from_c(params->lora_ids, params->lora_scales, params->lora_count);
+        }
+        if (notify_callback) {
+            // Capture the id by value, it is assigned on submit before the worker can see the request
+            llama_mobile::llama_mobile_async_request* raw = request.get();
+            request->notify = [notify_callback, user_data, raw]() {
+                notify_callback(raw->id, user_data);
+            };
+        }
+
+        if (worker->submit(request) < 0) {
+            return nullptr;
+        }
+        return reinterpret_cast<llama_mobile_async_request_handle_t>(new async_request_ref(std::move(request)));
+    } catch (const std::exception& e) {
+        std::cerr << "[FFI] Error submitting async completion: " << e.what() << std::endl;
+        return nullptr;
+    } catch (...) {
+        std::cerr << "[FFI] Unknown error submitting async completion." << std::endl;
+        return nullptr;
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_request_id_c(llama_mobile_async_request_handle_t request) {
+    if (!request) {
+        return -1;
+    }
+    return (*reinterpret_cast<async_request_ref*>(request))->id;
+}
+
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_poll_c(llama_mobile_async_request_handle_t request, llama_mobile_async_token_c_t* tokens, int32_t max_tokens) {
+    if (!request || !tokens || max_tokens <= 0) {
+        return 0;
+    }
+    llama_mobile::llama_mobile_async_request& req = **reinterpret_cast<async_request_ref*>(request);
+
+    int32_t n = 0;
+    llama_mobile::llama_mobile_async_chunk chunk;
+    while (n < max_tokens && req.tokens.pop(chunk)) {
+        tokens[n].token = chunk.token;
+        tokens[n].length = chunk.length;
+        tokens[n].partial = chunk.partial;
+        memcpy(tokens[n].text, chunk.text, chunk.length);
+        ++n;
+    }
+    return n;
+}
+
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_state_c(llama_mobile_async_request_handle_t request) {
+    if (!request) {
+        return LLAMA_MOBILE_ASYNC_FAILED;
+    }
+    return (*reinterpret_cast<async_request_ref*>(request))->state.load(std::memory_order_acquire);
+}
+
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_wait_c(llama_mobile_async_request_handle_t request, int32_t timeout_ms) {
+    if (!request) {
+        return LLAMA_MOBILE_ASYNC_FAILED;
+    }
+    llama_mobile::llama_mobile_async_request& req = **reinterpret_cast<async_request_ref*>(request);
+    req.wait(timeout_ms);
+    return req.state.load(std::memory_order_acquire);
+}
+
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_result_c(llama_mobile_async_request_handle_t request, llama_mobile_completion_result_c_t* result) {
+    if (!request || !result) {
+        return -1;
+    }
+    const llama_mobile::llama_mobile_async_request& req = **reinterpret_cast<async_request_ref*>(request);
+    if (!req.finished()) {
+        return -2;
+    }
+
+    memset(result, 0, sizeof(llama_mobile_completion_result_c_t));
+    result->text = safe_strdup(req.result.text);
+    result->tokens_predicted = static_cast<int32_t>(req.result.tokens_predicted);
+    result->tokens_evaluated = static_cast<int32_t>(req.result.tokens_evaluated);
+    result->truncated = req.result.truncated;
+    result->stopped_eos = req.result.stopped_eos;
+    result->stopped_word = req.result.stopped_word;
+    result->stopped_limit = req.result.stopped_limit;
+    result->cancelled = req.result.cancelled;
+    result->stopping_word = safe_strdup(req.result.stopping_word);
+    result->n_drafted = static_cast<int32_t>(req.n_drafted);
+    result->n_draft_accepted = static_cast<int32_t>(req.n_draft_accepted);
+    if (result->n_drafted > 0) {
+        result->draft_acceptance_rate = static_cast<double>(result->n_draft_accepted) / result->n_drafted;
+    }
+    result->tokens_per_second = req.tokens_per_second;
+    return req.state.load(std::memory_order_acquire) == LLAMA_MOBILE_ASYNC_FAILED ? -3 : 0;
+}
+
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_cancel_c(llama_mobile_async_request_handle_t request) {
+    if (request) {
+        (*reinterpret_cast<async_request_ref*>(request))->cancelled = true;
+    }
+}
+
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_release_c(llama_mobile_async_request_handle_t request) {
+    if (request) {
+        async_request_ref* ref = reinterpret_cast<async_request_ref*>(request);
+        // Nobody can read the output any more, stop generating it
+        (*ref)->cancelled = true;
+        delete ref;
+    }
+}
+
 } // extern "C"
\ No newline at end of file
@@ -55,9 +55,32 @@ typedef struct llama_mobile_init_params_c {
     const char* cache_type_k; 
     const char* cache_type_v; 
     void (*progress_callback)(float progress); 
+    const char* draft_model_path; // enables speculative decoding with this draft model
+    bool prompt_lookup; // speculative decoding from prompt n-grams, used when draft_model_path is NULL
+    int32_t n_draft; // max tokens drafted per step, 0 for default
+    int32_t n_seq_max; // sequences for llama_mobile_embedding_batch_c batches and llama_mobile_completion_n_c branches, 0 for 1
 
 } llama_mobile_init_params_c_t;
 
+typedef struct llama_mobile_token_prob_c {
+    int32_t token;
+    float prob;
+} llama_mobile_token_prob_c_t;
+
+// Streamed token, valid only for the duration of the callback.
+// text + offset points at length bytes of the generated text so far. Text that may
+// still complete a stop sequence is held back until it is ruled out, as are partial
+// code points in UTF-8 safe mode, so a span can cover several tokens or be delivered
+// after generation ends.
+typedef struct llama_mobile_token_event_c {
+    const char* text;
+    size_t offset;
+    size_t length;
+    int32_t token;
+    const llama_mobile_token_prob_c_t* probs; // top n_probs candidates, NULL when n_probs is 0
+    int32_t n_probs;
+} llama_mobile_token_event_c_t;
+
 typedef struct llama_mobile_completion_params_c {
     const char* prompt;
     int32_t n_predict; 
@@ -80,7 +103,16 @@ typedef struct llama_mobile_completion_params_c {
     const char** stop_sequences; 
     int stop_sequence_count;
     const char* grammar; 
-    bool (*token_callback)(const char* token_json);
+    bool (*token_callback)(const char* token);
+    bool (*token_event_callback)(const llama_mobile_token_event_c_t* event, void* user_data);
+    void* token_event_user_data;
+    bool token_event_utf8_safe; // only fire token_event_callback on complete UTF-8 code points
+    void (*audio_callback)(const float* pcm, int32_t n_samples, void* user_data); // streaming TTS PCM, needs the vocoder
+    void* audio_user_data;
+    int32_t audio_window_codes; // audio codes per vocoder call, 0 for the default
+    const char** lora_ids; // registered LoRA adapters for this request, NULL keeps the current set
+    const float* lora_scales; // one per id, NULL for 1.0
+    int32_t lora_count; // 0 with lora_ids set selects the base model
 
 } llama_mobile_completion_params_c_t;
 
@@ -103,7 +135,15 @@ typedef struct llama_mobile_completion_result_c {
     bool stopped_eos;
     bool stopped_word;
     bool stopped_limit;
+    bool cancelled; // stopped by a callback, a stop request or the engine shutting down
     char* stopping_word; 
+    int32_t n_drafted; // speculative decoding only
+    int32_t n_draft_accepted;
+    double draft_acceptance_rate;
+    double tokens_per_second; // decode rate after the first token
+    double time_to_first_audio_ms; // streaming TTS only
+    int32_t audio_samples;
+    char* error; // engine only: why the request could not be served, NULL otherwise
 } llama_mobile_completion_result_c_t;
 
 typedef struct llama_mobile_tokenize_result_c {
@@ -115,18 +155,56 @@ typedef struct llama_mobile_tokenize_result_c {
     int chunk_position_count;
     size_t* chunk_positions_media;
     int chunk_position_media_count;
+    size_t* media_n_tokens; // positions taken by each media, in input order
+    int media_n_tokens_count;
 } llama_mobile_tokenize_result_c_t;
 
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_context_handle_t llama_mobile_init_context_c(const llama_mobile_init_params_c_t* params);
 
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_context_c(llama_mobile_context_handle_t handle);
 
+// **BACKGROUND MODEL LOADING**
+typedef struct llama_mobile_load_task_opaque* llama_mobile_load_task_handle_t;
+typedef void (*llama_mobile_load_callback_c_t)(int32_t state, float progress, void* user_data);
+
+typedef enum {
+    LLAMA_MOBILE_LOAD_VOCAB = 0,
+    LLAMA_MOBILE_LOAD_WEIGHTS = 1,
+    LLAMA_MOBILE_LOAD_DONE = 2,
+    LLAMA_MOBILE_LOAD_CANCELLED = 3,
+    LLAMA_MOBILE_LOAD_FAILED = 4
+} llama_mobile_load_state_c_t;
+
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_load_task_handle_t llama_mobile_init_context_async_c(
+    const llama_mobile_init_params_c_t* params,
+    llama_mobile_load_callback_c_t callback,
+    void* user_data
+);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_load_state_c(llama_mobile_load_task_handle_t task);
+LLAMA_MOBILE_FFI_EXPORT float llama_mobile_load_progress_c(llama_mobile_load_task_handle_t task);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_load_wait_c(llama_mobile_load_task_handle_t task, int32_t timeout_ms);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_load_cancel_c(llama_mobile_load_task_handle_t task);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_token_array_c_t llama_mobile_load_tokenize_c(llama_mobile_load_task_handle_t task, const char* text);
+LLAMA_MOBILE_FFI_EXPORT char* llama_mobile_load_get_formatted_chat_c(llama_mobile_load_task_handle_t task, const char* messages, const char* chat_template);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_context_handle_t llama_mobile_load_take_context_c(llama_mobile_load_task_handle_t task);
+// Waits for a callback in progress, none runs once it returns and user_data may be freed
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_load_release_c(llama_mobile_load_task_handle_t task);
+
 LLAMA_MOBILE_FFI_EXPORT int llama_mobile_completion_c(
     llama_mobile_context_handle_t handle,
     const llama_mobile_completion_params_c_t* params,
     llama_mobile_completion_result_c_t* result
 );
 
+// n alternative completions of one prompt, evaluated once and decoded as n sequences in
+// one batch per step; n is at most n_seq_max, results holds n entries
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_completion_n_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    int32_t n,
+    llama_mobile_completion_result_c_t* results
+);
+
 // **MULTIMODAL COMPLETION**
 LLAMA_MOBILE_FFI_EXPORT int llama_mobile_multimodal_completion_c(
     llama_mobile_context_handle_t handle,
@@ -143,6 +221,8 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_token_array_c_t llama_mobile_tokenize_c(lla
 LLAMA_MOBILE_FFI_EXPORT char* llama_mobile_detokenize_c(llama_mobile_context_handle_t handle, const int32_t* tokens, int32_t count);
 
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_float_array_c_t llama_mobile_embedding_c(llama_mobile_context_handle_t handle, const char* text);
+// Embeds count texts into out_matrix, row-major count x n_embd, without touching the sampler
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_embedding_batch_c(llama_mobile_context_handle_t handle, const char** texts, int32_t count, float* out_matrix);
 
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_string_c(char* str);
 
@@ -182,6 +262,8 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_float_array_c_t llama_mobile_decode_audio_t
 
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_release_vocoder_c(llama_mobile_context_handle_t handle);
 
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_tts_pipeline_c(llama_mobile_context_handle_t handle, bool enabled, int32_t n_threads_llm, int32_t n_threads_vocoder, int32_t queue_windows);
+
 // **HIGH PRIORITY ADDITIONS**
 
 typedef struct {
@@ -194,6 +276,16 @@ typedef struct {
     int32_t count;
 } llama_mobile_lora_adapters_c_t;
 
+typedef struct {
+    int64_t loads; // adapter files read, including reloads after eviction
+    int64_t hits; // selections served by an adapter already in memory
+    int64_t evictions;
+    int64_t switches; // changes of the adapter set on the context
+    int64_t bytes;
+    int32_t n_registered;
+    int32_t n_resident;
+} llama_mobile_lora_registry_stats_c_t;
+
 typedef struct {
     char* model_name;
     int64_t model_size;
@@ -204,6 +296,16 @@ typedef struct {
     double tg_std;
 } llama_mobile_bench_result_c_t;
 
+typedef struct {
+    char* model_name;
+    int32_t n_prompt;
+    int32_t n_batch;
+    double prefill_avg; // tokens/sec through the completion path
+    double prefill_std;
+    double raw_avg; // tokens/sec through raw llama_decode
+    double raw_std;
+} llama_mobile_bench_prefill_result_c_t;
+
 typedef struct {
     char* text;
     int64_t time_to_first_token; // milliseconds
@@ -211,13 +313,64 @@ typedef struct {
     int32_t tokens_generated;
 } llama_mobile_conversation_result_c_t;
 
+typedef struct {
+    int64_t max_bytes; // RAM budget for snapshots, 0 disables the cache
+    const char* disk_dir; // optional directory snapshots are spilled to, NULL for RAM only
+    const int32_t* boundaries; // token counts to snapshot at, e.g. the end of the system prompt
+    int32_t boundary_count;
+    bool snapshot_prompt_end;
+    int32_t min_tokens;
+} llama_mobile_prefix_cache_params_c_t;
+
+typedef struct {
+    int64_t hits;
+    int64_t disk_hits;
+    int64_t misses;
+    int64_t snapshots;
+    int64_t evictions;
+    int64_t bytes;
+    int32_t n_entries;
+} llama_mobile_prefix_cache_stats_c_t;
+
+typedef struct {
+    int64_t max_bytes; // RAM budget for media embeddings, 0 disables the cache
+    const char* disk_dir; // optional directory embeddings are persisted to, NULL for RAM only
+    int64_t max_disk_bytes; // budget for the persisted files, 0 for four times max_bytes
+} llama_mobile_media_cache_params_c_t;
+
+typedef struct {
+    int64_t hits;
+    int64_t disk_hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t encode_ms; // time spent in the multimodal encoder on misses
+    int64_t encode_ms_saved; // encoder time the hits would have taken
+    int64_t bytes;
+    int32_t n_entries;
+} llama_mobile_media_cache_stats_c_t;
+
+typedef struct {
+    int32_t policy; // 0 drops half the history, 1 drops the oldest turns, 2 keeps the last turns, 3 stops when full
+    int32_t keep_turns; // turns kept by policy 2
+    int32_t n_free; // tokens freed per shift at least, 0 for n_ctx / 4
+    bool keep_first_turn; // never drop the first message, usually the system prompt
+    const char** turn_markers; // single-token strings that open a message, NULL to detect them
+    int32_t turn_marker_count;
+} llama_mobile_context_shift_params_c_t;
+
 // **HIGH PRIORITY: Benchmarking**
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_bench_result_c_t llama_mobile_bench_c(llama_mobile_context_handle_t handle, int pp, int tg, int pl, int nr);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_bench_prefill_result_c_t llama_mobile_bench_prefill_c(llama_mobile_context_handle_t handle, int pp, int nr);
 
 // **HIGH PRIORITY: LoRA Adapter Support**
 LLAMA_MOBILE_FFI_EXPORT int llama_mobile_apply_lora_adapters_c(llama_mobile_context_handle_t handle, const llama_mobile_lora_adapters_c_t* adapters);
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_remove_lora_adapters_c(llama_mobile_context_handle_t handle);
 LLAMA_MOBILE_FFI_EXPORT llama_mobile_lora_adapters_c_t llama_mobile_get_loaded_lora_adapters_c(llama_mobile_context_handle_t handle);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_configure_lora_registry_c(llama_mobile_context_handle_t handle, int64_t max_bytes);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_register_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id, const char* path);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_unregister_lora_adapter_c(llama_mobile_context_handle_t handle, const char* id);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_select_lora_adapters_c(llama_mobile_context_handle_t handle, const char** ids, const float* scales, int count);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_lora_registry_stats_c_t llama_mobile_get_lora_registry_stats_c(llama_mobile_context_handle_t handle);
 
 // **HIGH PRIORITY: Chat Template Support**
 LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_validate_chat_template_c(llama_mobile_context_handle_t handle, bool use_jinja, const char* name);
@@ -242,9 +395,39 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_chat_result_c_t llama_mobile_get_formatted_
     const char* tool_choice
 );
 
+// **ADVANCED: Grammar Cache**
+typedef struct {
+    int64_t schema_hits;
+    int64_t schema_misses;
+    int64_t grammar_hits;
+    int64_t grammar_misses;
+    int64_t evictions;
+    int32_t n_schemas;
+    int32_t n_grammars;
+    int64_t mask_bytes;
+} llama_mobile_grammar_cache_stats_c_t;
+
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_grammar_cache_stats_c_t llama_mobile_get_grammar_cache_stats_c(void);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_grammar_cache_c(void);
+
 // **HIGH PRIORITY: Context Management**
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_rewind_c(llama_mobile_context_handle_t handle);
 LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_init_sampling_c(llama_mobile_context_handle_t handle);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_context_shift_c(llama_mobile_context_handle_t handle, const llama_mobile_context_shift_params_c_t* params);
+
+// **HIGH PRIORITY: Prefix Cache**
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_prefix_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_prefix_cache_params_c_t* params);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_prefix_cache_stats_c_t llama_mobile_get_prefix_cache_stats_c(llama_mobile_context_handle_t handle);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_prefix_cache_c(llama_mobile_context_handle_t handle);
+
+// **MULTIMODAL: Media Embedding Cache**
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_configure_media_cache_c(llama_mobile_context_handle_t handle, const llama_mobile_media_cache_params_c_t* params);
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_media_cache_stats_c_t llama_mobile_get_media_cache_stats_c(llama_mobile_context_handle_t handle);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_media_cache_c(llama_mobile_context_handle_t handle);
+
+// **HIGH PRIORITY: Session Persistence**
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_session_save_c(llama_mobile_context_handle_t handle, const char* path);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_session_load_c(llama_mobile_context_handle_t handle, const char* path);
 
 // **COMPLETION CONTROL**
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_begin_completion_c(llama_mobile_context_handle_t handle);
@@ -269,8 +452,64 @@ LLAMA_MOBILE_FFI_EXPORT llama_mobile_conversation_result_c_t llama_mobile_contin
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_clear_conversation_c(llama_mobile_context_handle_t handle);
 LLAMA_MOBILE_FFI_EXPORT bool llama_mobile_is_conversation_active_c(llama_mobile_context_handle_t handle);
 
+// **CONTINUOUS BATCHING ENGINE**
+typedef struct llama_mobile_engine_opaque* llama_mobile_engine_handle_t;
+typedef bool (*llama_mobile_engine_token_callback_c_t)(int32_t request_id, const char* token, void* user_data);
+typedef void (*llama_mobile_engine_complete_callback_c_t)(int32_t request_id, const llama_mobile_completion_result_c_t* result, void* user_data);
+
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_engine_handle_t llama_mobile_engine_init_c(const llama_mobile_init_params_c_t* params, int32_t n_parallel);
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_engine_submit_c(
+    llama_mobile_engine_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_engine_token_callback_c_t token_callback,
+    llama_mobile_engine_complete_callback_c_t complete_callback,
+    void* user_data
+);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_cancel_c(llama_mobile_engine_handle_t handle, int32_t request_id);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_engine_register_lora_adapter_c(llama_mobile_engine_handle_t handle, const char* id, const char* path);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_engine_free_c(llama_mobile_engine_handle_t handle);
+
+// **ASYNC COMPLETION**
+#define LLAMA_MOBILE_ASYNC_TOKEN_TEXT_SIZE 48
+
+// Returned by synchronous calls on a context that an async request or another thread is using
+#define LLAMA_MOBILE_ERROR_BUSY -7
+
+typedef struct llama_mobile_async_request_opaque* llama_mobile_async_request_handle_t;
+typedef void (*llama_mobile_async_notify_callback_c_t)(int32_t request_id, void* user_data);
+
+typedef enum {
+    LLAMA_MOBILE_ASYNC_QUEUED = 0,
+    LLAMA_MOBILE_ASYNC_RUNNING = 1,
+    LLAMA_MOBILE_ASYNC_DONE = 2,
+    LLAMA_MOBILE_ASYNC_CANCELLED = 3,
+    LLAMA_MOBILE_ASYNC_FAILED = 4
+} llama_mobile_async_state_c_t;
+
+typedef struct llama_mobile_async_token_c {
+    int32_t token;
+    int32_t length;
+    bool partial; // the token's text continues in the next entry
+    char text[LLAMA_MOBILE_ASYNC_TOKEN_TEXT_SIZE]; // not NUL-terminated
+} llama_mobile_async_token_c_t;
+
+LLAMA_MOBILE_FFI_EXPORT llama_mobile_async_request_handle_t llama_mobile_completion_async_c(
+    llama_mobile_context_handle_t handle,
+    const llama_mobile_completion_params_c_t* params,
+    llama_mobile_async_notify_callback_c_t notify_callback,
+    void* user_data
+);
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_request_id_c(llama_mobile_async_request_handle_t request);
+LLAMA_MOBILE_FFI_EXPORT int32_t llama_mobile_async_poll_c(llama_mobile_async_request_handle_t request, llama_mobile_async_token_c_t* tokens, int32_t max_tokens);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_state_c(llama_mobile_async_request_handle_t request);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_wait_c(llama_mobile_async_request_handle_t request, int32_t timeout_ms);
+LLAMA_MOBILE_FFI_EXPORT int llama_mobile_async_result_c(llama_mobile_async_request_handle_t request, llama_mobile_completion_result_c_t* result);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_cancel_c(llama_mobile_async_request_handle_t request);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_async_release_c(llama_mobile_async_request_handle_t request);
+
 // Memory management functions
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_bench_result_members_c(llama_mobile_bench_result_c_t* result);
+LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_bench_prefill_result_members_c(llama_mobile_bench_prefill_result_c_t* result);
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_lora_adapters_c(llama_mobile_lora_adapters_c_t* adapters);
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_chat_result_members_c(llama_mobile_chat_result_c_t* result);
 LLAMA_MOBILE_FFI_EXPORT void llama_mobile_free_conversation_result_members_c(llama_mobile_conversation_result_c_t* result);
@@ -0,0 +1,251 @@
+#include "llama_mobile.h"
+#include <cmath>
+#include <utility>
+
+namespace llama_mobile {
+
+// The complex transform of length m = n/2 runs as a Stockham autosort FFT: stage s
+// combines r transforms of length L into transforms of length L*r, reading from one
+// buffer and writing to the other, so no bit reversal pass is needed. Real and
+// imaginary parts live in separate arrays and the innermost loop of every butterfly
+// walks j over [0, L) with unit stride in both buffers and in the twiddle table,
+// which the compiler turns into NEON/SSE code.
+
+static const double fft_pi = 3.14159265358979323846;
+
+bool llama_mobile_rfft::init(int size) {
+    n = 0;
+    radices.clear();
+    twiddle_re.clear();
+    twiddle_im.clear();
+    pack_re.clear();
+    pack_im.clear();
+
+    if (size < 2 || size % 2 != 0) {
+        return false;
+    }
+    const int m = size / 2;
+
+    int rest = m;
+    while (rest % 4 == 0) {
+        radices.push_back(4);
+        rest /= 4;
+    }
+    while (rest % 2 == 0) {
+        radices.push_back(2);
+        rest /= 2;
+    }
+    while (rest % 5 == 0) {
+        radices.push_back(5);
+        rest /= 5;
+    }
+    if (rest != 1) {
+        radices.clear();
+        return false;
+    }
+
+    // Per stage, w_{L*r}^(q*j) for q in [1, r) and j in [0, L), laid out [q-1][j]
+    int L = 1;
+    for (int r : radices) {
+        for (int q = 1; q < r; ++q) {
+            for (int j = 0; j < L; ++j) {
+                double angle = 2.0 * fft_pi * q * j / (L * r);
+                twiddle_re.push_back((float) cos(angle));
+                twiddle_im.push_back((float) sin(angle));
+            }
+        }
+        L *= r;
+    }
+
+    // w_n^k, used to split the packed transform into the even and odd samples
+    pack_re.resize(m);
+    pack_im.resize(m);
+    for (int k = 0; k < m; ++k) {
+        double angle = 2.0 * fft_pi * k / size;
+        pack_re[k] = (float) cos(angle);
+        pack_im[k] = (float) sin(angle);
+    }
+
+    n = size;
+    return true;
+}
+
+size_t llama_mobile_rfft::workSize() const {
+    return (size_t) 2 * n;
+}
+
+static void fft_radix2(int L, int m, int stride,
+                       const float * __restrict in_re, const float * __restrict in_im,
+                       float * __restrict out_re, float * __restrict out_im,
+                       const float * __restrict tw_re, const float * __restrict tw_im) {
+    for (int k = 0; k < m; ++k) {
+        const float * a0r = in_re + k * L;
+        const float * a0i = in_im + k * L;
+        const float * a1r = a0r + stride;
+        const float * a1i = a0i + stride;
+        float * b0r = out_re + k * L * 2;
+        float * b0i = out_im + k * L * 2;
+        float * b1r = b0r + L;
+        float * b1i = b0i + L;
+        for (int j = 0; j < L; ++j) {
+            float x1r = a1r[j] * tw_re[j] - a1i[j] * tw_im[j];
+            float x1i = a1r[j] * tw_im[j] + a1i[j] * tw_re[j];
+            b0r[j] = a0r[j] + x1r;
+            b0i[j] = a0i[j] + x1i;
+            b1r[j] = a0r[j] - x1r;
+            b1i[j] = a0i[j] - x1i;
+        }
+    }
+}
+
+static void fft_radix4(int L, int m, int stride,
+                       const float * __restrict in_re, const float * __restrict in_im,
+                       float * __restrict out_re, float * __restrict out_im,
+                       const float * __restrict tw_re, const float * __restrict tw_im) {
+    const float * w1r = tw_re;
+    const float * w1i = tw_im;
+    const float * w2r = tw_re + L;
+    const float * w2i = tw_im + L;
+    const float * w3r = tw_re + 2 * L;
+    const float * w3i = tw_im + 2 * L;
+    for (int k = 0; k < m; ++k) {
+        const float * a0r = in_re + k * L;
+        const float * a0i = in_im + k * L;
+        float * b0r = out_re + k * L * 4;
+        float * b0i = out_im + k * L * 4;
+        for (int j = 0; j < L; ++j) {
+            float x0r = a0r[j];
+            float x0i = a0i[j];
+            float y1r = a0r[j + stride],     y1i = a0i[j + stride];
+            float y2r = a0r[j + 2 * stride], y2i = a0i[j + 2 * stride];
+            float y3r = a0r[j + 3 * stride], y3i = a0i[j + 3 * stride];
+            float x1r = y1r * w1r[j] - y1i * w1i[j];
+            float x1i = y1r * w1i[j] + y1i * w1r[j];
+            float x2r = y2r * w2r[j] - y2i * w2i[j];
+            float x2i = y2r * w2i[j] + y2i * w2r[j];
+            float x3r = y3r * w3r[j] - y3i * w3i[j];
+            float x3i = y3r * w3i[j] + y3i * w3r[j];
+
+            float s02r = x0r + x2r, s02i = x0i + x2i;
+            float d02r = x0r - x2r, d02i = x0i - x2i;
+            float s13r = x1r + x3r, s13i = x1i + x3i;
+            float d13r = x1r - x3r, d13i = x1i - x3i;
+
+            // Inverse direction, so the quarter turn is +i
+            b0r[j]         = s02r + s13r;
+            b0i[j]         = s02i + s13i;
+            b0r[j + L]     = d02r - d13i;
+            b0i[j + L]     = d02i + d13r;
+            b0r[j + 2 * L] = s02r - s13r;
+            b0i[j + 2 * L] = s02i - s13i;
+            b0r[j + 3 * L] = d02r + d13i;
+            b0i[j + 3 * L] = d02i - d13r;
+        }
+    }
+}
+
+static void fft_radix5(int L, int m, int stride,
+                       const float * __restrict in_re, const float * __restrict in_im,
+                       float * __restrict out_re, float * __restrict out_im,
+                       const float * __restrict tw_re, const float * __restrict tw_im) {
+    const float c1 = (float) cos(2.0 * fft_pi / 5.0);
+    const float c2 = (float) cos(4.0 * fft_pi / 5.0);
+    const float s1 = (float) sin(2.0 * fft_pi / 5.0);
+    const float s2 = (float) sin(4.0 * fft_pi / 5.0);
+    for (int k = 0; k < m; ++k) {
+        const float * a0r = in_re + k * L;
+        const float * a0i = in_im + k * L;
+        float * b0r = out_re + k * L * 5;
+        float * b0i = out_im + k * L * 5;
+        for (int j = 0; j < L; ++j) {
+            float xr[5], xi[5];
+            xr[0] = a0r[j];
+            xi[0] = a0i[j];
+            for (int q = 1; q < 5; ++q) {
+                float yr = a0r[j + q * stride];
+                float yi = a0i[j + q * stride];
+                float wr = tw_re[(q - 1) * L + j];
+                float wi = tw_im[(q - 1) * L + j];
+                xr[q] = yr * wr - yi * wi;
+                xi[q] = yr * wi + yi * wr;
+            }
+
+            float t1r = xr[1] + xr[4], t1i = xi[1] + xi[4];
+            float t2r = xr[2] + xr[3], t2i = xi[2] + xi[3];
+            float t3r = xr[1] - xr[4], t3i = xi[1] - xi[4];
+            float t4r = xr[2] - xr[3], t4i = xi[2] - xi[3];
+
+            float p1r = xr[0] + c1 * t1r + c2 * t2r, p1i = xi[0] + c1 * t1i + c2 * t2i;
+            float p2r = xr[0] + c2 * t1r + c1 * t2r, p2i = xi[0] + c2 * t1i + c1 * t2i;
+            // i * (s1 t3 + s2 t4) and i * (s2 t3 - s1 t4)
+            float q1r = -(s1 * t3i + s2 * t4i), q1i = s1 * t3r + s2 * t4r;
+            float q2r = -(s2 * t3i - s1 * t4i), q2i = s2 * t3r - s1 * t4r;
+
+            b0r[j]         = xr[0] + t1r + t2r;
+            b0i[j]         = xi[0] + t1i + t2i;
+            b0r[j + L]     = p1r + q1r;
+            b0i[j + L]     = p1i + q1i;
+            b0r[j + 4 * L] = p1r - q1r;
+            b0i[j + 4 * L] = p1i - q1i;
+            b0r[j + 2 * L] = p2r + q2r;
+            b0i[j + 2 * L] = p2i + q2i;
+            b0r[j + 3 * L] = p2r - q2r;
+            b0i[j + 3 * L] = p2i - q2i;
+        }
+    }
+}
+
+void llama_mobile_rfft::inverse(const float *spectrum, float *out, float scale, float *work) const {
+    const int m = n / 2;
+    float * re0 = work;
+    float * im0 = work + m;
+    float * re1 = work + 2 * m;
+    float * im1 = work + 3 * m;
+
+    // The even samples of x are the inverse transform of X_k + X_{k+m} and the odd ones
+    // of (X_k - X_{k+m}) w_n^k; with X Hermitian X_{k+m} = conj(X_{m-k}), so both fit
+    // into one complex transform of length m as even + i * odd
+    {
+        float x0 = spectrum[0];
+        float xm = spectrum[2 * m];
+        re0[0] = x0 + xm;
+        im0[0] = x0 - xm;
+    }
+    for (int k = 1; k < m; ++k) {
+        float ar = spectrum[2 * k];
+        float ai = spectrum[2 * k + 1];
+        float br = spectrum[2 * (m - k)];
+        float bi = -spectrum[2 * (m - k) + 1];
+        float er = ar + br, ei = ai + bi;
+        float dr = ar - br, di = ai - bi;
+        float or_ = dr * pack_re[k] - di * pack_im[k];
+        float oi  = dr * pack_im[k] + di * pack_re[k];
+        re0[k] = er - oi;
+        im0[k] = ei + or_;
+    }
+
+    const float * tw_re = twiddle_re.data();
+    const float * tw_im = twiddle_im.data();
+    int L = 1;
+    for (int r : radices) {
+        const int stride = m / r;
+        const int batch = m / (L * r);
+        switch (r) {
+            case 4: fft_radix4(L, batch, stride, re0, im0, re1, im1, tw_re, tw_im); break;
+            case 2: fft_radix2(L, batch, stride, re0, im0, re1, im1, tw_re, tw_im); break;
+            default: fft_radix5(L, batch, stride, re0, im0, re1, im1, tw_re, tw_im); break;
+        }
+        tw_re += (r - 1) * L;
+        tw_im += (r - 1) * L;
+        std::swap(re0, re1);
+        std::swap(im0, im1);
+        L *= r;
+    }
+
+    for (int j = 0; j < m; ++j) {
+        out[2 * j]     = re0[j] * scale;
+        out[2 * j + 1] = im0[j] * scale;
+    }
+}
+
+} // namespace llama_mobile
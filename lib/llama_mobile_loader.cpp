@@ -4,17 +4,45 @@
 
 namespace llama_mobile {
 
+// Called by llama_model_loader after every tensor it reads, returning false aborts the load
+static bool llama_mobile_load_progress(float progress, void *user_data) {
+    llama_mobile_context *context = static_cast<llama_mobile_context *>(user_data);
+    context->loading_progress = progress;
+    if (context->on_load_progress) {
+        context->on_load_progress(progress);
+    }
+    return !context->is_load_interrupted;
+}
+
 bool llama_mobile_context::loadModel(common_params &params_) {
     params = params_;
+    if (params.load_progress_callback == nullptr) {
+        params.load_progress_callback = llama_mobile_load_progress;
+        params.load_progress_callback_user_data = this;
+    }
+    loading_progress = 0;
     LOG_INFO("Starting model loading process for: %s", params.model.path.c_str());
     LOG_INFO("Parameters: n_ctx=%d, n_batch=%d, n_gpu_layers=%d, use_mmap=%d, use_mlock=%d", 
              params.n_ctx, params.n_batch, params.n_gpu_layers, params.use_mmap, params.use_mlock);
     
+    // Registered adapters were loaded against the previous model, they reload on demand
+    if (ctx != nullptr) {
+        llama_clear_adapter_lora(ctx);
+    }
+    lora.clear();
+    lora_identity = 0;
+    lora_registry.unloadAll();
+    prefix_cache.setScope(0);
+
     llama_init = common_init_from_params(params);
     LOG_INFO("common_init_from_params returned: %p", llama_init.get());
     
     if (llama_init == nullptr) {
-        LOG_ERROR("unable to initialize model context: %s", params.model.path.c_str());
+        if (is_load_interrupted) {
+            LOG_INFO("Model loading cancelled: %s", params.model.path.c_str());
+        } else {
+            LOG_ERROR("unable to initialize model context: %s", params.model.path.c_str());
+        }
         return false;
     }
     
@@ -41,10 +69,150 @@ bool llama_mobile_context::loadModel(common_params &params_) {
     n_ctx = llama_n_ctx(ctx);
     LOG_INFO("Context size: %d", n_ctx);
 
+    // The context may clamp n_batch to n_ctx, and llama_decode rejects batches
+    // larger than the effective value, so prefill chunks are sized from it
+    params.n_batch = llama_n_batch(ctx);
+    if (batch.token != nullptr) {
+        llama_batch_free(batch);
+        batch = {};
+    }
+    batch = llama_batch_init(params.n_batch, 0, 1);
+
     LOG_INFO("Model loading process completed successfully!");
     return true;
 }
 
+llama_mobile_load_task::~llama_mobile_load_task() {
+    delete context;
+    templates.reset();
+    if (vocab_model != nullptr) {
+        llama_model_free(vocab_model);
+    }
+}
+
+void llama_mobile_load_task::start() {
+    std::thread([self = shared_from_this()] { self->run(); }).detach();
+}
+
+bool llama_mobile_load_task::finished() const {
+    return state.load(std::memory_order_acquire) >= LOAD_DONE;
+}
+
+bool llama_mobile_load_task::wait(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(done_mutex);
+    if (timeout_ms < 0) {
+        done_cv.wait(lock, [this] { return finished(); });
+        return true;
+    }
+    return done_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return finished(); });
+}
+
+void llama_mobile_load_task::cancel() {
+    std::lock_guard<std::mutex> lock(done_mutex);
+    if (context != nullptr && !finished()) {
+        context->is_load_interrupted = true;
+    }
+}
+
+llama_mobile_context *llama_mobile_load_task::takeContext() {
+    std::lock_guard<std::mutex> lock(done_mutex);
+    if (state.load(std::memory_order_acquire) != LOAD_DONE) {
+        return nullptr;
+    }
+    llama_mobile_context *taken = context;
+    context = nullptr;
+    return taken;
+}
+
+std::vector<llama_token> llama_mobile_load_task::tokenize(const std::string &text) const {
+    if (state.load(std::memory_order_acquire) == LOAD_VOCAB || vocab_model == nullptr) {
+        return {};
+    }
+    return common_tokenize(llama_model_get_vocab(vocab_model), text, false, true);
+}
+
+std::string llama_mobile_load_task::getFormattedChat(const std::string &messages, const std::string &chat_template) const {
+    if (state.load(std::memory_order_acquire) == LOAD_VOCAB || !templates) {
+        LOG_ERROR("Chat templates not loaded yet, cannot format chat.");
+        return "";
+    }
+    return format_chat(vocab_model, templates.get(), messages, chat_template);
+}
+
+void llama_mobile_load_task::setState(llama_mobile_load_state state_, float progress) {
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        state.store(state_, std::memory_order_release);
+    }
+    done_cv.notify_all();
+    notifyState(state_, progress);
+}
+
+void llama_mobile_load_task::notifyState(llama_mobile_load_state state_, float progress) {
+    std::lock_guard<std::recursive_mutex> lock(notify_mutex);
+    if (notify && !released) {
+        notify(state_, progress);
+    }
+}
+
+void llama_mobile_load_task::release() {
+    std::lock_guard<std::recursive_mutex> lock(notify_mutex);
+    released = true;
+}
+
+void llama_mobile_load_task::run() {
+    const int64_t t_start_us = lm_ggml_time_us();
+
+    // Only the GGUF metadata is read here, a few milliseconds even for large vocabularies
+    llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+    vocab_model = llama_model_load_from_file(model_path.c_str(), mparams);
+    if (vocab_model != nullptr) {
+        try {
+            templates = common_chat_templates_init(vocab_model, chat_template);
+        } catch (const std::exception &e) {
+            LOG_ERROR("Failed to initialize chat templates: %s", e.what());
+        }
+    }
+
+    bool ok = vocab_model != nullptr && templates && !context->is_load_interrupted;
+    if (ok) {
+        LOG_INFO("Vocabulary ready in %.1f ms, loading weights", 1e-3 * (lm_ggml_time_us() - t_start_us));
+        setState(LOAD_WEIGHTS, 0.0f);
+
+        context->on_load_progress = [this](float progress) {
+            loading_progress = progress;
+            // The loader reports every tensor, callers only hear about whole percents
+            if (progress >= 1.0f || progress - progress_notified >= 0.01f) {
+                progress_notified = progress;
+                notifyState(LOAD_WEIGHTS, progress);
+            }
+        };
+        try {
+            ok = load(*context);
+        } catch (const std::exception &e) {
+            LOG_ERROR("Error loading model: %s", e.what());
+            ok = false;
+        }
+        context->on_load_progress = nullptr;
+    }
+
+    if (ok && !context->is_load_interrupted) {
+        LOG_INFO("Model loaded in background in %.1f ms", 1e-3 * (lm_ggml_time_us() - t_start_us));
+        loading_progress = 1.0f;
+        setState(LOAD_DONE, 1.0f);
+        return;
+    }
+
+    const bool cancelled = context->is_load_interrupted;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        delete context;
+        context = nullptr;
+    }
+    setState(cancelled ? LOAD_CANCELLED : LOAD_FAILED, loading_progress);
+}
+
 bool llama_mobile_context::validateModelChatTemplate(bool use_jinja, const char *name) const {
     const char * tmpl = llama_model_chat_template(model, name);
     if (tmpl == nullptr) {
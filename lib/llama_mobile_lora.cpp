@@ -1,33 +1,222 @@
 #include "llama_mobile.h"
 #include "llama_cpp/common.h"
 #include "llama_cpp/llama.h"
+#include "llama_cpp/llama-adapter.h"
+#include <algorithm>
+#include <sys/stat.h>
 #include <vector>
 #include <string>
 
 namespace llama_mobile {
 
+static uint64_t lora_hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Identity of an adapter file: its path, size and modification time, so a file
+// replaced at the same path does not pick up the KV snapshots of the old one
+static uint64_t lora_file_identity(const std::string &path) {
+    uint64_t hash = lora_hash_bytes(14695981039346656037ULL, path.data(), path.size());
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        const int64_t size = (int64_t)st.st_size;
+        const int64_t mtime = (int64_t)st.st_mtime;
+        hash = lora_hash_bytes(hash, &size, sizeof(size));
+        hash = lora_hash_bytes(hash, &mtime, sizeof(mtime));
+    }
+    return hash;
+}
+
+// Identity of an adapter set as the KV cache sees it: the adapter files and their
+// scales, independent of the order they were given in. 0 is the base model.
+static uint64_t lora_set_identity(std::vector<std::pair<uint64_t, float>> adapters) {
+    if (adapters.empty()) {
+        return 0;
+    }
+    std::sort(adapters.begin(), adapters.end(), [](const std::pair<uint64_t, float> &a, const std::pair<uint64_t, float> &b) {
+        return a.first != b.first ? a.first < b.first : a.second < b.second;
+    });
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto &adapter : adapters) {
+        hash = lora_hash_bytes(hash, &adapter.first, sizeof(adapter.first));
+        hash = lora_hash_bytes(hash, &adapter.second, sizeof(adapter.second));
+    }
+    return hash != 0 ? hash : 1;
+}
+
+bool llama_mobile_lora_registry::add(const std::string &id, const std::string &path) {
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        if (it->second.path == path) {
+            return true;
+        }
+        if (!remove(id)) {
+            return false;
+        }
+    }
+
+    llama_mobile_lora_registry_entry &entry = entries[id];
+    entry.path = path;
+    entry.identity = lora_file_identity(path);
+    entry.lru_it = lru.end();
+    stats.n_registered = entries.size();
+    return true;
+}
+
+bool llama_mobile_lora_registry::remove(const std::string &id) {
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return true;
+    }
+    if (it->second.active) {
+        return false;
+    }
+    if (it->second.adapter) {
+        lru.erase(it->second.lru_it);
+        stats.bytes -= it->second.bytes;
+        stats.n_resident--;
+    }
+    entries.erase(it);
+    stats.n_registered = entries.size();
+    return true;
+}
+
+llama_mobile_lora_registry::llama_mobile_lora_registry_entry *llama_mobile_lora_registry::acquire(llama_model *model, const std::string &id) {
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return nullptr;
+    }
+    llama_mobile_lora_registry_entry &entry = it->second;
+
+    if (entry.adapter) {
+        lru.splice(lru.begin(), lru, entry.lru_it);
+        stats.hits++;
+        return &entry;
+    }
+
+    const int64_t t_start_us = lm_ggml_time_us();
+    // The file may have changed since it was registered or last evicted
+    entry.identity = lora_file_identity(entry.path);
+    entry.adapter.reset(llama_adapter_lora_init(model, entry.path.c_str()));
+    if (!entry.adapter) {
+        return nullptr;
+    }
+    entry.bytes = 0;
+    for (const auto &buf : entry.adapter->bufs) {
+        entry.bytes += lm_ggml_backend_buffer_get_size(buf.get());
+    }
+    lru.push_front(id);
+    entry.lru_it = lru.begin();
+    stats.bytes += entry.bytes;
+    stats.n_resident++;
+    stats.loads++;
+    LOG_INFO("Loaded LoRA adapter '%s' from %s: %zu bytes in %.1f ms",
+        id.c_str(), entry.path.c_str(), entry.bytes, 1e-3 * (lm_ggml_time_us() - t_start_us));
+    return &entry;
+}
+
+void llama_mobile_lora_registry::unloadAll() {
+    for (auto &it : entries) {
+        it.second.adapter.reset();
+        it.second.bytes = 0;
+        it.second.active = false;
+        it.second.lru_it = lru.end();
+    }
+    lru.clear();
+    stats.bytes = 0;
+    stats.n_resident = 0;
+}
+
+void llama_mobile_lora_registry::evict() {
+    if (max_bytes == 0) {
+        return;
+    }
+    // Adapters set on the context are never freed, the budget may be exceeded by them alone
+    auto it = lru.end();
+    while (stats.bytes > max_bytes && it != lru.begin()) {
+        --it;
+        llama_mobile_lora_registry_entry &entry = entries[*it];
+        if (entry.active) {
+            continue;
+        }
+        LOG_VERBOSE("Evicting LoRA adapter '%s' (%zu bytes)", it->c_str(), entry.bytes);
+        entry.adapter.reset();
+        stats.bytes -= entry.bytes;
+        stats.n_resident--;
+        stats.evictions++;
+        it = lru.erase(it);
+        entry.lru_it = lru.end();
+    }
+}
+
+void llama_mobile_context::setActiveLora(std::vector<common_adapter_lora_info> lora_, uint64_t identity) {
+    if (identity == lora_identity) {
+        return;
+    }
+
+    for (auto &it : lora_registry.entries) {
+        llama_adapter_lora *adapter = it.second.adapter.get();
+        it.second.active = adapter != nullptr && std::any_of(lora_.begin(), lora_.end(),
+            [adapter](const common_adapter_lora_info &la) { return la.ptr == adapter; });
+    }
+
+    this->lora = std::move(lora_);
+    common_set_adapter_lora(ctx, this->lora);
+    lora_identity = identity;
+    lora_registry.stats.switches++;
+
+    // The KV cache was filled under the previous adapters; cached prefixes of other
+    // adapter sets stay in the prefix cache and are found again when switching back
+    embd.clear();
+    n_past = 0;
+    mtmd_bitmap_past_hashes.clear();
+    prefix_cache_pending.clear();
+    prefix_cache.setScope(identity);
+
+    lora_registry.evict();
+}
+
 int llama_mobile_context::applyLoraAdapters(std::vector<common_adapter_lora_info> lora_adapters) {
     if (!ctx || !model) {
         LOG_ERROR("Context or model not initialized for applying LoRA adapters.");
         return -1;
     }
 
+    std::vector<common_adapter_lora_info> active;
+    std::vector<std::pair<uint64_t, float>> identities;
     for (auto &la : lora_adapters) {
         if (la.path.empty()) {
             LOG_WARNING("Skipping LoRA adapter with empty path.");
             continue;
         }
-        la.ptr = llama_adapter_lora_init(model, la.path.c_str());
-        if (la.ptr == nullptr) {
+        // Adapters are looked up by file, so applying the same one again does not reload it
+        std::string id = la.path;
+        for (const auto &it : lora_registry.entries) {
+            if (it.second.path == la.path) {
+                id = it.first;
+                break;
+            }
+        }
+        if (!lora_registry.entries.count(id)) {
+            lora_registry.add(id, la.path);
+        }
+        llama_mobile_lora_registry::llama_mobile_lora_registry_entry *entry = lora_registry.acquire(model, id);
+        if (entry == nullptr) {
             LOG_ERROR("Failed to initialize LoRA adapter '%s'\n", la.path.c_str());
             return -1;
         }
+        la.ptr = entry->adapter.get();
         LOG_INFO("Initialized LoRA adapter: %s, Scale: %f", la.path.c_str(), la.scale);
+        active.push_back(la);
+        identities.emplace_back(entry->identity, la.scale);
     }
 
-    this->lora = lora_adapters; 
-
-    common_set_adapter_lora(ctx, this->lora);
+    setActiveLora(std::move(active), lora_set_identity(std::move(identities)));
     LOG_INFO("Applied %zu LoRA adapters.", this->lora.size());
     return 0;
 }
@@ -37,8 +226,8 @@ void llama_mobile_context::removeLoraAdapters() {
         LOG_ERROR("Context not initialized, cannot remove LoRA adapters.");
         return;
     }
-    this->lora.clear();
-    common_set_adapter_lora(ctx, this->lora);
+    // The adapters stay loaded in the registry until evicted or unregistered
+    setActiveLora({}, 0);
     LOG_INFO("Removed all LoRA adapters.");
 }
 
@@ -46,4 +235,73 @@ std::vector<common_adapter_lora_info> llama_mobile_context::getLoadedLoraAdapter
     return this->lora;
 }
 
-} // namespace llama_mobile
\ No newline at end of file
+void llama_mobile_context::configureLoraRegistry(size_t max_bytes) {
+    lora_registry.max_bytes = max_bytes;
+    lora_registry.evict();
+    LOG_INFO("LoRA registry: max_bytes=%zu, %zu adapters resident (%zu bytes)",
+        max_bytes, lora_registry.stats.n_resident, lora_registry.stats.bytes);
+}
+
+int llama_mobile_context::registerLoraAdapter(const std::string &id, const std::string &path) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for registering LoRA adapters.");
+        return -1;
+    }
+    if (id.empty() || path.empty()) {
+        LOG_ERROR("LoRA adapter id and path must not be empty.");
+        return -1;
+    }
+    if (!lora_registry.add(id, path)) {
+        LOG_ERROR("LoRA adapter '%s' is in use, cannot replace it.", id.c_str());
+        return -2;
+    }
+    // Loaded right away so a bad file is reported here and the first selection is free
+    if (lora_registry.acquire(model, id) == nullptr) {
+        LOG_ERROR("Failed to initialize LoRA adapter '%s' from %s", id.c_str(), path.c_str());
+        lora_registry.remove(id);
+        return -3;
+    }
+    lora_registry.evict();
+    return 0;
+}
+
+int llama_mobile_context::unregisterLoraAdapter(const std::string &id) {
+    if (!lora_registry.remove(id)) {
+        LOG_ERROR("LoRA adapter '%s' is in use, select another adapter set first.", id.c_str());
+        return -2;
+    }
+    return 0;
+}
+
+int llama_mobile_context::selectLoraAdapters(const std::vector<llama_mobile_lora_selection> &selection) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for selecting LoRA adapters.");
+        return -1;
+    }
+    if (is_predicting) {
+        LOG_ERROR("Cannot switch LoRA adapters while a completion is running.");
+        return -1;
+    }
+
+    std::vector<common_adapter_lora_info> active;
+    std::vector<std::pair<uint64_t, float>> identities;
+    for (const auto &sel : selection) {
+        llama_mobile_lora_registry::llama_mobile_lora_registry_entry *entry = lora_registry.acquire(model, sel.id);
+        if (entry == nullptr) {
+            LOG_ERROR("LoRA adapter '%s' is not registered or failed to load.", sel.id.c_str());
+            lora_registry.evict();
+            return -2;
+        }
+        common_adapter_lora_info la;
+        la.path = entry->path;
+        la.scale = sel.scale;
+        la.ptr = entry->adapter.get();
+        active.push_back(std::move(la));
+        identities.emplace_back(entry->identity, sel.scale);
+    }
+
+    setActiveLora(std::move(active), lora_set_identity(std::move(identities)));
+    return 0;
+}
+
+} // namespace llama_mobile
@@ -0,0 +1,347 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sys/stat.h>
+
+namespace llama_mobile {
+
+static const char *MEDIA_CACHE_INDEX_FILE = "media_cache.idx";
+
+bool llama_mobile_media_cache::enabled() const {
+    return params.max_bytes > 0;
+}
+
+bool llama_mobile_media_cache::configure(const llama_mobile_media_cache_params &params_, const std::string &model_id_) {
+    entries.clear();
+    lru.clear();
+    use_clock = 0;
+    stats = llama_mobile_media_cache_stats();
+
+    params = params_;
+    if (params.max_disk_bytes == 0) {
+        params.max_disk_bytes = 4 * params.max_bytes;
+    }
+    model_id = model_id_;
+
+    if (enabled() && !params.disk_dir.empty()) {
+        loadDiskIndex();
+    }
+    LOG_INFO("Media cache %s: max_bytes=%zu, disk_dir=%s, max_disk_bytes=%zu",
+        enabled() ? "enabled" : "disabled", params.max_bytes,
+        params.disk_dir.empty() ? "(none)" : params.disk_dir.c_str(), params.max_disk_bytes);
+    return true;
+}
+
+void llama_mobile_media_cache::clear() {
+    for (const auto &it : entries) {
+        if (it.second.on_disk) {
+            std::remove(diskPath(it.first).c_str());
+        }
+    }
+    entries.clear();
+    lru.clear();
+    stats.bytes = 0;
+    stats.disk_bytes = 0;
+    stats.n_entries = 0;
+
+    if (!params.disk_dir.empty()) {
+        std::ofstream index(params.disk_dir + "/" + MEDIA_CACHE_INDEX_FILE, std::ios::trunc);
+        index << model_id << "\n";
+    }
+}
+
+std::string llama_mobile_media_cache::diskPath(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".embd", key);
+    return params.disk_dir + "/" + name;
+}
+
+void llama_mobile_media_cache::loadDiskIndex() {
+    const std::string index_path = params.disk_dir + "/" + MEDIA_CACHE_INDEX_FILE;
+
+    std::ifstream in(index_path);
+    std::string line;
+    if (in && std::getline(in, line) && line == model_id) {
+        uint64_t key;
+        size_t n_tokens;
+        int64_t encode_ms;
+        size_t disk_bytes;
+        while (std::getline(in, line)) {
+            const int n_fields = sscanf(line.c_str(), "%" SCNx64 " %zu %" SCNd64 " %zu", &key, &n_tokens, &encode_ms, &disk_bytes);
+            if (n_fields != 4) {
+                // Lines without a file size predate the disk budget, their files are not counted
+                if (n_fields >= 1) {
+                    std::remove(diskPath(key).c_str());
+                }
+                continue;
+            }
+            // A key written again replaces its earlier line, later lines are the more recent
+            llama_mobile_media_cache_entry &entry = entries[key];
+            stats.disk_bytes -= entry.disk_bytes;
+            entry.n_tokens = n_tokens;
+            entry.encode_ms = encode_ms;
+            entry.on_disk = true;
+            entry.disk_bytes = disk_bytes;
+            entry.last_used = ++use_clock;
+            entry.lru_it = lru.end();
+            stats.disk_bytes += disk_bytes;
+        }
+        in.close();
+        stats.n_entries = entries.size();
+        LOG_INFO("Loaded %zu media cache entries from %s", entries.size(), index_path.c_str());
+        // Drops the duplicate lines and whatever the disk budget no longer allows
+        evictDisk();
+        writeDiskIndex();
+        return;
+    }
+
+    // Missing index or one written for another projector: start over
+    if (in) {
+        while (std::getline(in, line)) {
+            uint64_t key;
+            if (sscanf(line.c_str(), "%" SCNx64, &key) == 1) {
+                std::remove(diskPath(key).c_str());
+            }
+        }
+        in.close();
+    }
+    std::ofstream out(index_path, std::ios::trunc);
+    if (!out) {
+        LOG_WARNING("Cannot write media cache index %s, persistence disabled", index_path.c_str());
+        params.disk_dir.clear();
+        return;
+    }
+    out << model_id << "\n";
+}
+
+void llama_mobile_media_cache::appendDiskIndex(uint64_t key, const llama_mobile_media_cache_entry &entry) {
+    std::ofstream out(params.disk_dir + "/" + MEDIA_CACHE_INDEX_FILE, std::ios::app);
+    char line[96];
+    snprintf(line, sizeof(line), "%016" PRIx64 " %zu %" PRId64 " %zu\n", key, entry.n_tokens, entry.encode_ms, entry.disk_bytes);
+    out << line;
+}
+
+// Rewrites the index with one line per persisted entry, least recently used first
+void llama_mobile_media_cache::writeDiskIndex() {
+    std::vector<std::pair<uint64_t, uint64_t>> order;
+    for (const auto &it : entries) {
+        if (it.second.on_disk) {
+            order.emplace_back(it.second.last_used, it.first);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    const std::string index_path = params.disk_dir + "/" + MEDIA_CACHE_INDEX_FILE;
+    const std::string tmp_path = index_path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        out << model_id << "\n";
+        for (const auto &it : order) {
+            const llama_mobile_media_cache_entry &entry = entries[it.second];
+            char line[96];
+            snprintf(line, sizeof(line), "%016" PRIx64 " %zu %" PRId64 " %zu\n", it.second, entry.n_tokens, entry.encode_ms, entry.disk_bytes);
+            out << line;
+        }
+        if (!out) {
+            LOG_WARNING("Failed to write media cache index %s", tmp_path.c_str());
+            out.close();
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+        LOG_WARNING("Failed to move media cache index into place: %s", index_path.c_str());
+        std::remove(tmp_path.c_str());
+    }
+}
+
+void llama_mobile_media_cache::evict() {
+    while (stats.bytes > params.max_bytes && !lru.empty()) {
+        const uint64_t key = lru.back();
+        lru.pop_back();
+
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            continue;
+        }
+        stats.bytes -= it->second.embd.size() * sizeof(float);
+        stats.evictions++;
+        if (it->second.on_disk) {
+            // Keep the record so the embeddings can still be read back from disk
+            std::vector<float>().swap(it->second.embd);
+            it->second.lru_it = lru.end();
+        } else {
+            entries.erase(it);
+        }
+    }
+    stats.n_entries = entries.size();
+}
+
+// Deletes the least recently used files until the persisted ones fit max_disk_bytes.
+// Returns with the index out of date, callers rewrite it
+void llama_mobile_media_cache::evictDisk() {
+    while (stats.disk_bytes > params.max_disk_bytes) {
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.on_disk && (oldest == entries.end() || it->second.last_used < oldest->second.last_used)) {
+                oldest = it;
+            }
+        }
+        if (oldest == entries.end()) {
+            break;
+        }
+        LOG_VERBOSE("Deleting media cache file %s (%zu bytes)", diskPath(oldest->first).c_str(), oldest->second.disk_bytes);
+        std::remove(diskPath(oldest->first).c_str());
+        stats.disk_bytes -= oldest->second.disk_bytes;
+        oldest->second.on_disk = false;
+        oldest->second.disk_bytes = 0;
+        if (oldest->second.embd.empty()) {
+            entries.erase(oldest);
+        }
+    }
+    stats.n_entries = entries.size();
+}
+
+const float *llama_mobile_media_cache::lookup(uint64_t key, size_t n_tokens, size_t n_floats) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second.n_tokens != n_tokens) {
+        stats.misses++;
+        return nullptr;
+    }
+    llama_mobile_media_cache_entry &entry = it->second;
+
+    if (entry.embd.size() == n_floats) {
+        lru.splice(lru.begin(), lru, entry.lru_it);
+        entry.last_used = ++use_clock;
+        stats.hits++;
+        stats.encode_ms_saved += entry.encode_ms;
+        return entry.embd.data();
+    }
+
+    if (entry.on_disk && entry.embd.empty() && n_floats * sizeof(float) <= params.max_bytes) {
+        const std::string path = diskPath(key);
+        std::ifstream in(path, std::ios::binary);
+        uint64_t header[2] = {0, 0};
+        if (in.read(reinterpret_cast<char *>(header), sizeof(header)) && header[0] == n_tokens && header[1] == n_floats) {
+            entry.embd.resize(n_floats);
+            if (in.read(reinterpret_cast<char *>(entry.embd.data()), n_floats * sizeof(float))) {
+                lru.push_front(key);
+                entry.lru_it = lru.begin();
+                entry.last_used = ++use_clock;
+                stats.bytes += n_floats * sizeof(float);
+                stats.disk_hits++;
+                stats.encode_ms_saved += entry.encode_ms;
+                LOG_VERBOSE("Media cache hit: %zu tokens read from %s", n_tokens, path.c_str());
+                // The entry just became the most recent, so it survives the eviction
+                evict();
+                return entry.embd.data();
+            }
+            std::vector<float>().swap(entry.embd);
+        }
+        LOG_WARNING("Dropping unreadable media cache file %s", path.c_str());
+        std::remove(path.c_str());
+        stats.disk_bytes -= entry.disk_bytes;
+        entries.erase(it);
+        stats.n_entries = entries.size();
+    }
+
+    stats.misses++;
+    return nullptr;
+}
+
+void llama_mobile_media_cache::insert(uint64_t key, size_t n_tokens, const float *embd, size_t n_floats, int64_t encode_ms) {
+    const size_t size = n_floats * sizeof(float);
+    if (!enabled() || size == 0 || size > params.max_bytes) {
+        return;
+    }
+
+    bool replaced_on_disk = false;
+    auto existing = entries.find(key);
+    if (existing != entries.end()) {
+        if (!existing->second.embd.empty()) {
+            lru.erase(existing->second.lru_it);
+            stats.bytes -= existing->second.embd.size() * sizeof(float);
+        }
+        if (existing->second.on_disk) {
+            std::remove(diskPath(key).c_str());
+            stats.disk_bytes -= existing->second.disk_bytes;
+            replaced_on_disk = true;
+        }
+        entries.erase(existing);
+    }
+
+    llama_mobile_media_cache_entry entry;
+    entry.n_tokens = n_tokens;
+    entry.encode_ms = encode_ms;
+    entry.last_used = ++use_clock;
+    entry.embd.assign(embd, embd + n_floats);
+
+    bool persisted = false;
+    const uint64_t header[2] = {n_tokens, n_floats};
+    if (!params.disk_dir.empty() && sizeof(header) + size <= params.max_disk_bytes) {
+        const std::string path = diskPath(key);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entry.embd.data()), size);
+        if (out) {
+            entry.on_disk = true;
+            entry.disk_bytes = sizeof(header) + size;
+            stats.disk_bytes += entry.disk_bytes;
+            persisted = true;
+        } else {
+            LOG_WARNING("Failed to persist media embeddings to %s", path.c_str());
+        }
+    }
+
+    lru.push_front(key);
+    entry.lru_it = lru.begin();
+    entries[key] = std::move(entry);
+    stats.bytes += size;
+    LOG_VERBOSE("Media cache insert: %zu tokens, %zu bytes, encoded in %" PRId64 " ms", n_tokens, size, encode_ms);
+
+    if (persisted || replaced_on_disk) {
+        // A new key only adds a line, anything else rewrites the index so it never
+        // lists a key twice or a file that was deleted
+        if (stats.disk_bytes > params.max_disk_bytes || replaced_on_disk) {
+            evictDisk();
+            writeDiskIndex();
+        } else {
+            appendDiskIndex(key, entries[key]);
+        }
+    }
+
+    evict();
+}
+
+bool llama_mobile_context::configureMediaCache(const llama_mobile_media_cache_params &cache_params) {
+    if (!isMultimodalEnabled()) {
+        LOG_ERROR("Multimodal is not initialized, cannot configure the media cache.");
+        return false;
+    }
+
+    // Embeddings are only valid for the projector and language model that consume them.
+    // The projector's size and mtime catch a different file put at the same path
+    char model_desc[128];
+    llama_model_desc(model, model_desc, sizeof(model_desc));
+    std::string model_id = mtmd_wrapper->mmproj_path +
+        " model=" + model_desc +
+        " n_embd_inp=" + std::to_string(llama_model_n_embd_inp(model));
+    struct stat st;
+    if (stat(mtmd_wrapper->mmproj_path.c_str(), &st) == 0) {
+        model_id += " size=" + std::to_string((int64_t)st.st_size) +
+            " mtime=" + std::to_string((int64_t)st.st_mtime);
+    }
+
+    return media_cache.configure(cache_params, model_id);
+}
+
+} // namespace llama_mobile
@@ -4,6 +4,10 @@
 #include <string>
 #include <fstream>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #ifndef LM_GGML_DISABLE_MULTIMODAL
 #include "llama_cpp/tools/mtmd/mtmd.h"
@@ -25,175 +29,219 @@ static std::string fnv_hash(const uint8_t * data, size_t len) {
     return std::to_string(hash);
 }
 
-static const std::string base64_chars =
-             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-             "abcdefghijklmnopqrstuvwxyz"
-             "0123456789+/";
-
-static std::vector<uint8_t> base64_decode(const std::string &encoded_string) {
-    std::vector<uint8_t> decoded;
-    int in_len = encoded_string.size();
-    int i = 0;
-    int j = 0;
-    int in_ = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-
-    while (in_len-- && (encoded_string[in_] != '=')) {
-        if (isspace(encoded_string[in_])) {
-            in_++;
-            continue;
+struct mtmd_tokenize_result {
+    std::vector<std::string> bitmap_hashes;
+    std::vector<llama_token> tokens;
+    std::vector<size_t> chunk_pos;
+    std::vector<size_t> chunk_pos_media;
+    std::vector<size_t> media_n_tokens;
+    std::vector<const mtmd_input_chunk*> chunks;
+    std::vector<int> chunk_bitmap;
+    std::vector<mtmd::input_chunks_ptr> chunk_owners;
+
+    // bitmap is the media the chunks come from, -1 when unknown or text only
+    void append(mtmd::input_chunks_ptr part, int bitmap) {
+        for (size_t i = 0; i < mtmd_input_chunks_size(part.get()); i++) {
+            chunks.push_back(mtmd_input_chunks_get(part.get(), i));
+            chunk_bitmap.push_back(bitmap);
         }
+        chunk_owners.push_back(std::move(part));
+    }
+};
 
-        if (encoded_string[in_] == '=' || base64_chars.find(encoded_string[in_]) == std::string::npos) {
-            break;
-        }
+struct llama_mobile_media_tokens {
+    std::string prompt;
+    std::vector<std::string> media_paths;
+    mtmd_tokenize_result result;
+};
 
-        char_array_4[i++] = encoded_string[in_]; in_++;
-        if (i == 4) {
-            for (i = 0; i < 4; i++) {
-                char_array_4[i] = base64_chars.find(char_array_4[i]);
-            }
+static mtmd::bitmap_ptr loadMedia(mtmd_context *mtmd_ctx, const std::string &media_path, std::string &hash) {
+    LOG_VERBOSE("Loading media: %s", media_path.substr(0, 50).c_str());
 
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+    if (media_path.compare(0, 11, "data:image/") == 0 || media_path.compare(0, 11, "data:audio/") == 0) {
+        LOG_VERBOSE("Detected base64 encoded media");
 
-            for (i = 0; i < 3; i++) {
-                decoded.push_back(char_array_3[i]);
-            }
-            i = 0;
+        size_t comma_pos = media_path.find(',');
+        if (comma_pos == std::string::npos) {
+            throw std::runtime_error("Invalid base64 media format, missing comma separator");
         }
-    }
 
-    if (i) {
-        for (j = i; j < 4; j++) {
-            char_array_4[j] = 0;
-        }
+        std::string_view header = std::string_view(media_path).substr(0, comma_pos);
+        std::string_view base64_data = std::string_view(media_path).substr(comma_pos + 1);
 
-        for (j = 0; j < 4; j++) {
-            char_array_4[j] = base64_chars.find(char_array_4[j]);
+        if (header.find("base64") == std::string_view::npos) {
+            throw std::runtime_error("Media must be base64 encoded");
         }
 
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+        std::vector<uint8_t> media_data(base64_decoded_size_max(base64_data.size()));
+        media_data.resize(base64_decode(base64_data, media_data.data()));
+        LOG_VERBOSE("Base64 decoded, size: %zu bytes", media_data.size());
 
-        for (j = 0; j < i - 1; j++) {
-            decoded.push_back(char_array_3[j]);
+        mtmd::bitmap bmp(mtmd_helper_bitmap_init_from_buf(mtmd_ctx, media_data.data(), media_data.size()));
+        if (!bmp.ptr) {
+            throw std::runtime_error("Failed to load base64 media");
         }
+
+        hash = fnv_hash(bmp.data(), bmp.n_bytes());
+        bmp.set_id(hash.c_str());
+        LOG_VERBOSE("Media hash: %s", hash.c_str());
+        return std::move(bmp.ptr);
+    }
+    if (media_path.compare(0, 7, "http://") == 0 || media_path.compare(0, 8, "https://") == 0) {
+        LOG_ERROR("HTTP/HTTPS URLs are not supported yet: %s", media_path.c_str());
+        throw std::runtime_error("HTTP/HTTPS URLs are not supported yet");
     }
 
-    return decoded;
-}
+    LOG_VERBOSE("Loading media from file");
 
-struct mtmd_tokenize_result {
-    std::vector<std::string> bitmap_hashes;
-    std::vector<llama_token> tokens;
-    std::vector<size_t> chunk_pos;
-    std::vector<size_t> chunk_pos_media;
-    mtmd_input_chunks* chunks = nullptr;
-};
+    std::ifstream file(media_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("File does not exist or cannot be opened");
+    }
 
-static mtmd_tokenize_result tokenizeWithMedia(llama_mobile_context::llama_mobile_context_mtmd *mtmd_wrapper, const std::string &prompt, const std::vector<std::string> &media_paths) {
-    mtmd_tokenize_result result;
-    mtmd::bitmaps bitmaps;
+    file.seekg(0, std::ios::end);
+    size_t file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    
+    LOG_VERBOSE("File exists and size is %zu bytes", file_size);
+    file.close();
 
-    for (const auto& media_path : media_paths) {
-        LOG_VERBOSE("Loading media: %s", media_path.substr(0, 50).c_str());
+    mtmd::bitmap bmp(mtmd_helper_bitmap_init_from_file(mtmd_ctx, media_path.c_str()));
+    if (!bmp.ptr) {
+        throw std::runtime_error("Failed to load media");
+    }
 
-        if (media_path.compare(0, 11, "data:image/") == 0 || media_path.compare(0, 11, "data:audio/") == 0) {
-            LOG_VERBOSE("Detected base64 encoded media");
+    hash = fnv_hash(bmp.data(), bmp.nx()*bmp.ny()*3);
+    bmp.set_id(hash.c_str());
+    LOG_VERBOSE("Media hash: %s", hash.c_str());
+    return std::move(bmp.ptr);
+}
 
-            size_t comma_pos = media_path.find(',');
-            if (comma_pos == std::string::npos) {
-                throw std::runtime_error("Invalid base64 media format, missing comma separator");
-            }
+static mtmd::input_chunks_ptr tokenizePart(mtmd_context *mtmd_ctx, const std::string &text, bool add_special, const mtmd_bitmap **bitmaps, size_t n_bitmaps) {
+    mtmd::input_chunks_ptr chunks(mtmd_input_chunks_init());
+    if (!chunks) {
+        throw std::runtime_error("Failed to initialize input chunks");
+    }
 
-            std::string header = media_path.substr(0, comma_pos);
-            std::string base64_data = media_path.substr(comma_pos + 1);
+    mtmd_input_text input_text;
+    input_text.text = text.c_str();
+    input_text.add_special = add_special;
+    input_text.parse_special = true;
 
-            if (header.find("base64") == std::string::npos) {
-                bitmaps.entries.clear();
-                throw std::runtime_error("Media must be base64 encoded");
-            }
+    int32_t res = mtmd_tokenize(mtmd_ctx, chunks.get(), &input_text, bitmaps, n_bitmaps);
+    if (res != 0) {
+        throw std::runtime_error("Failed to tokenize text and media");
+    }
+    return chunks;
+}
 
-            std::vector<uint8_t> media_data = base64_decode(base64_data);
-            LOG_VERBOSE("Base64 decoded, size: %zu bytes", media_data.size());
+struct media_job {
+    mtmd::bitmap_ptr bmp;
+    std::string hash;
+    mtmd::input_chunks_ptr chunks;
+    std::string error;
+};
 
-            mtmd::bitmap bmp(mtmd_helper_bitmap_init_from_buf(mtmd_wrapper->mtmd_ctx, media_data.data(), media_data.size()));
-            if (!bmp.ptr) {
-                bitmaps.entries.clear();
-                throw std::runtime_error("Failed to load base64 media");
+static mtmd_tokenize_result tokenizeWithMedia(llama_mobile_context::llama_mobile_context_mtmd *mtmd_wrapper, const llama_vocab *vocab, const std::string &prompt, const std::vector<std::string> &media_paths, int n_threads) {
+    mtmd_tokenize_result result;
+    mtmd_context *mtmd_ctx = mtmd_wrapper->mtmd_ctx;
+
+    const std::string marker = mtmd_default_marker();
+    std::vector<std::string> text_parts;
+    size_t part_start = 0;
+    for (size_t pos = prompt.find(marker); pos != std::string::npos; pos = prompt.find(marker, part_start)) {
+        text_parts.push_back(prompt.substr(part_start, pos - part_start));
+        part_start = pos + marker.size();
+    }
+    text_parts.push_back(prompt.substr(part_start));
+
+    // Tokenizing each marker with its media on its own gives the same tokens as a single
+    // mtmd_tokenize call, as long as every marker has a media and no EOS goes at the end
+    const bool per_media = text_parts.size() == media_paths.size() + 1 && !llama_vocab_get_add_eos(vocab);
+
+    // Loading, decoding, hashing and, when per_media, the clip preprocessing of every
+    // media are independent of each other and run on a pool of worker threads
+    std::vector<media_job> jobs(media_paths.size());
+    std::atomic<size_t> next_job{0};
+    auto work = [&]() {
+        for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+            media_job &job = jobs[i];
+            try {
+                job.bmp = loadMedia(mtmd_ctx, media_paths[i], job.hash);
+                if (per_media) {
+                    const mtmd_bitmap *bitmap = job.bmp.get();
+                    job.chunks = tokenizePart(mtmd_ctx, marker, false, &bitmap, 1);
+                }
+            } catch (const std::exception &e) {
+                job.error = e.what();
             }
+        }
+    };
 
-            std::string hash = fnv_hash(bmp.data(), bmp.n_bytes());
-            bmp.set_id(hash.c_str());
-            LOG_VERBOSE("Media hash: %s", hash.c_str());
-            bitmaps.entries.push_back(std::move(bmp));
-            result.bitmap_hashes.push_back(hash.c_str());
-        } else if (media_path.compare(0, 7, "http://") == 0 || media_path.compare(0, 8, "https://") == 0) {
-            LOG_ERROR("HTTP/HTTPS URLs are not supported yet: %s", media_path.c_str());
-            throw std::runtime_error("HTTP/HTTPS URLs are not supported yet");
-        } else {
-            LOG_VERBOSE("Loading media from file");
-
-            std::ifstream file(media_path, std::ios::binary);
-            if (!file.is_open()) {
-                bitmaps.entries.clear();
-                throw std::runtime_error("File does not exist or cannot be opened");
-            }
+    const int n_workers = std::min(std::max(1, n_threads), (int) jobs.size()) - 1;
+    LOG_VERBOSE("Loading %zu media on %d worker threads", jobs.size(), n_workers + 1);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < n_workers; i++) {
+        workers.emplace_back(work);
+    }
 
-            file.seekg(0, std::ios::end);
-            size_t file_size = file.tellg();
-            file.seekg(0, std::ios::beg);
-            
-            LOG_VERBOSE("File exists and size is %zu bytes", file_size);
-            file.close();
-
-            mtmd::bitmap bmp(mtmd_helper_bitmap_init_from_file(mtmd_wrapper->mtmd_ctx, media_path.c_str()));
-            if (!bmp.ptr) {
-                bitmaps.entries.clear();
-                throw std::runtime_error("Failed to load media");
+    // The text between the markers is tokenized while the workers decode
+    std::vector<mtmd::input_chunks_ptr> text_chunks;
+    std::string text_error;
+    if (per_media) {
+        try {
+            for (size_t i = 0; i < text_parts.size(); i++) {
+                text_chunks.push_back(tokenizePart(mtmd_ctx, text_parts[i], i == 0, nullptr, 0));
             }
-
-            std::string hash = fnv_hash(bmp.data(), bmp.nx()*bmp.ny()*3);
-            bmp.set_id(hash.c_str());
-            LOG_VERBOSE("Media hash: %s", hash.c_str());
-            bitmaps.entries.push_back(std::move(bmp));
-            result.bitmap_hashes.push_back(hash.c_str());
+        } catch (const std::exception &e) {
+            text_error = e.what();
         }
     }
 
-    LOG_VERBOSE("Initializing input chunks");
-    result.chunks = mtmd_input_chunks_init();
-    if (result.chunks == nullptr) {
-        bitmaps.entries.clear();
-        throw std::runtime_error("Failed to initialize input chunks");
+    work();
+    for (auto &worker : workers) {
+        worker.join();
     }
 
-    mtmd_input_text input_text;
-    input_text.text = prompt.c_str();
-    input_text.add_special = true;
-    input_text.parse_special = true;
+    for (const auto &job : jobs) {
+        if (!job.error.empty()) {
+            throw std::runtime_error(job.error);
+        }
+        result.bitmap_hashes.push_back(job.hash);
+    }
+    if (!text_error.empty()) {
+        throw std::runtime_error(text_error);
+    }
 
-    LOG_VERBOSE("Tokenizing text and %zu media", bitmaps.entries.size());
-    auto bitmaps_c_ptr = bitmaps.c_ptr();
-    int32_t res = mtmd_tokenize(mtmd_wrapper->mtmd_ctx, result.chunks, &input_text, bitmaps_c_ptr.data(), bitmaps_c_ptr.size());
-    if (res != 0) {
-        mtmd_input_chunks_free(result.chunks);
-        bitmaps.entries.clear();
-        throw std::runtime_error("Failed to tokenize text and media");
+    if (per_media) {
+        for (size_t i = 0; i < text_chunks.size(); i++) {
+            result.append(std::move(text_chunks[i]), -1);
+            if (i < jobs.size()) {
+                result.append(std::move(jobs[i].chunks), (int) i);
+            }
+        }
+    } else {
+        std::vector<const mtmd_bitmap*> bitmaps;
+        for (const auto &job : jobs) {
+            bitmaps.push_back(job.bmp.get());
+        }
+
+        LOG_VERBOSE("Tokenizing text and %zu media", bitmaps.size());
+        result.append(tokenizePart(mtmd_ctx, prompt, true, bitmaps.data(), bitmaps.size()), -1);
     }
 
-    size_t num_chunks = mtmd_input_chunks_size(result.chunks);
+    size_t num_chunks = result.chunks.size();
     LOG_VERBOSE("Tokenization successful: num_chunks=%zu", num_chunks);
 
     size_t total_token_count = 0;
+    result.media_n_tokens.assign(media_paths.size(), 0);
+    int inferred_bitmap = -1;
+    std::string inferred_id;
 
     for (size_t i = 0; i < num_chunks; i++) {
         result.chunk_pos.push_back(total_token_count);
 
-        const mtmd_input_chunk* chunk = mtmd_input_chunks_get(result.chunks, i);
+        const mtmd_input_chunk* chunk = result.chunks[i];
         mtmd_input_chunk_type chunk_type = mtmd_input_chunk_get_type(chunk);
 
         if (chunk_type == MTMD_INPUT_CHUNK_TYPE_TEXT) {
@@ -215,13 +263,70 @@ static mtmd_tokenize_result tokenizeWithMedia(llama_mobile_context::llama_mobile
                 result.tokens.push_back(LLAMA_TOKEN_NULL);
             }
             total_token_count += n_pos;
+
+            int bitmap = result.chunk_bitmap[i];
+            if (bitmap < 0) {
+                // From a single mtmd_tokenize call: the chunks of one media are adjacent and share its id
+                const char *id = mtmd_input_chunk_get_id(chunk);
+                if (inferred_bitmap < 0 || id == nullptr || inferred_id != id) {
+                    inferred_bitmap++;
+                    inferred_id = id != nullptr ? id : "";
+                }
+                bitmap = inferred_bitmap;
+            }
+            if ((size_t) bitmap < result.media_n_tokens.size()) {
+                result.media_n_tokens[bitmap] += n_pos;
+            }
         }
     }
 
-    bitmaps.entries.clear();
     return result;
 }
 
+// tokenize() keeps its result on the context, so the loadPrompt() that usually follows
+// for the same prompt and media reuses the decoded and preprocessed media. processMedia()
+// releases it once consumed
+static std::shared_ptr<llama_mobile_media_tokens> tokenizeWithMediaCached(llama_mobile_context *context, const std::string &prompt, const std::vector<std::string> &media_paths) {
+    std::string full_prompt = prompt;
+    auto default_media_marker = mtmd_default_marker();
+    if (full_prompt.find(default_media_marker) == std::string::npos) {
+        full_prompt += " ";
+        full_prompt += default_media_marker;
+    }
+
+    std::shared_ptr<llama_mobile_media_tokens> cached = context->media_tokens;
+    if (cached && cached->prompt == full_prompt && cached->media_paths == media_paths) {
+        LOG_VERBOSE("Reusing the tokenization of %zu media", media_paths.size());
+        return cached;
+    }
+
+    int n_threads = context->params.cpuparams.n_threads > 0 ? context->params.cpuparams.n_threads : (int) std::thread::hardware_concurrency();
+    auto media_tokens = std::make_shared<llama_mobile_media_tokens>();
+    media_tokens->result = tokenizeWithMedia(context->mtmd_wrapper, llama_model_get_vocab(context->model), full_prompt, media_paths, n_threads);
+    media_tokens->prompt = std::move(full_prompt);
+    media_tokens->media_paths = media_paths;
+    context->media_tokens = media_tokens;
+    return media_tokens;
+}
+
+llama_mobile_tokenize_result llama_mobile_context::tokenizeMedia(const std::string &text, const std::vector<std::string> &media_paths) {
+    if (!isMultimodalEnabled()) {
+        throw std::runtime_error("Multimodal is not enabled but media paths are provided");
+    }
+
+    std::shared_ptr<llama_mobile_media_tokens> media_tokens = tokenizeWithMediaCached(this, text, media_paths);
+    const mtmd_tokenize_result &result = media_tokens->result;
+
+    llama_mobile_tokenize_result tokenize_result;
+    tokenize_result.tokens = result.tokens;
+    tokenize_result.has_media = true;
+    tokenize_result.bitmap_hashes = result.bitmap_hashes;
+    tokenize_result.chunk_pos = result.chunk_pos;
+    tokenize_result.chunk_pos_media = result.chunk_pos_media;
+    tokenize_result.media_n_tokens = result.media_n_tokens;
+    return tokenize_result;
+}
+
 bool llama_mobile_context::initMultimodal(const std::string &mmproj_path, bool use_gpu) {
     LOG_VERBOSE("Initializing multimodal with mmproj path: %s", mmproj_path.c_str());
 
@@ -246,9 +351,16 @@ bool llama_mobile_context::initMultimodal(const std::string &mmproj_path, bool u
     }
     mtmd_wrapper = new llama_mobile_context_mtmd();
     mtmd_wrapper->mtmd_ctx = mtmd_ctx;
+    mtmd_wrapper->mmproj_path = mmproj_path;
+    media_tokens.reset();
 
     has_multimodal = true;
 
+    if (media_cache.enabled()) {
+        // Cached embeddings belong to the previous projector
+        configureMediaCache(media_cache.params);
+    }
+
     bool uses_mrope = mtmd_decode_use_mrope(mtmd_ctx);
     bool uses_non_causal = mtmd_decode_use_non_causal(mtmd_ctx);
     LOG_VERBOSE("Model multimodal properties: uses_mrope=%d, uses_non_causal=%d", uses_mrope ? 1 : 0, uses_non_causal ? 1 : 0);
@@ -270,6 +382,7 @@ bool llama_mobile_context::isMultimodalSupportAudio() const {
 }
 
 void llama_mobile_context::releaseMultimodal() {
+    media_tokens.reset();
     if (mtmd_wrapper && mtmd_wrapper->mtmd_ctx != nullptr) {
         mtmd_free(mtmd_wrapper->mtmd_ctx);
         mtmd_wrapper->mtmd_ctx = nullptr;
@@ -279,32 +392,55 @@ void llama_mobile_context::releaseMultimodal() {
     }
 }
 
+int32_t llama_mobile_context::evalMediaChunkCached(const mtmd_input_chunk *chunk, int slice, llama_pos chunk_n_past, llama_pos *new_n_past) {
+    const char *id = mtmd_input_chunk_get_id(chunk);
+    const size_t n_tokens = mtmd_input_chunk_get_n_tokens(chunk);
+    const size_t n_floats = n_tokens * (size_t) llama_model_n_embd_inp(model);
+    if (id == nullptr || id[0] == '\0') {
+        return mtmd_helper_eval_chunk_single(mtmd_wrapper->mtmd_ctx, ctx, chunk, chunk_n_past, 0, params.n_batch, false, new_n_past);
+    }
+    // The chunk id is the FNV hash of the decoded bitmap set in tokenizeWithMedia
+    const uint64_t key = strtoull(id, nullptr, 10) ^ ((uint64_t) slice * 0x9e3779b97f4a7c15ULL);
+
+    const float *embd = media_cache.lookup(key, n_tokens, n_floats);
+    if (embd == nullptr) {
+        const int64_t t_start = lm_ggml_time_ms();
+        int32_t res = mtmd_encode_chunk(mtmd_wrapper->mtmd_ctx, chunk);
+        if (res != 0) {
+            LOG_ERROR("Failed to encode media chunk: %d", res);
+            return res;
+        }
+        embd = mtmd_get_output_embd(mtmd_wrapper->mtmd_ctx);
+        media_cache.insert(key, n_tokens, embd, n_floats, lm_ggml_time_ms() - t_start);
+    }
+
+    // decode_image_chunk only reads the embeddings, the cast is for its signature
+    return mtmd_helper_decode_image_chunk(mtmd_wrapper->mtmd_ctx, ctx, chunk, const_cast<float *>(embd),
+                                          chunk_n_past, 0, params.n_batch, new_n_past);
+}
+
 void llama_mobile_context::processMedia(const std::string &prompt, const std::vector<std::string> &media_paths) {
     if (!isMultimodalEnabled()) {
         throw std::runtime_error("Multimodal is not enabled but image paths are provided");
     }
 
-    std::string full_prompt = prompt;
-    auto default_media_marker = mtmd_default_marker();
-    if (full_prompt.find(default_media_marker) == std::string::npos) {
-        full_prompt += " ";
-        full_prompt += default_media_marker;
-    }
-
-    LOG_VERBOSE("Processing message with content=%s", full_prompt.c_str());
     LOG_VERBOSE("Processing %zu media with prompt: %s", media_paths.size(), prompt.c_str());
     LOG_VERBOSE("Current context state: n_past=%d, n_ctx=%d", n_past, n_ctx);
 
-    auto result = tokenizeWithMedia(mtmd_wrapper, full_prompt, media_paths);
+    // Holds the chunks alive for the evaluation below. The context's reference is dropped
+    // right away, keeping the decoded bitmaps past this point would only take memory from
+    // the media cache's budget
+    std::shared_ptr<llama_mobile_media_tokens> media_tokens = tokenizeWithMediaCached(this, prompt, media_paths);
+    this->media_tokens.reset();
+    const mtmd_tokenize_result &result = media_tokens->result;
 
     auto all_tokens = result.tokens;
-    auto chunks = result.chunks;
+    const auto &chunks = result.chunks;
     auto chunk_pos = result.chunk_pos;
     auto chunk_pos_media = result.chunk_pos_media;
     auto bitmap_hashes = result.bitmap_hashes;
 
     if (all_tokens.size() >= (size_t)n_ctx) {
-        mtmd_input_chunks_free(chunks);
         context_full = true;
         throw std::runtime_error("Not enough context space");
     }
@@ -350,27 +486,47 @@ void llama_mobile_context::processMedia(const std::string &prompt, const std::ve
 
     LOG_VERBOSE("Evaluating chunks: n_past=%d, n_batch=%d", n_past, params.n_batch);
 
-    size_t num_chunks = mtmd_input_chunks_size(chunks);
+    size_t num_chunks = chunks.size();
+
+    // Sliced images and long audio produce several chunks sharing the bitmap id,
+    // each one needs its own cache entry
+    std::string media_id;
+    int media_slice = 0;
 
     for (size_t i = 0; i < chunk_pos.size(); i++) {
         LOG_VERBOSE("Evaluating chunk %zu: n_past=%d, chunk_pos=%zu", i, n_past, chunk_pos[i]);
 
+        auto chunk = chunks[i];
+        bool is_media = mtmd_input_chunk_get_type(chunk) != MTMD_INPUT_CHUNK_TYPE_TEXT;
+        if (is_media) {
+            const char *id = mtmd_input_chunk_get_id(chunk);
+            if (id != nullptr && media_id == id) {
+                media_slice++;
+            } else {
+                media_id = id != nullptr ? id : "";
+                media_slice = 0;
+            }
+        }
+
         if (chunk_pos[i] >= n_past) {
             bool chunk_logits_last = (i == num_chunks - 1);
-            auto chunk = mtmd_input_chunks_get(chunks, i);
-
-            int32_t res = mtmd_helper_eval_chunk_single(
-                mtmd_wrapper->mtmd_ctx,
-                ctx,
-                chunk,
-                n_past,
-                0,
-                params.n_batch,
-                chunk_logits_last,
-                &new_n_past
-            );
+
+            int32_t res;
+            if (media_cache.enabled() && is_media) {
+                res = evalMediaChunkCached(chunk, media_slice, n_past, &new_n_past);
+            } else {
+                res = mtmd_helper_eval_chunk_single(
+                    mtmd_wrapper->mtmd_ctx,
+                    ctx,
+                    chunk,
+                    n_past,
+                    0,
+                    params.n_batch,
+                    chunk_logits_last,
+                    &new_n_past
+                );
+            }
             if (res != 0) {
-                mtmd_input_chunks_free(chunks);
                 throw std::runtime_error("Failed to evaluate chunks");
             }
             n_past = new_n_past;
@@ -393,7 +549,6 @@ void llama_mobile_context::processMedia(const std::string &prompt, const std::ve
     mtmd_bitmap_past_hashes = bitmap_hashes;
 
     LOG_VERBOSE("Multimodal processing completed");
-    mtmd_input_chunks_free(chunks);
 }
 #else
 // Stub implementations when multimodal is disabled
@@ -421,6 +576,10 @@ void llama_mobile_context::releaseMultimodal() {
 void llama_mobile_context::processMedia(const std::string &prompt, const std::vector<std::string> &media_paths) {
     throw std::runtime_error("Multimodal functionality is disabled");
 }
+
+llama_mobile_tokenize_result llama_mobile_context::tokenizeMedia(const std::string &text, const std::vector<std::string> &media_paths) {
+    throw std::runtime_error("Multimodal functionality is disabled");
+}
 #endif
 
 
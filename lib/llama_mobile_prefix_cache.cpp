@@ -0,0 +1,341 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <string>
+
+namespace llama_mobile {
+
+static const char *PREFIX_CACHE_INDEX_FILE = "prefix_cache.idx";
+
+uint64_t llama_mobile_prefix_cache::hashStep(uint64_t hash, llama_token token) {
+    // FNV-1a over the token's bytes, extended one token at a time so every
+    // prefix of a prompt gets its key in a single pass
+    uint32_t value = static_cast<uint32_t>(token);
+    for (int i = 0; i < 4; ++i) {
+        hash ^= (value >> (8 * i)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Snapshots taken under different LoRA adapters hash apart, so switching adapters
+// only hides the entries of the others; scope 0 (no adapters) keeps the plain hash
+static uint64_t prefix_hash_seed(uint64_t scope) {
+    return 14695981039346656037ULL ^ scope;
+}
+
+static uint64_t prefix_hash(uint64_t scope, const std::vector<llama_token> &tokens, size_t n_tokens) {
+    uint64_t hash = prefix_hash_seed(scope);
+    for (size_t i = 0; i < n_tokens; ++i) {
+        hash = llama_mobile_prefix_cache::hashStep(hash, tokens[i]);
+    }
+    return hash;
+}
+
+bool llama_mobile_prefix_cache::enabled() const {
+    return params.max_bytes > 0;
+}
+
+bool llama_mobile_prefix_cache::configure(const llama_mobile_prefix_cache_params &params_, const std::string &model_id_) {
+    entries.clear();
+    lru.clear();
+    stats = llama_mobile_prefix_cache_stats();
+
+    params = params_;
+    model_id = model_id_;
+    std::sort(params.boundaries.begin(), params.boundaries.end());
+
+    if (enabled() && !params.disk_dir.empty()) {
+        loadDiskIndex();
+    }
+    LOG_INFO("Prefix cache %s: max_bytes=%zu, disk_dir=%s, boundaries=%zu",
+        enabled() ? "enabled" : "disabled", params.max_bytes,
+        params.disk_dir.empty() ? "(none)" : params.disk_dir.c_str(), params.boundaries.size());
+    return true;
+}
+
+void llama_mobile_prefix_cache::clear() {
+    for (const auto &it : entries) {
+        if (it.second.on_disk) {
+            std::remove(diskPath(it.first).c_str());
+        }
+    }
+    entries.clear();
+    lru.clear();
+    stats.bytes = 0;
+    stats.n_entries = 0;
+
+    if (!params.disk_dir.empty()) {
+        std::ofstream index(params.disk_dir + "/" + PREFIX_CACHE_INDEX_FILE, std::ios::trunc);
+        index << model_id << "\n";
+    }
+}
+
+void llama_mobile_prefix_cache::setScope(uint64_t scope_) {
+    scope = scope_;
+}
+
+std::string llama_mobile_prefix_cache::diskPath(uint64_t hash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".kv", hash);
+    return params.disk_dir + "/" + name;
+}
+
+void llama_mobile_prefix_cache::loadDiskIndex() {
+    const std::string index_path = params.disk_dir + "/" + PREFIX_CACHE_INDEX_FILE;
+
+    std::ifstream in(index_path);
+    std::string line;
+    if (in && std::getline(in, line) && line == model_id) {
+        uint64_t hash;
+        size_t n_tokens;
+        while (std::getline(in, line)) {
+            if (sscanf(line.c_str(), "%" SCNx64 " %zu", &hash, &n_tokens) != 2) {
+                continue;
+            }
+            llama_mobile_prefix_cache_entry &entry = entries[hash];
+            entry.n_tokens = n_tokens;
+            entry.on_disk = true;
+            entry.lru_it = lru.end();
+        }
+        stats.n_entries = entries.size();
+        LOG_INFO("Loaded %zu prefix cache entries from %s", entries.size(), index_path.c_str());
+        return;
+    }
+
+    // Missing index or one written for another model/KV layout: start over
+    if (in) {
+        while (std::getline(in, line)) {
+            uint64_t hash;
+            size_t n_tokens;
+            if (sscanf(line.c_str(), "%" SCNx64 " %zu", &hash, &n_tokens) == 2) {
+                std::remove(diskPath(hash).c_str());
+            }
+        }
+        in.close();
+    }
+    std::ofstream out(index_path, std::ios::trunc);
+    if (!out) {
+        LOG_WARNING("Cannot write prefix cache index %s, disk spill disabled", index_path.c_str());
+        params.disk_dir.clear();
+        return;
+    }
+    out << model_id << "\n";
+}
+
+void llama_mobile_prefix_cache::appendDiskIndex(uint64_t hash, size_t n_tokens) {
+    std::ofstream out(params.disk_dir + "/" + PREFIX_CACHE_INDEX_FILE, std::ios::app);
+    char line[64];
+    snprintf(line, sizeof(line), "%016" PRIx64 " %zu\n", hash, n_tokens);
+    out << line;
+}
+
+bool llama_mobile_prefix_cache::contains(const std::vector<llama_token> &tokens, size_t n_tokens) const {
+    auto it = entries.find(prefix_hash(scope, tokens, n_tokens));
+    return it != entries.end() && it->second.n_tokens == n_tokens;
+}
+
+void llama_mobile_prefix_cache::evict() {
+    while (stats.bytes > params.max_bytes && !lru.empty()) {
+        const uint64_t hash = lru.back();
+        lru.pop_back();
+
+        auto it = entries.find(hash);
+        if (it == entries.end()) {
+            continue;
+        }
+        stats.bytes -= it->second.data.size();
+        stats.evictions++;
+        if (it->second.on_disk) {
+            // Keep the record so the snapshot can still be restored from disk
+            std::vector<uint8_t>().swap(it->second.data);
+            it->second.lru_it = lru.end();
+        } else {
+            entries.erase(it);
+        }
+    }
+    stats.n_entries = entries.size();
+}
+
+void llama_mobile_prefix_cache::snapshot(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t n_tokens) {
+    if (!enabled() || n_tokens < (size_t)params.min_tokens || n_tokens > tokens.size()) {
+        return;
+    }
+    const uint64_t hash = prefix_hash(scope, tokens, n_tokens);
+    if (entries.count(hash)) {
+        return;
+    }
+
+    const size_t size = llama_state_seq_get_size_ext(ctx, seq_id, 0);
+    if (size == 0 || size > params.max_bytes) {
+        LOG_VERBOSE("Skipping prefix snapshot of %zu tokens (%zu bytes)", n_tokens, size);
+        return;
+    }
+
+    llama_mobile_prefix_cache_entry entry;
+    entry.n_tokens = n_tokens;
+    entry.tokens.assign(tokens.begin(), tokens.begin() + n_tokens);
+    entry.data.resize(size);
+    if (llama_state_seq_get_data_ext(ctx, entry.data.data(), size, seq_id, 0) != size) {
+        LOG_WARNING("Failed to copy sequence state for prefix snapshot");
+        return;
+    }
+
+    if (!params.disk_dir.empty()) {
+        const std::string path = diskPath(hash);
+        if (llama_state_seq_save_file(ctx, path.c_str(), seq_id, entry.tokens.data(), n_tokens) > 0) {
+            entry.on_disk = true;
+            appendDiskIndex(hash, n_tokens);
+        } else {
+            LOG_WARNING("Failed to spill prefix snapshot to %s", path.c_str());
+        }
+    }
+
+    lru.push_front(hash);
+    entry.lru_it = lru.begin();
+    entries[hash] = std::move(entry);
+    stats.bytes += size;
+    stats.snapshots++;
+    LOG_VERBOSE("Prefix snapshot: %zu tokens, %zu bytes", n_tokens, size);
+
+    evict();
+}
+
+// Reads a spilled snapshot written by llama_state_seq_save_file and checks that it
+// holds exactly the expected prefix, leaving the sequence state bytes in data
+static bool read_disk_snapshot(const std::string &path, const std::vector<llama_token> &tokens, size_t n_tokens, std::vector<uint8_t> &data) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return false;
+    }
+    const size_t file_size = (size_t)in.tellg();
+    in.seekg(0);
+
+    uint32_t header[3];
+    if (file_size < sizeof(header) || !in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+        header[0] != LLAMA_STATE_SEQ_MAGIC || header[1] != LLAMA_STATE_SEQ_VERSION || header[2] != n_tokens) {
+        return false;
+    }
+    const size_t tokens_size = sizeof(llama_token) * n_tokens;
+    if (file_size - sizeof(header) <= tokens_size) {
+        return false;
+    }
+    std::vector<llama_token> file_tokens(n_tokens);
+    if (!in.read(reinterpret_cast<char *>(file_tokens.data()), tokens_size) ||
+        !std::equal(file_tokens.begin(), file_tokens.end(), tokens.begin())) {
+        return false;
+    }
+    data.resize(file_size - sizeof(header) - tokens_size);
+    return (bool)in.read(reinterpret_cast<char *>(data.data()), data.size());
+}
+
+size_t llama_mobile_prefix_cache::restore(llama_context *ctx, llama_seq_id seq_id, const std::vector<llama_token> &tokens, size_t min_len, size_t max_len, bool &cleared) {
+    cleared = false;
+    if (!enabled()) {
+        return 0;
+    }
+    max_len = std::min(max_len, tokens.size());
+
+    std::vector<std::pair<size_t, uint64_t>> candidates;
+    uint64_t hash = prefix_hash_seed(scope);
+    for (size_t i = 0; i < max_len; ++i) {
+        hash = hashStep(hash, tokens[i]);
+        if (i + 1 <= min_len) {
+            continue;
+        }
+        auto it = entries.find(hash);
+        if (it != entries.end() && it->second.n_tokens == i + 1) {
+            candidates.emplace_back(i + 1, hash);
+        }
+    }
+
+    llama_memory_t mem = llama_get_memory(ctx);
+    for (auto cand = candidates.rbegin(); cand != candidates.rend(); ++cand) {
+        const size_t n_tokens = cand->first;
+        llama_mobile_prefix_cache_entry &entry = entries[cand->second];
+
+        // The snapshot is read and checked before the sequence is touched, so a stale
+        // index line or a corrupt file costs nothing but the candidate itself
+        const bool from_disk = entry.data.empty();
+        std::vector<uint8_t> file_data;
+        if (!from_disk) {
+            if (!std::equal(entry.tokens.begin(), entry.tokens.end(), tokens.begin())) {
+                continue;
+            }
+        } else {
+            const std::string path = diskPath(cand->second);
+            if (!entry.on_disk || !read_disk_snapshot(path, tokens, n_tokens, file_data)) {
+                LOG_WARNING("Dropping unreadable prefix snapshot %s", path.c_str());
+                std::remove(path.c_str());
+                entries.erase(cand->second);
+                stats.n_entries = entries.size();
+                continue;
+            }
+        }
+
+        const std::vector<uint8_t> &data = from_disk ? file_data : entry.data;
+        llama_memory_seq_rm(mem, seq_id, -1, -1);
+        cleared = true;
+        if (llama_state_seq_set_data_ext(ctx, data.data(), data.size(), seq_id, 0) == 0) {
+            llama_memory_seq_rm(mem, seq_id, -1, -1);
+            if (from_disk) {
+                LOG_WARNING("Dropping prefix snapshot %s that failed to load", diskPath(cand->second).c_str());
+                std::remove(diskPath(cand->second).c_str());
+                entries.erase(cand->second);
+                stats.n_entries = entries.size();
+            }
+            continue;
+        }
+        cleared = false;
+
+        if (!from_disk) {
+            lru.splice(lru.begin(), lru, entry.lru_it);
+            stats.hits++;
+            LOG_VERBOSE("Prefix cache hit: restored %zu tokens from memory", n_tokens);
+            return n_tokens;
+        }
+
+        stats.disk_hits++;
+        LOG_VERBOSE("Prefix cache hit: restored %zu tokens from %s", n_tokens, diskPath(cand->second).c_str());
+
+        // Bring the snapshot back into memory now that it has proven loadable
+        if (file_data.size() <= params.max_bytes) {
+            entry.tokens.assign(tokens.begin(), tokens.begin() + n_tokens);
+            entry.data = std::move(file_data);
+            lru.push_front(cand->second);
+            entry.lru_it = lru.begin();
+            stats.bytes += entry.data.size();
+            evict();
+        }
+        return n_tokens;
+    }
+
+    stats.misses++;
+    return 0;
+}
+
+bool llama_mobile_context::configurePrefixCache(const llama_mobile_prefix_cache_params &cache_params) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for prefix cache.");
+        return false;
+    }
+
+    // Snapshots are only valid for the exact model and KV layout that produced them
+    char model_desc[128];
+    llama_model_desc(model, model_desc, sizeof(model_desc));
+    std::string model_id = std::string(model_desc) +
+        " size=" + std::to_string(llama_model_size(model)) +
+        " params=" + std::to_string(llama_model_n_params(model)) +
+        " k=" + std::to_string(params.cache_type_k) +
+        " v=" + std::to_string(params.cache_type_v);
+
+    prefix_cache_pending.clear();
+    return prefix_cache.configure(cache_params, model_id);
+}
+
+} // namespace llama_mobile
@@ -0,0 +1,245 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <string>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace llama_mobile {
+
+static const uint32_t SESSION_MAGIC = 0x53534d4c; // "LMSS"
+static const uint32_t SESSION_VERSION = 2;
+
+// Fixed-size part of a session file, followed by the variable-length sections
+// embd, last_chat_template and the KV state of sequence 0 in that order
+struct session_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t model_hash;
+    uint64_t lora_identity;
+    int32_t n_ctx;
+    uint32_t seed;
+    uint64_t n_past;
+    uint64_t num_prompt_tokens;
+    uint64_t n_embd_tokens;
+    uint64_t template_size;
+    uint64_t state_size;
+    uint8_t conversation_active;
+    uint8_t reserved[7];
+};
+
+static uint64_t session_model_hash(const llama_model *model) {
+    char model_desc[128];
+    llama_model_desc(model, model_desc, sizeof(model_desc));
+    std::string id = std::string(model_desc) +
+        " size=" + std::to_string(llama_model_size(model)) +
+        " params=" + std::to_string(llama_model_n_params(model)) +
+        " vocab=" + std::to_string(llama_vocab_n_tokens(llama_model_get_vocab(model)));
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : id) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int llama_mobile_context::saveSession(const std::string &path) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized, cannot save session.");
+        return -1;
+    }
+    if (is_predicting) {
+        LOG_ERROR("Cannot save session while a completion is running.");
+        return -1;
+    }
+
+    const size_t state_size = llama_state_seq_get_size(ctx, 0);
+    std::vector<uint8_t> state(state_size);
+    if (state_size > 0 && llama_state_seq_get_data(ctx, state.data(), state_size, 0) != state_size) {
+        LOG_ERROR("Failed to copy KV state for session");
+        return -2;
+    }
+
+    session_header header = {};
+    header.magic = SESSION_MAGIC;
+    header.version = SESSION_VERSION;
+    header.model_hash = session_model_hash(model);
+    header.lora_identity = lora_identity;
+    header.n_ctx = llama_n_ctx(ctx);
+    header.seed = ctx_sampling ? common_sampler_get_seed(ctx_sampling) : params.sampling.seed;
+    header.n_past = n_past;
+    header.num_prompt_tokens = num_prompt_tokens;
+    header.n_embd_tokens = embd.size();
+    header.template_size = last_chat_template.size();
+    header.state_size = state_size;
+    header.conversation_active = conversation_active ? 1 : 0;
+
+    // Write next to the target and rename so a process killed mid-save never
+    // leaves a truncated session behind
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG_ERROR("Cannot open session file for writing: %s", tmp_path.c_str());
+            return -2;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(embd.data()), embd.size() * sizeof(llama_token));
+        out.write(last_chat_template.data(), last_chat_template.size());
+        out.write(reinterpret_cast<const char *>(state.data()), state.size());
+        if (!out) {
+            LOG_ERROR("Failed to write session file: %s", tmp_path.c_str());
+            out.close();
+            std::remove(tmp_path.c_str());
+            return -2;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Failed to move session file into place: %s", path.c_str());
+        std::remove(tmp_path.c_str());
+        return -2;
+    }
+
+    LOG_INFO("Saved session: %zu tokens, %zu bytes of KV state to %s", embd.size(), state_size, path.c_str());
+    return 0;
+}
+
+int llama_mobile_context::loadSession(const std::string &path) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized, cannot load session.");
+        return -1;
+    }
+    if (is_predicting) {
+        LOG_ERROR("Cannot load session while a completion is running.");
+        return -1;
+    }
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    std::vector<uint8_t> buffer;
+#if !defined(_WIN32)
+    // Map the file so the KV state is handed to llama.cpp straight from the page cache
+    void *mapped = MAP_FAILED;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = (size_t)st.st_size;
+            mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+    }
+    if (mapped != MAP_FAILED) {
+        data = static_cast<const uint8_t *>(mapped);
+    }
+#endif
+    if (data == nullptr) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            LOG_ERROR("Cannot open session file: %s", path.c_str());
+            return -2;
+        }
+        size = (size_t)in.tellg();
+        buffer.resize(size);
+        in.seekg(0);
+        in.read(reinterpret_cast<char *>(buffer.data()), size);
+        if (!in) {
+            LOG_ERROR("Failed to read session file: %s", path.c_str());
+            return -2;
+        }
+        data = buffer.data();
+    }
+
+    int status = 0;
+    session_header header;
+    size_t offset = sizeof(header);
+    if (size < sizeof(header)) {
+        LOG_ERROR("Session file is truncated: %s", path.c_str());
+        status = -2;
+    } else {
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != SESSION_MAGIC || header.version != SESSION_VERSION) {
+            LOG_ERROR("Unsupported session file (magic %08x, version %u)", header.magic, header.version);
+            status = -2;
+        } else if (header.model_hash != session_model_hash(model) || (uint32_t)header.n_ctx != llama_n_ctx(ctx)) {
+            LOG_ERROR("Session was saved with a different model or n_ctx (%d, current %u)", header.n_ctx, llama_n_ctx(ctx));
+            status = -3;
+        } else if (header.lora_identity != lora_identity) {
+            // The KV state was computed under the adapters active at save time
+            LOG_ERROR("Session was saved with different LoRA adapters active");
+            status = -3;
+        } else if (header.n_embd_tokens > (uint64_t)header.n_ctx || header.n_past > header.n_embd_tokens) {
+            LOG_ERROR("Session file is corrupt: %s", path.c_str());
+            status = -2;
+        } else {
+            // Each section is checked against what is left, a sum of sizes from the file could wrap
+            const uint64_t section_sizes[] = {header.n_embd_tokens * sizeof(llama_token), header.template_size, header.state_size};
+            uint64_t remaining = size - offset;
+            for (uint64_t section_size : section_sizes) {
+                if (section_size > remaining) {
+                    LOG_ERROR("Session file is truncated: %s", path.c_str());
+                    status = -2;
+                    break;
+                }
+                remaining -= section_size;
+            }
+        }
+    }
+
+    if (status == 0) {
+        std::vector<llama_token> session_embd(header.n_embd_tokens);
+        memcpy(session_embd.data(), data + offset, header.n_embd_tokens * sizeof(llama_token));
+        offset += header.n_embd_tokens * sizeof(llama_token);
+        std::string session_template(reinterpret_cast<const char *>(data + offset), header.template_size);
+        offset += header.template_size;
+
+        llama_memory_seq_rm(llama_get_memory(ctx), 0, -1, -1);
+        if (header.state_size > 0 && llama_state_seq_set_data(ctx, data + offset, header.state_size, 0) == 0) {
+            LOG_ERROR("Failed to restore KV state from session");
+            llama_memory_seq_rm(llama_get_memory(ctx), 0, -1, -1);
+            rewind();
+            status = -4;
+        } else {
+            rewind();
+            prefix_cache_pending.clear();
+            embd = std::move(session_embd);
+            n_past = header.n_past;
+            num_prompt_tokens = header.num_prompt_tokens;
+            conversation_active = header.conversation_active != 0;
+            last_chat_template = std::move(session_template);
+
+            // The sampler's RNG cannot be serialized, re-seed it with the session's seed and
+            // replay the history so repetition penalties see the same tokens as before
+            params.sampling.seed = header.seed;
+            if (!initSampling()) {
+                status = -4;
+            } else {
+                for (auto token : embd) {
+                    common_sampler_accept(ctx_sampling, token, false);
+                }
+            }
+        }
+    }
+
+#if !defined(_WIN32)
+    if (data != nullptr && buffer.empty()) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+
+    if (status == 0) {
+        LOG_INFO("Loaded session: %zu tokens, n_past=%zu from %s", embd.size(), n_past, path.c_str());
+    }
+    return status;
+}
+
+} // namespace llama_mobile
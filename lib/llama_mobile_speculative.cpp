@@ -0,0 +1,160 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include "llama_cpp/ngram-cache.h"
+#include "llama_cpp/sampling.h"
+#include "llama_cpp/speculative.h"
+#include <algorithm>
+#include <vector>
+#include <string>
+
+namespace llama_mobile {
+
+bool llama_mobile_context::initSpeculative(const std::string &draft_model_path, int n_draft) {
+    if (!ctx || !model) {
+        LOG_ERROR("Context or model not initialized for speculative decoding.");
+        return false;
+    }
+    releaseSpeculative();
+
+    llama_mobile_context_speculative *wrapper = new llama_mobile_context_speculative();
+    wrapper->params.n_draft = n_draft > 0 ? n_draft : params.speculative.n_max;
+    wrapper->params.p_min = params.speculative.p_min;
+
+    if (!draft_model_path.empty()) {
+        common_params draft_params = params;
+        draft_params.model.path = draft_model_path;
+        draft_params.n_gpu_layers = params.speculative.n_gpu_layers;
+        draft_params.n_ctx = params.speculative.n_ctx > 0 ? params.speculative.n_ctx : params.n_ctx;
+        draft_params.embedding = false;
+        draft_params.lora_adapters.clear();
+
+        wrapper->draft_init = common_init_from_params(draft_params);
+        llama_context *ctx_dft = wrapper->draft_init ? wrapper->draft_init->context() : nullptr;
+        if (ctx_dft == nullptr) {
+            LOG_ERROR("Failed to load draft model: %s", draft_model_path.c_str());
+            delete wrapper;
+            return false;
+        }
+        if (!common_speculative_are_compatible(ctx, ctx_dft)) {
+            LOG_ERROR("Draft model %s is not compatible with the target model", draft_model_path.c_str());
+            delete wrapper;
+            return false;
+        }
+        wrapper->spec = common_speculative_init(ctx, ctx_dft);
+        if (wrapper->spec == nullptr) {
+            LOG_ERROR("Failed to initialize speculative decoding");
+            delete wrapper;
+            return false;
+        }
+    }
+
+    spec_wrapper = wrapper;
+    LOG_INFO("Speculative decoding enabled: %s, n_draft=%d",
+        wrapper->spec ? draft_model_path.c_str() : "prompt lookup", wrapper->params.n_draft);
+    return true;
+}
+
+bool llama_mobile_context::isSpeculativeEnabled() const {
+    return spec_wrapper != nullptr;
+}
+
+void llama_mobile_context::releaseSpeculative() {
+    if (spec_wrapper == nullptr) {
+        return;
+    }
+    discardSpeculative();
+    if (spec_wrapper->spec != nullptr) {
+        common_speculative_free(spec_wrapper->spec);
+    }
+    delete spec_wrapper;
+    spec_wrapper = nullptr;
+}
+
+void llama_mobile_context::discardSpeculative() {
+    if (spec_wrapper == nullptr || spec_wrapper->accepted.empty()) {
+        return;
+    }
+    // Verified tokens that will never be returned still occupy the KV cache
+    spec_wrapper->accepted.clear();
+    if (ctx) {
+        llama_memory_seq_rm(llama_get_memory(ctx), 0, embd.size(), -1);
+    }
+}
+
+bool llama_mobile_context::speculativeStep() {
+    // Only plain generation steps are drafted: prompt chunks, guide tokens, per-token
+    // probabilities and context shifts keep going through the regular path
+    if (spec_wrapper == nullptr || ctx_sampling == nullptr || embd.empty() || n_past + 1 != embd.size() ||
+        !guide_tokens.empty() || params.sampling.n_probs > 0 || params.n_predict == 0 || is_interrupted) {
+        return false;
+    }
+
+    int n_draft = spec_wrapper->params.n_draft;
+    n_draft = std::min(n_draft, params.n_batch - 1);
+    n_draft = std::min(n_draft, n_ctx - (int)embd.size());
+    if (params.n_predict != -1) {
+        n_draft = std::min(n_draft, (int)n_remain - 1);
+    }
+    if (n_draft < 1) {
+        return false;
+    }
+
+    const llama_token id_last = embd.back();
+    std::vector<llama_token> draft;
+    if (spec_wrapper->spec != nullptr) {
+        common_speculative_params spec_params = spec_wrapper->params;
+        spec_params.n_draft = n_draft;
+        const std::vector<llama_token> prompt_tgt(embd.begin(), embd.end() - 1);
+        draft = common_speculative_gen_draft(spec_wrapper->spec, spec_params, prompt_tgt, id_last);
+    } else {
+        // Prompt lookup: draft whatever followed the latest n-gram earlier in the context
+        if (spec_wrapper->ngram_n_tokens > embd.size()) {
+            spec_wrapper->ngram_cache.clear();
+            spec_wrapper->ngram_n_tokens = 0;
+        }
+        common_ngram_cache_update(spec_wrapper->ngram_cache, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX,
+            embd, embd.size() - spec_wrapper->ngram_n_tokens, false);
+        spec_wrapper->ngram_n_tokens = embd.size();
+
+        common_ngram_cache nc_dynamic;
+        common_ngram_cache nc_static;
+        draft.push_back(id_last);
+        common_ngram_cache_draft(embd, draft, n_draft, LLAMA_NGRAM_MIN, LLAMA_NGRAM_MAX,
+            spec_wrapper->ngram_cache, nc_dynamic, nc_static);
+        draft.erase(draft.begin());
+    }
+    if (draft.size() > (size_t)n_draft) {
+        draft.resize(n_draft);
+    }
+    if (draft.empty()) {
+        return false;
+    }
+
+    // Verify the last sampled token and the whole draft in one batch
+    llama_batch_clear(&batch);
+    llama_batch_add(&batch, id_last, n_past, {0}, true);
+    for (size_t i = 0; i < draft.size(); ++i) {
+        llama_batch_add(&batch, draft[i], n_past + 1 + i, {0}, true);
+    }
+    if (llama_decode(ctx, batch) != 0) {
+        LOG_WARNING("Speculative verification failed, falling back to single-token decoding");
+        llama_memory_seq_rm(llama_get_memory(ctx), 0, n_past, -1);
+        return false;
+    }
+
+    const std::vector<llama_token> ids = common_sampler_sample_and_accept_n(ctx_sampling, ctx, draft);
+
+    // id_last plus every accepted draft token stays in the cache, the last id is
+    // a fresh sample that gets decoded on the next step
+    llama_memory_seq_rm(llama_get_memory(ctx), 0, n_past + ids.size(), -1);
+
+    spec_wrapper->n_drafted += draft.size();
+    spec_wrapper->n_draft_accepted += ids.size() - 1;
+    spec_wrapper->accepted.assign(ids.begin(), ids.end());
+
+    LOG_VERBOSE("speculative step: drafted %zu, accepted %zu", draft.size(), ids.size() - 1);
+    return true;
+}
+
+} // namespace llama_mobile
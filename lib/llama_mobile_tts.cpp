@@ -9,7 +9,6 @@
 #include <map>
 #include <algorithm>
 #include <cmath>
-#include <thread>
 
 namespace llama_mobile {
 
@@ -151,147 +150,78 @@ static void fill_hann_window(int length, bool periodic, float * output) {
     }
 }
 
-static void twiddle(float * real, float * imag, int k, int N) {
-    float angle = 2 * M_PI * k / N;
-    *real = cos(angle);
-    *imag = sin(angle);
-}
-
-static void irfft(int n, const float * inp_cplx, float * out_real) {
-    int N = n / 2 + 1;
-
-    std::vector<float> real_input(N);
-    std::vector<float> imag_input(N);
-    for (int i = 0; i < N; ++i) {
-        real_input[i] = inp_cplx[2 * i];
-        imag_input[i] = inp_cplx[2 * i + 1];
-    }
-
-    std::vector<float> real_output(n);
-    std::vector<float> imag_output(n);
-
-    for (int k = 0; k < n; ++k) {
-        real_output[k] = 0.0f;
-        imag_output[k] = 0.0f;
-        for (int m = 0; m < N; ++m) {
-            float twiddle_real;
-            float twiddle_imag;
-
-            twiddle(&twiddle_real, &twiddle_imag, k * m, n);
-
-            real_output[k] += real_input[m] * twiddle_real - imag_input[m] * twiddle_imag;
-            imag_output[k] += real_input[m] * twiddle_imag + imag_input[m] * twiddle_real;
-        }
-    }
-
-    for (int i = 0; i < n; ++i) {
-        out_real[i] = real_output[i] / N;
-    }
-}
+static const int tts_n_fft = 1280;
+static const int tts_n_hop = 320;
+static const int tts_n_win = 1280;
 
-static void fold(const std::vector<float> & data, int64_t n_out, int64_t n_win, int64_t n_hop, int64_t n_pad, std::vector<float> & output) {
-    int64_t output_height = n_out;
-    int64_t kernel_w = n_win;
-    int64_t stride_w = n_hop;
-    int64_t width    = n_out;
-
-    output.resize(width, 0.0f);
-
-    int64_t col_idx = 0;
-    for (int64_t w_col = 0; w_col < width; ++w_col) {
-        int64_t start = w_col * stride_w - n_pad;
-        int64_t end   = start + kernel_w;
-
-        for (int64_t w_im = start; w_im < end; ++w_im) {
-            if (w_im >= 0 && w_im < output_height && col_idx < (int64_t) data.size()) {
-                output[w_im] += data[col_idx];
-            }
-            col_idx++;
-        }
-    }
-
-    output.resize(n_out - 2 * n_pad);
-}
-
-static std::vector<float> embd_to_audio(
+// Turns the embeddings of n_codes consecutive codes into frames and overlap-adds them
+// into audio, with the squared window into env; frame l starts at sample l*n_hop
+static void add_frames(
+        const llama_mobile_context::llama_mobile_context_vocoder & vocoder,
         const float * embd,
         const int n_codes,
         const int n_embd,
-        const int n_thread) {
-    const int n_fft = 1280;
-    const int n_hop = 320;
-    const int n_win = 1280;
-    const int n_pad = (n_win - n_hop)/2;
-    const int n_out = (n_codes - 1)*n_hop + n_win;
-
-    std::vector<float> hann(n_fft);
-
-    fill_hann_window(hann.size(), true, hann.data());
-
-    int n_spec = n_embd*n_codes;
-
-    std::vector<float> E (n_spec);
-    std::vector<float> S (n_spec);
-    std::vector<float> ST(n_spec);
-
+        float * audio,
+        float * env) {
+    const int n_fft  = tts_n_fft;
+    const int n_hop  = tts_n_hop;
+    const int n_bins = n_embd/2;
+    const float * hann = vocoder.hann.data();
+
+    std::vector<float> spec(n_embd);
+    std::vector<float> frame(n_fft);
+    std::vector<float> work(vocoder.rfft.workSize());
+
+    // Magnitude and phase halves of the embedding give the spectrum of each frame
     for (int l = 0; l < n_codes; ++l) {
-        for (int k = 0; k < n_embd; ++k) {
-            E[k*n_codes + l] = embd[l*n_embd + k];
-        }
-    }
-
-    for (int k = 0; k < n_embd/2; ++k) {
-        for (int l = 0; l < n_codes; ++l) {
-            float mag = E[(k           )*n_codes + l];
-            float phi = E[(k + n_embd/2)*n_codes + l];
-
-            mag = exp(mag);
+        const float * row = embd + l*n_embd;
+        for (int k = 0; k < n_bins; ++k) {
+            float mag = exp(row[k]);
+            float phi = row[k + n_bins];
 
             if (mag > 1e2) {
                 mag = 1e2;
             }
-            S[2*(k*n_codes + l) + 0] = mag*cosf(phi);
-            S[2*(k*n_codes + l) + 1] = mag*sinf(phi);
+            spec[2*k + 0] = mag*cosf(phi);
+            spec[2*k + 1] = mag*sinf(phi);
         }
-    }
 
-    for (int l = 0; l < n_codes; ++l) {
-        for (int k = 0; k < n_embd/2; ++k) {
-            ST[l*n_embd + 2*k + 0] = S[2*(k*n_codes + l) + 0];
-            ST[l*n_embd + 2*k + 1] = S[2*(k*n_codes + l) + 1];
+        // Same output as the direct sum_{k=0}^{n_fft/2} Re(X_k e^{2 pi i k t/n_fft}) / n_bins
+        // used before, which weights DC and Nyquist like every other bin rather than half
+        spec[0]            *= 2.0f;
+        spec[2*(n_bins-1)] *= 2.0f;
+        vocoder.rfft.inverse(spec.data(), frame.data(), 0.5f/n_bins, work.data());
+
+        float * dst_audio = audio + l*n_hop;
+        float * dst_env   = env   + l*n_hop;
+        for (int j = 0; j < n_fft; ++j) {
+            dst_audio[j] += frame[j] * hann[j];
+            dst_env  [j] += hann[j] * hann[j];
         }
     }
+}
 
-    std::vector<float> res  (n_codes*n_fft);
-    std::vector<float> hann2(n_codes*n_fft);
-
-    std::vector<std::thread> workers(n_thread);
-    for (int i = 0; i < n_thread; ++i) {
-        workers[i] = std::thread([&, i]() {
-            for (int l = i; l < n_codes; l += n_thread) {
-                irfft(n_fft, ST.data() + l*n_embd, res.data() + l*n_fft);
-                for (int j = 0; j < n_fft; ++j) {
-                    res  [l*n_fft + j] *= hann[j];
-                    hann2[l*n_fft + j]  = hann[j] * hann[j];
-                }
-            }
-        });
-    }
-    for (int i = 0; i < n_thread; ++i) {
-        workers[i].join();
-    }
+static std::vector<float> embd_to_audio(
+        const llama_mobile_context::llama_mobile_context_vocoder & vocoder,
+        const float * embd,
+        const int n_codes,
+        const int n_embd) {
+    const int n_hop = tts_n_hop;
+    const int n_win = tts_n_win;
+    const int n_pad = (n_win - n_hop)/2;
+    const int n_out = (n_codes - 1)*n_hop + n_win;
 
-    std::vector<float> audio;
-    std::vector<float> env;
+    std::vector<float> audio(n_out, 0.0f);
+    std::vector<float> env  (n_out, 0.0f);
 
-    fold(res,   n_out, n_win, n_hop, n_pad, audio);
-    fold(hann2, n_out, n_win, n_hop, n_pad, env);
+    add_frames(vocoder, embd, n_codes, n_embd, audio.data(), env.data());
 
-    for (size_t i = 0; i < audio.size(); ++i) {
-        audio[i] /= env[i];
+    std::vector<float> output(n_out - 2*n_pad);
+    for (size_t i = 0; i < output.size(); ++i) {
+        output[i] = audio[i + n_pad] / env[i + n_pad];
     }
 
-    return audio;
+    return output;
 }
 
 bool llama_mobile_context::initVocoder(const std::string &vocoder_model_path) {
@@ -331,6 +261,14 @@ bool llama_mobile_context::initVocoder(const std::string &vocoder_model_path) {
         }
     }
 
+    if (!wrapper->rfft.init(tts_n_fft)) {
+        LOG_ERROR("Failed to set up the vocoder FFT for n_fft = %d", tts_n_fft);
+        delete wrapper;
+        return false;
+    }
+    wrapper->hann.resize(tts_n_fft);
+    fill_hann_window(tts_n_fft, true, wrapper->hann.data());
+
     wrapper->type = TTS_OUTETTS_V0_2;
     vocoder_wrapper = wrapper;
     has_vocoder = true;
@@ -344,6 +282,8 @@ bool llama_mobile_context::isVocoderEnabled() const {
 }
 
 void llama_mobile_context::releaseVocoder() {
+    // The pipeline thread decodes with the vocoder context
+    releaseTTSPipeline();
     if (vocoder_wrapper != nullptr) {
         delete vocoder_wrapper;
         vocoder_wrapper = nullptr;
@@ -484,12 +424,176 @@ std::vector<float> llama_mobile_context::decodeAudioTokens(const std::vector<lla
     
     llama_synchronize(vocoder_wrapper->ctx);
     const int n_embd = llama_model_n_embd(vocoder_wrapper->model);
+    if (n_embd != tts_n_fft + 2) {
+        LOG_ERROR("Vocoder embedding size %d does not match n_fft = %d", n_embd, tts_n_fft);
+        llama_batch_free(batch);
+        return std::vector<float>();
+    }
     const float * embd = llama_get_embeddings(vocoder_wrapper->ctx);
     
-    std::vector<float> audio_output = embd_to_audio(embd, n_codes, n_embd, params.cpuparams.n_threads);
+    std::vector<float> audio_output = embd_to_audio(*vocoder_wrapper, embd, n_codes, n_embd);
     
     llama_batch_free(batch);
     return audio_output;
 }
 
+// Hands out the normalized samples before signal position end and drops them from the
+// pending buffers; the first n_pad samples of the signal are cut as in embd_to_audio
+static void stream_emit(llama_mobile_tts_stream & stream, size_t end) {
+    const size_t n_pad = (tts_n_win - tts_n_hop)/2;
+    if (end <= stream.ola_start) {
+        return;
+    }
+    const size_t begin = std::max(stream.ola_start, n_pad);
+    if (end > begin) {
+        stream.pcm.resize(end - begin);
+        for (size_t i = 0; i < stream.pcm.size(); ++i) {
+            const size_t j = begin - stream.ola_start + i;
+            stream.pcm[i] = stream.ola_audio[j] / stream.ola_env[j];
+        }
+        if (stream.t_first_audio_us == 0) {
+            stream.t_first_audio_us = lm_ggml_time_us();
+        }
+        stream.n_samples += stream.pcm.size();
+        if (stream.on_audio) {
+            stream.on_audio(stream.pcm.data(), stream.pcm.size());
+        }
+    }
+    const size_t n_done = end - stream.ola_start;
+    stream.ola_audio.erase(stream.ola_audio.begin(), stream.ola_audio.begin() + n_done);
+    stream.ola_env.erase(stream.ola_env.begin(), stream.ola_env.begin() + n_done);
+    stream.ola_start = end;
+}
+
+// Codes [first, last) are encoded together with up to context_codes neighbours on each
+// side so the vocoder convolutions see the same surroundings as in a whole-utterance
+// decode. The codes are copied so the window can be synthesized on another thread.
+static llama_mobile_tts_window stream_window(llama_mobile_tts_stream & stream, size_t last, size_t emit_end) {
+    llama_mobile_tts_window window;
+    window.first = stream.n_scheduled;
+    window.last = last;
+    window.lo = window.first - std::min(window.first, (size_t) stream.context_codes);
+    const size_t hi = std::min(stream.codes.size(), last + stream.context_codes);
+    window.codes.assign(stream.codes.begin() + window.lo, stream.codes.begin() + hi);
+    window.emit_end = emit_end;
+    stream.n_scheduled = last;
+    return window;
+}
+
+bool llama_mobile_context::synthesizeAudioWindow(const llama_mobile_tts_window &window) {
+    llama_mobile_tts_stream &stream = tts_stream;
+
+    if (window.last > window.first) {
+        llama_batch batch = llama_batch_init(window.codes.size(), 0, 1);
+        for (size_t i = 0; i < window.codes.size(); ++i) {
+            llama_batch_add(&batch, window.codes[i], i, { 0 }, true);
+        }
+        if (llama_encode(vocoder_wrapper->ctx, batch) != 0) {
+            LOG_ERROR("llama_encode() failed for audio codes %zu..%zu", window.lo, window.lo + window.codes.size());
+            llama_batch_free(batch);
+            return false;
+        }
+        llama_synchronize(vocoder_wrapper->ctx);
+
+        const int n_embd = llama_model_n_embd(vocoder_wrapper->model);
+        const float * embd = llama_get_embeddings(vocoder_wrapper->ctx);
+
+        const size_t frames_end = (window.last - 1)*tts_n_hop + tts_n_fft - stream.ola_start;
+        if (stream.ola_audio.size() < frames_end) {
+            stream.ola_audio.resize(frames_end, 0.0f);
+            stream.ola_env.resize(frames_end, 0.0f);
+        }
+        const size_t offset = window.first*tts_n_hop - stream.ola_start;
+        add_frames(*vocoder_wrapper, embd + (window.first - window.lo)*n_embd, window.last - window.first, n_embd,
+                   stream.ola_audio.data() + offset, stream.ola_env.data() + offset);
+
+        llama_batch_free(batch);
+        stream.n_synthesized = window.last;
+    }
+
+    stream_emit(stream, window.emit_end);
+    return true;
+}
+
+// Synthesizes a window here or hands it to the vocoder thread when pipelined
+static bool stream_dispatch(llama_mobile_context & context, llama_mobile_tts_window window) {
+    if (context.tts_pipeline != nullptr) {
+        return context.tts_pipeline->push(std::move(window));
+    }
+    return context.synthesizeAudioWindow(window);
+}
+
+bool llama_mobile_context::beginAudioStream(int window_codes, int context_codes, std::function<void(const float *pcm, size_t n_samples)> on_audio) {
+    if (!isVocoderEnabled()) {
+        LOG_ERROR("Vocoder is not enabled but audio streaming is requested");
+        return false;
+    }
+    const int n_batch = (int) std::min(llama_n_batch(vocoder_wrapper->ctx), llama_n_ubatch(vocoder_wrapper->ctx));
+    if (window_codes < 1 || context_codes < 0 || window_codes + 2*context_codes > n_batch) {
+        LOG_ERROR("Invalid audio stream window: %d codes with %d context codes, vocoder batch is %d",
+                  window_codes, context_codes, n_batch);
+        return false;
+    }
+    if (llama_model_n_embd(vocoder_wrapper->model) != tts_n_fft + 2) {
+        LOG_ERROR("Vocoder embedding size %d does not match n_fft = %d",
+                  llama_model_n_embd(vocoder_wrapper->model), tts_n_fft);
+        return false;
+    }
+
+    // The vocoder thread must be idle before the stream state is replaced
+    if (tts_pipeline != nullptr) {
+        tts_pipeline->clear();
+    }
+    tts_stream = llama_mobile_tts_stream();
+    tts_stream.window_codes = window_codes;
+    tts_stream.context_codes = context_codes;
+    tts_stream.on_audio = std::move(on_audio);
+    tts_stream.t_start_us = lm_ggml_time_us();
+    tts_stream.active = true;
+    return true;
+}
+
+void llama_mobile_context::pushAudioCode(llama_token token) {
+    if (!tts_stream.active) {
+        return;
+    }
+    const tts_type type = getTTSType();
+    if ((type != TTS_OUTETTS_V0_2 && type != TTS_OUTETTS_V0_3) || token < 151672 || token > 155772) {
+        return;
+    }
+    tts_stream.codes.push_back(token - 151672);
+
+    // A window is decoded once its right-hand context has been generated too. Frames
+    // from later codes start at or after last*n_hop, so everything before is final.
+    while (tts_stream.codes.size() >= tts_stream.n_scheduled + tts_stream.window_codes + tts_stream.context_codes) {
+        const size_t last = tts_stream.n_scheduled + tts_stream.window_codes;
+        if (!stream_dispatch(*this, stream_window(tts_stream, last, last*tts_n_hop))) {
+            tts_stream.active = false;
+            return;
+        }
+    }
+}
+
+bool llama_mobile_context::endAudioStream() {
+    if (!tts_stream.active) {
+        return false;
+    }
+    tts_stream.active = false;
+
+    bool ok = true;
+    while (ok && tts_stream.n_scheduled < tts_stream.codes.size()) {
+        const size_t last = std::min(tts_stream.codes.size(), tts_stream.n_scheduled + tts_stream.window_codes);
+        ok = stream_dispatch(*this, stream_window(tts_stream, last, last*tts_n_hop));
+    }
+    if (ok && !tts_stream.codes.empty()) {
+        // No frames, only the tail of the signal up to the trailing n_pad
+        const size_t n_out = (tts_stream.codes.size() - 1)*tts_n_hop + tts_n_win;
+        ok = stream_dispatch(*this, stream_window(tts_stream, tts_stream.n_scheduled, n_out - (tts_n_win - tts_n_hop)/2));
+    }
+    if (tts_pipeline != nullptr) {
+        ok = tts_pipeline->drain() && ok;
+    }
+    return ok;
+}
+
 } // namespace llama_mobile 
\ No newline at end of file
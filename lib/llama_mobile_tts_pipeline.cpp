@@ -0,0 +1,152 @@
+#include "llama_mobile.h"
+#include "llama_cpp/common.h"
+#include "llama_cpp/llama.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace llama_mobile {
+
+bool llama_mobile_context::configureTTSPipeline(bool enabled, int n_threads_llm, int n_threads_vocoder, int queue_windows) {
+    if (!isVocoderEnabled()) {
+        LOG_ERROR("Vocoder is not enabled, cannot configure the TTS pipeline.");
+        return false;
+    }
+    if (tts_stream.active) {
+        LOG_ERROR("Cannot reconfigure the TTS pipeline while an audio stream is active.");
+        return false;
+    }
+
+    int n_threads = params.cpuparams.n_threads;
+    if (n_threads <= 0) {
+        n_threads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+
+    releaseTTSPipeline();
+    if (!enabled) {
+        // Serial decoding runs one stage at a time, each can have every thread again
+        llama_set_n_threads(ctx, n_threads, n_threads);
+        llama_set_n_threads(vocoder_wrapper->ctx, n_threads, n_threads);
+        return true;
+    }
+
+    // Generation is the longer stage, so it keeps most of the cores by default
+    if (n_threads_vocoder <= 0) {
+        n_threads_vocoder = n_threads_llm > 0 ? std::max(1, n_threads - n_threads_llm) : std::max(1, n_threads / 4);
+    }
+    if (n_threads_llm <= 0) {
+        n_threads_llm = std::max(1, n_threads - n_threads_vocoder);
+    }
+    llama_set_n_threads(ctx, n_threads_llm, n_threads_llm);
+    llama_set_n_threads(vocoder_wrapper->ctx, n_threads_vocoder, n_threads_vocoder);
+
+    llama_mobile_tts_pipeline *pipeline = new llama_mobile_tts_pipeline();
+    if (!pipeline->start(this, queue_windows > 0 ? queue_windows : 4)) {
+        delete pipeline;
+        return false;
+    }
+    tts_pipeline = pipeline;
+    LOG_INFO("TTS pipeline enabled: %d model threads, %d vocoder threads, %zu queued windows",
+             n_threads_llm, n_threads_vocoder, pipeline->capacity);
+    return true;
+}
+
+void llama_mobile_context::releaseTTSPipeline() {
+    if (tts_pipeline != nullptr) {
+        delete tts_pipeline;
+        tts_pipeline = nullptr;
+    }
+}
+
+llama_mobile_tts_pipeline::~llama_mobile_tts_pipeline() {
+    shutdown();
+}
+
+bool llama_mobile_tts_pipeline::start(llama_mobile_context *context_, size_t capacity_) {
+    if (context_ == nullptr || !context_->isVocoderEnabled()) {
+        LOG_ERROR("Vocoder not initialized, cannot start the TTS pipeline.");
+        return false;
+    }
+    context = context_;
+    capacity = std::max<size_t>(1, capacity_);
+    is_running = true;
+    worker = std::thread(&llama_mobile_tts_pipeline::run, this);
+    return true;
+}
+
+bool llama_mobile_tts_pipeline::push(llama_mobile_tts_window window) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    // A full queue means the vocoder is behind, hold generation until it catches up
+    queue_cv.wait(lock, [this] { return !is_running || failed || queue.size() < capacity; });
+    if (!is_running || failed) {
+        return false;
+    }
+    queue.push_back(std::move(window));
+    queue_cv.notify_all();
+    return true;
+}
+
+bool llama_mobile_tts_pipeline::drain() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cv.wait(lock, [this] { return !is_running || (queue.empty() && !busy); });
+    return !failed && queue.empty();
+}
+
+void llama_mobile_tts_pipeline::clear() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue.clear();
+    queue_cv.wait(lock, [this] { return !busy; });
+    failed = false;
+    queue_cv.notify_all();
+}
+
+void llama_mobile_tts_pipeline::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!is_running) {
+            return;
+        }
+        is_running = false;
+        queue.clear();
+        queue_cv.notify_all();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void llama_mobile_tts_pipeline::run() {
+    while (true) {
+        llama_mobile_tts_window window;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !is_running || !queue.empty(); });
+            if (!is_running) {
+                return;
+            }
+            window = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+            // Wakes a producer waiting for room
+            queue_cv.notify_all();
+        }
+
+        bool ok = false;
+        try {
+            ok = context->synthesizeAudioWindow(window);
+        } catch (const std::exception &e) {
+            LOG_ERROR("TTS pipeline window %zu..%zu failed: %s", window.first, window.last, e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        busy = false;
+        if (!ok) {
+            // Later windows depend on the pending samples of this one, drop them too
+            failed = true;
+            queue.clear();
+        }
+        queue_cv.notify_all();
+    }
+}
+
+} // namespace llama_mobile
@@ -2,6 +2,7 @@
 #include "llama_cpp/llama.h"
 #include "llama_cpp/common.h"
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <stdarg.h>
@@ -106,6 +107,142 @@ size_t find_partial_stop_string(const std::string &stop,
     return std::string::npos;
 }
 
+void llama_mobile_stop_matcher::build(const std::vector<std::string> &stop_words) {
+    std::vector<std::string> unique_words;
+    for (const std::string &word : stop_words) {
+        if (!word.empty() && std::find(unique_words.begin(), unique_words.end(), word) == unique_words.end()) {
+            unique_words.push_back(word);
+        }
+    }
+    // Unchanged words keep the automaton and its streaming state, callers reset() explicitly
+    if (unique_words == words && !next.empty()) {
+        return;
+    }
+
+    words = std::move(unique_words);
+    next.assign(256, -1);
+    depth.assign(1, 0);
+    match_word.assign(1, -1);
+    max_word_size = 0;
+
+    // Trie of the stop words
+    for (size_t w = 0; w < words.size(); ++w) {
+        int32_t s = 0;
+        for (unsigned char c : words[w]) {
+            if (next[s * 256 + c] < 0) {
+                next[s * 256 + c] = (int32_t)depth.size();
+                next.resize(next.size() + 256, -1);
+                depth.push_back(depth[s] + 1);
+                match_word.push_back(-1);
+            }
+            s = next[s * 256 + c];
+        }
+        match_word[s] = (int32_t)w;
+        max_word_size = std::max(max_word_size, words[w].size());
+    }
+
+    // Breadth-first over the trie, folding failure links into the table. A state
+    // without its own word inherits the longest word ending at its failure state
+    std::vector<int32_t> fail(depth.size(), 0);
+    std::vector<int32_t> queue;
+    queue.reserve(depth.size());
+    for (int c = 0; c < 256; ++c) {
+        int32_t &t = next[c];
+        if (t < 0) {
+            t = 0;
+        } else {
+            queue.push_back(t);
+        }
+    }
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const int32_t s = queue[i];
+        if (match_word[s] < 0) {
+            match_word[s] = match_word[fail[s]];
+        }
+        for (int c = 0; c < 256; ++c) {
+            const int32_t t = next[s * 256 + c];
+            const int32_t t_fail = next[fail[s] * 256 + c];
+            if (t < 0) {
+                next[s * 256 + c] = t_fail;
+            } else {
+                fail[t] = t_fail;
+                queue.push_back(t);
+            }
+        }
+    }
+
+    reset();
+}
+
+void llama_mobile_stop_matcher::reset(size_t offset) {
+    state = 0;
+    n_fed = offset;
+}
+
+bool llama_mobile_stop_matcher::empty() const {
+    return words.empty();
+}
+
+size_t llama_mobile_stop_matcher::feed(const char *text, size_t length, int32_t &word) {
+    size_t stop_pos = std::string::npos;
+    if (words.empty()) {
+        n_fed += length;
+        return stop_pos;
+    }
+    // Keep scanning after a hit, a longer word completing later in the same piece
+    // may start earlier
+    for (size_t i = 0; i < length; ++i) {
+        state = next[state * 256 + (unsigned char)text[i]];
+        const int32_t w = match_word[state];
+        if (w >= 0) {
+            const size_t pos = n_fed + i + 1 - words[w].size();
+            if (pos < stop_pos) {
+                stop_pos = pos;
+                word = w;
+            }
+        }
+    }
+    n_fed += length;
+    return stop_pos;
+}
+
+size_t llama_mobile_stop_matcher::partialLength() const {
+    return words.empty() ? 0 : depth[state];
+}
+
+size_t llama_mobile_stop_matcher::findFull(const std::string &text, size_t from, int32_t &word) const {
+    size_t stop_pos = std::string::npos;
+    if (words.empty()) {
+        return stop_pos;
+    }
+    // A match has to end at or after from, so start early enough for the longest word
+    const size_t start = from > max_word_size ? from - max_word_size : 0;
+    int32_t s = 0;
+    for (size_t i = start; i < text.size(); ++i) {
+        s = next[s * 256 + (unsigned char)text[i]];
+        const int32_t w = match_word[s];
+        if (w >= 0 && i + 1 >= from) {
+            const size_t pos = i + 1 - words[w].size();
+            if (pos < stop_pos) {
+                stop_pos = pos;
+                word = w;
+            }
+        }
+    }
+    return stop_pos;
+}
+
+size_t llama_mobile_stop_matcher::findPartial(const std::string &text) const {
+    if (words.empty() || text.empty()) {
+        return std::string::npos;
+    }
+    int32_t s = 0;
+    for (size_t i = text.size() > max_word_size ? text.size() - max_word_size : 0; i < text.size(); ++i) {
+        s = next[s * 256 + (unsigned char)text[i]];
+    }
+    return depth[s] > 0 ? text.size() - depth[s] : std::string::npos;
+}
+
 std::string tokens_to_output_formatted_string(const llama_context *ctx, const llama_token token)
 {
     if (!ctx) return "<null_ctx>"; 
@@ -0,0 +1,213 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "../llama_mobile.h"
+#include "../llama_cpp/base64.hpp"
+
+// Fuzz and throughput test for llama_mobile::base64_decode. Every input is also fed
+// to the character-at-a-time decoder the multimodal path used before, and both must
+// produce the same bytes, including for whitespace, padding, garbage and truncated
+// input. The output buffer is sized with base64_decoded_size_max and followed by
+// canary bytes that must survive the vector kernels' full-register stores.
+//
+// Usage: base64_test [n_fuzz] [payload_mb]
+
+static const std::string base64_chars =
+             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+             "abcdefghijklmnopqrstuvwxyz"
+             "0123456789+/";
+
+// The previous decoder, kept verbatim
+static std::vector<uint8_t> base64_decode_reference(const std::string &encoded_string) {
+    std::vector<uint8_t> decoded;
+    int in_len = encoded_string.size();
+    int i = 0;
+    int j = 0;
+    int in_ = 0;
+    unsigned char char_array_4[4], char_array_3[3];
+
+    while (in_len-- && (encoded_string[in_] != '=')) {
+        if (isspace(encoded_string[in_])) {
+            in_++;
+            continue;
+        }
+
+        if (encoded_string[in_] == '=' || base64_chars.find(encoded_string[in_]) == std::string::npos) {
+            break;
+        }
+
+        char_array_4[i++] = encoded_string[in_]; in_++;
+        if (i == 4) {
+            for (i = 0; i < 4; i++) {
+                char_array_4[i] = base64_chars.find(char_array_4[i]);
+            }
+
+            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
+            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+
+            for (i = 0; i < 3; i++) {
+                decoded.push_back(char_array_3[i]);
+            }
+            i = 0;
+        }
+    }
+
+    if (i) {
+        for (j = i; j < 4; j++) {
+            char_array_4[j] = 0;
+        }
+
+        for (j = 0; j < 4; j++) {
+            char_array_4[j] = base64_chars.find(char_array_4[j]);
+        }
+
+        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
+        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+
+        for (j = 0; j < i - 1; j++) {
+            decoded.push_back(char_array_3[j]);
+        }
+    }
+
+    return decoded;
+}
+
+static const size_t CANARY_SIZE = 64;
+static const uint8_t CANARY = 0xA5;
+
+static bool check(const std::string &encoded, const char *what) {
+    std::vector<uint8_t> expected = base64_decode_reference(encoded);
+
+    const size_t bound = llama_mobile::base64_decoded_size_max(encoded.size());
+    std::vector<uint8_t> out(bound + CANARY_SIZE, CANARY);
+    size_t n = llama_mobile::base64_decode(encoded, out.data());
+
+    if (n != expected.size() || memcmp(out.data(), expected.data(), n) != 0) {
+        std::cerr << "Mismatch (" << what << ") for input of " << encoded.size() << " chars: got "
+                  << n << " bytes, expected " << expected.size() << std::endl;
+        return false;
+    }
+    for (size_t i = bound; i < out.size(); ++i) {
+        if (out[i] != CANARY) {
+            std::cerr << "Write past base64_decoded_size_max (" << what << ") at offset " << i
+                      << " for input of " << encoded.size() << " chars" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string random_bytes(std::mt19937 &rng, size_t n) {
+    std::string bytes(n, '\0');
+    for (auto &c : bytes) {
+        c = (char) (rng() & 0xff);
+    }
+    return bytes;
+}
+
+int main(int argc, char* argv[]) {
+    int n_fuzz = argc > 1 ? std::stoi(argv[1]) : 20000;
+    int payload_mb = argc > 2 ? std::stoi(argv[2]) : 8;
+
+    std::mt19937 rng(1234);
+    int n_failed = 0;
+
+    // Every length around the block sizes of the kernels, padded and unpadded
+    for (size_t len = 0; len < 400; ++len) {
+        std::string encoded = base64::encode(random_bytes(rng, len));
+        n_failed += !check(encoded, "exact length");
+        while (!encoded.empty() && encoded.back() == '=') {
+            encoded.pop_back();
+        }
+        n_failed += !check(encoded, "unpadded");
+    }
+
+    const std::string noise = " \t\r\n=-_.:%\x80\xff";
+    for (int iter = 0; iter < n_fuzz; ++iter) {
+        std::string encoded = base64::encode(random_bytes(rng, rng() % 2048));
+        switch (rng() % 6) {
+            case 0:
+                // MIME style line breaks
+                for (size_t pos = 76; pos < encoded.size(); pos += 78) {
+                    encoded.insert(pos, "\r\n");
+                }
+                break;
+            case 1: {
+                // Scattered noise characters, the first one that is not whitespace ends the input
+                int n_noise = 1 + rng() % 4;
+                for (int k = 0; k < n_noise && !encoded.empty(); ++k) {
+                    encoded.insert(encoded.begin() + rng() % encoded.size(), noise[rng() % noise.size()]);
+                }
+                break;
+            }
+            case 2:
+                // Truncated anywhere
+                encoded.resize(encoded.empty() ? 0 : rng() % encoded.size());
+                break;
+            case 3:
+                // Data after the padding
+                encoded += "==" + base64::encode(random_bytes(rng, 64));
+                break;
+            case 4: {
+                // Arbitrary characters
+                std::string garbage(rng() % 512, '\0');
+                for (auto &c : garbage) {
+                    c = rng() % 4 == 0 ? (char) (rng() & 0xff) : base64_chars[rng() % 64];
+                }
+                encoded = garbage;
+                break;
+            }
+            default:
+                break;
+        }
+        n_failed += !check(encoded, "fuzz");
+        if (n_failed > 10) {
+            break;
+        }
+    }
+
+    if (n_failed > 0) {
+        std::cerr << n_failed << " base64 decoding mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "Fuzz: " << n_fuzz << " random inputs decode like the reference decoder" << std::endl;
+
+    // Throughput on a data URI sized payload
+    const size_t payload_size = (size_t) payload_mb * 1024 * 1024;
+    const std::string payload = random_bytes(rng, payload_size);
+    const std::string encoded = base64::encode(payload);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<uint8_t> reference = base64_decode_reference(encoded);
+    auto end = std::chrono::high_resolution_clock::now();
+    double reference_seconds = std::chrono::duration<double>(end - start).count();
+
+    const int n_runs = 20;
+    std::vector<uint8_t> out(llama_mobile::base64_decoded_size_max(encoded.size()));
+    size_t n = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < n_runs; ++i) {
+        n = llama_mobile::base64_decode(encoded, out.data());
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double fast_seconds = std::chrono::duration<double>(end - start).count() / n_runs;
+
+    if (n != payload.size() || memcmp(out.data(), payload.data(), n) != 0 || reference.size() != n) {
+        std::cerr << "Payload did not round trip" << std::endl;
+        return 1;
+    }
+
+    const double mb = encoded.size() / (1024.0 * 1024.0);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Decoding " << mb << " MB of base64" << std::endl;
+    std::cout << "  reference:     " << std::setw(10) << mb / reference_seconds << " MB/s" << std::endl;
+    std::cout << "  base64_decode: " << std::setw(10) << mb / fast_seconds << " MB/s" << std::endl;
+    std::cout << "  speedup: " << reference_seconds / fast_seconds << "x" << std::endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <vector>
+#include <string>
+#include "../llama_mobile.h"
+
+// Generates N_BRANCHES completions of one prompt with completeBranches() and checks
+// that they come back complete and differ, that the forked sequences are gone from
+// the KV cache afterwards and that sequence 0 holds branch 0 like a plain completion.
+// Prints the time of N single completions of the same prompt next to it.
+//
+// Usage: completion_branches_test [model.gguf]
+
+static const int N_BRANCHES = 4;
+static const int N_PREDICT = 32;
+
+static void prepare(llama_mobile::llama_mobile_context& context, const std::string& prompt) {
+    context.rewind();
+    context.params.prompt = prompt;
+    context.params.n_predict = N_PREDICT;
+    context.initSampling();
+    context.beginCompletion();
+    context.loadPrompt();
+}
+
+static double ms_since(std::chrono::high_resolution_clock::time_point start) {
+    return 1e3 * std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    common_params params;
+    params.model.path = argc > 1 ? argv[1] : "../../lib/models/SmolLM-360M-Instruct.Q6_K.gguf";
+    params.n_ctx = 1024;
+    params.n_batch = 256;
+    params.n_gpu_layers = 0;
+    params.cpuparams.n_threads = 4;
+    params.n_parallel = N_BRANCHES;
+    params.kv_unified = true;
+    params.sampling.seed = 42;
+    params.sampling.temp = 0.8f;
+
+    llama_mobile::llama_mobile_context context;
+    if (!context.loadModel(params)) {
+        std::cerr << "Failed to load model: " << params.model.path << std::endl;
+        return 1;
+    }
+
+    const std::string prompt = context.getFormattedChat(R"([
+        {"role": "user", "content": "Suggest a short reply to: are you coming to dinner tonight?"}
+    ])", "");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < N_BRANCHES; ++i) {
+        prepare(context, prompt);
+        while (context.has_next_token && !context.is_interrupted) {
+            context.doCompletion();
+        }
+        context.endCompletion();
+    }
+    const double single_ms = ms_since(start);
+    const std::string single_text = context.generated_text;
+
+    prepare(context, prompt);
+    start = std::chrono::high_resolution_clock::now();
+    const std::vector<llama_mobile::completion_branch_result> branches = context.completeBranches(N_BRANCHES);
+    const double branches_ms = ms_since(start);
+    context.endCompletion();
+
+    bool ok = branches.size() == (size_t)N_BRANCHES;
+    std::set<std::string> distinct;
+    for (size_t b = 0; b < branches.size(); ++b) {
+        const auto& branch = branches[b];
+        std::cout << "[" << b << "] " << branch.tokens_predicted << " tokens: " << branch.text << std::endl;
+        if (branch.tokens_predicted < 1 || branch.tokens_predicted > N_PREDICT ||
+            !(branch.stopped_eos || branch.stopped_word || branch.stopped_limit)) {
+            std::cerr << "Branch " << b << " did not finish properly" << std::endl;
+            ok = false;
+        }
+        distinct.insert(branch.text);
+    }
+    if (distinct.size() < 2) {
+        std::cerr << "All branches generated the same text" << std::endl;
+        ok = false;
+    }
+
+    llama_memory_t mem = llama_get_memory(context.ctx);
+    for (int b = 1; b < N_BRANCHES; ++b) {
+        if (llama_memory_seq_pos_max(mem, b) != -1) {
+            std::cerr << "Sequence " << b << " was left in the KV cache" << std::endl;
+            ok = false;
+        }
+    }
+    if (llama_memory_seq_pos_max(mem, 0) + 1 != (llama_pos)context.n_past || (ok && context.generated_text != branches[0].text)) {
+        std::cerr << "Sequence 0 does not hold branch 0" << std::endl;
+        ok = false;
+    }
+    std::cout << "Branch 0 " << (branches.empty() || branches[0].text != single_text ? "differs from" : "matches")
+              << " the single completion" << std::endl;
+
+    std::cout << N_BRANCHES << " single completions: " << single_ms << " ms, completeBranches: " << branches_ms
+              << " ms (prompt included)" << std::endl;
+    std::cout << (ok ? "Completion branches test passed" : "Completion branches test failed") << std::endl;
+    return ok ? 0 : 1;
+}
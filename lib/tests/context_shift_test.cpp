@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "../llama_mobile.h"
+
+// Generates 10x n_ctx tokens through a small context under every shift policy and
+// checks that the KV cache and embd stay consistent, the first message survives
+// and generation never falls back to re-evaluating the whole history.
+//
+// Usage: context_shift_test [model.gguf]
+
+static const int N_CTX = 256;
+
+static bool run_policy(llama_mobile::llama_mobile_context& context, llama_mobile::context_shift_policy policy, const char* name) {
+    llama_mobile::llama_mobile_context_shift_params shift_params;
+    shift_params.policy = policy;
+    shift_params.keep_turns = 2;
+    shift_params.n_free = N_CTX / 4;
+    if (!context.configureContextShift(shift_params)) {
+        std::cerr << "[" << name << "] configureContextShift failed" << std::endl;
+        return false;
+    }
+
+    // A short multi-turn chat so the turn based policies have message boundaries to cut at
+    std::string messages = R"([
+        {"role": "system", "content": "You are a helpful assistant."},
+        {"role": "user", "content": "Tell me about rivers."},
+        {"role": "assistant", "content": "Rivers carry water from high ground to the sea."},
+        {"role": "user", "content": "And mountains?"},
+        {"role": "assistant", "content": "Mountains rise where the crust is pushed up."},
+        {"role": "user", "content": "Write a very long story about both."}
+    ])";
+
+    context.rewind();
+    context.params.prompt = context.getFormattedChat(messages, "");
+    context.params.n_predict = 10 * N_CTX;
+    context.params.sampling.ignore_eos = true;
+    if (!context.initSampling()) {
+        std::cerr << "[" << name << "] initSampling failed" << std::endl;
+        return false;
+    }
+    context.beginCompletion();
+    context.loadPrompt();
+
+    const std::vector<llama_token> first_tokens(context.embd.begin(), context.embd.begin() + 8);
+    llama_memory_t mem = llama_get_memory(context.ctx);
+    size_t shifts_seen = 0;
+    bool ok = true;
+
+    while (context.has_next_token && ok) {
+        context.doCompletion();
+
+        if (context.embd.size() > (size_t)N_CTX || context.n_past > context.embd.size()) {
+            std::cerr << "[" << name << "] embd size " << context.embd.size() << ", n_past " << context.n_past
+                      << " exceed n_ctx " << N_CTX << std::endl;
+            ok = false;
+        }
+        if (context.n_context_shifts != shifts_seen) {
+            shifts_seen = context.n_context_shifts;
+            // After a shift the KV cache has to hold exactly the tokens before the last
+            // sampled one, otherwise the history was evaluated again
+            const llama_pos pos_max = llama_memory_seq_pos_max(mem, 0);
+            if (llama_memory_can_shift(mem) && pos_max + 1 != (llama_pos)context.n_past) {
+                std::cerr << "[" << name << "] KV cache ends at " << pos_max << " but n_past is " << context.n_past << std::endl;
+                ok = false;
+            }
+            if (!std::equal(first_tokens.begin(), first_tokens.end(), context.embd.begin())) {
+                std::cerr << "[" << name << "] the start of the prompt was discarded" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    context.endCompletion();
+
+    if (policy == llama_mobile::CONTEXT_SHIFT_NONE) {
+        ok = ok && context.context_full && context.num_tokens_predicted < (size_t)(10 * N_CTX);
+    } else {
+        ok = ok && context.num_tokens_predicted == (size_t)(10 * N_CTX) && context.n_context_shifts > 0;
+    }
+    std::cout << "[" << name << "] " << (ok ? "PASS" : "FAIL") << ": " << context.num_tokens_predicted
+              << " tokens, " << context.n_context_shifts << " shifts, " << context.n_tokens_discarded
+              << " tokens discarded, " << context.turn_tokens.size() << " turn tokens" << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    common_params params;
+    params.model.path = argc > 1 ? argv[1] : "../../lib/models/SmolLM-360M-Instruct.Q6_K.gguf";
+    params.n_ctx = N_CTX;
+    params.n_batch = 64;
+    params.n_gpu_layers = 0;
+    params.cpuparams.n_threads = 4;
+
+    llama_mobile::llama_mobile_context context;
+    if (!context.loadModel(params)) {
+        std::cerr << "Failed to load model: " << params.model.path << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+    ok = run_policy(context, llama_mobile::CONTEXT_SHIFT_HALF, "half") && ok;
+    ok = run_policy(context, llama_mobile::CONTEXT_SHIFT_DROP_OLDEST_TURNS, "drop-oldest-turns") && ok;
+    ok = run_policy(context, llama_mobile::CONTEXT_SHIFT_KEEP_LAST_TURNS, "keep-last-turns") && ok;
+    ok = run_policy(context, llama_mobile::CONTEXT_SHIFT_NONE, "none") && ok;
+
+    std::cout << (ok ? "All context shift tests passed" : "Context shift tests failed") << std::endl;
+    return ok ? 0 : 1;
+}
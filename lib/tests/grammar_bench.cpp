@@ -0,0 +1,149 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <nlohmann/json.hpp>
+#include "../llama_cpp/llama.h"
+#include "../llama_cpp/llama-grammar.h"
+#include "../llama_cpp/llama-vocab.h"
+#include "../llama_cpp/json-schema-to-grammar.h"
+
+// Grammar time per token for JSON schemas converted by json_schema_to_grammar, over
+// the full vocabulary of a real model (only its vocabulary is loaded). Each schema is
+// followed by two grammars in lockstep: one matching token by token as before and one
+// using the token trie and the cached per-stack masks. Random logits pick the next
+// allowed token, and both grammars must allow exactly the same tokens at every step.
+// Each schema is also compiled twice to show the cost of a cold and a cached compile.
+//
+// Usage: grammar_bench [model.gguf] [n_tokens]
+
+static const char *schemas[] = {
+    R"({"type": "object", "properties": {"name": {"type": "string"}, "age": {"type": "integer"}, "email": {"type": "string", "format": "email"}}, "required": ["name", "age"]})",
+    R"({"type": "object", "properties": {"tool": {"enum": ["search", "calculator", "weather"]}, "arguments": {"type": "object", "properties": {"query": {"type": "string"}, "limit": {"type": "integer", "minimum": 1, "maximum": 50}}, "required": ["query"]}}, "required": ["tool", "arguments"]})",
+    R"({"type": "array", "items": {"type": "object", "properties": {"id": {"type": "string", "format": "uuid"}, "score": {"type": "number"}, "tags": {"type": "array", "items": {"type": "string"}, "maxItems": 4}}, "required": ["id", "score"]}, "maxItems": 8})",
+};
+
+int main(int argc, char* argv[]) {
+    const char *model_path = argc > 1 ? argv[1] : "../../lib/models/SmolLM-360M-Instruct.Q6_K.gguf";
+    const int n_tokens = argc > 2 ? std::atoi(argv[2]) : 256;
+
+    llama_backend_init();
+    llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+    llama_model *model = llama_model_load_from_file(model_path, mparams);
+    if (model == nullptr) {
+        std::cerr << "Failed to load " << model_path << std::endl;
+        return 1;
+    }
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    vocab->grammar_trie();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Vocabulary: " << n_vocab << " tokens, trie built in "
+              << std::fixed << std::setprecision(1) << 1e3 * std::chrono::duration<double>(end - start).count() << " ms" << std::endl;
+    std::cout << std::setw(8) << "schema" << std::setw(8) << "tokens" << std::setw(16) << "per token (ms)"
+              << std::setw(14) << "masks (ms)" << std::setw(10) << "speedup" << std::setw(12) << "hit rate" << std::endl;
+
+    bool ok = true;
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<llama_token_data> reference(n_vocab);
+    std::vector<llama_token_data> masked(n_vocab);
+
+    for (size_t s = 0; s < sizeof(schemas) / sizeof(schemas[0]); ++s) {
+        // Compiling a schema the second time is served by the process-wide caches
+        double compile_ms[2];
+        std::string grammar_str;
+        for (double &ms : compile_ms) {
+            start = std::chrono::high_resolution_clock::now();
+            grammar_str = json_schema_to_grammar(nlohmann::ordered_json::parse(schemas[s]));
+            llama_grammar_free_impl(llama_grammar_init_impl(vocab, grammar_str.c_str(), "root", false, nullptr, 0, nullptr, 0));
+            end = std::chrono::high_resolution_clock::now();
+            ms = 1e3 * std::chrono::duration<double>(end - start).count();
+        }
+        std::cout << "Schema " << s << " compiled in " << std::setprecision(3) << compile_ms[0] << " ms, again in "
+                  << compile_ms[1] << " ms" << std::endl;
+
+        llama_grammar *by_token = llama_grammar_init_impl(vocab, grammar_str.c_str(), "root", false, nullptr, 0, nullptr, 0);
+        llama_grammar *by_mask = llama_grammar_init_impl(vocab, grammar_str.c_str(), "root", false, nullptr, 0, nullptr, 0);
+        if (by_token == nullptr || by_mask == nullptr) {
+            std::cerr << "Failed to compile schema " << s << std::endl;
+            return 1;
+        }
+        by_token->masks.reset();
+
+        double token_seconds = 0.0;
+        double mask_seconds = 0.0;
+        int n_steps = 0;
+        for (; n_steps < n_tokens; ++n_steps) {
+            for (llama_token id = 0; id < n_vocab; ++id) {
+                reference[id] = llama_token_data{id, noise(rng), 0.0f};
+            }
+            masked = reference;
+            llama_token_data_array ref_p = { reference.data(), reference.size(), -1, false };
+            llama_token_data_array mask_p = { masked.data(), masked.size(), -1, false };
+
+            start = std::chrono::high_resolution_clock::now();
+            llama_grammar_apply_impl(*by_token, &ref_p);
+            end = std::chrono::high_resolution_clock::now();
+            token_seconds += std::chrono::duration<double>(end - start).count();
+
+            start = std::chrono::high_resolution_clock::now();
+            llama_grammar_apply_impl(*by_mask, &mask_p);
+            end = std::chrono::high_resolution_clock::now();
+            mask_seconds += std::chrono::duration<double>(end - start).count();
+
+            llama_token best = LLAMA_TOKEN_NULL;
+            for (llama_token id = 0; id < n_vocab; ++id) {
+                const bool allowed_ref = reference[id].logit != -INFINITY;
+                const bool allowed_mask = masked[id].logit != -INFINITY;
+                if (allowed_ref != allowed_mask) {
+                    std::cout << "FAIL: schema " << s << " step " << n_steps << " token " << id
+                              << " allowed " << allowed_ref << " by token, " << allowed_mask << " by mask" << std::endl;
+                    ok = false;
+                    break;
+                }
+                if (allowed_ref && (best == LLAMA_TOKEN_NULL || reference[id].logit > reference[best].logit)) {
+                    best = id;
+                }
+            }
+            if (!ok || best == LLAMA_TOKEN_NULL || vocab->is_eog(best)) {
+                break;
+            }
+            llama_grammar_accept_impl(*by_token, best);
+            llama_grammar_accept_impl(*by_mask, best);
+        }
+
+        const auto &masks = *by_mask->masks;
+        const uint64_t lookups = masks.n_hits + masks.n_misses;
+        const int n = std::max(n_steps, 1);
+        std::cout << std::setw(8) << s << std::setw(8) << n_steps
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(16) << 1e3 * token_seconds / n << std::setw(14) << 1e3 * mask_seconds / n
+                  << std::setprecision(1) << std::setw(9) << token_seconds / mask_seconds << "x"
+                  << std::setw(11) << (lookups ? 100.0 * masks.n_hits / lookups : 0.0) << "%" << std::endl;
+
+        llama_grammar_free_impl(by_token);
+        llama_grammar_free_impl(by_mask);
+        if (!ok) {
+            break;
+        }
+    }
+
+    const llama_grammar_cache_stats grammars = llama_grammar_cache_get_stats();
+    const common_schema_cache_stats schemas_cached = json_schema_to_grammar_cache_stats();
+    std::cout << "Compile cache: " << grammars.hits << " grammar hits, " << grammars.misses << " misses; "
+              << schemas_cached.hits << " schema hits, " << schemas_cached.misses << " misses; "
+              << grammars.mask_bytes / 1024 << " KiB of token masks" << std::endl;
+
+    llama_model_free(model);
+    llama_backend_free();
+
+    std::cout << (ok ? "Masks allow the same tokens as token by token matching" : "Grammar paths disagree") << std::endl;
+    return ok ? 0 : 1;
+}
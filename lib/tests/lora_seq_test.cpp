@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../llama_mobile.h"
+
+// Checks the stacked per-sequence LoRA path (llama_set_adapter_lora_seq, one mul_mat_id
+// per weight) against the adapter set on the whole context with llama_set_adapter_lora.
+// One batch decodes the prompt twice: sequence 0 with the adapter, sequence 1 without.
+// Their logits must match the context-wide adapter and the base model. Selecting the
+// adapter again after clearing it must give the same logits.
+//
+// Usage: lora_seq_test [model.gguf] lora.gguf
+
+static const float TOLERANCE = 2e-2f; // the stacked adapter weights are F16
+
+static llama_context * new_context(llama_model * model, bool lora_seq) {
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx = 512;
+    cparams.n_batch = 256;
+    cparams.n_seq_max = 2;
+    cparams.n_threads = 4;
+    cparams.kv_unified = true;
+    cparams.lora_seq = lora_seq;
+    return llama_init_from_model(model, cparams);
+}
+
+// Decodes the prompt once for each sequence in a single batch, returns the last logits of each
+static std::vector<std::vector<float>> decode(llama_context * ctx, const std::vector<llama_token> & tokens, int n_seq) {
+    llama_memory_clear(llama_get_memory(ctx), true);
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx)));
+    llama_batch batch = llama_batch_init(tokens.size() * n_seq, 0, 1);
+    for (int s = 0; s < n_seq; ++s) {
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            common_batch_add(batch, tokens[i], i, { s }, i + 1 == tokens.size());
+        }
+    }
+
+    std::vector<std::vector<float>> logits;
+    if (llama_decode(ctx, batch) == 0) {
+        for (int s = 0; s < n_seq; ++s) {
+            const float * row = llama_get_logits_ith(ctx, (s + 1) * tokens.size() - 1);
+            logits.emplace_back(row, row + n_vocab);
+        }
+    }
+    llama_batch_free(batch);
+    return logits;
+}
+
+static float max_diff(const std::vector<float> & a, const std::vector<float> & b) {
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+    }
+    return diff;
+}
+
+static bool check(const char * what, float diff, float limit) {
+    const bool ok = diff <= limit;
+    std::cout << what << ": max diff " << diff << (ok ? "" : " (too large)") << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " [model.gguf] lora.gguf" << std::endl;
+        return 1;
+    }
+    const std::string model_path = argc > 2 ? argv[1] : "../../lib/models/SmolLM-360M-Instruct.Q6_K.gguf";
+    const std::string lora_path = argv[argc > 2 ? 2 : 1];
+
+    llama_backend_init();
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = 0;
+    llama_model * model = llama_model_load_from_file(model_path.c_str(), mparams);
+    if (model == nullptr) {
+        std::cerr << "Failed to load model: " << model_path << std::endl;
+        return 1;
+    }
+    llama_adapter_lora * lora = llama_adapter_lora_init(model, lora_path.c_str());
+    if (lora == nullptr) {
+        std::cerr << "Failed to load LoRA adapter: " << lora_path << std::endl;
+        llama_model_free(model);
+        return 1;
+    }
+
+    const std::vector<llama_token> tokens = common_tokenize(llama_model_get_vocab(model),
+        "The quick brown fox jumps over the lazy dog.", true, false);
+
+    bool ok = true;
+
+    llama_context * ctx_wide = new_context(model, false);
+    const std::vector<std::vector<float>> base = decode(ctx_wide, tokens, 1);
+    llama_set_adapter_lora(ctx_wide, lora, 1.0f);
+    const std::vector<std::vector<float>> wide = decode(ctx_wide, tokens, 1);
+    if (llama_set_adapter_lora_seq(ctx_wide, lora, 0, 1.0f) == 0) {
+        std::cerr << "Per-sequence adapter accepted without lora_seq" << std::endl;
+        ok = false;
+    }
+    llama_free(ctx_wide);
+
+    llama_context * ctx_seq = new_context(model, true);
+    std::vector<std::vector<float>> stacked;
+    std::vector<std::vector<float>> reselected;
+    if (llama_set_adapter_lora_seq(ctx_seq, nullptr, 0, 1.0f) == 0) {
+        std::cerr << "Null per-sequence adapter accepted" << std::endl;
+        ok = false;
+    }
+    if (llama_set_adapter_lora_seq(ctx_seq, lora, 0, 1.0f) == 0) {
+        stacked = decode(ctx_seq, tokens, 2);
+        llama_clear_adapter_lora_seq(ctx_seq, 0);
+        if (llama_set_adapter_lora_seq(ctx_seq, lora, 0, 1.0f) == 0) {
+            reselected = decode(ctx_seq, tokens, 2);
+        }
+    }
+    llama_free(ctx_seq);
+
+    if (base.size() != 1 || wide.size() != 1 || stacked.size() != 2 || reselected.size() != 2) {
+        std::cerr << "Decoding failed" << std::endl;
+        ok = false;
+    } else {
+        const float limit = TOLERANCE * std::max(1.0f, max_diff(base[0], std::vector<float>(base[0].size(), 0.0f)));
+        ok &= check("stacked vs context-wide adapter", max_diff(stacked[0], wide[0]), limit);
+        ok &= check("sequence without adapter vs base", max_diff(stacked[1], base[0]), limit);
+        ok &= check("reselected vs stacked adapter", max_diff(reselected[0], stacked[0]), 0.0f);
+        if (max_diff(wide[0], base[0]) <= limit) {
+            std::cerr << "The adapter does not change the logits, use another one" << std::endl;
+            ok = false;
+        }
+    }
+
+    llama_adapter_lora_free(lora);
+    llama_model_free(model);
+    llama_backend_free();
+
+    std::cout << (ok ? "LoRA per sequence test passed" : "LoRA per sequence test failed") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include "../llama_cpp/llama.h"
+#include "../llama_cpp/common.h"
+#include "../llama_cpp/sampling.h"
+
+// Per-request sampling setup cost across vocabulary sizes. The rebuild column is what
+// initSampling did for every completion and conversation turn: free the sampler and
+// common_sampler_init a new one. The reconfigure columns run common_sampler_reconfigure
+// on the sampler of the previous request, once with the same parameters and once with
+// temperature, top-k, top-p and penalties changed every turn. The parameters are those
+// of a chat turn with penalties, DRY, a JSON grammar and a logit bias, and the history
+// is sized to the context as initSampling does. A reconfigured chain must then pick the
+// same tokens as a freshly built one. Only the vocabulary of each model is loaded.
+//
+// Usage: sampler_init_bench [model.gguf ...]
+
+static const int n_requests = 200;
+
+static const char *json_grammar = R"(
+root   ::= object
+value  ::= object | array | string | number | ("true" | "false" | "null") ws
+object ::= "{" ws ( string ":" ws value ("," ws string ":" ws value)* )? "}" ws
+array  ::= "[" ws ( value ("," ws value)* )? "]" ws
+string ::= "\"" ( [^"\\\x7F\x00-\x1F] | "\\" (["\\bfnrt] | "u" [0-9a-fA-F]{4}) )* "\"" ws
+number ::= ("-"? ([0-9] | [1-9] [0-9]{0,15})) ("." [0-9]+)? ([eE] [-+]? [1-9] [0-9]{0,15})? ws
+ws ::= | " " | "\n" [ \t]{0,20}
+)";
+
+static common_params_sampling chat_params(int turn) {
+    common_params_sampling params;
+    params.n_prev = 4096;
+    params.seed = 1234;
+    params.temp = 0.7f + 0.1f * (turn % 3);
+    params.top_k = 40 + turn % 2;
+    params.top_p = 0.9f + 0.01f * (turn % 4);
+    params.penalty_repeat = 1.1f + 0.05f * (turn % 2);
+    params.dry_multiplier = 0.8f;
+    params.dry_penalty_last_n = 1024; // -1 means n_ctx_train, which a vocab-only model leaves at 0
+    params.grammar = json_grammar;
+    params.logit_bias.push_back({ 2, -1.0f });
+    return params;
+}
+
+static double ms_since(std::chrono::high_resolution_clock::time_point start) {
+    return 1e3 * std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Runs both chains over the same random logits and accepts the first one's pick in both
+static bool same_picks(common_sampler *a, common_sampler *b, int32_t n_vocab) {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 2.0f);
+    std::vector<llama_token_data> cur_a(n_vocab);
+    std::vector<llama_token_data> cur_b(n_vocab);
+    for (int step = 0; step < 64; ++step) {
+        for (llama_token id = 0; id < n_vocab; ++id) {
+            cur_a[id] = llama_token_data{id, noise(rng), 0.0f};
+        }
+        cur_b = cur_a;
+        llama_token_data_array p_a = { cur_a.data(), cur_a.size(), -1, false };
+        llama_token_data_array p_b = { cur_b.data(), cur_b.size(), -1, false };
+        llama_sampler_apply(common_sampler_get(a), &p_a);
+        llama_sampler_apply(common_sampler_get(b), &p_b);
+        const llama_token id = p_a.data[p_a.selected].id;
+        if (id != p_b.data[p_b.selected].id) {
+            return false;
+        }
+        common_sampler_accept(a, id, false);
+        common_sampler_accept(b, id, false);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> model_paths;
+    for (int i = 1; i < argc; ++i) {
+        model_paths.push_back(argv[i]);
+    }
+    if (model_paths.empty()) {
+        model_paths.push_back("../../lib/models/SmolLM-360M-Instruct.Q6_K.gguf");
+    }
+
+    llama_backend_init();
+    llama_log_set([](lm_ggml_log_level, const char *, void *) {}, nullptr);
+
+    std::cout << "Sampling setup per request, " << n_requests << " requests" << std::endl;
+    std::cout << std::setw(10) << "n_vocab" << std::setw(14) << "rebuild (us)" << std::setw(14) << "same (us)"
+              << std::setw(16) << "changed (us)" << std::setw(10) << "speedup" << std::endl;
+
+    bool ok = true;
+    for (const auto &path : model_paths) {
+        llama_model_params mparams = llama_model_default_params();
+        mparams.vocab_only = true;
+        llama_model *model = llama_model_load_from_file(path.c_str(), mparams);
+        if (model == nullptr) {
+            std::cerr << "Failed to load " << path << std::endl;
+            return 1;
+        }
+        const int32_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+        // warm the grammar caches so every column sees the same compile cost
+        common_sampler_free(common_sampler_init(model, chat_params(0)));
+
+        common_sampler *smpl = nullptr;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int turn = 0; turn < n_requests; ++turn) {
+            common_sampler_free(smpl);
+            smpl = common_sampler_init(model, chat_params(0));
+        }
+        const double rebuild_ms = ms_since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int turn = 0; turn < n_requests; ++turn) {
+            common_sampler_reconfigure(smpl, model, chat_params(0));
+        }
+        const double same_ms = ms_since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int turn = 0; turn < n_requests; ++turn) {
+            common_sampler_reconfigure(smpl, model, chat_params(turn));
+        }
+        const double changed_ms = ms_since(start);
+
+        // history from a previous turn must not leak into the reconfigured chain
+        for (llama_token id = 0; id < 32; ++id) {
+            common_sampler_accept(smpl, id, false);
+        }
+        common_sampler_reconfigure(smpl, model, chat_params(5));
+        common_sampler *fresh = common_sampler_init(model, chat_params(5));
+        if (!same_picks(smpl, fresh, n_vocab)) {
+            std::cout << "FAIL: n_vocab " << n_vocab << ", the reconfigured chain picks other tokens than a new one" << std::endl;
+            ok = false;
+        }
+        common_sampler_free(fresh);
+        common_sampler_free(smpl);
+
+        std::cout << std::setw(10) << n_vocab
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(14) << 1e3 * rebuild_ms / n_requests << std::setw(14) << 1e3 * same_ms / n_requests
+                  << std::setw(16) << 1e3 * changed_ms / n_requests
+                  << std::setw(9) << rebuild_ms / changed_ms << "x" << std::endl;
+
+        llama_model_free(model);
+    }
+
+    llama_backend_free();
+
+    std::cout << (ok ? "Reconfigured samplers pick the same tokens as new ones" : "Reconfigured samplers disagree") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "../llama_cpp/llama.h"
+#include "../llama_cpp/sampling.h"
+
+// Per-token sampler time across vocabulary sizes, no model needed. The full path is
+// what every token cost before: one llama_token_data per vocabulary entry, the
+// penalties / top-k / temperature / dist chain over all of them and the full sort
+// nextToken did for the probabilities. The fast path is what common_sampler_sample
+// does for such a chain: common_sampler_select_top_k picks the k largest logits plus
+// one per penalized token, the penalized tokens are added and the same chain runs on
+// that. Both chains use the same seed and must pick the same token at every step.
+//
+// Usage: sampling_bench [n_tokens] [top_k]
+
+static const int32_t penalty_last_n = 64;
+
+static llama_sampler *make_chain(int32_t top_k) {
+    llama_sampler *chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    llama_sampler_chain_add(chain, llama_sampler_init_penalties(penalty_last_n, 1.1f, 0.0f, 0.0f));
+    llama_sampler_chain_add(chain, llama_sampler_init_top_k(top_k));
+    llama_sampler_chain_add(chain, llama_sampler_init_temp(0.8f));
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(1234));
+    return chain;
+}
+
+// Logits shaped like a language model's: a long tail of noise and a handful of
+// likely tokens that move from step to step
+static void make_logits(std::mt19937 &rng, std::vector<float> &logits) {
+    std::normal_distribution<float> noise(0.0f, 2.0f);
+    std::uniform_int_distribution<int> pick(0, (int) logits.size() - 1);
+    for (auto &l : logits) {
+        l = noise(rng);
+    }
+    for (int i = 0; i < 32; ++i) {
+        logits[pick(rng)] += 12.0f;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const int n_tokens = argc > 1 ? std::atoi(argv[1]) : 200;
+    const int32_t top_k = argc > 2 ? std::atoi(argv[2]) : 40;
+
+    const int32_t vocab_sizes[] = { 32000, 128256, 151936, 262144 };
+
+    std::cout << "Sampler time per token, chain: penalties(last " << penalty_last_n
+              << ") -> top_k(" << top_k << ") -> temp -> dist" << std::endl;
+    std::cout << std::setw(10) << "n_vocab" << std::setw(14) << "full (us)" << std::setw(14) << "fast (us)"
+              << std::setw(10) << "speedup" << std::setw(14) << "candidates" << std::endl;
+
+    bool ok = true;
+    for (const int32_t n_vocab : vocab_sizes) {
+        std::mt19937 rng(42);
+        std::vector<float> step_logits(n_vocab);
+
+        llama_sampler *chain_full = make_chain(top_k);
+        llama_sampler *chain_fast = make_chain(top_k);
+
+        std::vector<llama_token_data> cur;
+        std::vector<llama_token> history;
+        std::vector<llama_token> moved;
+        std::vector<llama_token> picked_full;
+        std::vector<llama_token> picked_fast;
+        double full_seconds = 0.0;
+        double fast_seconds = 0.0;
+        size_t n_candidates = 0;
+
+        for (int t = 0; t < n_tokens; ++t) {
+            make_logits(rng, step_logits);
+            const float *logits = step_logits.data();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            cur.resize(n_vocab);
+            for (llama_token id = 0; id < n_vocab; ++id) {
+                cur[id] = llama_token_data{id, logits[id], 0.0f};
+            }
+            llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+            llama_sampler_apply(chain_full, &cur_p);
+            const llama_token id_full = cur_p.data[cur_p.selected].id;
+            std::sort(cur.begin(), cur.end(), [](const llama_token_data &a, const llama_token_data &b) {
+                return a.p > b.p;
+            });
+            auto end = std::chrono::high_resolution_clock::now();
+            full_seconds += std::chrono::duration<double>(end - start).count();
+
+            start = std::chrono::high_resolution_clock::now();
+            moved.assign(history.end() - std::min<size_t>(history.size(), penalty_last_n), history.end());
+            std::sort(moved.begin(), moved.end());
+            moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+            common_sampler_select_top_k(logits, n_vocab, top_k + (int32_t) moved.size(), cur);
+            const size_t n_selected = cur.size();
+            for (const llama_token token : moved) {
+                const auto sel_end = cur.begin() + n_selected;
+                if (std::find_if(cur.begin(), sel_end, [token](const llama_token_data &td) { return td.id == token; }) == sel_end) {
+                    cur.push_back(llama_token_data{token, logits[token], 0.0f});
+                }
+            }
+            cur_p = { cur.data(), cur.size(), -1, false };
+            n_candidates += cur.size();
+            llama_sampler_apply(chain_fast, &cur_p);
+            const llama_token id_fast = cur_p.data[cur_p.selected].id;
+            end = std::chrono::high_resolution_clock::now();
+            fast_seconds += std::chrono::duration<double>(end - start).count();
+
+            picked_full.push_back(id_full);
+            picked_fast.push_back(id_fast);
+
+            // Both chains see the same history so a mismatch does not cascade
+            llama_sampler_accept(chain_full, id_full);
+            llama_sampler_accept(chain_fast, id_full);
+            history.push_back(id_full);
+        }
+
+        llama_sampler_free(chain_full);
+        llama_sampler_free(chain_fast);
+
+        const size_t mismatches = std::inner_product(picked_full.begin(), picked_full.end(), picked_fast.begin(), size_t(0),
+            std::plus<size_t>(), [](llama_token a, llama_token b) { return a != b ? 1 : 0; });
+        if (mismatches != 0) {
+            std::cout << "FAIL: n_vocab " << n_vocab << ", " << mismatches << " of " << n_tokens
+                      << " tokens differ between the full and the fast path" << std::endl;
+            ok = false;
+        }
+
+        const double full_us = 1e6 * full_seconds / n_tokens;
+        const double fast_us = 1e6 * fast_seconds / n_tokens;
+        std::cout << std::setw(10) << n_vocab
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(14) << full_us << std::setw(14) << fast_us
+                  << std::setw(9) << full_us / fast_us << "x"
+                  << std::setw(14) << n_candidates / n_tokens << std::endl;
+    }
+
+    std::cout << (ok ? "All vocab sizes sample the same tokens on both paths" : "Sampling paths disagree") << std::endl;
+    return ok ? 0 : 1;
+}
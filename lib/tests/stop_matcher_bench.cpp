@@ -0,0 +1,136 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include "../llama_mobile.h"
+
+// Micro-benchmark for stop sequence detection: the per-token rescans that
+// findStoppingStrings used to do against the incremental llama_mobile_stop_matcher.
+// Both run over the same synthetic token stream and must agree on every result.
+
+struct BenchResult {
+    double ns_per_token;
+    size_t full_pos;
+    size_t partial_sum;
+};
+
+// The previous implementation: a find() per stop word over the tail of the text
+// for full matches and find_partial_stop_string per stop word for partial ones
+static BenchResult run_rescan(const std::vector<std::string>& stop_words, const std::vector<std::string>& pieces) {
+    std::string text;
+    text.reserve(1 << 20);
+    BenchResult result = {0.0, std::string::npos, 0};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::string& piece : pieces) {
+        text += piece;
+
+        size_t stop_pos = std::string::npos;
+        for (const std::string& word : stop_words) {
+            size_t from_pos = 0;
+            size_t tmp_len = word.size() + piece.size();
+            if (text.size() > tmp_len) {
+                from_pos = text.size() - tmp_len;
+            }
+            size_t pos = text.find(word, from_pos);
+            if (pos != std::string::npos && pos < stop_pos) {
+                stop_pos = pos;
+            }
+        }
+        if (stop_pos != std::string::npos) {
+            result.full_pos = stop_pos;
+            break;
+        }
+
+        size_t partial_pos = std::string::npos;
+        for (const std::string& word : stop_words) {
+            size_t pos = llama_mobile::find_partial_stop_string(word, text);
+            if (pos < partial_pos) {
+                partial_pos = pos;
+            }
+        }
+        if (partial_pos != std::string::npos) {
+            result.partial_sum += text.size() - partial_pos;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    result.ns_per_token = std::chrono::duration<double, std::nano>(end - start).count() / pieces.size();
+    return result;
+}
+
+static BenchResult run_matcher(const std::vector<std::string>& stop_words, const std::vector<std::string>& pieces) {
+    std::string text;
+    text.reserve(1 << 20);
+    BenchResult result = {0.0, std::string::npos, 0};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    llama_mobile::llama_mobile_stop_matcher matcher;
+    matcher.build(stop_words);
+    for (const std::string& piece : pieces) {
+        text += piece;
+
+        int32_t word = -1;
+        size_t stop_pos = matcher.feed(piece.data(), piece.size(), word);
+        if (stop_pos != std::string::npos) {
+            result.full_pos = stop_pos;
+            break;
+        }
+        result.partial_sum += matcher.partialLength();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    result.ns_per_token = std::chrono::duration<double, std::nano>(end - start).count() / pieces.size();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n_tokens = argc > 1 ? std::stoul(argv[1]) : 200000;
+
+    // A dozen stop sequences in the style chat templates produce
+    std::vector<std::string> stop_words = {
+        "</s>", "<|im_end|>", "<|eot_id|>", "<|end|>", "<end_of_turn>", "\nUser:",
+        "\nHuman:", "\n\n###", "<|endoftext|>", "[/INST]", "<|user|>", "\nAssistant:"
+    };
+
+    // Token-sized pieces, with characters that start stop words sprinkled in so the
+    // partial paths are exercised, and one real stop sequence at the end
+    std::mt19937 rng(42);
+    const std::string alphabet = "abcdefghijklmnopqrstuvwxyz     ,.<|/\n#[";
+    std::uniform_int_distribution<size_t> len_dist(1, 6);
+    std::uniform_int_distribution<size_t> char_dist(0, alphabet.size() - 1);
+    std::vector<std::string> pieces;
+    pieces.reserve(n_tokens + 2);
+    for (size_t i = 0; i < n_tokens; ++i) {
+        std::string piece;
+        size_t len = len_dist(rng);
+        for (size_t j = 0; j < len; ++j) {
+            piece += alphabet[char_dist(rng)];
+        }
+        pieces.push_back(piece);
+    }
+    pieces.push_back("<|im_");
+    pieces.push_back("end|>");
+
+    std::cout << "Stop sequence matching, " << stop_words.size() << " stop words, "
+              << pieces.size() << " tokens" << std::endl;
+
+    BenchResult rescan = run_rescan(stop_words, pieces);
+    BenchResult matcher = run_matcher(stop_words, pieces);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  rescan:  " << std::setw(8) << rescan.ns_per_token << " ns/token" << std::endl;
+    std::cout << "  matcher: " << std::setw(8) << matcher.ns_per_token << " ns/token" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "  speedup: " << rescan.ns_per_token / matcher.ns_per_token << "x" << std::endl;
+
+    if (rescan.full_pos != matcher.full_pos || rescan.partial_sum != matcher.partial_sum) {
+        std::cerr << "Mismatch: rescan stop at " << rescan.full_pos << " partial " << rescan.partial_sum
+                  << ", matcher stop at " << matcher.full_pos << " partial " << matcher.partial_sum << std::endl;
+        return 1;
+    }
+    std::cout << "  results match, stop at offset " << matcher.full_pos << std::endl;
+    return 0;
+}
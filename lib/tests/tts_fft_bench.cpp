@@ -0,0 +1,193 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include "../llama_mobile.h"
+
+// Benchmark for the vocoder's spectrum to audio step: the direct O(n^2) inverse DFT
+// with a thread per call that embd_to_audio used to run, against the inverse real FFT
+// plan. Both synthesize the same random embeddings and must produce the same audio.
+//
+// Usage: tts_fft_bench [n_codes] [n_threads]
+
+static const int N_FFT = 1280;
+static const int N_HOP = 320;
+static const int N_EMBD = N_FFT + 2;
+static const int SAMPLE_RATE = 24000;
+
+static void fill_hann_window(int length, float * output) {
+    for (int i = 0; i < length; i++) {
+        output[i] = 0.5 * (1.0 - cosf((2.0 * M_PI * i) / length));
+    }
+}
+
+static void twiddle(float * real, float * imag, int k, int N) {
+    float angle = 2 * M_PI * k / N;
+    *real = cos(angle);
+    *imag = sin(angle);
+}
+
+// The previous transform, kept verbatim
+static void irfft_direct(int n, const float * inp_cplx, float * out_real) {
+    int N = n / 2 + 1;
+
+    std::vector<float> real_input(N);
+    std::vector<float> imag_input(N);
+    for (int i = 0; i < N; ++i) {
+        real_input[i] = inp_cplx[2 * i];
+        imag_input[i] = inp_cplx[2 * i + 1];
+    }
+
+    std::vector<float> real_output(n);
+    std::vector<float> imag_output(n);
+
+    for (int k = 0; k < n; ++k) {
+        real_output[k] = 0.0f;
+        imag_output[k] = 0.0f;
+        for (int m = 0; m < N; ++m) {
+            float twiddle_real;
+            float twiddle_imag;
+
+            twiddle(&twiddle_real, &twiddle_imag, k * m, n);
+
+            real_output[k] += real_input[m] * twiddle_real - imag_input[m] * twiddle_imag;
+            imag_output[k] += real_input[m] * twiddle_imag + imag_input[m] * twiddle_real;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        out_real[i] = real_output[i] / N;
+    }
+}
+
+static void make_spectrum(const float * row, float * spec) {
+    for (int k = 0; k < N_EMBD / 2; ++k) {
+        float mag = std::min(expf(row[k]), 1e2f);
+        float phi = row[k + N_EMBD / 2];
+        spec[2 * k + 0] = mag * cosf(phi);
+        spec[2 * k + 1] = mag * sinf(phi);
+    }
+}
+
+// Overlap-add of windowed frames followed by the window envelope normalization, as
+// embd_to_audio does it
+static std::vector<float> overlap_add(const std::vector<float> & frames, const std::vector<float> & hann, int n_codes) {
+    const int n_pad = (N_FFT - N_HOP) / 2;
+    const int n_out = (n_codes - 1) * N_HOP + N_FFT;
+    std::vector<float> audio(n_out, 0.0f);
+    std::vector<float> env(n_out, 0.0f);
+    for (int l = 0; l < n_codes; ++l) {
+        for (int j = 0; j < N_FFT; ++j) {
+            audio[l * N_HOP + j] += frames[l * N_FFT + j] * hann[j];
+            env  [l * N_HOP + j] += hann[j] * hann[j];
+        }
+    }
+    std::vector<float> output(n_out - 2 * n_pad);
+    for (size_t i = 0; i < output.size(); ++i) {
+        output[i] = audio[i + n_pad] / env[i + n_pad];
+    }
+    return output;
+}
+
+static std::vector<float> synthesize_direct(const std::vector<float> & embd, const std::vector<float> & hann, int n_codes, int n_thread) {
+    std::vector<float> frames(n_codes * N_FFT);
+    std::vector<std::thread> workers(n_thread);
+    for (int i = 0; i < n_thread; ++i) {
+        workers[i] = std::thread([&, i]() {
+            std::vector<float> spec(N_EMBD);
+            for (int l = i; l < n_codes; l += n_thread) {
+                make_spectrum(embd.data() + l * N_EMBD, spec.data());
+                irfft_direct(N_FFT, spec.data(), frames.data() + l * N_FFT);
+            }
+        });
+    }
+    for (int i = 0; i < n_thread; ++i) {
+        workers[i].join();
+    }
+    return overlap_add(frames, hann, n_codes);
+}
+
+static std::vector<float> synthesize_fft(const llama_mobile::llama_mobile_rfft & rfft, const std::vector<float> & embd, const std::vector<float> & hann, int n_codes) {
+    const int n_bins = N_EMBD / 2;
+    std::vector<float> frames(n_codes * N_FFT);
+    std::vector<float> spec(N_EMBD);
+    std::vector<float> work(rfft.workSize());
+    for (int l = 0; l < n_codes; ++l) {
+        make_spectrum(embd.data() + l * N_EMBD, spec.data());
+        spec[0] *= 2.0f;
+        spec[2 * (n_bins - 1)] *= 2.0f;
+        rfft.inverse(spec.data(), frames.data() + l * N_FFT, 0.5f / n_bins, work.data());
+    }
+    return overlap_add(frames, hann, n_codes);
+}
+
+int main(int argc, char* argv[]) {
+    int n_codes = argc > 1 ? std::stoi(argv[1]) : 75;
+    int n_thread = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    // Log magnitudes and phases in the ranges the vocoder produces
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> mag_dist(-6.0f, 3.0f);
+    std::uniform_real_distribution<float> phi_dist(-3.14159265f, 3.14159265f);
+    std::vector<float> embd(n_codes * N_EMBD);
+    for (int l = 0; l < n_codes; ++l) {
+        for (int k = 0; k < N_EMBD / 2; ++k) {
+            embd[l * N_EMBD + k] = mag_dist(rng);
+            embd[l * N_EMBD + k + N_EMBD / 2] = phi_dist(rng);
+        }
+    }
+    std::vector<float> hann(N_FFT);
+    fill_hann_window(N_FFT, hann.data());
+
+    llama_mobile::llama_mobile_rfft rfft;
+    if (!rfft.init(N_FFT)) {
+        std::cerr << "Failed to build the FFT plan for n_fft = " << N_FFT << std::endl;
+        return 1;
+    }
+
+    const double audio_seconds = (double) ((n_codes - 1) * N_HOP + N_FFT - (N_FFT - N_HOP)) / SAMPLE_RATE;
+    std::cout << "Vocoder synthesis, n_fft " << N_FFT << ", " << n_codes << " frames, "
+              << std::fixed << std::setprecision(2) << audio_seconds << " s of audio" << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<float> direct = synthesize_direct(embd, hann, n_codes, n_thread);
+    auto end = std::chrono::high_resolution_clock::now();
+    double direct_seconds = std::chrono::duration<double>(end - start).count();
+
+    // Repeat the fast path so the timing is not dominated by a single run
+    const int n_runs = 20;
+    std::vector<float> fast;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < n_runs; ++i) {
+        fast = synthesize_fft(rfft, embd, hann, n_codes);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double fft_seconds = std::chrono::duration<double>(end - start).count() / n_runs;
+
+    double max_err = 0.0;
+    double max_abs = 0.0;
+    for (size_t i = 0; i < direct.size(); ++i) {
+        max_err = std::max(max_err, (double) std::fabs(direct[i] - fast[i]));
+        max_abs = std::max(max_abs, (double) std::fabs(direct[i]));
+    }
+
+    std::cout << std::setprecision(1);
+    std::cout << "  direct DFT (" << n_thread << " threads): " << std::setw(10) << audio_seconds / direct_seconds
+              << " audio s / wall s" << std::endl;
+    std::cout << "  real FFT (1 thread):    " << std::setw(10) << audio_seconds / fft_seconds
+              << " audio s / wall s" << std::endl;
+    std::cout << "  speedup: " << direct_seconds / fft_seconds << "x" << std::endl;
+    std::cout << std::scientific << std::setprecision(2)
+              << "  max abs difference " << max_err << " (peak sample " << max_abs << ")" << std::endl;
+
+    if (direct.size() != fast.size() || max_err > 1e-3 * std::max(max_abs, 1.0)) {
+        std::cerr << "Mismatch between the direct DFT and the FFT" << std::endl;
+        return 1;
+    }
+    return 0;
+}